@@ -0,0 +1,205 @@
+#include "capture.h"
+#include <string.h>
+
+// Payload bytes encoded per sink write
+#define CAPTURE_PIECE_BYTES 256
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static bool capture_write(capture_t *cap, const void *data, size_t bytes)
+{
+    if (cap->failed || !cap->sink.write(cap->sink.ctx, data, bytes))
+    {
+        cap->failed = true;
+        return false;
+    }
+    cap->bytes += bytes;
+    return true;
+}
+
+static uint32_t half_value(uint32_t duration, uint32_t level)
+{
+    return duration << 1 | level;
+}
+
+static size_t varint_bytes(uint32_t v)
+{
+    return v < (1u << 7) ? 1 : v < (1u << 14) ? 2 : 3;
+}
+
+static size_t put_varint(uint8_t *p, uint32_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80)
+    {
+        p[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+bool capture_start(capture_t *cap, const spdif_capture_sink_t *sink, uint32_t resolution_hz,
+                   uint32_t dropped_total)
+{
+    memset(cap, 0, sizeof(*cap));
+    cap->sink = *sink;
+    cap->last_dropped = dropped_total;
+
+    uint8_t header[CAPTURE_HEADER_BYTES] = {0};
+    memcpy(header, CAPTURE_MAGIC, 4);
+    header[4] = CAPTURE_VERSION;
+    header[6] = CAPTURE_HEADER_BYTES;
+    put_le32(header + 8, resolution_hz);
+    return capture_write(cap, header, sizeof(header));
+}
+
+bool capture_chunk(capture_t *cap, const rmt_symbol_word_t *symbols, size_t num_symbols, int64_t time_us,
+                   uint32_t dropped_total)
+{
+    if (cap->failed)
+    {
+        return false;
+    }
+
+    // Size first, so the record header goes out ahead of the payload
+    uint32_t payload = 0;
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        payload += varint_bytes(half_value(symbols[i].duration0, symbols[i].level0)) +
+                   varint_bytes(half_value(symbols[i].duration1, symbols[i].level1));
+    }
+    uint8_t record[CAPTURE_RECORD_BYTES];
+    put_le32(record, payload);
+    put_le32(record + 4, (uint32_t)num_symbols);
+    put_le32(record + 8, dropped_total - cap->last_dropped);
+    put_le32(record + 12, (uint32_t)time_us);
+    put_le32(record + 16, (uint32_t)((uint64_t)time_us >> 32));
+    cap->last_dropped = dropped_total;
+    if (!capture_write(cap, record, sizeof(record)))
+    {
+        return false;
+    }
+
+    uint8_t piece[CAPTURE_PIECE_BYTES + CAPTURE_MAX_SYMBOL_BYTES];
+    size_t fill = 0;
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        fill += put_varint(piece + fill, half_value(symbols[i].duration0, symbols[i].level0));
+        fill += put_varint(piece + fill, half_value(symbols[i].duration1, symbols[i].level1));
+        if (fill >= CAPTURE_PIECE_BYTES && !capture_write(cap, piece, fill))
+        {
+            return false;
+        }
+        fill = fill >= CAPTURE_PIECE_BYTES ? 0 : fill;
+    }
+    if (fill && !capture_write(cap, piece, fill))
+    {
+        return false;
+    }
+    cap->symbols += num_symbols;
+    return true;
+}
+
+bool capture_reader_open(capture_reader_t *reader, const uint8_t *data, size_t size)
+{
+    memset(reader, 0, sizeof(*reader));
+    reader->data = data;
+    reader->size = size;
+    if (size < CAPTURE_HEADER_BYTES || memcmp(data, CAPTURE_MAGIC, 4))
+    {
+        reader->error = true;
+        return false;
+    }
+    uint32_t header_bytes = data[6] | (data[7] << 8);
+    reader->version = data[4] | (data[5] << 8);
+    reader->resolution_hz = get_le32(data + 8);
+    if (reader->version < 1 || header_bytes < CAPTURE_HEADER_BYTES || header_bytes > size)
+    {
+        reader->error = true;
+        return false;
+    }
+    reader->pos = header_bytes;
+    return true;
+}
+
+// One varint of a symbol half; false if it runs past end or beyond 15-bit durations
+static bool get_half(const uint8_t **p, const uint8_t *end, uint32_t *duration, uint32_t *level)
+{
+    uint32_t v = 0;
+    for (uint32_t shift = 0; shift < 21; shift += 7)
+    {
+        if (*p == end)
+        {
+            return false;
+        }
+        uint8_t b = *(*p)++;
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80))
+        {
+            *duration = v >> 1;
+            *level = v & 1;
+            return *duration < (1u << 15);
+        }
+    }
+    return false;
+}
+
+bool capture_reader_next(capture_reader_t *reader, capture_chunk_t *chunk, rmt_symbol_word_t *symbols,
+                         size_t max_symbols)
+{
+    if (reader->error || reader->pos == reader->size)
+    {
+        return false;
+    }
+    const uint8_t *p = reader->data + reader->pos;
+    size_t left = reader->size - reader->pos;
+    if (left < CAPTURE_RECORD_BYTES)
+    {
+        reader->error = true;
+        return false;
+    }
+    uint32_t payload = get_le32(p);
+    chunk->num_symbols = get_le32(p + 4);
+    chunk->dropped = get_le32(p + 8);
+    chunk->time_us = (int64_t)(get_le32(p + 12) | (uint64_t)get_le32(p + 16) << 32);
+    if (payload > left - CAPTURE_RECORD_BYTES || chunk->num_symbols > max_symbols)
+    {
+        reader->error = true;
+        return false;
+    }
+
+    p += CAPTURE_RECORD_BYTES;
+    const uint8_t *end = p + payload;
+    for (uint32_t i = 0; i < chunk->num_symbols; i++)
+    {
+        uint32_t d0, l0, d1, l1;
+        if (!get_half(&p, end, &d0, &l0) || !get_half(&p, end, &d1, &l1))
+        {
+            reader->error = true;
+            return false;
+        }
+        symbols[i].duration0 = d0;
+        symbols[i].level0 = l0;
+        symbols[i].duration1 = d1;
+        symbols[i].level1 = l1;
+    }
+    if (p != end)
+    {
+        reader->error = true;
+        return false;
+    }
+    reader->pos = end - reader->data;
+    return true;
+}
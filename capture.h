@@ -0,0 +1,72 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Raw RMT symbol capture: the chunks the decoder is fed, with the RMT
+// resolution and arrival times, for replay off-device. Platform independent:
+// the driver writes captures, the host replay tool and bench read them.
+//
+// Stream format, version 1, all integers little-endian:
+//   Header, CAPTURE_HEADER_BYTES:
+//     "SPDC", u16 version, u16 header bytes, u32 RMT resolution in Hz, u32 reserved (0)
+//   Then one record per chunk, CAPTURE_RECORD_BYTES plus the payload:
+//     u32 payload bytes, u32 symbols, u32 symbols the receiver dropped since
+//     the previous record, i64 arrival time in us (0 if not known), payload
+//   Payload: per symbol two LEB128 varints, (duration0 << 1 | level0) and
+//   (duration1 << 1 | level1): one byte for pulses under 64 ticks, two up to
+//   8191 ticks, three beyond.
+// A reader skips header bytes beyond the ones it knows, so later versions may
+// extend the header.
+
+#define CAPTURE_MAGIC "SPDC"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_BYTES 16
+#define CAPTURE_RECORD_BYTES 20
+#define CAPTURE_MAX_SYMBOL_BYTES 6
+
+typedef struct
+{
+    spdif_capture_sink_t sink;
+    uint32_t last_dropped; // Receiver's symbols_dropped as of the last record
+    bool failed;           // The sink refused a write; nothing more is written
+    uint64_t bytes;        // Written so far
+    uint64_t symbols;
+} capture_t;
+
+// Write the header; dropped_total is the receiver's current symbols_dropped
+bool capture_start(capture_t *cap, const spdif_capture_sink_t *sink, uint32_t resolution_hz,
+                   uint32_t dropped_total);
+
+// Append one chunk. Returns false once the sink has failed.
+bool capture_chunk(capture_t *cap, const rmt_symbol_word_t *symbols, size_t num_symbols, int64_t time_us,
+                   uint32_t dropped_total);
+
+typedef struct
+{
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    uint32_t version;
+    uint32_t resolution_hz;
+    bool error;            // Malformed or truncated stream
+} capture_reader_t;
+
+typedef struct
+{
+    uint32_t num_symbols;
+    uint32_t dropped;
+    int64_t time_us;
+} capture_chunk_t;
+
+// Check the header of a capture held in memory
+bool capture_reader_open(capture_reader_t *reader, const uint8_t *data, size_t size);
+
+// Decode the next record into symbols, which has room for max_symbols.
+// Returns false at the end of the stream, or with reader->error set on a
+// malformed record or one larger than max_symbols.
+bool capture_reader_next(capture_reader_t *reader, capture_chunk_t *chunk, rmt_symbol_word_t *symbols,
+                         size_t max_symbols);
+
+#endif // CAPTURE_H
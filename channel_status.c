@@ -0,0 +1,53 @@
+#include "channel_status.h"
+
+// Consumer sample frequency, bits 24-27
+static const uint32_t consumer_rates[16] = {
+    [0x0] = 44100,
+    [0x2] = 48000,
+    [0x3] = 32000,
+    [0x4] = 22050,
+    [0x6] = 24000,
+    [0x8] = 88200,
+    [0x9] = 768000,
+    [0xA] = 96000,
+    [0xC] = 176400,
+    [0xE] = 192000,
+};
+
+// Professional sample frequency, bits 6-7 read as a number: AES3 lists
+// them bit 6 first, so "01" (48 kHz) is 2 and "10" (44.1 kHz) is 1
+static const uint32_t professional_rates[4] = {0, 44100, 48000, 32000};
+
+// Consumer word length, bits 33-35, indexed by bit 32 (max 20 or 24 bits)
+static const uint8_t word_lengths[2][8] = {
+    {0, 16, 18, 0, 19, 20, 17, 0},
+    {0, 20, 22, 0, 23, 24, 21, 0},
+};
+
+void channel_status_parse(spdif_channel_status_t *status)
+{
+    const uint8_t *raw = status->raw;
+
+    status->professional = raw[0] & 0x01;
+    status->non_audio = raw[0] & 0x02;
+
+    if (status->professional)
+    {
+        status->copy_permitted = true;
+        status->original = false;
+        status->pre_emphasis = (raw[0] >> 2) & 0x07;
+        status->category_code = 0;
+        status->sample_rate_code = (raw[0] >> 6) & 0x03;
+        status->sample_rate = professional_rates[status->sample_rate_code];
+        status->word_length = 0;
+        return;
+    }
+
+    status->copy_permitted = raw[0] & 0x04;
+    status->pre_emphasis = (raw[0] >> 3) & 0x07;
+    status->category_code = raw[1];
+    status->original = raw[1] & 0x80;
+    status->sample_rate_code = raw[3] & 0x0F;
+    status->sample_rate = consumer_rates[status->sample_rate_code];
+    status->word_length = word_lengths[raw[4] & 0x01][(raw[4] >> 1) & 0x07];
+}
@@ -0,0 +1,10 @@
+#ifndef CHANNEL_STATUS_H
+#define CHANNEL_STATUS_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Fill the decoded fields of status from status->raw
+void channel_status_parse(spdif_channel_status_t *status);
+
+#endif // CHANNEL_STATUS_H
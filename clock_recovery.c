@@ -0,0 +1,93 @@
+#include "clock_recovery.h"
+#include "histogram.h"
+#include <math.h>
+#include <string.h>
+
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+
+#define CLOCK_BLOCK_FRAMES 192
+#define CLOCK_BANDWIDTH_HZ (CONFIG_SPDIF_IN_CLOCK_BANDWIDTH_MHZ / 1000.0)
+
+// Observations before the estimate is reported as locked: about four loop
+// time constants
+#define CLOCK_LOCK_TIME_CONSTANTS 4
+
+// A preamble this far from its prediction means lost symbols or a different
+// stream; the loop restarts instead of slewing
+#define CLOCK_MAX_ERROR_FRACTION (1.0 / 256)
+
+void clock_loop_reset(clock_loop_t *loop)
+{
+    memset(loop, 0, sizeof(*loop));
+}
+
+// Second-order DLL gains for a loop bandwidth B updated once per period T:
+// w = 2 pi B T, b = sqrt(2) w, c = w^2 (critically damped)
+static void clock_loop_gains(clock_loop_t *loop, uint32_t resolution_hz)
+{
+    double w = 2 * M_PI * CLOCK_BANDWIDTH_HZ * loop->period / resolution_hz;
+    loop->b = sqrt(2) * w;
+    loop->c = w * w;
+}
+
+bool clock_loop_observe(clock_loop_t *loop, uint32_t ticks, uint64_t frame, uint32_t resolution_hz)
+{
+    uint32_t dt = ticks - loop->last_ticks;
+    bool in_sequence = loop->observations && frame - loop->last_frame == CLOCK_BLOCK_FRAMES;
+
+    if (in_sequence && loop->observations >= 2 &&
+        fabs(dt - loop->predicted) > loop->period * CLOCK_MAX_ERROR_FRACTION)
+    {
+        in_sequence = false;
+    }
+    if (!in_sequence)
+    {
+        uint64_t last = loop->ticks + (loop->observations ? dt : 0);
+        clock_loop_reset(loop);
+        loop->ticks = last;
+    }
+    else
+    {
+        loop->ticks += dt;
+        if (loop->observations == 1)
+        {
+            loop->period = dt;
+            loop->predicted = dt;
+            clock_loop_gains(loop, resolution_hz);
+        }
+        else
+        {
+            // e is the phase error; the next prediction, relative to this
+            // preamble, is t1 + b e + period - t = period - (1 - b) e
+            double e = dt - loop->predicted;
+            double period = loop->period;
+            loop->period += loop->c * e;
+            loop->predicted = period - (1 - loop->b) * e;
+        }
+    }
+    loop->last_ticks = ticks;
+    loop->last_frame = frame;
+    loop->observations++;
+    return in_sequence;
+}
+
+void clock_loop_rate(const clock_loop_t *loop, uint32_t resolution_hz, spdif_clock_t *clock)
+{
+    if (loop->observations < 2)
+    {
+        clock->locked = false;
+        clock->nominal_rate = 0;
+        clock->sample_rate = 0;
+        clock->ppm = 0;
+        return;
+    }
+    double rate = CLOCK_BLOCK_FRAMES * (double)resolution_hz / loop->period;
+    double time_constant = 1 / (2 * M_PI * CLOCK_BANDWIDTH_HZ);
+    double elapsed = (loop->observations - 1) * loop->period / resolution_hz;
+    clock->locked = elapsed >= CLOCK_LOCK_TIME_CONSTANTS * time_constant;
+    clock->nominal_rate = nominal_sample_rate((uint32_t)(rate + 0.5));
+    clock->sample_rate = rate;
+    clock->ppm = clock->nominal_rate ? (rate / clock->nominal_rate - 1) * 1e6 : 0;
+}
+
+#endif // CONFIG_SPDIF_IN_CLOCK_RECOVERY
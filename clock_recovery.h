@@ -0,0 +1,30 @@
+#ifndef CLOCK_RECOVERY_H
+#define CLOCK_RECOVERY_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Delay-locked loop on the tick positions of consecutive B preambles. Each
+// observation is 192 frames after the previous one; the loop filters the
+// period and the predicted position of the next preamble.
+typedef struct
+{
+    uint32_t observations;  // Since the last reset; the loop runs from the second
+    uint32_t last_ticks;    // Decoder tick count at the last B preamble
+    uint64_t last_frame;
+    uint64_t ticks;         // last_ticks extended to 64 bits
+    double period;          // Filtered ticks per 192 frames
+    double predicted;       // Expected ticks from the last preamble to the next
+    double b, c;            // Loop gains for the configured bandwidth
+} clock_loop_t;
+
+void clock_loop_reset(clock_loop_t *loop);
+
+// Feed the tick count at a B preamble and the index of the frame it starts.
+// Returns false if the observation broke the sequence and restarted the loop.
+bool clock_loop_observe(clock_loop_t *loop, uint32_t ticks, uint64_t frame, uint32_t resolution_hz);
+
+// Fill the rate fields of clock from the loop state
+void clock_loop_rate(const clock_loop_t *loop, uint32_t resolution_hz, spdif_clock_t *clock);
+
+#endif // CLOCK_RECOVERY_H
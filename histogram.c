@@ -1,11 +1,8 @@
 #include "histogram.h"
-#include "spdif_in.h"
-#include "esp_log.h"
+#include <stdlib.h>
 #include "string.h"
 #include "math.h"
 
-static const char *TAG = "spdif_histogram";
-
 // Pulse timing analysis constants
 #define HISTOGRAM_BINS CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT
 #define MAX_PULSE_WIDTH_NS CONFIG_SPDIF_IN_MAX_PULSE_WIDTH_NS
@@ -18,19 +15,17 @@ static const char *TAG = "spdif_histogram";
 #define EXPECTED_LONG_PULSE_PCT (CONFIG_SPDIF_IN_EXPECTED_LONG_PULSE_PCT_TENTHS / 10.0f)
 #define DISTRIBUTION_TOLERANCE CONFIG_SPDIF_IN_DISTRIBUTION_TOLERANCE_PCT
 
-// Pulse timing analysis data
-struct g_timing_t g_timing = {0};
+// Cached timing check: pulses classified before accepting it, and the
+// largest frame period change still taken as the same rate (1/50 = 2%)
+#define CACHE_VERIFY_PULSES 512
+#define CACHE_RATE_TOLERANCE 50
 
-// Helper function to smooth histogram data (3-point moving average)
-static void smooth_histogram(uint32_t *input, uint32_t *output, int size)
-{
-    output[0] = input[0];
-    output[size - 1] = input[size - 1];
-    for (int i = 1; i < size - 1; i++)
-    {
-        output[i] = (input[i - 1] + input[i] + input[i + 1]) / 3;
-    }
-}
+// ADAT frame: an 11-cell sync, then 1-5 cell pulses only, 256 cells in all.
+// A pulse counts as on the cell grid within this fraction of a cell.
+#define ADAT_SYNC_CELLS 11
+#define ADAT_MAX_DATA_CELLS 5
+#define ADAT_FRAME_CELLS 256
+#define ADAT_CELL_TOLERANCE 0.35f
 
 // Helper function to find the center of mass for a peak
 static float find_peak_center(uint32_t *histogram, int peak_bin, int window)
@@ -47,12 +42,30 @@ static float find_peak_center(uint32_t *histogram, int peak_bin, int window)
     return (weight_total > 0) ? weighted_sum / weight_total : peak_bin;
 }
 
+// Peaks closer than this belong to the same pulse group. Neighbouring groups
+// are one unit interval apart, which is at least half the lower group's bin,
+// so a third of it only merges ripples within a group.
+static int peak_merge_distance(int bin)
+{
+    return (bin / 3 > 3) ? bin / 3 : 3;
+}
+
+// Centroid window: a quarter of the bin keeps neighbouring groups out
+static int peak_window(int bin)
+{
+    return (bin / 4 > 1) ? bin / 4 : 1;
+}
+
 // Calculate adaptive thresholds between pulse groups
-static void calculate_adaptive_thresholds(void)
+static void calculate_adaptive_thresholds(spdif_timing_t *timing)
 {
-    if (!g_timing.timing_discovered) return;
-    g_timing.short_medium_threshold = (g_timing.short_pulse_ticks + g_timing.medium_pulse_ticks) / 2;
-    g_timing.medium_long_threshold = (g_timing.medium_pulse_ticks + g_timing.long_pulse_ticks) / 2;
+    // Midpoints between groups; the outer bounds are half a unit interval
+    // beyond the short and long peaks (1 UI = (long - short) / 2)
+    uint32_t half_ui = (timing->long_pulse_x16 - timing->short_pulse_x16) / 4;
+    timing->min_pulse_threshold = (timing->short_pulse_x16 > half_ui) ? timing->short_pulse_x16 - half_ui : 0;
+    timing->short_medium_threshold = (timing->short_pulse_x16 + timing->medium_pulse_x16) / 2;
+    timing->medium_long_threshold = (timing->medium_pulse_x16 + timing->long_pulse_x16) / 2;
+    timing->max_pulse_threshold = timing->long_pulse_x16 + half_ui;
 }
 
 // Validate pulse distribution against S/PDIF specification
@@ -86,30 +99,31 @@ static timing_validation_t validate_pulse_distribution(
 }
 
 // Helper function to analyze pulse timing histogram
-void analyze_pulse_timing(void)
+void analyze_pulse_timing(spdif_timing_t *timing)
 {
-    uint32_t smoothed[HISTOGRAM_BINS];
-    smooth_histogram(g_timing.histogram, smoothed, HISTOGRAM_BINS);
+    // Peaks are searched in the raw histogram: at 176.4/192 kHz the pulse
+    // groups are only ~3 ticks apart and smoothing would merge them.
+    uint32_t *histogram = timing->histogram;
 
     peak_t peaks[10] = {0};
     int num_peaks = 0;
-    uint32_t max_count = 0;
-    for (int i = 0; i < HISTOGRAM_BINS; i++) {
-        if (smoothed[i] > max_count) max_count = smoothed[i];
-    }
-    uint32_t min_peak_height = (max_count / 50 > g_timing.total_samples / 200) ? max_count / 50 : g_timing.total_samples / 200;
+    uint32_t max_count = timing->max_count;
+    uint32_t min_peak_height = (max_count / 50 > timing->total_samples / 200) ? max_count / 50 : timing->total_samples / 200;
 
-    for (int i = 2; i < HISTOGRAM_BINS - 2 && num_peaks < 10; i++) {
-        if (smoothed[i] > min_peak_height &&
-            smoothed[i] >= smoothed[i - 1] && smoothed[i] >= smoothed[i - 2] &&
-            smoothed[i] >= smoothed[i + 1] && smoothed[i] >= smoothed[i + 2]) {
+    // Only the occupied range can hold a peak
+    int first = (timing->min_bin > 2) ? (int)timing->min_bin : 2;
+    int last = (timing->max_bin < HISTOGRAM_BINS - 2) ? (int)timing->max_bin : HISTOGRAM_BINS - 2;
+    for (int i = first; i <= last && num_peaks < 10; i++) {
+        if (histogram[i] > min_peak_height &&
+            histogram[i] >= histogram[i - 1] && histogram[i] >= histogram[i + 1]) {
             bool is_distinct = true;
             for (int j = 0; j < num_peaks; j++) {
-                if (abs((int)i - (int)peaks[j].bin) < 8) {
-                    if (smoothed[i] > peaks[j].count) {
+                int near = (int)peaks[j].bin < i ? (int)peaks[j].bin : i;
+                if (abs((int)i - (int)peaks[j].bin) < peak_merge_distance(near)) {
+                    if (histogram[i] > peaks[j].count) {
                         peaks[j].bin = i;
-                        peaks[j].count = smoothed[i];
-                        peaks[j].center = find_peak_center(smoothed, i, 3);
+                        peaks[j].count = histogram[i];
+                        peaks[j].center = find_peak_center(histogram, i, peak_window(i));
                     }
                     is_distinct = false;
                     break;
@@ -117,8 +131,8 @@ void analyze_pulse_timing(void)
             }
             if (is_distinct) {
                 peaks[num_peaks].bin = i;
-                peaks[num_peaks].count = smoothed[i];
-                peaks[num_peaks].center = find_peak_center(smoothed, i, 3);
+                peaks[num_peaks].count = histogram[i];
+                peaks[num_peaks].center = find_peak_center(histogram, i, peak_window(i));
                 num_peaks++;
             }
         }
@@ -160,33 +174,254 @@ void analyze_pulse_timing(void)
         float ratio2 = selected_peaks[2].center / selected_peaks[0].center;
 
         timing_validation_t validation = validate_pulse_distribution(selected_peaks, 3, ratio1, ratio2, best_error);
-        g_timing.last_validation = validation;
+        timing->last_validation = validation;
 
         if (validation.groups_identified && validation.ratios_valid && validation.distribution_valid) {
-            g_timing.base_unit_ticks = (uint32_t)(selected_peaks[0].center * 2); // Short pulse is 0.5T
-            g_timing.short_pulse_ticks = (uint32_t)selected_peaks[0].center;     // 0.5T
-            g_timing.medium_pulse_ticks = (uint32_t)selected_peaks[1].center;    // 1.0T
-            g_timing.long_pulse_ticks = (uint32_t)selected_peaks[2].center;      // 1.5T
-            g_timing.timing_discovered = true;
-            calculate_adaptive_thresholds();
+            timing->base_unit_ticks = (uint32_t)(selected_peaks[0].center * 2); // Short pulse is 0.5T
+            timing->short_pulse_ticks = (uint32_t)selected_peaks[0].center;     // 0.5T
+            timing->medium_pulse_ticks = (uint32_t)selected_peaks[1].center;    // 1.0T
+            timing->long_pulse_ticks = (uint32_t)selected_peaks[2].center;      // 1.5T
+            timing->short_pulse_x16 = (uint32_t)lroundf(selected_peaks[0].center * 16);
+            timing->medium_pulse_x16 = (uint32_t)lroundf(selected_peaks[1].center * 16);
+            timing->long_pulse_x16 = (uint32_t)lroundf(selected_peaks[2].center * 16);
+            timing->protocol = SPDIF_PROTOCOL_SPDIF;
+            timing->timing_discovered = true;
+            calculate_adaptive_thresholds(timing);
         }
     }
 }
 
-// Helper function to collect pulse width histogram
-void collect_pulse_histogram(rmt_symbol_word_t *symbols, size_t num_symbols)
+void analyze_adat_timing(spdif_timing_t *timing)
 {
-    for (size_t i = 0; i < num_symbols; i++)
+    uint32_t *histogram = timing->histogram;
+    uint32_t total = timing->total_samples;
+
+    // The sync is the longest pulse group; a longer stray pulse is rarer
+    // than one in a thousand
+    int first = (timing->min_bin > 1) ? (int)timing->min_bin : 1;
+    int last = (timing->max_bin < HISTOGRAM_BINS - 1) ? (int)timing->max_bin : HISTOGRAM_BINS - 1;
+    int sync = 0;
+    for (int i = last; i >= first; i--)
+    {
+        if ((uint64_t)histogram[i] * 1000 > total)
+        {
+            sync = i;
+            break;
+        }
+    }
+    // Below two ticks per cell neighbouring classes would share bins
+    if (sync < ADAT_SYNC_CELLS * 2)
+    {
+        return;
+    }
+    float cell = find_peak_center(histogram, sync, sync / ADAT_SYNC_CELLS) / ADAT_SYNC_CELLS;
+
+    // Count the pulses on the grid and fit the cell length to them
+    uint32_t data = 0, syncs = 0;
+    double sum_dn = 0, sum_nn = 0;
+    for (int i = first; i <= last; i++)
     {
-        uint32_t dur0 = symbols[i].duration0;
-        uint32_t dur1 = symbols[i].duration1;
-        if (dur0 > 0 && dur0 < HISTOGRAM_BINS) {
-            g_timing.histogram[dur0]++;
-            g_timing.total_samples++;
+        if (!histogram[i])
+        {
+            continue;
         }
-        if (dur1 > 0 && dur1 < HISTOGRAM_BINS) {
-            g_timing.histogram[dur1]++;
-            g_timing.total_samples++;
+        float cells = i / cell;
+        int n = (int)lroundf(cells);
+        if (n < 1 || (n > ADAT_MAX_DATA_CELLS && n != ADAT_SYNC_CELLS) || fabsf(cells - n) > ADAT_CELL_TOLERANCE)
+        {
+            continue;
         }
+        if (n == ADAT_SYNC_CELLS)
+        {
+            syncs += histogram[i];
+        }
+        else
+        {
+            data += histogram[i];
+        }
+        sum_dn += (double)histogram[i] * i * n;
+        sum_nn += (double)histogram[i] * n * n;
+    }
+
+    // Under 1% off the grid, and one sync per frame: a frame is 50 pulses
+    // (all-zero audio) to 246 (all ones). S/PDIF fails the first test: with
+    // its long pulse taken for the sync, medium pulses come to 7.3 cells.
+    if ((total - data - syncs) * 100 > total || syncs * 300 < total || syncs * 40 > total)
+    {
+        return;
+    }
+    cell = (float)(sum_dn / sum_nn);
+    timing->cell_x16 = (uint32_t)lroundf(cell * 16);
+    timing->base_unit_ticks = (uint32_t)cell;
+    timing->short_pulse_ticks = 0;
+    timing->medium_pulse_ticks = 0;
+    timing->long_pulse_ticks = 0;
+    timing->short_pulse_x16 = 0;
+    timing->medium_pulse_x16 = 0;
+    timing->long_pulse_x16 = 0;
+    timing->short_medium_threshold = 0;
+    timing->medium_long_threshold = 0;
+    // Half a cell either side of the shortest and the longest pulse
+    timing->min_pulse_threshold = timing->cell_x16 / 2;
+    timing->max_pulse_threshold = timing->cell_x16 * (2 * ADAT_SYNC_CELLS + 1) / 2;
+    timing->protocol = SPDIF_PROTOCOL_ADAT;
+    timing->timing_discovered = true;
+}
+
+// Nearest IEC 60958 sample rate, 0 if none is within 4%
+uint32_t nominal_sample_rate(uint32_t measured)
+{
+    static const uint32_t rates[] = {22050, 24000, 32000, 44100, 48000, 88200, 96000, 176400, 192000, 768000};
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        if (measured > rates[i] - rates[i] / 25 && measured < rates[i] + rates[i] / 25)
+        {
+            return rates[i];
+        }
+    }
+    return 0;
+}
+
+// Nominal sample rate for the discovered timing. One unit interval is 1/128
+// of a frame period and the three pulse groups span 1 + 2 + 3 = 6 unit
+// intervals; an ADAT frame is 256 cells.
+uint32_t timing_sample_rate(const spdif_timing_t *timing, uint32_t resolution_hz)
+{
+    if (timing->timing_discovered && timing->protocol == SPDIF_PROTOCOL_ADAT && timing->cell_x16)
+    {
+        uint64_t frame_x16 = (uint64_t)timing->cell_x16 * ADAT_FRAME_CELLS;
+        return nominal_sample_rate((uint32_t)(((uint64_t)resolution_hz * 16 + frame_x16 / 2) / frame_x16));
+    }
+    uint32_t sum_x16 = timing->short_pulse_x16 + timing->medium_pulse_x16 + timing->long_pulse_x16;
+    if (!timing->timing_discovered || !sum_x16)
+    {
+        return 0;
+    }
+    // rate = resolution / (128 * ui), ui = sum / (6 * 16)
+    uint32_t measured = (uint32_t)(((uint64_t)resolution_hz * 6 * 16 + sum_x16 * 64) / ((uint64_t)sum_x16 * 128));
+    return nominal_sample_rate(measured);
+}
+
+// Helper function to collect pulse width histogram
+void collect_pulse_histogram(spdif_timing_t *timing, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        histogram_add(timing, symbols[i].duration0);
+        histogram_add(timing, symbols[i].duration1);
+    }
+}
+
+void reset_pulse_histogram(spdif_timing_t *timing)
+{
+    if (timing->histogram)
+    {
+        memset(timing->histogram, 0, HISTOGRAM_BINS * sizeof(uint32_t));
+    }
+    timing->total_samples = 0;
+    timing->min_bin = 0;
+    timing->max_bin = 0;
+    timing->max_count = 0;
+}
+
+bool histogram_acquire(spdif_timing_t *timing)
+{
+    if (!timing->histogram)
+    {
+        timing->histogram = (uint32_t *)spdif_discovery_calloc(HISTOGRAM_BINS, sizeof(uint32_t));
+    }
+    return timing->histogram != NULL;
+}
+
+void histogram_release(spdif_timing_t *timing)
+{
+    spdif_discovery_free(timing->histogram);
+    timing->histogram = NULL;
+}
+
+void load_cached_timing(spdif_timing_t *timing, const spdif_timing_cache_t *cache)
+{
+    if (!cache->short_pulse_x16 || cache->medium_pulse_x16 <= cache->short_pulse_x16 ||
+        cache->long_pulse_x16 <= cache->medium_pulse_x16)
+    {
+        return;
+    }
+    timing->cache = *cache;
+    timing->cache_pending = true;
+    memset(timing->cache_sum, 0, sizeof(timing->cache_sum));
+    memset(timing->cache_count, 0, sizeof(timing->cache_count));
+}
+
+// Class of a pulse under the current thresholds, 3 = unknown
+static uint32_t classify_pulse(const spdif_timing_t *timing, uint32_t dur)
+{
+    uint32_t x16 = dur * 16;
+    if (x16 < timing->min_pulse_threshold || x16 > timing->max_pulse_threshold) return 3;
+    if (x16 < timing->short_medium_threshold) return 0;
+    return (x16 < timing->medium_long_threshold) ? 1 : 2;
+}
+
+void verify_cached_timing(spdif_timing_t *timing, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    if (!timing->cache_pending) return;
+
+    // Thresholds of the cached centres; only used once the cache is accepted
+    timing->short_pulse_x16 = timing->cache.short_pulse_x16;
+    timing->medium_pulse_x16 = timing->cache.medium_pulse_x16;
+    timing->long_pulse_x16 = timing->cache.long_pulse_x16;
+    calculate_adaptive_thresholds(timing);
+
+    uint32_t pulses = timing->cache_count[0] + timing->cache_count[1] + timing->cache_count[2] + timing->cache_count[3];
+    for (size_t i = 0; i < num_symbols && pulses < CACHE_VERIFY_PULSES; i++, pulses += 2)
+    {
+        uint32_t c0 = classify_pulse(timing, symbols[i].duration0);
+        uint32_t c1 = classify_pulse(timing, symbols[i].duration1);
+        timing->cache_sum[c0] += symbols[i].duration0;
+        timing->cache_count[c0]++;
+        timing->cache_sum[c1] += symbols[i].duration1;
+        timing->cache_count[c1]++;
     }
-}
\ No newline at end of file
+    if (pulses < CACHE_VERIFY_PULSES) return;
+    timing->cache_pending = false;
+
+    // Few unknowns, the usual class shares and 1:2:3 spacing, and the same
+    // rate: the class means may sit anywhere inside the cached classes, so
+    // 44.1 kHz input would pass with 48 kHz thresholds, but the means add up
+    // to a frame period that differs by 8.8% between neighbouring rates
+    if (timing->cache_count[3] * 64 > pulses) return;
+    peak_t peaks[3] = {0};
+    float sum = 0;
+    for (int c = 0; c < 3; c++)
+    {
+        if (!timing->cache_count[c]) return;
+        peaks[c].count = timing->cache_count[c];
+        peaks[c].center = (float)timing->cache_sum[c] / timing->cache_count[c];
+        sum += peaks[c].center;
+    }
+    float ratio1 = peaks[1].center / peaks[0].center;
+    float ratio2 = peaks[2].center / peaks[0].center;
+    timing_validation_t validation = validate_pulse_distribution(
+        peaks, 3, ratio1, ratio2, fabs(ratio1 - 2.0) + fabs(ratio2 - 3.0));
+    uint32_t cached_x16 = timing->cache.short_pulse_x16 + timing->cache.medium_pulse_x16 + timing->cache.long_pulse_x16;
+    if (!validation.ratios_valid || !validation.distribution_valid ||
+        fabs(sum * 16 - cached_x16) * CACHE_RATE_TOLERANCE > cached_x16)
+    {
+        return;
+    }
+
+    timing->last_validation = validation;
+    timing->base_unit_ticks = timing->short_pulse_x16 / 8;
+    timing->short_pulse_ticks = timing->short_pulse_x16 / 16;
+    timing->medium_pulse_ticks = timing->medium_pulse_x16 / 16;
+    timing->long_pulse_ticks = timing->long_pulse_x16 / 16;
+    timing->protocol = SPDIF_PROTOCOL_SPDIF;
+    timing->timing_discovered = true;
+}
+
+void save_cached_timing(const spdif_timing_t *timing, uint32_t resolution_hz, spdif_timing_cache_t *cache)
+{
+    cache->resolution_hz = resolution_hz;
+    cache->short_pulse_x16 = timing->short_pulse_x16;
+    cache->medium_pulse_x16 = timing->medium_pulse_x16;
+    cache->long_pulse_x16 = timing->long_pulse_x16;
+}
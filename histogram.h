@@ -1,23 +1,88 @@
 #ifndef HISTOGRAM_H
 #define HISTOGRAM_H
 
-#include "spdif_in.h"
+#include "spdif_port.h"
+#include "spdif_types.h"
 
-extern struct g_timing_t {
-    uint32_t histogram[CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT];
+typedef struct spdif_timing {
+    // CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT bins, held only while a discovery
+    // or tracker window collects (histogram_acquire), NULL otherwise
+    uint32_t *histogram;
     uint32_t total_samples;
+    // Kept up to date as samples arrive so analysis only scans occupied bins
+    uint32_t min_bin;           // Lowest and highest non-empty bin, 0 while empty
+    uint32_t max_bin;
+    uint32_t max_count;         // Tallest bin
     uint32_t base_unit_ticks;
     uint32_t short_pulse_ticks;
     uint32_t medium_pulse_ticks;
     uint32_t long_pulse_ticks;
+    // Peak centers and class boundaries in 1/16 tick, derived from the peak spacing
+    uint32_t short_pulse_x16;
+    uint32_t medium_pulse_x16;
+    uint32_t long_pulse_x16;
+    uint32_t min_pulse_threshold;
     uint32_t short_medium_threshold;
     uint32_t medium_long_threshold;
+    uint32_t max_pulse_threshold;
+    spdif_protocol_t protocol;  // Line coding the timing was found for, SPDIF or ADAT
+    uint32_t cell_x16;          // ADAT bit cell in 1/16 tick; the class centres are unused
     bool timing_discovered;
     uint32_t last_analysis_time;
     timing_validation_t last_validation;
-} g_timing;
 
-void analyze_pulse_timing(void);
-void collect_pulse_histogram(rmt_symbol_word_t *symbols, size_t num_symbols);
+    // Timing of an earlier lock, tried on the first pulses before discovery
+    bool cache_pending;
+    spdif_timing_cache_t cache;
+    uint32_t cache_sum[4];      // Durations per class under the cached thresholds, [3] = unknown
+    uint32_t cache_count[4];
+} spdif_timing_t;
 
-#endif // HISTOGRAM_H
\ No newline at end of file
+void analyze_pulse_timing(spdif_timing_t *timing);
+// ADAT has no 1:2:3 groups: pulses are 1-5 bit cells plus an 11-cell sync
+// once per 256-cell frame. Sets timing_discovered and cell_x16 if nearly all
+// pulses fall on that grid.
+void analyze_adat_timing(spdif_timing_t *timing);
+void reset_pulse_histogram(spdif_timing_t *timing);
+
+// Allocate zeroed bins if the timing has none; false if out of memory.
+// Release them once the window is analyzed, so a locked decoder holds none.
+bool histogram_acquire(spdif_timing_t *timing);
+void histogram_release(spdif_timing_t *timing);
+
+// Count one pulse; durations outside the histogram are ignored
+FORCE_INLINE_ATTR void histogram_add(spdif_timing_t *timing, uint32_t dur)
+{
+    if (dur == 0 || dur >= CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT)
+    {
+        return;
+    }
+    uint32_t count = ++timing->histogram[dur];
+    timing->total_samples++;
+    if (count > timing->max_count)
+    {
+        timing->max_count = count;
+    }
+    if (!timing->min_bin || dur < timing->min_bin)
+    {
+        timing->min_bin = dur;
+    }
+    if (dur > timing->max_bin)
+    {
+        timing->max_bin = dur;
+    }
+}
+uint32_t nominal_sample_rate(uint32_t measured);
+uint32_t timing_sample_rate(const spdif_timing_t *timing, uint32_t resolution_hz);
+void collect_pulse_histogram(spdif_timing_t *timing, const rmt_symbol_word_t *symbols, size_t num_symbols);
+
+// Cached timing: load() takes the centres from a previous lock as the
+// candidate, verify_cached_timing() classifies the first pulses with them and
+// either sets timing_discovered or drops the candidate; save() fills a cache
+// entry from the current timing. Centres are only comparable at the same RMT
+// resolution, which the caller checks.
+void load_cached_timing(spdif_timing_t *timing, const spdif_timing_cache_t *cache);
+void verify_cached_timing(spdif_timing_t *timing, const rmt_symbol_word_t *symbols, size_t num_symbols);
+void save_cached_timing(const spdif_timing_t *timing, uint32_t resolution_hz, spdif_timing_cache_t *cache);
+
+#endif // HISTOGRAM_H
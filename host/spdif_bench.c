@@ -0,0 +1,3336 @@
+// Host benchmark for the S/PDIF decoder core: encodes known PCM with the
+// synthetic generator, runs timing discovery and decoding, and reports
+// throughput and bit-exactness against the input.
+
+#include "spdif_decoder.h"
+#include "spdif_gen.h"
+#include "spdif_wav.h"
+#include "spdif_asrc.h"
+#include "spdif_post.h"
+#include "latency.h"
+#include "profile.h"
+#include "capture.h"
+#include "pcm_ring.h"
+#include "oversample.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include <pthread.h>
+
+#define BENCH_CHUNK_SYMBOLS 512
+#define BENCH_BLOCK_FRAMES 256
+
+typedef struct
+{
+    uint32_t sample_rate;
+    uint32_t resolution_hz;
+    float jitter_ticks;
+} bench_case_t;
+
+typedef struct
+{
+    uint8_t *data;
+    size_t count;
+    size_t capacity;
+    size_t frame_bytes;
+} pcm_capture_t;
+
+typedef struct
+{
+    size_t num_frames;
+    int iterations;
+    const char *capture_path;   // Write a capture for spdif_replay instead of benchmarking
+} bench_options_t;
+
+typedef struct
+{
+    bench_case_t bc;
+    size_t num_frames;
+    int32_t *input;
+    rmt_symbol_word_t *symbols;
+    size_t num_symbols;
+    uint8_t channel_status[24];
+    uint8_t user_data[24];
+} bench_stream_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint8_t data[4096];
+    size_t head;
+    size_t sends;
+} ring_sink_t;
+
+static const bench_case_t bench_cases[] = {
+    {44100, 80000000, 0.0f},
+    {48000, 80000000, 0.0f},
+    {44100, 80000000, 0.5f},
+    {48000, 80000000, 0.5f},
+};
+
+// Every IEC 60958 rate the RMT can resolve at 80 MHz; the 176.4/192 kHz
+// short pulse is ~3.3 ticks, so jitter there is kept to a quarter tick
+static const bench_case_t rate_cases[] = {
+    {32000, 80000000, 0.5f},
+    {88200, 80000000, 0.5f},
+    {96000, 80000000, 0.5f},
+    {176400, 80000000, 0.25f},
+    {192000, 80000000, 0.25f},
+};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static const char *format_names[SPDIF_PCM_FORMAT_COUNT] = {"s16", "s24_32", "s24_packed", "f32"};
+
+static void capture_init(pcm_capture_t *cap, size_t capacity, spdif_pcm_format_t format)
+{
+    cap->frame_bytes = spdif_pcm_frame_bytes(format);
+    cap->data = malloc(capacity * cap->frame_bytes);
+    cap->capacity = capacity;
+    cap->count = 0;
+}
+
+static void capture_flush(void *ctx, const void *frames, size_t num_frames)
+{
+    pcm_capture_t *cap = (pcm_capture_t *)ctx;
+    if (cap->count + num_frames > cap->capacity)
+    {
+        num_frames = cap->capacity - cap->count;
+    }
+    memcpy(&cap->data[cap->count * cap->frame_bytes], frames, num_frames * cap->frame_bytes);
+    cap->count += num_frames;
+}
+
+// Reference conversion of a 24-bit input sample pair, independent of the decoder
+static void expected_frame(spdif_pcm_format_t format, int32_t l, int32_t r, uint8_t *out)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t f[2] = {(int16_t)(l >> 8), (int16_t)(r >> 8)};
+            memcpy(out, f, sizeof(f));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t f[2] = {l * 256, r * 256};
+            memcpy(out, f, sizeof(f));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            for (int i = 0; i < 3; i++)
+            {
+                out[i] = (uint8_t)(l >> (8 * i));
+                out[3 + i] = (uint8_t)(r >> (8 * i));
+            }
+            break;
+        default:
+        {
+            float f[2] = {l / 8388608.0f, r / 8388608.0f};
+            memcpy(out, f, sizeof(f));
+            break;
+        }
+    }
+}
+
+typedef void (*decode_fn_t)(spdif_decoder_t *, const rmt_symbol_word_t *, size_t);
+
+static void feed_chunks(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                        decode_fn_t fn)
+{
+    for (size_t off = 0; off < num_symbols; off += BENCH_CHUNK_SYMBOLS)
+    {
+        size_t n = num_symbols - off;
+        if (n > BENCH_CHUNK_SYMBOLS)
+        {
+            n = BENCH_CHUNK_SYMBOLS;
+        }
+        fn(dec, symbols + off, n);
+    }
+}
+
+static void ring_discard(void *ctx, const void *frames, size_t num_frames)
+{
+    (void)ctx;
+    (void)frames;
+    (void)num_frames;
+}
+
+// Count frames that differ from the input, allowing a small start offset
+static size_t verify_pcm(spdif_pcm_format_t format, const int32_t *input, size_t num_frames,
+                         const pcm_capture_t *cap, size_t *compared)
+{
+    uint8_t expected[SPDIF_PCM_MAX_FRAME_BYTES];
+    size_t best_errors = (size_t)-1;
+    for (size_t offset = 0; offset < 4 && offset < num_frames; offset++)
+    {
+        size_t errors = 0;
+        size_t n = cap->count;
+        if (n > num_frames - offset)
+        {
+            n = num_frames - offset;
+        }
+        for (size_t i = 0; i < n; i++)
+        {
+            expected_frame(format, input[(i + offset) * 2], input[(i + offset) * 2 + 1], expected);
+            if (memcmp(&cap->data[i * cap->frame_bytes], expected, cap->frame_bytes))
+            {
+                errors++;
+            }
+        }
+        errors += num_frames - n;
+        if (errors < best_errors)
+        {
+            best_errors = errors;
+            *compared = n;
+        }
+    }
+    return best_errors;
+}
+
+// Encode st->input (st->num_frames frames) into symbols
+static void stream_encode(bench_stream_t *st, const bench_case_t *bc, uint32_t parity_error_interval,
+                          double rate_ppm)
+{
+    st->bc = *bc;
+    st->symbols = malloc((st->num_frames * SPDIF_GEN_MAX_SYMBOLS_PER_FRAME + 1) * sizeof(rmt_symbol_word_t));
+    spdif_gen_config_t gcfg = {
+        .sample_rate = bc->sample_rate,
+        .resolution_hz = bc->resolution_hz,
+        .jitter_ticks = bc->jitter_ticks,
+        .seed = 42,
+        .parity_error_interval = parity_error_interval,
+        .rate_ppm = rate_ppm,
+    };
+    spdif_gen_channel_status(gcfg.channel_status, bc->sample_rate);
+    for (int i = 0; i < 24; i++)
+    {
+        gcfg.user_data[i] = (uint8_t)(0x5A ^ i);
+    }
+    memcpy(st->channel_status, gcfg.channel_status, sizeof(st->channel_status));
+    memcpy(st->user_data, gcfg.user_data, sizeof(st->user_data));
+    spdif_gen_t gen;
+    spdif_gen_init(&gen, &gcfg);
+    st->num_symbols = spdif_gen_encode(&gen, st->input, st->num_frames, st->symbols);
+    st->num_symbols += spdif_gen_finish(&gen, st->symbols + st->num_symbols);
+}
+
+static void stream_create_ex(bench_stream_t *st, const bench_case_t *bc, size_t num_frames,
+                             uint32_t parity_error_interval, double rate_ppm)
+{
+    st->num_frames = num_frames;
+    st->input = malloc(num_frames * 2 * sizeof(int32_t));
+    spdif_gen_test_signal(st->input, num_frames, bc->sample_rate, 1234);
+    stream_encode(st, bc, parity_error_interval, rate_ppm);
+}
+
+static void stream_create(bench_stream_t *st, const bench_case_t *bc, size_t num_frames)
+{
+    stream_create_ex(st, bc, num_frames, 0, 0);
+}
+
+static void stream_free(bench_stream_t *st)
+{
+    free(st->input);
+    free(st->symbols);
+}
+
+// Audio time covered by the first num_symbols symbols of the stream
+static double stream_ms(const bench_stream_t *st, size_t num_symbols)
+{
+    return (double)num_symbols * st->num_frames / st->num_symbols * 1000.0 / st->bc.sample_rate;
+}
+
+// Timing discovery, chunked like RMT partial receives; returns symbols consumed or 0
+static size_t stream_lock(const bench_stream_t *st, spdif_decoder_t *dec)
+{
+    size_t lock_symbols = 0;
+    while (!dec->timing->timing_discovered && lock_symbols < st->num_symbols)
+    {
+        size_t n = st->num_symbols - lock_symbols;
+        if (n > BENCH_CHUNK_SYMBOLS)
+        {
+            n = BENCH_CHUNK_SYMBOLS;
+        }
+        spdif_decoder_feed(dec, st->symbols + lock_symbols, n);
+        lock_symbols += n;
+    }
+    if (!dec->timing->timing_discovered)
+    {
+        return 0;
+    }
+    decoder_init_thresholds(dec);
+    return lock_symbols;
+}
+
+// Decode symbols from a clean start; returns the best time in ns
+static double decode_timed(const rmt_symbol_word_t *symbols, size_t num_symbols, spdif_decoder_t *dec,
+                           pcm_capture_t *cap, int iterations, decode_fn_t fn)
+{
+    double best_ns = 0;
+    for (int it = 0; it < iterations; it++)
+    {
+        spdif_decoder_reset(dec);
+        memset(&dec->stats, 0, sizeof(dec->stats));
+        if (cap)
+        {
+            cap->count = 0;
+        }
+        double t0 = now_ns();
+        feed_chunks(dec, symbols, num_symbols, fn);
+        spdif_decoder_flush(dec);
+        double dt = now_ns() - t0;
+        if (it == 0 || dt < best_ns)
+        {
+            best_ns = dt;
+        }
+    }
+    return best_ns;
+}
+
+// Decode the whole stream from the start; returns the best time in ns
+static double stream_decode(const bench_stream_t *st, spdif_decoder_t *dec, pcm_capture_t *cap, int iterations)
+{
+    return decode_timed(st->symbols, st->num_symbols, dec, cap, iterations, spdif_decoder_process);
+}
+
+static bool run_case(const bench_case_t *bc, spdif_pcm_format_t format, const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bench_stream_t st;
+    stream_create(&st, bc, opt->num_frames);
+    pcm_capture_t cap;
+    capture_init(&cap, st.num_frames, format);
+
+    memset(&timing, 0, sizeof(timing));
+    spdif_decoder_init(&dec, &timing, format, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+    size_t lock_symbols = stream_lock(&st, &dec);
+    if (!lock_symbols)
+    {
+        printf("%6u Hz %5.1f MHz jitter %.1f: timing not discovered\n",
+               (unsigned)bc->sample_rate, bc->resolution_hz / 1e6, bc->jitter_ticks);
+        stream_free(&st);
+        free(cap.data);
+        return false;
+    }
+
+    double best_ns = stream_decode(&st, &dec, &cap, opt->iterations);
+
+    size_t compared = 0;
+    size_t errors = verify_pcm(format, st.input, st.num_frames, &cap, &compared);
+
+    // Channel status must match what was sent and report the stream's rate
+    spdif_channel_status_t status;
+    bool status_ok = spdif_decoder_get_channel_status(&dec, &status) &&
+                     !memcmp(status.raw, st.channel_status, sizeof(status.raw)) &&
+                     !memcmp(status.user_data, st.user_data, sizeof(status.user_data)) &&
+                     status.sample_rate == bc->sample_rate && status.word_length == 24 &&
+                     dec.stats.parity_errors == 0;
+    if (!status_ok)
+    {
+        printf("channel status mismatch or parity errors (%u)\n", (unsigned)dec.stats.parity_errors);
+        errors++;
+    }
+    // A clean stream decodes without any error counted, and every frame is counted
+    spdif_stats_t stats;
+    spdif_decoder_get_stats(&dec, &stats);
+    if (stats.frames_decoded != cap.count || stats.unknown_pulses || stats.invalid_preambles ||
+        stats.invalid_subframes)
+    {
+        printf("stats: %u frames, %u unknown pulses, %u bad preambles, %u invalid\n",
+               (unsigned)stats.frames_decoded, (unsigned)stats.unknown_pulses,
+               (unsigned)stats.invalid_preambles, (unsigned)stats.invalid_subframes);
+        errors++;
+    }
+    uint32_t measured_rate = timing_sample_rate(&timing, bc->resolution_hz);
+    if (measured_rate != bc->sample_rate)
+    {
+        printf("measured sample rate %u\n", (unsigned)measured_rate);
+        errors++;
+    }
+
+    printf("%6u Hz %5.1f MHz jitter %.2f %-10s | T=%2u lock %5zu sym %5.2f ms | %7.1f Msym/s %7.2f ns/frame | %zu/%zu frames %s\n",
+           (unsigned)bc->sample_rate, bc->resolution_hz / 1e6, bc->jitter_ticks, format_names[format],
+           (unsigned)timing.base_unit_ticks, lock_symbols, stream_ms(&st, lock_symbols),
+           st.num_symbols / best_ns * 1e3, best_ns / st.num_frames,
+           st.num_frames - errors, st.num_frames, errors ? "MISMATCH" : "bit-exact");
+
+    stream_free(&st);
+    free(cap.data);
+    return errors == 0;
+}
+
+// Table decoder against the original branch decoder: identical PCM, status and
+// error counts on clean, jittery and random input, plus relative throughput
+static bool run_reference_compare(const bench_options_t *opt)
+{
+    static const struct
+    {
+        const char *name;
+        bench_case_t bc;
+        bool random;
+    } streams[] = {
+        {"clean 44.1k", {44100, 80000000, 0.0f}, false},
+        {"clean 48k", {48000, 80000000, 0.0f}, false},
+        {"jitter 0.5", {48000, 80000000, 0.5f}, false},
+        {"jitter 2.5", {48000, 80000000, 2.5f}, false},
+        {"random", {48000, 80000000, 0.0f}, true},
+    };
+    static uint8_t block_a[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static uint8_t block_b[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dfa;
+    static spdif_decoder_t ref;
+    bool all_ok = true;
+
+    printf("\nTransition table vs reference decoder (s24_32)\n");
+    for (size_t i = 0; i < sizeof(streams) / sizeof(streams[0]); i++)
+    {
+        bench_stream_t st;
+        stream_create(&st, &streams[i].bc, opt->num_frames);
+        pcm_capture_t cap_a;
+        pcm_capture_t cap_b;
+        capture_init(&cap_a, st.num_frames, SPDIF_PCM_FORMAT_S24_32);
+        capture_init(&cap_b, st.num_frames, SPDIF_PCM_FORMAT_S24_32);
+
+        // Lock on a clean stream of the same rate, then decode the test stream
+        bench_stream_t clean;
+        bench_case_t clean_case = {streams[i].bc.sample_rate, streams[i].bc.resolution_hz, 0.0f};
+        stream_create(&clean, &clean_case, 48000 / 4);
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dfa, &timing, SPDIF_PCM_FORMAT_S24_32, block_a, BENCH_BLOCK_FRAMES, capture_flush, &cap_a);
+        spdif_decoder_init(&ref, &timing, SPDIF_PCM_FORMAT_S24_32, block_b, BENCH_BLOCK_FRAMES, capture_flush, &cap_b);
+        stream_lock(&clean, &dfa);
+        decoder_init_thresholds(&ref);
+        stream_free(&clean);
+
+        if (streams[i].random)
+        {
+            uint32_t rng = 7;
+            for (size_t k = 0; k < st.num_symbols; k++)
+            {
+                rng = rng * 1664525 + 1013904223;
+                st.symbols[k].duration0 = 1 + ((rng >> 8) % 60);
+                st.symbols[k].duration1 = 1 + ((rng >> 20) % 60);
+            }
+        }
+
+        double dfa_ns = decode_timed(st.symbols, st.num_symbols, &dfa, &cap_a, opt->iterations, spdif_decoder_process);
+        double ref_ns = decode_timed(st.symbols, st.num_symbols, &ref, &cap_b, opt->iterations, spdif_decoder_process_reference);
+
+        spdif_channel_status_t status_a;
+        spdif_channel_status_t status_b;
+        bool has_a = spdif_decoder_get_channel_status(&dfa, &status_a);
+        bool has_b = spdif_decoder_get_channel_status(&ref, &status_b);
+        bool ok = cap_a.count == cap_b.count &&
+                  !memcmp(cap_a.data, cap_b.data, cap_a.count * cap_a.frame_bytes) &&
+                  !memcmp(&dfa.stats, &ref.stats, sizeof(dfa.stats)) &&
+                  has_a == has_b && (!has_a || !memcmp(&status_a, &status_b, sizeof(status_a)));
+        all_ok &= ok;
+
+        printf("  %-12s | table %7.1f Msym/s | reference %7.1f Msym/s | %.2fx | %7zu frames %5u parity %7u unknown %5u bad preambles | %s\n",
+               streams[i].name, st.num_symbols / dfa_ns * 1e3, st.num_symbols / ref_ns * 1e3, ref_ns / dfa_ns,
+               cap_a.count, (unsigned)dfa.stats.parity_errors, (unsigned)dfa.stats.unknown_pulses,
+               (unsigned)dfa.stats.invalid_preambles, ok ? "identical" : "DIFFERENT");
+
+        free(cap_a.data);
+        free(cap_b.data);
+        stream_free(&st);
+    }
+    return all_ok;
+}
+
+// Corrupted parity bits must be counted exactly
+static bool run_parity_check(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const uint32_t interval = 1000;
+    bench_stream_t st;
+    stream_create_ex(&st, &bench_cases[1], opt->num_frames, interval, 0);
+
+    memset(&timing, 0, sizeof(timing));
+    spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+    bool ok = stream_lock(&st, &dec) != 0;
+    stream_decode(&st, &dec, NULL, 1);
+
+    uint32_t expected = (uint32_t)(st.num_frames * 2 / interval);
+    ok = ok && dec.stats.parity_errors == expected;
+    printf("\nParity check: %u/%u corrupted subframes detected %s\n",
+           (unsigned)dec.stats.parity_errors, (unsigned)expected, ok ? "ok" : "FAILED");
+    stream_free(&st);
+    return ok;
+}
+
+// AES3 sources mark their rate in byte 0 of a professional block; the
+// parsed rate must match the stream's
+static bool run_professional_status(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static const uint32_t rates[] = {32000, 44100, 48000};
+    bool ok = true;
+    printf("\nProfessional channel status:");
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        bench_case_t bc = {rates[i], 80000000, 0.5f};
+        bench_stream_t st;
+        st.num_frames = opt->num_frames;
+        st.input = malloc(st.num_frames * 2 * sizeof(int32_t));
+        spdif_gen_test_signal(st.input, st.num_frames, bc.sample_rate, 1234);
+        st.bc = bc;
+        spdif_gen_config_t gcfg = {.sample_rate = bc.sample_rate, .resolution_hz = bc.resolution_hz,
+                                   .jitter_ticks = bc.jitter_ticks, .seed = 42};
+        spdif_gen_professional_status(gcfg.channel_status, bc.sample_rate);
+        st.symbols = malloc((st.num_frames * SPDIF_GEN_MAX_SYMBOLS_PER_FRAME + 1) * sizeof(rmt_symbol_word_t));
+        spdif_gen_t gen;
+        spdif_gen_init(&gen, &gcfg);
+        st.num_symbols = spdif_gen_encode(&gen, st.input, st.num_frames, st.symbols);
+        st.num_symbols += spdif_gen_finish(&gen, st.symbols + st.num_symbols);
+
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+        bool case_ok = stream_lock(&st, &dec) != 0;
+        stream_decode(&st, &dec, NULL, 1);
+        spdif_channel_status_t status;
+        case_ok = case_ok && spdif_decoder_get_channel_status(&dec, &status) &&
+                  !memcmp(status.raw, gcfg.channel_status, sizeof(status.raw)) && status.professional &&
+                  status.sample_rate == bc.sample_rate;
+        printf(" %u Hz %s", (unsigned)bc.sample_rate, case_ok ? "ok" : "FAILED");
+        ok &= case_ok;
+        stream_free(&st);
+    }
+    printf("\n");
+    return ok;
+}
+
+// Stand-ins for the two RMT ISR handoffs: a locked copy of the chunk into a
+// symbol ring (xRingbufferSendFromISR) or a locked copy of a chunk descriptor
+// into a queue (xQueueSendFromISR)
+typedef struct
+{
+    pthread_mutex_t lock;
+    uint8_t data[8192 * sizeof(rmt_symbol_word_t)];
+    size_t head;
+} symbol_ring_t;
+
+typedef struct
+{
+    const rmt_symbol_word_t *symbols;
+    uint32_t num_symbols;
+    uint16_t buffer;
+    uint16_t last;
+    uint32_t transaction;
+    uint32_t end_count;
+} chunk_desc_t;
+
+typedef struct
+{
+    pthread_mutex_t lock;
+    chunk_desc_t items[32];
+    size_t head;
+} chunk_queue_t;
+
+static void isr_copy(symbol_ring_t *ring, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    size_t bytes = num_symbols * sizeof(rmt_symbol_word_t);
+    pthread_mutex_lock(&ring->lock);
+    size_t first = sizeof(ring->data) - ring->head;
+    if (first > bytes)
+    {
+        first = bytes;
+    }
+    memcpy(&ring->data[ring->head], symbols, first);
+    memcpy(&ring->data[0], (const uint8_t *)symbols + first, bytes - first);
+    ring->head = (ring->head + bytes) % sizeof(ring->data);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+static void isr_post(chunk_queue_t *queue, const rmt_symbol_word_t *symbols, size_t num_symbols, uint32_t count)
+{
+    chunk_desc_t desc = {symbols, (uint32_t)num_symbols, 0, 0, 1, count};
+    pthread_mutex_lock(&queue->lock);
+    queue->items[queue->head] = desc;
+    queue->head = (queue->head + 1) % 32;
+    pthread_mutex_unlock(&queue->lock);
+}
+
+// ISR work per received chunk with and without the copy into the symbol ring
+static void run_isr_handoff(void)
+{
+    static const size_t chunk_sizes[] = {64, 256, 1024, 4096};
+    static rmt_symbol_word_t dma[8192];
+    static symbol_ring_t ring = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    static chunk_queue_t queue = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    const size_t total = 1 << 24;
+
+    printf("\nRMT ISR handoff per chunk (host stand-in)\n");
+    for (size_t i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++)
+    {
+        size_t n = chunk_sizes[i];
+        size_t chunks = total / n;
+        double t0 = now_ns();
+        for (size_t c = 0; c < chunks; c++)
+        {
+            isr_copy(&ring, &dma[(c * n) % 8192], n);
+        }
+        double copy_ns = (now_ns() - t0) / chunks;
+        t0 = now_ns();
+        for (size_t c = 0; c < chunks; c++)
+        {
+            isr_post(&queue, &dma[(c * n) % 8192], n, (uint32_t)(c * n));
+        }
+        double post_ns = (now_ns() - t0) / chunks;
+        printf("  %4zu symbols | copy %8.1f ns | descriptor %6.1f ns | %5.1fx\n",
+               n, copy_ns, post_ns, copy_ns / post_ns);
+    }
+    printf("  internal RAM, 8192-symbol DMA: copy %zu KB (DMA + symbol ring) | zero-copy %zu KB (2 DMA halves + queue)\n",
+           (size_t)(8192 * 4 * 2) / 1024, (size_t)(8192 * 4 + 32 * sizeof(chunk_desc_t)) / 1024);
+}
+
+static void print_stage(const char *name, const spdif_profile_stage_stats_t *st)
+{
+    printf("    %-9s | %6u samples | min %7u | mean %7u | p50 %7u | p90 %7u | p99 %7u | max %7u ns\n", name,
+           (unsigned)st->samples, (unsigned)st->min, (unsigned)st->mean, (unsigned)st->p50, (unsigned)st->p90,
+           (unsigned)st->p99, (unsigned)st->max);
+}
+
+static bool stage_ordered(const spdif_profile_stage_stats_t *st)
+{
+    return st->samples && st->min <= st->p50 && st->p50 <= st->p90 && st->p90 <= st->p99 && st->p99 <= st->max &&
+           st->min <= st->mean && st->mean <= st->max;
+}
+
+// The driver's profile on the host clock: each RMT-sized chunk is copied into
+// a symbol ring as the ISR would, then fed to the decoder. Load is against the
+// audio time the chunks cover, as on a real-time input.
+static bool run_profile(const bench_options_t *opt)
+{
+    static const uint32_t rates[] = {48000, 192000};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static symbol_ring_t ring = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static profile_t profile;
+    static const char *names[SPDIF_PROFILE_STAGE_COUNT] = {"isr copy", "rx wait", "discovery", "decode", "tracker"};
+    bool ok = true;
+
+    printf("\nHot-path profile (%d-symbol chunks, host clock)\n", BENCH_CHUNK_SYMBOLS);
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        bench_case_t bc = {rates[i], 80000000, rates[i] > 96000 ? 0.25f : 0.5f};
+        bench_stream_t st;
+        stream_create(&st, &bc, opt->num_frames);
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+        profile_init(&profile);
+        spdif_decoder_set_profile(&dec, &profile);
+
+        size_t chunks = 0;
+        double t0 = now_ns();
+        for (size_t off = 0; off < st.num_symbols; off += BENCH_CHUNK_SYMBOLS, chunks++)
+        {
+            size_t n = st.num_symbols - off < BENCH_CHUNK_SYMBOLS ? st.num_symbols - off : BENCH_CHUNK_SYMBOLS;
+            uint32_t isr_start = spdif_profile_now();
+            isr_copy(&ring, st.symbols + off, n);
+            profile_add(&profile, SPDIF_PROFILE_ISR, spdif_profile_now() - isr_start);
+            spdif_decoder_feed(&dec, st.symbols + off, n);
+        }
+        double wall_ns = now_ns() - t0;
+        spdif_decoder_flush(&dec);
+
+        // Stand in for the decoder task's wall time: the audio the chunks cover
+        profile.elapsed = (uint64_t)((double)st.num_frames * 1e9 / bc.sample_rate);
+        spdif_profile_t report;
+        profile_get(&profile, &report);
+        const spdif_profile_stage_stats_t *stage = report.stage;
+        uint64_t busy = stage[SPDIF_PROFILE_DISCOVERY].total + stage[SPDIF_PROFILE_DECODE].total +
+                        stage[SPDIF_PROFILE_TRACKER].total;
+
+        // Every chunk is discovery or decoding; the one that locks is both
+        bool case_ok = report.clock_hz == 1000000000u && stage[SPDIF_PROFILE_ISR].samples == chunks &&
+                       stage[SPDIF_PROFILE_DISCOVERY].samples + stage[SPDIF_PROFILE_DECODE].samples == chunks + 1 &&
+                       stage[SPDIF_PROFILE_TRACKER].samples == stage[SPDIF_PROFILE_DECODE].samples &&
+                       !stage[SPDIF_PROFILE_RX_WAIT].samples && busy <= wall_ns &&
+                       report.load_permille == busy * 1000 / report.elapsed;
+        for (int s = 0; s < SPDIF_PROFILE_STAGE_COUNT; s++)
+        {
+            case_ok &= s == SPDIF_PROFILE_RX_WAIT || stage_ordered(&stage[s]);
+        }
+        ok &= case_ok;
+        printf("  %6u Hz | %zu chunks | decoder load at real time %u.%u%% | profiled %.1f%% of the loop %s\n",
+               (unsigned)bc.sample_rate, chunks, (unsigned)report.load_permille / 10,
+               (unsigned)report.load_permille % 10, busy * 100.0 / wall_ns, case_ok ? "ok" : "FAILED");
+        for (int s = 0; s < SPDIF_PROFILE_STAGE_COUNT; s++)
+        {
+            if (s != SPDIF_PROFILE_RX_WAIT)
+            {
+                print_stage(names[s], &stage[s]);
+            }
+        }
+        stream_free(&st);
+    }
+    return ok;
+}
+
+// Frames of the second stream lost before output became bit-exact again: the
+// longest run at the end of the capture that matches the end of the input
+static size_t matched_suffix(const int32_t *input, size_t num_frames, const pcm_capture_t *cap)
+{
+    uint8_t expected[SPDIF_PCM_MAX_FRAME_BYTES];
+    size_t n = 0;
+    while (n < num_frames && n < cap->count)
+    {
+        size_t in = num_frames - 1 - n;
+        expected_frame(SPDIF_PCM_FORMAT_S16, input[in * 2], input[in * 2 + 1], expected);
+        if (memcmp(&cap->data[(cap->count - 1 - n) * cap->frame_bytes], expected, cap->frame_bytes))
+        {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+// Rate change mid-stream: lock on the first rate, switch to the second, and
+// measure how much audio the tracker loses before output is correct again
+static bool run_relock(const bench_options_t *opt)
+{
+    static const struct
+    {
+        uint32_t from;
+        uint32_t to;
+    } switches[] = {{44100, 48000}, {48000, 96000}, {96000, 44100}, {48000, 32000}, {44100, 192000}};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bool ok = true;
+
+    printf("\nRelock after rate change (tracker on / off)\n");
+    for (size_t i = 0; i < sizeof(switches) / sizeof(switches[0]); i++)
+    {
+        bench_case_t a = {switches[i].from, 80000000, 0.25f};
+        bench_case_t b = {switches[i].to, 80000000, 0.25f};
+        bench_stream_t sa, sb;
+        stream_create(&sa, &a, opt->num_frames);
+        stream_create(&sb, &b, opt->num_frames);
+        size_t total = sa.num_symbols + sb.num_symbols;
+        rmt_symbol_word_t *symbols = malloc(total * sizeof(rmt_symbol_word_t));
+        memcpy(symbols, sa.symbols, sa.num_symbols * sizeof(rmt_symbol_word_t));
+        memcpy(symbols + sa.num_symbols, sb.symbols, sb.num_symbols * sizeof(rmt_symbol_word_t));
+        pcm_capture_t cap;
+        capture_init(&cap, sa.num_frames + sb.num_frames, SPDIF_PCM_FORMAT_S16);
+
+        size_t lost[2];
+        uint32_t relocks = 0;
+        for (int tracking = 1; tracking >= 0; tracking--)
+        {
+            memset(&timing, 0, sizeof(timing));
+            spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+            dec.tracker.enabled = tracking;
+            cap.count = 0;
+            feed_chunks(&dec, symbols, total, spdif_decoder_feed);
+            spdif_decoder_flush(&dec);
+            lost[tracking] = sb.num_frames - matched_suffix(sb.input, sb.num_frames, &cap);
+            if (tracking)
+            {
+                relocks = dec.stats.relocks;
+            }
+        }
+
+        // One relock, within 100 ms of the switch. 44.1 and 48 kHz pulses fall
+        // inside each other's classes, so those decode even without a relock.
+        bool case_ok = relocks == 1 && lost[1] * 10 < b.sample_rate && lost[0] >= lost[1];
+        ok &= case_ok;
+        printf("  %6u -> %6u Hz | relocks %u | lost %5zu frames (%6.2f ms) | without tracking %zu/%zu lost %s\n",
+               (unsigned)a.sample_rate, (unsigned)b.sample_rate, (unsigned)relocks, lost[1],
+               lost[1] * 1000.0 / b.sample_rate, lost[0], sb.num_frames, case_ok ? "ok" : "FAILED");
+
+        free(cap.data);
+        free(symbols);
+        stream_free(&sa);
+        stream_free(&sb);
+    }
+    return ok;
+}
+
+// Error injection on the pulse stream
+typedef enum
+{
+    INJECT_CHUNK,    // 128 symbols lost, as with a full symbol ring
+    INJECT_EDGE,     // Two pulses merged by a missed edge
+    INJECT_GLITCH,   // Spike in the middle of a pulse
+    INJECT_PREAMBLE, // First long pulse from the position on read as short
+    INJECT_COUNT,
+} inject_kind_t;
+
+// Tag that marks the right channel; left carries the frame index
+#define RESYNC_RIGHT_TAG 0x400000
+
+// Apply one injection at pulse index at; returns the new pulse count
+static size_t inject_error(uint16_t *pulses, size_t count, size_t at, inject_kind_t kind, uint16_t short_ticks)
+{
+    switch (kind)
+    {
+        case INJECT_CHUNK:
+            memmove(pulses + at, pulses + at + 256, (count - at - 256) * sizeof(pulses[0]));
+            return count - 256;
+        case INJECT_EDGE:
+            pulses[at] += pulses[at + 1];
+            memmove(pulses + at + 1, pulses + at + 2, (count - at - 2) * sizeof(pulses[0]));
+            return count - 1;
+        case INJECT_GLITCH:
+        {
+            uint16_t d = pulses[at];
+            memmove(pulses + at + 3, pulses + at + 1, (count - at - 1) * sizeof(pulses[0]));
+            pulses[at] = d / 2 - 1;
+            pulses[at + 1] = 2;
+            pulses[at + 2] = d - d / 2 - 1;
+            return count + 2;
+        }
+        case INJECT_PREAMBLE:
+        default:
+            while (at < count && pulses[at] < short_ticks * 5 / 2)
+            {
+                at++;
+            }
+            if (at < count)
+            {
+                pulses[at] = short_ticks;
+            }
+            return count;
+    }
+}
+
+// Dropped chunks, noisy pulses and hit preambles in a stream whose left
+// channel counts frames and whose right channel is the same count tagged:
+// every output frame shows whether it is a true [L,R] pair of one input
+// frame, and which. Recovery is the number of input frames from the one
+// hit until output is exact again; lost frames are neither decoded nor
+// concealed. Interpolating a ramp restores lost frames exactly.
+static bool run_resync(const bench_options_t *opt)
+{
+    static const char *kind_names[INJECT_COUNT] = {"chunk", "edge", "glitch", "preamble"};
+    static const char *conceal_names[] = {"none", "hold", "interpolate"};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const bench_case_t bc = {48000, 80000000, 0.0f};
+    const size_t spacing = 1000;
+    bool ok = true;
+
+    bench_stream_t st;
+    st.num_frames = opt->num_frames < RESYNC_RIGHT_TAG ? opt->num_frames : RESYNC_RIGHT_TAG;
+    st.input = malloc(st.num_frames * 2 * sizeof(int32_t));
+    for (size_t i = 0; i < st.num_frames; i++)
+    {
+        st.input[i * 2] = (int32_t)i;
+        st.input[i * 2 + 1] = (int32_t)i | RESYNC_RIGHT_TAG;
+    }
+    stream_encode(&st, &bc, 0, 0);
+    size_t num_pulses = st.num_symbols * 2;
+    size_t injections = st.num_frames / spacing - 1;
+    uint16_t *clean = malloc(num_pulses * sizeof(uint16_t));
+    uint16_t *pulses = malloc((num_pulses + 2 * injections) * sizeof(uint16_t));
+    rmt_symbol_word_t *symbols = malloc((num_pulses / 2 + injections + 1) * sizeof(rmt_symbol_word_t));
+    size_t *hit_frame = malloc(injections * sizeof(size_t));
+    for (size_t k = 0; k < st.num_symbols; k++)
+    {
+        clean[k * 2] = st.symbols[k].duration0;
+        clean[k * 2 + 1] = st.symbols[k].duration1;
+    }
+    const double ticks_per_frame = (double)bc.resolution_hz / bc.sample_rate;
+    const uint16_t short_ticks = (uint16_t)(ticks_per_frame / 128 + 0.5);
+    pcm_capture_t cap;
+    capture_init(&cap, st.num_frames + injections * SPDIF_CONCEAL_MAX_FRAMES, SPDIF_PCM_FORMAT_S24_32);
+    uint8_t *seen = malloc(st.num_frames);
+
+    printf("\nResync after injected errors (%zu per run, 48000 Hz)\n", injections);
+    for (int kind = 0; kind < INJECT_COUNT; kind++)
+    {
+        // Hit a pseudo-random pulse in frame spacing * (n + 1) plus a bit
+        memcpy(pulses, clean, num_pulses * sizeof(uint16_t));
+        size_t count = num_pulses;
+        uint32_t rng = 99;
+        for (size_t n = injections; n-- > 0;)
+        {
+            rng = rng * 1664525 + 1013904223;
+            double target = (spacing * (n + 1) + (rng >> 24) % 8) * ticks_per_frame + (rng >> 8) % 3000;
+            double ticks = 0;
+            size_t at = 0;
+            while (ticks < target)
+            {
+                ticks += pulses[at++];
+            }
+            hit_frame[n] = (size_t)(ticks / ticks_per_frame);
+            count = inject_error(pulses, count, at, (inject_kind_t)kind, short_ticks);
+            if (kind == INJECT_CHUNK)
+            {
+                // Damage shows in the frame the stream resumes in
+                hit_frame[n] = (size_t)((ticks + 256 * 1.5 * short_ticks) / ticks_per_frame);
+            }
+        }
+        size_t num_symbols = count / 2;
+        for (size_t k = 0; k < num_symbols; k++)
+        {
+            symbols[k].duration0 = pulses[k * 2];
+            symbols[k].duration1 = pulses[k * 2 + 1];
+            symbols[k].level0 = 1;
+            symbols[k].level1 = 0;
+        }
+
+        for (int mode = SPDIF_CONCEAL_NONE; mode <= SPDIF_CONCEAL_INTERPOLATE; mode++)
+        {
+            // Lock on the clean stream, then decode the damaged one from the start
+            memset(&timing, 0, sizeof(timing));
+            spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S24_32, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+            stream_lock(&st, &dec);
+            spdif_decoder_set_concealment(&dec, (spdif_conceal_t)mode);
+            decode_timed(symbols, num_symbols, &dec, &cap, 1, spdif_decoder_process);
+
+            // Output frames that are no true pair, and input frames never seen in order
+            size_t bad = 0;
+            memset(seen, 0, st.num_frames);
+            for (size_t f = 0; f < cap.count; f++)
+            {
+                int32_t frame[2];
+                memcpy(frame, &cap.data[f * cap.frame_bytes], sizeof(frame));
+                int32_t l = frame[0] >> 8;
+                int32_t r = frame[1] >> 8;
+                if (r != (l | RESYNC_RIGHT_TAG) || l < 0 || (size_t)l >= st.num_frames)
+                {
+                    bad++;
+                }
+                else
+                {
+                    seen[l] = 1;
+                }
+            }
+            size_t lost = 0;
+            for (size_t i = spacing / 2; i < st.num_frames - spacing / 2; i++)
+            {
+                lost += !seen[i];
+            }
+            size_t max_recovery = 0;
+            for (size_t n = 0; n < injections; n++)
+            {
+                size_t i = hit_frame[n];
+                while (i < hit_frame[n] + spacing / 2 && !(seen[i] && seen[i + 1] && seen[i + 2] && seen[i + 3]))
+                {
+                    i++;
+                }
+                size_t recovery = i - hit_frame[n];
+                max_recovery = recovery > max_recovery ? recovery : max_recovery;
+            }
+
+            spdif_stats_t stats;
+            spdif_decoder_get_stats(&dec, &stats);
+            // At most one garbled frame per hit and back in order within two
+            // frames. Concealment keeps the output as long as the input.
+            size_t shortfall = st.num_frames > cap.count ? st.num_frames - cap.count : 0;
+            bool case_ok = bad <= injections && max_recovery <= 2 &&
+                           (mode == SPDIF_CONCEAL_NONE || shortfall <= 2);
+            ok &= case_ok;
+            printf("  %-8s %-11s | %3u sync %3u block errors | %4u concealed | %4zu lost %3zu bad frames | "
+                   "output %3zu short | recovery <= %zu frames %s\n",
+                   kind_names[kind], conceal_names[mode], (unsigned)stats.sync_errors, (unsigned)stats.block_errors,
+                   (unsigned)stats.frames_concealed, lost, bad, shortfall, max_recovery, case_ok ? "ok" : "FAILED");
+        }
+    }
+
+    free(seen);
+    free(cap.data);
+    free(hit_frame);
+    free(symbols);
+    free(pulses);
+    free(clean);
+    stream_free(&st);
+    return ok;
+}
+
+// Passthrough consumer: one burst buffer, payload checked against the generator's
+typedef struct
+{
+    uint8_t *buffer;
+    size_t max_frames;
+    uint8_t data_type;
+    uint32_t period;
+    size_t payload_bytes;
+    uint32_t received;
+    uint32_t errors;
+} burst_check_t;
+
+// Payload of the n-th burst
+static void burst_payload(uint8_t *out, size_t bytes, uint32_t n)
+{
+    uint32_t x = 0x9E3779B9u * (n + 1);
+    for (size_t i = 0; i < bytes; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        out[i] = (uint8_t)x;
+    }
+}
+
+static void *burst_get_buffer(void *ctx, size_t *max_frames)
+{
+    burst_check_t *bc = (burst_check_t *)ctx;
+    *max_frames = bc->max_frames;
+    return bc->buffer;
+}
+
+static void burst_write(void *ctx, const spdif_burst_t *burst)
+{
+    burst_check_t *bc = (burst_check_t *)ctx;
+    static uint8_t expect[IEC61937_MAX_BURST_FRAMES * 4], got[IEC61937_MAX_BURST_FRAMES * 4];
+    burst_payload(expect, bc->payload_bytes, bc->received);
+    size_t n = spdif_burst_read_payload(burst, got, sizeof(got));
+    if (burst->data_type != bc->data_type || burst->frames != bc->buffer || n != bc->payload_bytes ||
+        memcmp(got, expect, n) || (bc->received && burst->period != bc->period))
+    {
+        bc->errors++;
+    }
+    bc->received++;
+}
+
+// IEC 61937 streams: every burst must reach the passthrough consumer intact,
+// zero-copy, and the PCM side must carry silence from the first burst on
+static bool run_iec61937(const bench_options_t *opt)
+{
+    static const struct
+    {
+        const char *name;
+        uint8_t data_type;
+        uint32_t period;
+        uint32_t payload_bytes;
+        bool non_audio;
+        spdif_pcm_format_t format;
+    } cases[] = {
+        {"AC-3", IEC61937_AC3, 1536, 1792, false, SPDIF_PCM_FORMAT_S16},
+        {"AC-3", IEC61937_AC3, 1536, 1792, true, SPDIF_PCM_FORMAT_S24_32},
+        {"DTS I", IEC61937_DTS1, 512, 2012, true, SPDIF_PCM_FORMAT_S24_PACKED},
+        {"E-AC-3", IEC61937_EAC3, 6144, 6000, true, SPDIF_PCM_FORMAT_F32},
+    };
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static uint8_t payload[IEC61937_MAX_BURST_FRAMES * 4];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const size_t lead = 64;
+    bool ok = true;
+
+    printf("\nIEC 61937 passthrough (48000 Hz)\n");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        bench_case_t bc = {48000, 80000000, 0.5f};
+        bench_stream_t st;
+        st.num_frames = opt->num_frames;
+        st.input = calloc(st.num_frames * 2, sizeof(int32_t));
+        uint32_t expected = 0;
+        for (size_t f = lead; f + cases[i].period <= st.num_frames; f += cases[i].period, expected++)
+        {
+            burst_payload(payload, cases[i].payload_bytes, expected);
+            spdif_gen_burst(st.input + f * 2, cases[i].data_type, payload, cases[i].payload_bytes);
+        }
+        stream_encode(&st, &bc, 0, 0);
+        if (cases[i].non_audio)
+        {
+            // Re-encode with the non-audio channel status bit set
+            free(st.symbols);
+            spdif_gen_config_t gcfg = {.sample_rate = bc.sample_rate, .resolution_hz = bc.resolution_hz,
+                                       .jitter_ticks = bc.jitter_ticks, .seed = 42};
+            spdif_gen_channel_status(gcfg.channel_status, bc.sample_rate);
+            gcfg.channel_status[0] |= 0x02;
+            st.symbols = malloc((st.num_frames * SPDIF_GEN_MAX_SYMBOLS_PER_FRAME + 1) * sizeof(rmt_symbol_word_t));
+            spdif_gen_t gen;
+            spdif_gen_init(&gen, &gcfg);
+            st.num_symbols = spdif_gen_encode(&gen, st.input, st.num_frames, st.symbols);
+            st.num_symbols += spdif_gen_finish(&gen, st.symbols + st.num_symbols);
+        }
+
+        spdif_pcm_format_t format = cases[i].format;
+        size_t frame_bytes = spdif_pcm_frame_bytes(format);
+        burst_check_t check = {
+            .max_frames = IEC61937_MAX_BURST_FRAMES,
+            .data_type = cases[i].data_type,
+            .period = cases[i].period,
+            .payload_bytes = cases[i].payload_bytes,
+        };
+        check.buffer = malloc(check.max_frames * frame_bytes);
+        spdif_burst_sink_t sink = {burst_get_buffer, burst_write, &check};
+        pcm_capture_t cap;
+        capture_init(&cap, st.num_frames, format);
+
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, format, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+        spdif_decoder_set_burst_sink(&dec, &sink);
+        stream_lock(&st, &dec);
+        check.received = 0;
+        double ns = stream_decode(&st, &dec, &cap, 1);
+
+        // Silence from the first Pa on (the capture starts within a frame of the input)
+        size_t loud = 0;
+        for (size_t f = lead + 2; f < cap.count; f++)
+        {
+            for (size_t b = 0; b < frame_bytes; b++)
+            {
+                loud += cap.data[f * frame_bytes + b] != 0;
+            }
+        }
+        spdif_stats_t stats;
+        spdif_decoder_get_stats(&dec, &stats);
+        bool case_ok = check.received == expected && !check.errors && !loud && stats.bursts_dropped == 0 &&
+                       cap.count + 2 >= st.num_frames;
+        ok &= case_ok;
+        printf("  %-6s %-10s non-audio %d | %4u/%4u bursts %u bad | pcm %zu/%zu frames, %zu non-zero bytes | "
+               "%6.2f ns/frame %s\n",
+               cases[i].name, format_names[format], cases[i].non_audio, (unsigned)check.received,
+               (unsigned)expected, (unsigned)check.errors, cap.count, st.num_frames, loud, ns / st.num_frames,
+               case_ok ? "ok" : "FAILED");
+
+        free(check.buffer);
+        free(cap.data);
+        stream_free(&st);
+    }
+    return ok;
+}
+
+// Virtual clock for the latency probe: chunk arrivals are stream time, and
+// decoding them takes the host's wall-clock time on top
+typedef struct
+{
+    int64_t arrival_us;
+    double wall_start_ns;
+} virtual_clock_t;
+
+static int64_t virtual_now_us(void *ctx)
+{
+    virtual_clock_t *vc = (virtual_clock_t *)ctx;
+    return vc->arrival_us + (int64_t)((now_ns() - vc->wall_start_ns) / 1000);
+}
+
+// Input-to-PCM latency for the Kconfig sizes and for latency budgets, on a
+// music-like signal and on digital silence (fewest symbols per frame, so the
+// slowest chunks). Each chunk arrives when its last symbol ends and is decoded
+// at once; the probe times it to the sink write holding its last frame. With
+// a budget the block is flushed after each chunk, as the receiver does.
+// A frame's delay from the wire is up to one chunk more.
+static bool run_latency(const bench_options_t *opt)
+{
+    static const uint32_t budgets_us[] = {0, 8000, 4000, 2000, 1000, 500};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static latency_probe_t probe;
+    const bench_case_t *bc = &bench_cases[3];
+    bool ok = true;
+
+    printf("\nInput-to-PCM latency (%u Hz, s16)\n", (unsigned)bc->sample_rate);
+    for (int silent = 0; silent < 2; silent++)
+    {
+        bench_stream_t st;
+        if (silent)
+        {
+            st.num_frames = opt->num_frames;
+            st.input = calloc(st.num_frames * 2, sizeof(int32_t));
+            stream_encode(&st, bc, 0, 0);
+        }
+        else
+        {
+            stream_create(&st, bc, opt->num_frames);
+        }
+        for (size_t i = 0; i < sizeof(budgets_us) / sizeof(budgets_us[0]); i++)
+        {
+            latency_plan_t plan = {.rx_symbols = 8192, .ring_symbols = 8192, .block_frames = 32, .pcm_frames = 1024};
+            if (budgets_us[i])
+            {
+                latency_plan(&plan, budgets_us[i]);
+            }
+            memset(&timing, 0, sizeof(timing));
+            spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, plan.block_frames, ring_discard, NULL);
+            virtual_clock_t vc = {0};
+            latency_probe_init(&probe, &dec.sink, virtual_now_us, &vc);
+            spdif_pcm_sink_t sink = latency_probe_sink(&probe);
+            spdif_decoder_set_sink(&dec, &sink);
+
+            size_t pos = stream_lock(&st, &dec);
+            uint64_t ticks = 0;
+            for (size_t k = 0; k < pos; k++)
+            {
+                ticks += st.symbols[k].duration0 + st.symbols[k].duration1;
+            }
+            size_t chunks = 0;
+            double wall_ns = 0;
+            while (pos < st.num_symbols)
+            {
+                size_t n = st.num_symbols - pos < plan.rx_symbols ? st.num_symbols - pos : plan.rx_symbols;
+                for (size_t k = pos; k < pos + n; k++)
+                {
+                    ticks += st.symbols[k].duration0 + st.symbols[k].duration1;
+                }
+                vc.arrival_us = (int64_t)(ticks * 1000000 / bc->resolution_hz);
+                vc.wall_start_ns = now_ns();
+                spdif_decoder_feed(&dec, st.symbols + pos, n);
+                latency_probe_arrival(&probe, dec.frames_out + dec.block_fill, vc.arrival_us);
+                if (budgets_us[i])
+                {
+                    spdif_decoder_flush(&dec);
+                }
+                wall_ns += now_ns() - vc.wall_start_ns;
+                pos += n;
+                chunks++;
+            }
+
+            spdif_latency_t lat;
+            latency_probe_get(&probe, &lat);
+            double stream_s = (double)ticks / bc->resolution_hz;
+            double chunk_us = stream_ms(&st, plan.rx_symbols) * 1000;
+            bool case_ok = lat.samples > 0 && (!budgets_us[i] || chunk_us + lat.p99_us <= budgets_us[i]);
+            ok &= case_ok;
+            char budget[16];
+            snprintf(budget, sizeof(budget), budgets_us[i] ? "%u us" : "Kconfig", (unsigned)budgets_us[i]);
+            printf("  %-7s %-8s | chunk %4u sym %5.0f us, block %2u fr | ISR-to-PCM p50 %5u p99 %5u max %5u us | "
+                   "%6.0f chunks/s | %5.2f%% CPU %s\n",
+                   silent ? "silence" : "music", budget, (unsigned)plan.rx_symbols, chunk_us,
+                   (unsigned)plan.block_frames, (unsigned)lat.p50_us, (unsigned)lat.p99_us, (unsigned)lat.max_us,
+                   chunks / stream_s,
+                   wall_ns / 1e9 / stream_s * 100, case_ok ? "ok" : "FAILED");
+        }
+        stream_free(&st);
+    }
+    return ok;
+}
+
+// File-backed stand-in for a persistent timing store such as NVS
+static bool file_store_load(void *ctx, spdif_timing_cache_t *cache)
+{
+    FILE *f = fopen((const char *)ctx, "rb");
+    if (!f)
+    {
+        return false;
+    }
+    bool ok = fread(cache, sizeof(*cache), 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+static void file_store_save(void *ctx, const spdif_timing_cache_t *cache)
+{
+    FILE *f = fopen((const char *)ctx, "wb");
+    if (f)
+    {
+        fwrite(cache, sizeof(*cache), 1, f);
+        fclose(f);
+    }
+}
+
+// Feed RMT-sized chunks until locked; returns symbols consumed or 0
+static size_t lock_chunked(const bench_stream_t *st, spdif_decoder_t *dec, size_t chunk)
+{
+    size_t fed = 0;
+    while (!dec->timing->timing_discovered && fed < st->num_symbols)
+    {
+        size_t n = st->num_symbols - fed < chunk ? st->num_symbols - fed : chunk;
+        spdif_decoder_feed(dec, st->symbols + fed, n);
+        fed += n;
+    }
+    return dec->timing->timing_discovered ? fed : 0;
+}
+
+// Time to lock from a cold start, on the timing the cold start saved, and on
+// a stale entry saved at the previous rate, which must fall back to discovery
+static bool run_lock(const bench_options_t *opt)
+{
+    static const char *path = "spdif_bench_timing.bin";
+    static const uint32_t rates[] = {44100, 48000, 96000, 192000, 32000};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const spdif_timing_store_t store = {file_store_load, file_store_save, (void *)path};
+    const size_t chunk = 64;
+    bool ok = true;
+
+    printf("\nTime to lock (%zu-symbol chunks): cold / cached timing / stale cache\n", chunk);
+    remove(path);
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        bench_case_t bc = {rates[i], 80000000, rates[i] > 96000 ? 0.25f : 0.5f};
+        bench_stream_t st;
+        stream_create(&st, &bc, opt->num_frames);
+        pcm_capture_t cap;
+        capture_init(&cap, st.num_frames, SPDIF_PCM_FORMAT_S16);
+
+        // stale (entry of the previous rate, if any), cold, cached
+        size_t lock[3] = {0};
+        bool rate_ok = true;
+        for (int pass = (i == 0); pass < 3; pass++)
+        {
+            if (pass == 1)
+            {
+                remove(path);
+            }
+            memset(&timing, 0, sizeof(timing));
+            spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+            spdif_decoder_set_timing_store(&dec, &store);
+            lock[pass] = lock_chunked(&st, &dec, chunk);
+            rate_ok &= lock[pass] && timing_sample_rate(&timing, bc.resolution_hz) == bc.sample_rate;
+            // The timing is saved once the lock has decoded a window
+            feed_chunks(&dec, st.symbols + lock[pass], st.num_symbols - lock[pass], spdif_decoder_feed);
+        }
+
+        // Decode with the timing taken from the cache
+        decoder_init_thresholds(&dec);
+        stream_decode(&st, &dec, &cap, 1);
+        size_t compared = 0;
+        size_t errors = verify_pcm(SPDIF_PCM_FORMAT_S16, st.input, st.num_frames, &cap, &compared);
+
+        bool case_ok = rate_ok && !errors && lock[2] < lock[1];
+        ok &= case_ok;
+        printf("  %6u Hz | cold %5.3f ms %5zu sym | cached %5.3f ms %5zu sym | ", (unsigned)bc.sample_rate,
+               stream_ms(&st, lock[1]), lock[1], stream_ms(&st, lock[2]), lock[2]);
+        if (i)
+        {
+            printf("stale %5.3f ms %5zu sym | ", stream_ms(&st, lock[0]), lock[0]);
+        }
+        else
+        {
+            printf("stale  none              | ");
+        }
+        printf("%s\n", case_ok ? "ok" : "FAILED");
+
+        free(cap.data);
+        stream_free(&st);
+    }
+    remove(path);
+    return ok;
+}
+
+typedef struct
+{
+    spdif_lock_state_t states[32];
+    size_t count;
+} lock_log_t;
+
+static void lock_log(void *ctx, spdif_lock_state_t state)
+{
+    lock_log_t *log = (lock_log_t *)ctx;
+    if (log->count < sizeof(log->states) / sizeof(log->states[0]))
+    {
+        log->states[log->count++] = state;
+    }
+}
+
+static const char *lock_state_name(spdif_lock_state_t state)
+{
+    static const char *names[SPDIF_LOCK_STATE_COUNT] = {"no signal", "acquiring", "locked", "lost"};
+    return state < SPDIF_LOCK_STATE_COUNT ? names[state] : "?";
+}
+
+static bool count_store_load(void *ctx, spdif_timing_cache_t *cache)
+{
+    (void)ctx;
+    (void)cache;
+    return false;
+}
+
+static void count_store_save(void *ctx, const spdif_timing_cache_t *cache)
+{
+    (void)cache;
+    (*(uint32_t *)ctx)++;
+}
+
+// Feed chunks until the decoder reports state; returns symbols fed, or
+// num_symbols + 1 if it never did
+static size_t feed_until_state(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                               spdif_lock_state_t state)
+{
+    for (size_t off = 0; off < num_symbols; off += BENCH_CHUNK_SYMBOLS)
+    {
+        size_t n = num_symbols - off < BENCH_CHUNK_SYMBOLS ? num_symbols - off : BENCH_CHUNK_SYMBOLS;
+        spdif_decoder_feed(dec, symbols + off, n);
+        if (spdif_decoder_get_lock_state(dec) == state)
+        {
+            return off + n;
+        }
+    }
+    return num_symbols + 1;
+}
+
+// Lock state machine: a clean stream, the input stopping and coming back
+// (relocking on the last timing), noise that must end the lock, a new rate
+// after it, and a rate change that the tracker follows without losing lock
+static bool run_lock_state(const bench_options_t *opt)
+{
+    static const uint32_t rates[][2] = {{44100, 48000}, {48000, 96000}, {96000, 32000}, {44100, 192000}};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static const spdif_lock_state_t expected[] = {SPDIF_LOCK_ACQUIRING, SPDIF_LOCK_LOCKED, SPDIF_LOCK_NO_SIGNAL,
+                                                  SPDIF_LOCK_ACQUIRING, SPDIF_LOCK_LOCKED, SPDIF_LOCK_LOST};
+    const size_t num_expected = sizeof(expected) / sizeof(expected[0]);
+    bool ok = true;
+
+    // Pulses of 0.05 to 3.75 us, as an open input picking up interference
+    const size_t noise_symbols = 262144;
+    rmt_symbol_word_t *noise = malloc(noise_symbols * sizeof(rmt_symbol_word_t));
+    srand(7);
+    uint64_t noise_ticks = 0;
+    for (size_t i = 0; i < noise_symbols; i++)
+    {
+        noise[i].duration0 = 4 + rand() % 296;
+        noise[i].duration1 = 4 + rand() % 296;
+        noise[i].level0 = 1;
+        noise[i].level1 = 0;
+        noise_ticks += noise[i].duration0 + noise[i].duration1;
+    }
+
+    printf("\nLock state: cold lock / relock after input loss / noise to lost / new rate / rate change\n");
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        bench_case_t a = {rates[i][0], 80000000, 0.25f};
+        bench_case_t b = {rates[i][1], 80000000, 0.25f};
+        bench_stream_t sa, sb;
+        stream_create(&sa, &a, opt->num_frames);
+        stream_create(&sb, &b, opt->num_frames);
+        pcm_capture_t cap;
+        capture_init(&cap, sa.num_frames + sb.num_frames, SPDIF_PCM_FORMAT_S16);
+        lock_log_t log = {0};
+        uint32_t saves = 0;
+        const spdif_timing_store_t store = {count_store_load, count_store_save, &saves};
+
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+        spdif_decoder_set_timing_store(&dec, &store);
+        spdif_decoder_set_lock_cb(&dec, lock_log, &log);
+        bool case_ok = spdif_decoder_get_lock_state(&dec) == SPDIF_LOCK_NO_SIGNAL;
+
+        size_t cold = feed_until_state(&dec, sa.symbols, sa.num_symbols, SPDIF_LOCK_LOCKED);
+        feed_chunks(&dec, sa.symbols + cold, sa.num_symbols - cold, spdif_decoder_feed);
+        spdif_decoder_input_lost(&dec);
+        case_ok &= !timing.timing_discovered;
+
+        size_t relock = feed_until_state(&dec, sa.symbols, sa.num_symbols, SPDIF_LOCK_LOCKED);
+        // Noise may lock for a moment, but no such timing gets stored
+        uint32_t saves_before = saves;
+        size_t lost = feed_until_state(&dec, noise, noise_symbols, SPDIF_LOCK_LOST);
+        if (lost < noise_symbols)
+        {
+            feed_chunks(&dec, noise + lost, noise_symbols - lost, spdif_decoder_feed);
+        }
+        case_ok &= saves == saves_before && saves_before == 1;
+
+        // The second rate after the noise; its last frames must decode
+        cap.count = 0;
+        feed_chunks(&dec, sb.symbols, sb.num_symbols, spdif_decoder_feed);
+        spdif_decoder_flush(&dec);
+        size_t matched = matched_suffix(sb.input, sb.num_frames, &cap);
+
+        for (size_t n = 0; n < num_expected; n++)
+        {
+            case_ok &= n < log.count && log.states[n] == expected[n];
+        }
+        case_ok &= log.count > num_expected && log.states[log.count - 1] == SPDIF_LOCK_LOCKED;
+        case_ok &= relock < cold && lost <= noise_symbols && matched * 2 > sb.num_frames;
+
+        // Rate change on a continuous stream: the tracker relocks, the lock holds
+        log.count = 0;
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+        spdif_decoder_set_lock_cb(&dec, lock_log, &log);
+        feed_chunks(&dec, sa.symbols, sa.num_symbols, spdif_decoder_feed);
+        feed_chunks(&dec, sb.symbols, sb.num_symbols, spdif_decoder_feed);
+        bool held = log.count == 2 && log.states[1] == SPDIF_LOCK_LOCKED && dec.stats.relocks == 1;
+        case_ok &= held;
+
+        ok &= case_ok;
+        printf("  %6u -> %6u Hz | cold %5.3f ms | relock %5.3f ms | lost after %5.2f ms noise | "
+               "%zu/%zu frames | rate change %s %s\n",
+               (unsigned)a.sample_rate, (unsigned)b.sample_rate, stream_ms(&sa, cold), stream_ms(&sa, relock),
+               lost <= noise_symbols ? noise_ticks * 1000.0 / a.resolution_hz * lost / noise_symbols : -1.0,
+               matched, sb.num_frames, held ? "held" : lock_state_name(log.count ? log.states[log.count - 1] : 0),
+               case_ok ? "ok" : "FAILED");
+
+        free(cap.data);
+        stream_free(&sa);
+        stream_free(&sb);
+    }
+    free(noise);
+    return ok;
+}
+
+// Kconfig buffer defaults, as the receiver would be built with them
+#define KCONFIG_RMT_MEM_BLOCK_SYMBOLS 8192
+#define KCONFIG_SYMBOL_BUFFER_SIZE 8192
+#define KCONFIG_PCM_BLOCK_FRAMES 32
+#define KCONFIG_PCM_BUFFER_SIZE 4096
+#define KCONFIG_RX_BUFFER_COUNT 2
+
+typedef struct
+{
+    const char *name;
+    uint32_t max_sample_rate;
+    uint32_t latency_us;
+    bool zero_copy;
+    bool psram;
+} memory_case_t;
+
+static void memory_case(const memory_case_t *mc, size_t state_bytes, spdif_memory_t *mem)
+{
+    latency_plan_t plan = {
+        .rx_symbols = mc->zero_copy ? KCONFIG_RMT_MEM_BLOCK_SYMBOLS / KCONFIG_RX_BUFFER_COUNT
+                                    : KCONFIG_RMT_MEM_BLOCK_SYMBOLS,
+        .ring_symbols = KCONFIG_SYMBOL_BUFFER_SIZE,
+        .block_frames = KCONFIG_PCM_BLOCK_FRAMES,
+        .pcm_frames = KCONFIG_PCM_BUFFER_SIZE / spdif_pcm_frame_bytes(SPDIF_PCM_FORMAT_S16),
+    };
+    memory_plan(&plan, mc->max_sample_rate);
+    if (mc->latency_us)
+    {
+        latency_plan(&plan, mc->latency_us);
+    }
+    memory_footprint(&plan, mc->zero_copy ? KCONFIG_RX_BUFFER_COUNT : 0, spdif_pcm_frame_bytes(SPDIF_PCM_FORMAT_S16),
+                     state_bytes, mc->psram, mem);
+}
+
+static bool run_memory(const bench_options_t *opt)
+{
+    static const memory_case_t cases[] = {
+        {"Kconfig defaults", 0, 0, false, false},
+        {"max 48 kHz", 48000, 0, false, false},
+        {"max 48 kHz, PSRAM", 48000, 0, false, true},
+        {"zero-copy", 0, 0, true, false},
+        {"zero-copy, max 48 kHz, PSRAM", 48000, 0, true, true},
+        {"2 ms latency", 0, 2000, false, false},
+        {"2 ms latency, max 96 kHz", 96000, 2000, false, false},
+    };
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    size_t state_bytes = sizeof(spdif_decoder_t) + sizeof(spdif_timing_t) +
+                         KCONFIG_PCM_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES;
+    bool ok = true;
+
+    printf("\nMemory footprint in bytes, S16 with the PCM ring (state: decoder core only)\n");
+    printf("  %-30s | %6s | %8s | %8s | %5s | %15s | %9s | %5s\n", "", "DMA", "sym ring", "PCM ring", "state",
+           "internal locked", "acquiring", "PSRAM");
+    spdif_memory_t mem[sizeof(cases) / sizeof(cases[0])];
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        memory_case(&cases[i], state_bytes, &mem[i]);
+        printf("  %-30s | %6u | %8u | %8u | %5u | %15u | %9u | %5u\n", cases[i].name, (unsigned)mem[i].dma_bytes,
+               (unsigned)mem[i].symbol_ring_bytes, (unsigned)mem[i].pcm_ring_bytes, (unsigned)mem[i].state_bytes,
+               (unsigned)mem[i].internal_bytes, (unsigned)mem[i].internal_peak_bytes, (unsigned)mem[i].psram_bytes);
+    }
+    // 48 kHz receive buffers hold the time the defaults hold at 192 kHz (the
+    // ring keeps room for two of them); PSRAM takes
+    // the PCM ring and the histograms out of internal RAM
+    bool table_ok = mem[1].dma_bytes * 4 == mem[0].dma_bytes && mem[1].symbol_ring_bytes < mem[0].symbol_ring_bytes &&
+                    mem[2].internal_peak_bytes == mem[2].internal_bytes &&
+                    mem[2].internal_bytes + mem[2].psram_bytes == mem[1].internal_peak_bytes &&
+                    !mem[3].symbol_ring_bytes && mem[4].dma_bytes * 4 == mem[3].dma_bytes &&
+                    mem[6].dma_bytes <= mem[5].dma_bytes;
+    ok &= table_ok;
+
+    // The histograms exist only while discovery or a tracker window collects
+    bench_case_t a = {48000, 80000000, 0.25f};
+    bench_case_t b = {96000, 80000000, 0.25f};
+    bench_stream_t sa, sb;
+    stream_create(&sa, &a, opt->num_frames);
+    stream_create(&sb, &b, opt->num_frames);
+    memset(&timing, 0, sizeof(timing));
+    spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+    bool held_state = !timing.histogram;
+    spdif_decoder_feed(&dec, sa.symbols, BENCH_CHUNK_SYMBOLS);
+    held_state &= timing.histogram != NULL;
+    size_t lock = feed_until_state(&dec, sa.symbols + BENCH_CHUNK_SYMBOLS, sa.num_symbols - BENCH_CHUNK_SYMBOLS,
+                                   SPDIF_LOCK_LOCKED);
+    held_state &= !timing.histogram && !dec.tracker.candidate.histogram;
+    feed_chunks(&dec, sa.symbols + BENCH_CHUNK_SYMBOLS + lock, sa.num_symbols - BENCH_CHUNK_SYMBOLS - lock,
+                spdif_decoder_feed);
+    feed_chunks(&dec, sb.symbols, sb.num_symbols, spdif_decoder_feed);
+    held_state &= dec.stats.relocks == 1 && !timing.histogram && !dec.tracker.candidate.histogram;
+    // Input loss keeps the timing to check: nothing is allocated until the
+    // input returns, and the check hands the histogram back on relock
+    spdif_decoder_input_lost(&dec);
+    held_state &= !timing.histogram;
+    feed_until_state(&dec, sb.symbols, sb.num_symbols, SPDIF_LOCK_LOCKED);
+    held_state &= dec.lock_state == SPDIF_LOCK_LOCKED && !timing.histogram;
+    spdif_decoder_deinit(&dec);
+    held_state &= !timing.histogram;
+    ok &= held_state;
+    printf("  discovery histograms %u bytes, held only until lock and during a tracker window %s\n",
+           (unsigned)mem[0].discovery_bytes, table_ok && held_state ? "ok" : "FAILED");
+    stream_free(&sa);
+    stream_free(&sb);
+    return ok;
+}
+
+// Cost of the background tracker on a steady locked stream
+static void run_tracker_overhead(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bench_stream_t st;
+    stream_create(&st, &bench_cases[3], opt->num_frames);
+
+    double ns[2];
+    for (int tracking = 0; tracking < 2; tracking++)
+    {
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+        dec.tracker.enabled = tracking;
+        stream_lock(&st, &dec);
+        ns[tracking] = decode_timed(st.symbols, st.num_symbols, &dec, NULL, opt->iterations, spdif_decoder_feed);
+    }
+    printf("  tracker overhead (%u Hz) | off %7.2f ns/frame | on %7.2f ns/frame | %+.1f%%\n",
+           (unsigned)st.bc.sample_rate, ns[0] / st.num_frames, ns[1] / st.num_frames,
+           (ns[1] / ns[0] - 1) * 100);
+    stream_free(&st);
+}
+
+// Stand-in for xRingbufferSend: a lock plus a copy into a byte ring per call
+static void ring_flush(void *ctx, const void *frames, size_t num_frames)
+{
+    ring_sink_t *ring = (ring_sink_t *)ctx;
+    size_t bytes = num_frames * 2 * sizeof(int16_t);
+    pthread_mutex_lock(&ring->lock);
+    size_t head = ring->head;
+    size_t first = sizeof(ring->data) - head;
+    if (first > bytes)
+    {
+        first = bytes;
+    }
+    memcpy(&ring->data[head], frames, first);
+    memcpy(&ring->data[0], (const uint8_t *)frames + first, bytes - first);
+    ring->head = (head + bytes) % sizeof(ring->data);
+    ring->sends++;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// Decoder plus ring buffer cost for different PCM block sizes
+static void run_block_sweep(const bench_options_t *opt)
+{
+    static const size_t block_sizes[] = {1, 8, 32, 128};
+    static int16_t block[128 * 2];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static ring_sink_t ring = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    bench_stream_t st;
+    stream_create(&st, &bench_cases[1], opt->num_frames);
+
+    printf("\nPCM block size sweep (%u Hz, locked ring sink)\n", (unsigned)st.bc.sample_rate);
+    for (size_t i = 0; i < sizeof(block_sizes) / sizeof(block_sizes[0]); i++)
+    {
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, block_sizes[i], ring_flush, &ring);
+        if (!stream_lock(&st, &dec))
+        {
+            continue;
+        }
+        ring.sends = 0;
+        double best_ns = stream_decode(&st, &dec, NULL, opt->iterations);
+        double ns_per_frame = best_ns / st.num_frames;
+        printf("  block %3zu frames | %7.2f ns/frame | %8.4f%% of one core at %u Hz | %zu sends/iteration\n",
+               block_sizes[i], ns_per_frame, ns_per_frame * st.bc.sample_rate / 1e7,
+               (unsigned)st.bc.sample_rate, ring.sends / (size_t)opt->iterations);
+    }
+    stream_free(&st);
+}
+
+// Direct-buffer sink: the decoder writes into the destination array in
+// BENCH_BLOCK_FRAMES pieces, like DMA descriptors of an I2S TX ring
+typedef struct
+{
+    pcm_capture_t *cap;
+    size_t taken;    // Frames handed out by get_buffer
+    size_t copies;   // Blocks that arrived outside our buffers
+} direct_sink_t;
+
+static void *direct_get_buffer(void *ctx, size_t *max_frames)
+{
+    direct_sink_t *ds = (direct_sink_t *)ctx;
+    pcm_capture_t *cap = ds->cap;
+    size_t room = cap->capacity - cap->count;
+    if (room == 0)
+    {
+        return NULL;
+    }
+    *max_frames = room < BENCH_BLOCK_FRAMES ? room : BENCH_BLOCK_FRAMES;
+    return &cap->data[cap->count * cap->frame_bytes];
+}
+
+static void direct_write(void *ctx, const void *frames, size_t num_frames)
+{
+    direct_sink_t *ds = (direct_sink_t *)ctx;
+    pcm_capture_t *cap = ds->cap;
+    if (frames != &cap->data[cap->count * cap->frame_bytes])
+    {
+        ds->copies++;
+        capture_flush(cap, frames, num_frames);
+        return;
+    }
+    cap->count += num_frames;
+}
+
+// Copy sink (flush callback) against a direct-buffer sink, plus the WAV sink
+static bool run_sinks(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const spdif_pcm_format_t format = SPDIF_PCM_FORMAT_S24_32;
+    bench_stream_t st;
+    stream_create(&st, &bench_cases[1], opt->num_frames);
+    pcm_capture_t cap;
+    capture_init(&cap, st.num_frames, format);
+    size_t compared = 0;
+
+    printf("\nPCM sinks (%u Hz, %s)\n", (unsigned)st.bc.sample_rate, format_names[format]);
+    memset(&timing, 0, sizeof(timing));
+    spdif_decoder_init(&dec, &timing, format, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+    bool ok = stream_lock(&st, &dec) != 0;
+    double copy_ns = stream_decode(&st, &dec, &cap, opt->iterations);
+    bool copy_ok = ok && verify_pcm(format, st.input, st.num_frames, &cap, &compared) == 0;
+
+    direct_sink_t ds = {.cap = &cap};
+    spdif_pcm_sink_t sink = {.write = direct_write, .get_buffer = direct_get_buffer, .ctx = &ds};
+    double direct_ns = 0;
+    for (int it = 0; it < opt->iterations; it++)
+    {
+        spdif_decoder_reset(&dec);
+        cap.count = 0;
+        ds.copies = 0;
+        double t0 = now_ns();
+        spdif_decoder_set_sink(&dec, &sink);
+        feed_chunks(&dec, st.symbols, st.num_symbols, spdif_decoder_process);
+        spdif_decoder_flush(&dec);
+        double dt = now_ns() - t0;
+        if (it == 0 || dt < direct_ns)
+        {
+            direct_ns = dt;
+        }
+    }
+    bool direct_ok = ok && ds.copies == 0 &&
+                     verify_pcm(format, st.input, st.num_frames, &cap, &compared) == 0;
+    printf("  copy sink   | %7.2f ns/frame | %s\n", copy_ns / st.num_frames, copy_ok ? "bit-exact" : "FAILED");
+    printf("  direct sink | %7.2f ns/frame | %s (%.1f%%)\n", direct_ns / st.num_frames,
+           direct_ok ? "bit-exact" : "FAILED", (direct_ns / copy_ns - 1) * 100);
+
+    // WAV sink: decode to a file and read the samples back
+    const char *path = "spdif_bench.wav";
+    spdif_wav_sink_t wav;
+    bool wav_ok = ok && spdif_wav_sink_open(&wav, path, format, 0);
+    if (wav_ok)
+    {
+        spdif_pcm_sink_t wav_sink = spdif_wav_sink(&wav);
+        spdif_decoder_reset(&dec);
+        spdif_decoder_set_sink(&dec, &wav_sink);
+        feed_chunks(&dec, st.symbols, st.num_symbols, spdif_decoder_process);
+        spdif_decoder_flush(&dec);
+        wav.sample_rate = timing_sample_rate(&timing, st.bc.resolution_hz);
+        wav_ok = spdif_wav_sink_close(&wav);
+    }
+    uint8_t header[44];
+    FILE *f = wav_ok ? fopen(path, "rb") : NULL;
+    wav_ok = f && fread(header, 1, sizeof(header), f) == sizeof(header);
+    if (wav_ok)
+    {
+        uint32_t rate, data_bytes;
+        memcpy(&rate, header + 24, sizeof(rate));
+        memcpy(&data_bytes, header + 40, sizeof(data_bytes));
+        cap.count = fread(cap.data, cap.frame_bytes, cap.capacity, f);
+        wav_ok = !memcmp(header, "RIFF", 4) && !memcmp(header + 8, "WAVE", 4) &&
+                 rate == st.bc.sample_rate && data_bytes == cap.count * cap.frame_bytes &&
+                 verify_pcm(format, st.input, st.num_frames, &cap, &compared) == 0;
+    }
+    if (f)
+    {
+        fclose(f);
+    }
+    remove(path);
+    printf("  wav sink    | %zu frames read back | %s\n", cap.count, wav_ok ? "bit-exact" : "FAILED");
+
+    free(cap.data);
+    stream_free(&st);
+    return copy_ok && direct_ok && wav_ok;
+}
+
+// One receiver's decoder for run_instances: everything it touches is its own
+typedef struct
+{
+    const bench_stream_t *st;
+    spdif_timing_t timing;
+    spdif_decoder_t dec;
+    uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    pcm_capture_t cap;
+    double ns;
+    size_t errors;
+} instance_t;
+
+static void *instance_thread(void *arg)
+{
+    instance_t *in = (instance_t *)arg;
+    size_t compared = 0;
+    memset(&in->timing, 0, sizeof(in->timing));
+    spdif_decoder_init(&in->dec, &in->timing, SPDIF_PCM_FORMAT_S16, in->block, BENCH_BLOCK_FRAMES,
+                       capture_flush, &in->cap);
+    in->errors = (size_t)-1;
+    if (stream_lock(in->st, &in->dec))
+    {
+        in->ns = stream_decode(in->st, &in->dec, &in->cap, 1);
+        in->errors = verify_pcm(SPDIF_PCM_FORMAT_S16, in->st->input, in->st->num_frames, &in->cap, &compared);
+    }
+    return NULL;
+}
+
+// Independent decoders on concurrent threads, as with two receivers on two
+// cores: each must lock to its own rate and decode bit-exact
+static bool run_instances(const bench_options_t *opt)
+{
+    static const bench_case_t cases[] = {
+        {44100, 80000000, 0.5f},
+        {96000, 80000000, 0.5f},
+        {48000, 80000000, 0.5f},
+        {192000, 80000000, 0.25f},
+    };
+    enum { N = sizeof(cases) / sizeof(cases[0]) };
+    static bench_stream_t st[N];
+    static instance_t in[N];
+    pthread_t threads[N];
+
+    printf("\nConcurrent decoder instances\n");
+    for (int i = 0; i < N; i++)
+    {
+        stream_create(&st[i], &cases[i], opt->num_frames);
+        in[i].st = &st[i];
+        capture_init(&in[i].cap, st[i].num_frames, SPDIF_PCM_FORMAT_S16);
+    }
+    for (int i = 0; i < N; i++)
+    {
+        pthread_create(&threads[i], NULL, instance_thread, &in[i]);
+    }
+    bool ok = true;
+    for (int i = 0; i < N; i++)
+    {
+        pthread_join(threads[i], NULL);
+        bool inst_ok = in[i].errors == 0 &&
+                       timing_sample_rate(&in[i].timing, cases[i].resolution_hz) == cases[i].sample_rate;
+        printf("  instance %d | %6u Hz | %7.2f ns/frame | %s\n", i, (unsigned)cases[i].sample_rate,
+               in[i].ns / st[i].num_frames, inst_ok ? "bit-exact" : "FAILED");
+        ok &= inst_ok;
+        free(in[i].cap.data);
+        stream_free(&st[i]);
+    }
+    return ok;
+}
+
+// Clock recovery on sources running off their nominal rate: the measured
+// offset and the extrapolated time of a frame against the generator's
+static bool run_clock(void)
+{
+    static const double offsets_ppm[] = {0, 37.5, -120.25, 0.3};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    const bench_case_t *bc = &bench_cases[3];
+    // Four seconds: the loop reports lock after ~1.3 s at the default bandwidth
+    const size_t num_frames = bc->sample_rate * 4;
+    bool ok = true;
+
+    printf("\nClock recovery (%u Hz, jitter %.1f, %.2f Hz loop)\n", (unsigned)bc->sample_rate,
+           bc->jitter_ticks, CONFIG_SPDIF_IN_CLOCK_BANDWIDTH_MHZ / 1000.0);
+    for (size_t i = 0; i < sizeof(offsets_ppm) / sizeof(offsets_ppm[0]); i++)
+    {
+        bench_stream_t st;
+        stream_create_ex(&st, bc, num_frames, 0, offsets_ppm[i]);
+        pcm_capture_t cap;
+        capture_init(&cap, st.num_frames, SPDIF_PCM_FORMAT_S24_32);
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S24_32, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+
+        // Anchor the decoder to "RMT time" after every chunk, as the driver
+        // does with the ISR's esp_timer timestamp
+        uint64_t tick_pos = 0;
+        for (size_t off = 0; off < st.num_symbols; off += BENCH_CHUNK_SYMBOLS)
+        {
+            size_t n = st.num_symbols - off < BENCH_CHUNK_SYMBOLS ? st.num_symbols - off : BENCH_CHUNK_SYMBOLS;
+            for (size_t k = 0; k < n; k++)
+            {
+                tick_pos += st.symbols[off + k].duration0 + st.symbols[off + k].duration1;
+            }
+            spdif_decoder_feed(&dec, st.symbols + off, n);
+            spdif_decoder_set_time(&dec, (int64_t)(tick_pos * 1000000 / bc->resolution_hz));
+        }
+        spdif_decoder_flush(&dec);
+
+        // Generator frame of the first decoded frame; discovery consumes the start of
+        // the stream and the first frames after lock may be partial, so match a later pair
+        const size_t probe = 8;
+        size_t first;
+        for (first = 0; first + probe + 2 <= st.num_frames; first++)
+        {
+            uint8_t expected[2 * SPDIF_PCM_MAX_FRAME_BYTES];
+            const int32_t *in = &st.input[(first + probe) * 2];
+            expected_frame(SPDIF_PCM_FORMAT_S24_32, in[0], in[1], expected);
+            expected_frame(SPDIF_PCM_FORMAT_S24_32, in[2], in[3], expected + cap.frame_bytes);
+            if (cap.count >= probe + 2 && !memcmp(&cap.data[probe * cap.frame_bytes], expected, 2 * cap.frame_bytes))
+            {
+                break;
+            }
+        }
+
+        spdif_clock_t clock;
+        bool have = spdif_decoder_get_clock(&dec, &clock);
+        double rate = bc->sample_rate * (1 + offsets_ppm[i] * 1e-6);
+        double ppm_error = clock.ppm - offsets_ppm[i];
+        double true_us = (first + clock.frame) * 1e6 / rate;
+        double time_error = spdif_clock_frame_time_us(&clock, clock.frame) - true_us;
+        bool case_ok = have && clock.locked && first + probe + 2 <= st.num_frames && clock.nominal_rate == bc->sample_rate &&
+                       fabs(ppm_error) < 0.5 && fabs(time_error) < 3;
+        printf("  source %+8.2f ppm | measured %+9.3f ppm | error %+.3f ppm | frame time %+6.1f us | %s\n",
+               offsets_ppm[i], clock.ppm, ppm_error, time_error, case_ok ? "ok" : "FAILED");
+        ok &= case_ok;
+        free(cap.data);
+        stream_free(&st);
+    }
+    return ok;
+}
+
+// Least-squares fit of a sine plus DC with the frequency as a free parameter
+// (four-parameter fit, IEEE 1057), starting at w radians per frame. Returns the
+// residual power over the fitted sine's power in dB; *w_fit gets the frequency.
+static double sine_fit(const double *y, size_t n, double w, double *w_fit)
+{
+    double a = 0, b = 0, dc = 0, mid = n / 2.0;
+    for (int iter = 0; iter < 8; iter++)
+    {
+        // Columns: cos, sin, 1, and after the first pass d/dw of the current fit
+        int dim = iter ? 4 : 3;
+        double m[4][5] = {{0}};
+        for (size_t i = 0; i < n; i++)
+        {
+            double t = i - mid;
+            double c = cos(w * t), s = sin(w * t);
+            double col[4] = {c, s, 1, t * (b * c - a * s)};
+            for (int r = 0; r < dim; r++)
+            {
+                for (int k = 0; k < dim; k++)
+                {
+                    m[r][k] += col[r] * col[k];
+                }
+                m[r][4] += col[r] * y[i];
+            }
+        }
+        // Gaussian elimination with partial pivoting
+        for (int r = 0; r < dim; r++)
+        {
+            int pivot = r;
+            for (int k = r + 1; k < dim; k++)
+            {
+                if (fabs(m[k][r]) > fabs(m[pivot][r]))
+                {
+                    pivot = k;
+                }
+            }
+            for (int k = 0; k < 5; k++)
+            {
+                double tmp = m[r][k];
+                m[r][k] = m[pivot][k];
+                m[pivot][k] = tmp;
+            }
+            for (int k = r + 1; k < dim; k++)
+            {
+                double f = m[k][r] / m[r][r];
+                for (int j = r; j < 5; j++)
+                {
+                    m[k][j] -= f * m[r][j];
+                }
+            }
+        }
+        double x[4];
+        for (int r = dim - 1; r >= 0; r--)
+        {
+            x[r] = m[r][4];
+            for (int k = r + 1; k < dim; k++)
+            {
+                x[r] -= m[r][k] * x[k];
+            }
+            x[r] /= m[r][r];
+        }
+        a = x[0];
+        b = x[1];
+        dc = x[2];
+        if (iter)
+        {
+            w += x[3];
+        }
+    }
+
+    double residual = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        double t = i - mid;
+        double e = y[i] - a * cos(w * t) - b * sin(w * t) - dc;
+        residual += e * e;
+    }
+    *w_fit = w;
+    return 10 * log10(residual / n / ((a * a + b * b) / 2));
+}
+
+typedef struct
+{
+    uint32_t sample_rate;
+    double rate_ppm;
+} asrc_case_t;
+
+#define ASRC_OUTPUT_RATE 48000
+#define ASRC_ANALYSIS_FRAMES (ASRC_OUTPUT_RATE / 2)
+
+// Decode a tone into the converter, setting its input rate from the decoder's
+// recovered clock after every chunk as the driver does. Returns THD+N over
+// the last half second and the frequency error of the output in ppm.
+static bool asrc_pipeline(const bench_stream_t *st, spdif_asrc_quality_t quality, double tone, double rate_ppm,
+                          double *thdn_db, double *freq_error_ppm)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    pcm_capture_t cap;
+    capture_init(&cap, (size_t)((double)st->num_frames * ASRC_OUTPUT_RATE / st->bc.sample_rate) + 1024,
+                 SPDIF_PCM_FORMAT_S24_32);
+    spdif_pcm_sink_t cap_sink = {.write = capture_flush, .get_buffer = NULL, .ctx = &cap};
+    spdif_asrc_t asrc;
+    bool ok = spdif_asrc_init(&asrc, SPDIF_PCM_FORMAT_S24_32, ASRC_OUTPUT_RATE, quality, &cap_sink);
+    spdif_pcm_sink_t asrc_sink = spdif_asrc_sink(&asrc);
+
+    memset(&timing, 0, sizeof(timing));
+    spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S24_32, block, BENCH_BLOCK_FRAMES,
+                       asrc_sink.write, asrc_sink.ctx);
+    for (size_t off = 0; ok && off < st->num_symbols; off += BENCH_CHUNK_SYMBOLS)
+    {
+        size_t n = st->num_symbols - off < BENCH_CHUNK_SYMBOLS ? st->num_symbols - off : BENCH_CHUNK_SYMBOLS;
+        spdif_decoder_feed(&dec, st->symbols + off, n);
+        spdif_clock_t clock;
+        double rate = 0;
+        if (spdif_decoder_get_clock(&dec, &clock) && clock.locked)
+        {
+            rate = clock.sample_rate;
+        }
+        else if (timing.timing_discovered)
+        {
+            rate = timing_sample_rate(&timing, st->bc.resolution_hz);
+        }
+        if (rate > 0)
+        {
+            spdif_asrc_set_input_rate(&asrc, rate);
+        }
+    }
+    spdif_decoder_flush(&dec);
+
+    // Left channel of the last half second, short of the filter's tail
+    ok = ok && cap.count > ASRC_ANALYSIS_FRAMES + 64;
+    if (ok)
+    {
+        double *y = malloc(ASRC_ANALYSIS_FRAMES * sizeof(double));
+        const int32_t *frames = (const int32_t *)cap.data + (cap.count - ASRC_ANALYSIS_FRAMES - 64) * 2;
+        for (size_t i = 0; i < ASRC_ANALYSIS_FRAMES; i++)
+        {
+            y[i] = frames[i * 2] / 2147483648.0;
+        }
+        double w = 2 * M_PI * tone * (1 + rate_ppm * 1e-6) / ASRC_OUTPUT_RATE;
+        double w_fit;
+        *thdn_db = sine_fit(y, ASRC_ANALYSIS_FRAMES, w, &w_fit);
+        *freq_error_ppm = (w_fit / w - 1) * 1e6;
+        free(y);
+    }
+    spdif_asrc_deinit(&asrc);
+    free(cap.data);
+    return ok;
+}
+
+// Converter alone on PCM frames, 32-frame input blocks as from the driver;
+// returns ns per output frame
+static double asrc_timed(const int32_t *input, size_t num_frames, uint32_t sample_rate,
+                         spdif_asrc_quality_t quality, int iterations)
+{
+    int32_t *frames = malloc(num_frames * 2 * sizeof(int32_t));
+    for (size_t i = 0; i < num_frames * 2; i++)
+    {
+        frames[i] = input[i] * 256;
+    }
+    ring_sink_t ring = {.lock = PTHREAD_MUTEX_INITIALIZER};
+    spdif_pcm_sink_t sink = {.write = ring_flush, .get_buffer = NULL, .ctx = &ring};
+    double best_ns = 1e30;
+    for (int it = 0; it < iterations; it++)
+    {
+        spdif_asrc_t asrc;
+        spdif_asrc_init(&asrc, SPDIF_PCM_FORMAT_S24_32, ASRC_OUTPUT_RATE, quality, &sink);
+        spdif_asrc_set_input_rate(&asrc, sample_rate);
+        spdif_pcm_sink_t in = spdif_asrc_sink(&asrc);
+        double t0 = now_ns();
+        for (size_t off = 0; off < num_frames; off += 32)
+        {
+            in.write(in.ctx, &frames[off * 2], num_frames - off < 32 ? num_frames - off : 32);
+        }
+        double ns = now_ns() - t0;
+        spdif_asrc_deinit(&asrc);
+        double out_frames = (double)num_frames * ASRC_OUTPUT_RATE / sample_rate;
+        if (ns / out_frames < best_ns)
+        {
+            best_ns = ns / out_frames;
+        }
+    }
+    free(frames);
+    return best_ns;
+}
+
+// Sample-rate conversion of known tones through the decoder: THD+N and the
+// output frequency against the source clock, and the converter's cost
+static bool run_asrc(const bench_options_t *opt)
+{
+    static const asrc_case_t cases[] = {{44100, 0}, {48000, 100}, {96000, -50}};
+    static const double tones[] = {997, 15000};
+    static const char *quality_names[SPDIF_ASRC_QUALITY_COUNT] = {"low", "medium", "high"};
+    // THD+N limits per quality at 997 Hz and 15 kHz
+    static const double max_thdn_db[SPDIF_ASRC_QUALITY_COUNT][2] = {{-55, -50}, {-85, -85}, {-100, -100}};
+    bool ok = true;
+
+    printf("\nSample-rate converter to %u Hz (tones at -6 dBFS: THD+N, output frequency error, cost)\n",
+           ASRC_OUTPUT_RATE);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const bench_case_t bc = {cases[c].sample_rate, 80000000, 0.5f};
+        // Four seconds: clock recovery settles in ~3 s, the last half second is analyzed
+        const size_t num_frames = bc.sample_rate * 4;
+        double thdn[SPDIF_ASRC_QUALITY_COUNT][2], freq_error[SPDIF_ASRC_QUALITY_COUNT][2];
+        double ns[SPDIF_ASRC_QUALITY_COUNT];
+        bool case_ok[SPDIF_ASRC_QUALITY_COUNT];
+        for (int q = 0; q < SPDIF_ASRC_QUALITY_COUNT; q++)
+        {
+            case_ok[q] = true;
+        }
+        for (size_t t = 0; t < 2; t++)
+        {
+            bench_stream_t st;
+            st.num_frames = num_frames;
+            st.input = malloc(num_frames * 2 * sizeof(int32_t));
+            spdif_gen_tone(st.input, num_frames, bc.sample_rate, tones[t], 0.5);
+            stream_encode(&st, &bc, 0, cases[c].rate_ppm);
+            for (int q = 0; q < SPDIF_ASRC_QUALITY_COUNT; q++)
+            {
+                case_ok[q] &= asrc_pipeline(&st, (spdif_asrc_quality_t)q, tones[t], cases[c].rate_ppm,
+                                            &thdn[q][t], &freq_error[q][t]) &&
+                              thdn[q][t] < max_thdn_db[q][t] && fabs(freq_error[q][t]) < 0.1;
+                if (t == 0)
+                {
+                    ns[q] = asrc_timed(st.input, bc.sample_rate / 4, bc.sample_rate, (spdif_asrc_quality_t)q,
+                                       opt->iterations);
+                }
+            }
+            stream_free(&st);
+        }
+        for (int q = 0; q < SPDIF_ASRC_QUALITY_COUNT; q++)
+        {
+            printf("%6u Hz %+6.1f ppm %-6s | 997 Hz %6.1f dB %+6.3f ppm | 15 kHz %6.1f dB %+6.3f ppm | "
+                   "%6.1f ns/frame | %s\n",
+                   (unsigned)bc.sample_rate, cases[c].rate_ppm, quality_names[q], thdn[q][0], freq_error[q][0],
+                   thdn[q][1], freq_error[q][1], ns[q], case_ok[q] ? "ok" : "FAILED");
+            ok &= case_ok[q];
+        }
+    }
+    return ok;
+}
+
+typedef struct
+{
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    uint32_t writes;
+    uint32_t fail_after;        // Refuse writes after this many, 0 = never
+} capture_buffer_t;
+
+static bool capture_buffer_write(void *ctx, const void *data, size_t bytes)
+{
+    capture_buffer_t *buf = (capture_buffer_t *)ctx;
+    if ((buf->fail_after && buf->writes >= buf->fail_after) || buf->size + bytes > buf->capacity)
+    {
+        return false;
+    }
+    memcpy(buf->data + buf->size, data, bytes);
+    buf->size += bytes;
+    buf->writes++;
+    return true;
+}
+
+static bool capture_file_write(void *ctx, const void *data, size_t bytes)
+{
+    return fwrite(data, 1, bytes, (FILE *)ctx) == bytes;
+}
+
+// Capture the stream in receive-sized chunks, stamped a millisecond apart,
+// optionally with one symbol counted dropped every tenth chunk (none is
+// missing, so a replay restarting there would lose frames)
+static bool capture_stream(const bench_stream_t *st, const spdif_capture_sink_t *sink, bool count_drops)
+{
+    capture_t cap;
+    bool ok = capture_start(&cap, sink, st->bc.resolution_hz, 0);
+    for (size_t off = 0, i = 0; ok && off < st->num_symbols; off += BENCH_CHUNK_SYMBOLS, i++)
+    {
+        size_t n = st->num_symbols - off < BENCH_CHUNK_SYMBOLS ? st->num_symbols - off : BENCH_CHUNK_SYMBOLS;
+        ok = capture_chunk(&cap, st->symbols + off, n, 1000 * (int64_t)(i + 1), count_drops ? (uint32_t)(i / 10) : 0);
+    }
+    return ok;
+}
+
+// Stream for the spdif_replay test: 48 kHz test signal with edge jitter
+static bool write_capture_file(const char *path, const bench_options_t *opt)
+{
+    bench_case_t bc = {48000, 80000000, 0.5f};
+    bench_stream_t st;
+    stream_create(&st, &bc, opt->num_frames);
+    FILE *f = fopen(path, "wb");
+    spdif_capture_sink_t sink = {capture_file_write, f};
+    bool ok = f && capture_stream(&st, &sink, false);
+    ok &= f && !fclose(f);
+    printf("%s: %zu frames, %zu symbols %s\n", path, st.num_frames, st.num_symbols, ok ? "written" : "FAILED");
+    stream_free(&st);
+    return ok;
+}
+
+static bool run_capture(const bench_options_t *opt)
+{
+    static const uint32_t rates[] = {48000, 192000};
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bool ok = true;
+
+    printf("\nRaw symbol capture (%d-symbol chunks): write, read back, replay\n", BENCH_CHUNK_SYMBOLS);
+    for (size_t i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+    {
+        bench_case_t bc = {rates[i], 80000000, rates[i] > 96000 ? 0.25f : 0.5f};
+        bench_stream_t st;
+        stream_create(&st, &bc, opt->num_frames);
+        size_t num_chunks = (st.num_symbols + BENCH_CHUNK_SYMBOLS - 1) / BENCH_CHUNK_SYMBOLS;
+        capture_buffer_t buf = {.capacity = CAPTURE_HEADER_BYTES + num_chunks * CAPTURE_RECORD_BYTES +
+                                            st.num_symbols * CAPTURE_MAX_SYMBOL_BYTES};
+        buf.data = malloc(buf.capacity);
+        spdif_capture_sink_t sink = {capture_buffer_write, &buf};
+
+        double write_ns = 0;
+        bool case_ok = true;
+        for (int it = 0; it < opt->iterations; it++)
+        {
+            buf.size = 0;
+            double t0 = now_ns();
+            case_ok &= capture_stream(&st, &sink, true);
+            double dt = now_ns() - t0;
+            write_ns = it == 0 || dt < write_ns ? dt : write_ns;
+        }
+
+        // Read back: the same symbols, chunks, times and drop counts
+        rmt_symbol_word_t *symbols = malloc(st.num_symbols * sizeof(rmt_symbol_word_t));
+        capture_reader_t reader;
+        capture_chunk_t chunk;
+        size_t read = 0, chunks = 0;
+        uint32_t dropped = 0;
+        double t0 = now_ns();
+        case_ok &= capture_reader_open(&reader, buf.data, buf.size) && reader.resolution_hz == bc.resolution_hz;
+        while (capture_reader_next(&reader, &chunk, symbols + read, st.num_symbols - read))
+        {
+            case_ok &= chunk.time_us == 1000 * (int64_t)(chunks + 1);
+            read += chunk.num_symbols;
+            dropped += chunk.dropped;
+            chunks++;
+        }
+        double read_ns = now_ns() - t0;
+        case_ok &= !reader.error && read == st.num_symbols && chunks == num_chunks &&
+                   dropped == (num_chunks - 1) / 10;
+        for (size_t s = 0; case_ok && s < read; s++)
+        {
+            case_ok &= symbols[s].val == st.symbols[s].val;
+        }
+
+        // Replayed symbols decode bit-exact
+        pcm_capture_t pcm;
+        capture_init(&pcm, st.num_frames, SPDIF_PCM_FORMAT_S16);
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &pcm);
+        feed_chunks(&dec, symbols, read, spdif_decoder_feed);
+        size_t compared = 0;
+        case_ok &= timing.timing_discovered && timing_sample_rate(&timing, bc.resolution_hz) == bc.sample_rate;
+        decoder_init_thresholds(&dec);
+        decode_timed(symbols, read, &dec, &pcm, 1, spdif_decoder_process);
+        case_ok &= verify_pcm(SPDIF_PCM_FORMAT_S16, st.input, st.num_frames, &pcm, &compared) == 0;
+
+        // A truncated stream is an error, not a short capture; a refused
+        // write ends the capture for good
+        reader.error = false;
+        case_ok &= capture_reader_open(&reader, buf.data, buf.size - 1);
+        while (capture_reader_next(&reader, &chunk, symbols, st.num_symbols))
+        {
+        }
+        case_ok &= reader.error;
+        capture_t failing;
+        capture_buffer_t short_buf = {.data = buf.data, .capacity = buf.capacity};
+        spdif_capture_sink_t short_sink = {capture_buffer_write, &short_buf};
+        capture_start(&failing, &short_sink, bc.resolution_hz, 0);
+        capture_chunk(&failing, st.symbols, BENCH_CHUNK_SYMBOLS, 0, 0);
+        short_buf.fail_after = short_buf.writes;
+        short_buf.writes = 0;
+        short_buf.size = 0;
+        case_ok &= capture_start(&failing, &short_sink, bc.resolution_hz, 0);
+        for (int c = 0; c < 4; c++)
+        {
+            case_ok &= capture_chunk(&failing, st.symbols, BENCH_CHUNK_SYMBOLS, 0, 0) == (c == 0);
+        }
+        case_ok &= failing.failed && short_buf.writes == short_buf.fail_after &&
+                   failing.symbols == BENCH_CHUNK_SYMBOLS;
+
+        ok &= case_ok;
+        printf("  %6u Hz | %.2f bytes/symbol (%.0f%% of raw) | write %.2f ns/sym | read %.2f ns/sym | %s\n",
+               (unsigned)bc.sample_rate, (double)buf.size / st.num_symbols,
+               100.0 * buf.size / (st.num_symbols * sizeof(rmt_symbol_word_t)), write_ns / st.num_symbols,
+               read_ns / st.num_symbols, case_ok ? "ok" : "FAILED");
+        free(pcm.data);
+        free(symbols);
+        free(buf.data);
+        stream_free(&st);
+    }
+    return ok;
+}
+
+// What a consumer re-reading the PCM ring does: per sample, float gain, a
+// map switch, rand() dither and float meters. Writes int16 into out.
+typedef struct
+{
+    double peak[2];
+    double sum_sq[2];
+} naive_meter_t;
+
+static void post_naive(const int32_t *in, int16_t *out, size_t num_frames, const spdif_post_config_t *cfg,
+                       naive_meter_t *meter)
+{
+    double gain = pow(10.0, cfg->gain_db / 20.0);
+    for (size_t i = 0; i < num_frames; i++)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            double l = in[2 * i], r = in[2 * i + 1], v;
+            switch (cfg->channel_map)
+            {
+                case SPDIF_CHANNEL_MAP_SWAP:
+                    v = c ? l : r;
+                    break;
+                case SPDIF_CHANNEL_MAP_DOWNMIX:
+                    v = (l + r) / 2;
+                    break;
+                case SPDIF_CHANNEL_MAP_LEFT:
+                    v = l;
+                    break;
+                case SPDIF_CHANNEL_MAP_RIGHT:
+                    v = r;
+                    break;
+                default:
+                    v = c ? r : l;
+                    break;
+            }
+            v *= gain;
+            if (fabs(v) / 2147483648.0 > meter->peak[c])
+            {
+                meter->peak[c] = fabs(v) / 2147483648.0;
+            }
+            meter->sum_sq[c] += (v / 2147483648.0) * (v / 2147483648.0);
+            if (cfg->dither)
+            {
+                v += ((double)rand() / RAND_MAX - (double)rand() / RAND_MAX) * 65536.0;
+            }
+            v = floor(v / 65536.0);
+            out[2 * i + c] = (int16_t)(v > 32767 ? 32767 : v < -32768 ? -32768 : v);
+        }
+    }
+}
+
+// Time fn over the whole input in SPDIF_POST_BLOCK_FRAMES pieces; ns per frame
+#define POST_TIMED(iterations, num_frames, result, body)                              \
+    do                                                                                \
+    {                                                                                 \
+        double best = 0;                                                              \
+        for (int it = 0; it < (iterations); it++)                                     \
+        {                                                                             \
+            double t0 = now_ns();                                                     \
+            for (size_t at = 0; at < (num_frames); at += SPDIF_POST_BLOCK_FRAMES)     \
+            {                                                                         \
+                size_t len = (num_frames) - at;                                       \
+                len = len < SPDIF_POST_BLOCK_FRAMES ? len : SPDIF_POST_BLOCK_FRAMES;  \
+                body;                                                                 \
+            }                                                                         \
+            double dt = now_ns() - t0;                                                \
+            best = it == 0 || dt < best ? dt : best;                                  \
+        }                                                                             \
+        (result) = best / (num_frames);                                               \
+    } while (0)
+
+static bool run_post(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static spdif_post_t post;
+    bool ok = true;
+
+    // Unity settings must reproduce the decoder's own conversion in every format
+    bench_stream_t st;
+    stream_create(&st, &bench_cases[3], opt->num_frames);
+    printf("\nPCM post-processing (%u Hz): decode to s24_32, then the stage converts\n", (unsigned)st.bc.sample_rate);
+    for (spdif_pcm_format_t format = 0; format < SPDIF_PCM_FORMAT_COUNT; format++)
+    {
+        pcm_capture_t cap;
+        capture_init(&cap, st.num_frames, format);
+        size_t compared = 0;
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, format, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+        bool case_ok = stream_lock(&st, &dec) != 0;
+        double direct_ns = stream_decode(&st, &dec, &cap, opt->iterations);
+
+        spdif_post_config_t cfg = {.enabled = true, .meter_frames = 4800};
+        spdif_pcm_sink_t out = {.write = capture_flush, .ctx = &cap};
+        spdif_post_init(&post, format, &cfg, &out);
+        spdif_pcm_sink_t in = spdif_post_sink(&post);
+        dec.format = SPDIF_PCM_FORMAT_S24_32;
+        spdif_decoder_set_sink(&dec, &in);
+        double post_ns = stream_decode(&st, &dec, &cap, opt->iterations);
+        spdif_meter_t meter;
+        case_ok &= verify_pcm(format, st.input, st.num_frames, &cap, &compared) == 0 &&
+                   spdif_post_get_meter(&post, &meter) && meter.windows >= opt->num_frames / 4800 - 1;
+        ok &= case_ok;
+        printf("  %-10s | direct %6.2f ns/frame | unity post %6.2f ns/frame (%+.2f) | %s\n", format_names[format],
+               direct_ns / st.num_frames, post_ns / st.num_frames, (post_ns - direct_ns) / st.num_frames,
+               case_ok ? "bit-exact" : "FAILED");
+        free(cap.data);
+    }
+
+    // Kernels against the naive loop on a 0.5 full-scale tone, swapped and 6 dB down
+    const size_t n = st.num_frames;
+    int32_t *in = malloc(n * 2 * sizeof(int32_t));
+    int16_t *out = malloc(n * 2 * sizeof(int16_t));
+    int16_t *ref = malloc(n * 2 * sizeof(int16_t));
+    int32_t *mixed = malloc(n * 2 * sizeof(int32_t));
+    spdif_gen_tone(in, n, st.bc.sample_rate, 997.0, 0.5);
+    for (size_t i = 0; i < n; i++)
+    {
+        in[2 * i] <<= 8;
+        in[2 * i + 1] = in[2 * i] / 2; // Right at half the left level
+    }
+    spdif_post_config_t cfg = {.enabled = true, .gain_db = -6.0206f, .channel_map = SPDIF_CHANNEL_MAP_SWAP,
+                               .meter_frames = (uint32_t)n};
+    spdif_pcm_sink_t discard = {.write = ring_discard};
+    spdif_post_init(&post, SPDIF_PCM_FORMAT_S16, &cfg, &discard);
+    double mix_ns, meter_ns, quant_ns, dither_ns, total_ns, total_dither_ns, naive_ns, naive_dither_ns;
+    uint32_t rng = 1;
+    POST_TIMED(opt->iterations, n, mix_ns, spdif_post_mix(in + at * 2, mixed + at * 2, len, post.matrix));
+    POST_TIMED(opt->iterations, n, meter_ns, spdif_post_meter(&post, mixed + at * 2, len));
+    POST_TIMED(opt->iterations, n, quant_ns, spdif_post_quantize_s16(mixed + at * 2, out + at * 2, len, NULL));
+    POST_TIMED(opt->iterations, n, dither_ns, spdif_post_quantize_s16(mixed + at * 2, out + at * 2, len, &rng));
+    spdif_pcm_sink_t post_in = spdif_post_sink(&post);
+    POST_TIMED(opt->iterations, n, total_ns, post_in.write(post_in.ctx, in + at * 2, len));
+    cfg.dither = true;
+    spdif_post_configure(&post, &cfg);
+    POST_TIMED(opt->iterations, n, total_dither_ns, post_in.write(post_in.ctx, in + at * 2, len));
+    naive_meter_t nm = {0};
+    POST_TIMED(opt->iterations, n, naive_dither_ns, post_naive(in + at * 2, ref + at * 2, len, &cfg, &nm));
+    cfg.dither = false;
+    POST_TIMED(opt->iterations, n, naive_ns, post_naive(in + at * 2, ref + at * 2, len, &cfg, &nm));
+
+    // Without dither the two agree to 1 LSB (float against Q28 gain)
+    memset(&nm, 0, sizeof(nm));
+    post_naive(in, ref, n, &cfg, &nm);
+    spdif_post_mix(in, mixed, n, post.matrix);
+    spdif_post_quantize_s16(mixed, out, n, NULL);
+    int max_diff = 0;
+    for (size_t i = 0; i < n * 2; i++)
+    {
+        int d = abs(out[i] - ref[i]);
+        max_diff = d > max_diff ? d : max_diff;
+    }
+    spdif_post_init(&post, SPDIF_PCM_FORMAT_S16, &cfg, &discard);
+    post_in = spdif_post_sink(&post);
+    post_in.write(post_in.ctx, in, n);
+    spdif_meter_t meter;
+    bool meter_ok = spdif_post_get_meter(&post, &meter) && meter.frames == n && !meter.clipped;
+    for (int c = 0; c < 2; c++)
+    {
+        double rms = sqrt(nm.sum_sq[c] / n);
+        meter_ok &= fabs(meter.peak[c] - nm.peak[c]) < 1e-4 && fabs(meter.rms[c] - rms) < 1e-4;
+    }
+    // Swapped: left carries the right input, 0.25 * 0.5 full scale
+    meter_ok &= fabs(meter.peak[0] - 0.125) < 1e-3 && fabs(meter.rms[1] - 0.25 / sqrt(2)) < 1e-3;
+    bool kernels_ok = max_diff <= 1 && meter_ok;
+    ok &= kernels_ok;
+    printf("  kernels, ns/frame: mix %.2f | meter %.2f | s16 %.2f | s16 dither %.2f\n", mix_ns, meter_ns, quant_ns,
+           dither_ns);
+    printf("  stage, ns/frame: %.2f, %.2f with dither | naive per-sample loop %.2f (%.1fx), %.2f with rand() "
+           "dither (%.1fx) | %s\n",
+           total_ns, total_dither_ns, naive_ns, naive_ns / total_ns, naive_dither_ns, naive_dither_ns / total_dither_ns,
+           kernels_ok ? "ok" : "FAILED");
+
+    // TPDF dither: a level between two LSBs averages out to it, with at most
+    // one LSB of error either way; silence becomes +-1 LSB of noise
+    for (size_t i = 0; i < n * 2; i++)
+    {
+        in[i] = 0x2000 * 3 + (i & 1 ? 0 : 0x7FFF0000); // 0.375 LSB, and one near full scale on the left
+    }
+    spdif_post_quantize_s16(in, out, n, &rng);
+    double sum = 0;
+    bool dither_ok = true;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += out[2 * i + 1];
+        dither_ok &= out[2 * i + 1] >= -1 && out[2 * i + 1] <= 1 && out[2 * i] >= 32766;
+    }
+    dither_ok &= fabs(sum / n - 0.375) < 0.01;
+
+    // Settings change between writes: +18 dB clips, then a mute
+    spdif_gen_tone(in, n, st.bc.sample_rate, 997.0, 0.5);
+    for (size_t i = 0; i < n * 2; i++)
+    {
+        in[i] <<= 8;
+    }
+    pcm_capture_t cap;
+    capture_init(&cap, n, SPDIF_PCM_FORMAT_S16);
+    spdif_pcm_sink_t to_cap = {.write = capture_flush, .ctx = &cap};
+    cfg = (spdif_post_config_t){.enabled = true, .gain_db = 18.0f, .meter_frames = (uint32_t)n / 2};
+    spdif_post_init(&post, SPDIF_PCM_FORMAT_S16, &cfg, &to_cap);
+    post_in = spdif_post_sink(&post);
+    post_in.write(post_in.ctx, in, n / 2);
+    bool live_ok = spdif_post_get_meter(&post, &meter) && meter.clipped > 0 && meter.peak[0] > 0.999f;
+    cfg.gain_db = -200.0f;
+    spdif_post_configure(&post, &cfg);
+    post_in.write(post_in.ctx, in + n, n - n / 2);
+    const int16_t *pcm = (const int16_t *)cap.data;
+    bool muted = cap.count == n;
+    for (size_t i = n / 2; i < cap.count; i++)
+    {
+        muted &= pcm[2 * i] == 0 && pcm[2 * i + 1] == 0;
+    }
+    live_ok &= muted && pcm[2 * 100] != 0 && spdif_post_get_meter(&post, &meter) && meter.windows == 2 &&
+               meter.peak[0] == 0;
+    ok &= dither_ok && live_ok;
+    printf("  dither mean %.4f LSB for 0.375 | +18 dB clipped %u samples, mute applied at the next write | %s\n",
+           sum / n, (unsigned)post.meter_slots[1].clipped, dither_ok && live_ok ? "ok" : "FAILED");
+
+    free(cap.data);
+    free(in);
+    free(out);
+    free(ref);
+    free(mixed);
+    stream_free(&st);
+    return ok;
+}
+
+// 8-channel ADAT stream: the stereo test signal with a different seed per pair
+static void adat_stream_create(bench_stream_t *st, const bench_case_t *bc, size_t num_frames)
+{
+    memset(st, 0, sizeof(*st));
+    st->bc = *bc;
+    st->num_frames = num_frames;
+    st->input = malloc(num_frames * SPDIF_ADAT_CHANNELS * sizeof(int32_t));
+    int32_t *pair = malloc(num_frames * 2 * sizeof(int32_t));
+    for (int p = 0; p < SPDIF_ADAT_CHANNELS / 2; p++)
+    {
+        spdif_gen_test_signal(pair, num_frames, bc->sample_rate, 1234 + p);
+        for (size_t f = 0; f < num_frames; f++)
+        {
+            st->input[f * SPDIF_ADAT_CHANNELS + 2 * p] = pair[f * 2] >> p;
+            st->input[f * SPDIF_ADAT_CHANNELS + 2 * p + 1] = pair[f * 2 + 1];
+        }
+    }
+    free(pair);
+    st->symbols = malloc((num_frames * SPDIF_GEN_ADAT_MAX_SYMBOLS_PER_FRAME + 1) * sizeof(rmt_symbol_word_t));
+    spdif_gen_config_t gcfg = {
+        .sample_rate = bc->sample_rate,
+        .resolution_hz = bc->resolution_hz,
+        .jitter_ticks = bc->jitter_ticks,
+        .seed = 42,
+    };
+    spdif_gen_t gen;
+    spdif_gen_adat_init(&gen, &gcfg);
+    st->num_symbols = spdif_gen_adat_encode(&gen, st->input, num_frames, st->symbols);
+    st->num_symbols += spdif_gen_finish(&gen, st->symbols + st->num_symbols);
+}
+
+// Frames of an 8-channel capture that differ from the input, plus any missing
+static size_t adat_verify(spdif_pcm_format_t format, const int32_t *input, size_t num_frames, const pcm_capture_t *cap)
+{
+    const size_t pair_bytes = spdif_pcm_frame_bytes(format);
+    uint8_t expected[SPDIF_PCM_MAX_FRAME_BYTES];
+    size_t errors = num_frames - (cap->count < num_frames ? cap->count : num_frames);
+    for (size_t i = 0; i < cap->count && i < num_frames; i++)
+    {
+        for (int p = 0; p < SPDIF_ADAT_CHANNELS / 2; p++)
+        {
+            const int32_t *in = &input[i * SPDIF_ADAT_CHANNELS + 2 * p];
+            expected_frame(format, in[0], in[1], expected);
+            if (memcmp(&cap->data[i * cap->frame_bytes + p * pair_bytes], expected, pair_bytes))
+            {
+                errors++;
+                break;
+            }
+        }
+    }
+    return errors;
+}
+
+// ADAT: discovery without the 1:2:3 groups, bit-exact 8-channel decoding in
+// every format, the recovered clock, auto-detection both ways, and
+// throughput against stereo S/PDIF at the same rate (ADAT's line rate is
+// twice as high)
+static bool run_adat(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bool ok = true;
+
+    printf("\nADAT Lightpipe, 8 channels\n");
+    for (size_t c = 0; c < sizeof(bench_cases) / sizeof(bench_cases[0]); c++)
+    {
+        const bench_case_t *bc = &bench_cases[c];
+        bench_stream_t st;
+        adat_stream_create(&st, bc, opt->num_frames);
+        spdif_pcm_format_t formats = (c == 3) ? SPDIF_PCM_FORMAT_COUNT : 1;
+        for (spdif_pcm_format_t format = 0; format < formats; format++)
+        {
+            pcm_capture_t cap;
+            capture_init(&cap, st.num_frames * SPDIF_ADAT_CHANNELS / 2, format);
+            cap.frame_bytes *= SPDIF_ADAT_CHANNELS / 2;
+            cap.capacity = st.num_frames;
+            memset(&timing, 0, sizeof(timing));
+            spdif_decoder_init(&dec, &timing, format, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+            spdif_decoder_set_protocol(&dec, SPDIF_PROTOCOL_ADAT);
+            size_t lock_symbols = stream_lock(&st, &dec);
+            double best_ns = lock_symbols ? stream_decode(&st, &dec, &cap, opt->iterations) : 0;
+
+            spdif_stats_t stats;
+            spdif_decoder_get_stats(&dec, &stats);
+            spdif_clock_t clock;
+            bool clock_ok = spdif_decoder_get_clock(&dec, &clock) && clock.nominal_rate == bc->sample_rate &&
+                            fabs(clock.ppm) < 100;
+            size_t errors = lock_symbols ? adat_verify(format, st.input, st.num_frames, &cap) : st.num_frames;
+            bool case_ok = lock_symbols && !errors && spdif_decoder_get_channels(&dec) == SPDIF_ADAT_CHANNELS &&
+                           timing_sample_rate(&timing, bc->resolution_hz) == bc->sample_rate &&
+                           stats.frames_decoded == st.num_frames && !stats.unknown_pulses && !stats.sync_errors &&
+                           clock_ok;
+            ok &= case_ok;
+            printf("%6u Hz jitter %.2f %-10s | cell %5.2f ticks lock %5zu sym %5.2f ms | %7.1f Msym/s %7.2f ns/frame "
+                   "| clock %+.1f ppm | %zu/%zu frames %s\n",
+                   (unsigned)bc->sample_rate, bc->jitter_ticks, format_names[format], timing.cell_x16 / 16.0,
+                   lock_symbols, stream_ms(&st, lock_symbols), best_ns ? st.num_symbols / best_ns * 1e3 : 0,
+                   best_ns / st.num_frames, clock_ok ? clock.ppm : 0, st.num_frames - errors, st.num_frames,
+                   case_ok ? "bit-exact" : "FAILED");
+            free(cap.data);
+        }
+        stream_free(&st);
+    }
+
+    // Throughput at 48 kHz: time per second of input for each line coding
+    bench_stream_t adat, spdif;
+    adat_stream_create(&adat, &bench_cases[3], opt->num_frames);
+    stream_create(&spdif, &bench_cases[3], opt->num_frames);
+    pcm_capture_t cap;
+    capture_init(&cap, opt->num_frames * SPDIF_ADAT_CHANNELS / 2, SPDIF_PCM_FORMAT_S16);
+    cap.frame_bytes *= SPDIF_ADAT_CHANNELS / 2;
+    cap.capacity = opt->num_frames;
+    double ns[2];
+    for (int i = 0; i < 2; i++)
+    {
+        const bench_stream_t *st = i ? &spdif : &adat;
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, ring_discard, NULL);
+        spdif_decoder_set_protocol(&dec, i ? SPDIF_PROTOCOL_SPDIF : SPDIF_PROTOCOL_ADAT);
+        stream_lock(st, &dec);
+        ns[i] = stream_decode(st, &dec, NULL, opt->iterations);
+    }
+    double audio_s = (double)opt->num_frames / bench_cases[3].sample_rate;
+    printf("  48 kHz throughput: ADAT %.2f Msym/s, %.2f ms per second of input (%.0fx real time) | "
+           "S/PDIF %.2f Msym/s, %.2f ms per second (%.0fx) | %.2fx the symbols\n",
+           adat.num_symbols / ns[0] * 1e3, ns[0] / audio_s * 1e-6, audio_s * 1e9 / ns[0],
+           spdif.num_symbols / ns[1] * 1e3, ns[1] / audio_s * 1e-6, audio_s * 1e9 / ns[1],
+           (double)adat.num_symbols / spdif.num_symbols);
+
+    // Auto-detection picks each protocol from its histogram; ADAT-only
+    // discovery never locks on S/PDIF
+    bool auto_ok = true;
+    for (int i = 0; i < 3; i++)
+    {
+        const bench_stream_t *st = (i == 1) ? &spdif : &adat;
+        spdif_protocol_t protocol = (i == 2) ? SPDIF_PROTOCOL_ADAT : SPDIF_PROTOCOL_AUTO;
+        if (i == 2)
+        {
+            st = &spdif;
+        }
+        cap.count = 0;
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+        spdif_decoder_set_protocol(&dec, protocol);
+        feed_chunks(&dec, st->symbols, st->num_symbols, spdif_decoder_feed);
+        spdif_decoder_flush(&dec);
+        if (i == 2)
+        {
+            auto_ok &= !timing.timing_discovered && cap.count == 0;
+        }
+        else
+        {
+            auto_ok &= timing.timing_discovered &&
+                       spdif_decoder_get_channels(&dec) == (i ? 2u : (uint32_t)SPDIF_ADAT_CHANNELS) &&
+                       cap.count > st->num_frames * 9 / 10;
+        }
+        spdif_decoder_deinit(&dec);
+    }
+    ok &= auto_ok;
+    printf("  auto-detect: ADAT as 8 channels, S/PDIF as 2; ADAT-only ignores S/PDIF | %s\n",
+           auto_ok ? "ok" : "FAILED");
+
+    free(cap.data);
+    stream_free(&adat);
+    stream_free(&spdif);
+    return ok;
+}
+
+// Overflow policies under a stalling reader, on a virtual clock. The RMT ISR
+// stand-in queues each 512-symbol chunk into a bounded symbol ring when its
+// last symbol ends, dropping it (and marking the gap) when the ring is full;
+// the decoder takes chunks as they come and writes 32-frame blocks into a
+// PCM ring stand-in through pcm_ring_write(). The reader takes up to two
+// milliseconds of frames every millisecond, except for stalls of
+// OVERFLOW_STALL_MS every OVERFLOW_STALL_PERIOD_MS. A send that waits moves
+// the clock on, so chunks keep arriving and the reader keeps reading.
+#define OVERFLOW_RING_CHUNKS 16
+#define OVERFLOW_PCM_FRAMES 1024
+#define OVERFLOW_BLOCK_FRAMES 32
+#define OVERFLOW_FIRST_STALL_MS 100
+#define OVERFLOW_STALL_MS 40
+#define OVERFLOW_STALL_PERIOD_MS 150
+
+typedef struct
+{
+    const bench_stream_t *st;
+    spdif_decoder_t *dec;
+    spdif_overflow_t policy;
+    uint32_t wait_ms;
+    bool mark_gaps;
+    double now_us;
+
+    // Chunks and the symbol ring
+    double *chunk_end_us;
+    size_t num_chunks;
+    size_t next_chunk;          // Next to arrive
+    size_t ring[OVERFLOW_RING_CHUNKS];
+    bool ring_gap[OVERFLOW_RING_CHUNKS];
+    size_t ring_head;
+    size_t ring_tail;
+    bool gap;                   // A chunk was dropped since the last one queued
+
+    // PCM ring of S24_32 frames
+    int32_t pcm[OVERFLOW_PCM_FRAMES * 2];
+    size_t pcm_head;
+    size_t pcm_count;
+    double longest_wait_us;
+
+    // Reader: each frame taken and when
+    double next_read_us;
+    int32_t *out;
+    double *out_us;
+    size_t out_count;
+} overflow_sim_t;
+
+static bool overflow_stalled(double t_us)
+{
+    double ms = t_us / 1000 - OVERFLOW_FIRST_STALL_MS;
+    return ms >= 0 && fmod(ms, OVERFLOW_STALL_PERIOD_MS) < OVERFLOW_STALL_MS;
+}
+
+static size_t overflow_chunk_symbols(const overflow_sim_t *sim, size_t chunk)
+{
+    size_t start = chunk * BENCH_CHUNK_SYMBOLS;
+    return sim->st->num_symbols - start < BENCH_CHUNK_SYMBOLS ? sim->st->num_symbols - start : BENCH_CHUNK_SYMBOLS;
+}
+
+// Run the ISR and the reader up to time until_us
+static void overflow_advance(overflow_sim_t *sim, double until_us)
+{
+    for (;;)
+    {
+        double arrival = sim->next_chunk < sim->num_chunks ? sim->chunk_end_us[sim->next_chunk] : INFINITY;
+        double t = arrival < sim->next_read_us ? arrival : sim->next_read_us;
+        if (t > until_us)
+        {
+            break;
+        }
+        sim->now_us = t;
+        if (t == arrival)
+        {
+            if (sim->ring_head - sim->ring_tail < OVERFLOW_RING_CHUNKS)
+            {
+                sim->ring[sim->ring_head % OVERFLOW_RING_CHUNKS] = sim->next_chunk;
+                sim->ring_gap[sim->ring_head % OVERFLOW_RING_CHUNKS] = sim->gap && sim->mark_gaps;
+                sim->ring_head++;
+                sim->gap = false;
+            }
+            else
+            {
+                spdif_stat_add(&sim->dec->stats.symbols_dropped, (uint32_t)overflow_chunk_symbols(sim, sim->next_chunk));
+                sim->gap = true;
+            }
+            sim->next_chunk++;
+        }
+        else
+        {
+            size_t n = overflow_stalled(t) ? 0 : sim->pcm_count < 96 ? sim->pcm_count : 96;
+            for (size_t i = 0; i < n; i++)
+            {
+                size_t at = (sim->pcm_head + i) % OVERFLOW_PCM_FRAMES;
+                sim->out[sim->out_count * 2] = sim->pcm[at * 2];
+                sim->out[sim->out_count * 2 + 1] = sim->pcm[at * 2 + 1];
+                sim->out_us[sim->out_count++] = t;
+            }
+            sim->pcm_head = (sim->pcm_head + n) % OVERFLOW_PCM_FRAMES;
+            sim->pcm_count -= n;
+            sim->next_read_us += 1000;
+        }
+    }
+    sim->now_us = until_us > sim->now_us ? until_us : sim->now_us;
+}
+
+static bool overflow_send(void *ctx, const void *data, size_t bytes, uint32_t wait_ms)
+{
+    overflow_sim_t *sim = (overflow_sim_t *)ctx;
+    size_t frames = bytes / (2 * sizeof(int32_t));
+    double start = sim->now_us;
+    double deadline = start + wait_ms * 1000.0;
+    while (OVERFLOW_PCM_FRAMES - sim->pcm_count < frames && sim->now_us < deadline)
+    {
+        double arrival = sim->next_chunk < sim->num_chunks ? sim->chunk_end_us[sim->next_chunk] : INFINITY;
+        double t = arrival < sim->next_read_us ? arrival : sim->next_read_us;
+        overflow_advance(sim, t < deadline ? t : deadline);
+    }
+    if (sim->now_us - start > sim->longest_wait_us)
+    {
+        sim->longest_wait_us = sim->now_us - start;
+    }
+    if (OVERFLOW_PCM_FRAMES - sim->pcm_count < frames)
+    {
+        return false;
+    }
+    const int32_t *in = (const int32_t *)data;
+    for (size_t i = 0; i < frames; i++)
+    {
+        size_t at = (sim->pcm_head + sim->pcm_count + i) % OVERFLOW_PCM_FRAMES;
+        sim->pcm[at * 2] = in[i * 2];
+        sim->pcm[at * 2 + 1] = in[i * 2 + 1];
+    }
+    sim->pcm_count += frames;
+    return true;
+}
+
+static size_t overflow_discard(void *ctx, size_t bytes, size_t frame_bytes)
+{
+    overflow_sim_t *sim = (overflow_sim_t *)ctx;
+    size_t room = OVERFLOW_PCM_FRAMES - sim->pcm_count;
+    size_t need = (bytes + frame_bytes - 1) / frame_bytes;
+    size_t n = need > room ? need - room : 0;
+    n = n < sim->pcm_count ? n : sim->pcm_count;
+    sim->pcm_head = (sim->pcm_head + n) % OVERFLOW_PCM_FRAMES;
+    sim->pcm_count -= n;
+    return n * frame_bytes;
+}
+
+static void overflow_write(void *ctx, const void *frames, size_t num_frames)
+{
+    overflow_sim_t *sim = (overflow_sim_t *)ctx;
+    pcm_ring_t ring = {.send = overflow_send, .discard = overflow_discard, .ctx = sim};
+    pcm_ring_write(&ring, sim->policy, sim->wait_ms, frames, num_frames, 2 * sizeof(int32_t), &sim->dec->stats);
+}
+
+// The decoder task: take each chunk as it arrives, restart after a gap
+static void overflow_run(overflow_sim_t *sim)
+{
+    while (sim->next_chunk < sim->num_chunks || sim->ring_tail != sim->ring_head)
+    {
+        if (sim->ring_tail == sim->ring_head)
+        {
+            overflow_advance(sim, sim->chunk_end_us[sim->next_chunk]);
+            continue;
+        }
+        size_t chunk = sim->ring[sim->ring_tail % OVERFLOW_RING_CHUNKS];
+        if (sim->ring_gap[sim->ring_tail % OVERFLOW_RING_CHUNKS])
+        {
+            spdif_decoder_gap(sim->dec);
+        }
+        sim->ring_tail++;
+        spdif_decoder_feed(sim->dec, sim->st->symbols + chunk * BENCH_CHUNK_SYMBOLS, overflow_chunk_symbols(sim, chunk));
+    }
+    spdif_decoder_flush(sim->dec);
+    while (sim->pcm_count)
+    {
+        overflow_advance(sim, sim->now_us + 1000);
+    }
+}
+
+// Each policy must keep every frame read a true pair, account for every
+// frame decoded, wait no longer than it may, and be back to continuous
+// output within a bounded time of each stall's end
+static bool run_overflow(const bench_options_t *opt)
+{
+    typedef struct
+    {
+        const char *name;
+        spdif_overflow_t policy;
+        uint32_t wait_ms;
+        bool mark_gaps;
+    } overflow_case_t;
+    static const overflow_case_t cases[] = {
+        {"drop newest", SPDIF_OVERFLOW_DROP_NEWEST, 0, true},
+        {"drop oldest", SPDIF_OVERFLOW_DROP_OLDEST, 0, true},
+        {"block 2 ms", SPDIF_OVERFLOW_BLOCK, 2, true},
+        {"block 50 ms", SPDIF_OVERFLOW_BLOCK, 50, true},
+        {"block 50 ms, gaps unmarked", SPDIF_OVERFLOW_BLOCK, 50, false},
+    };
+    static uint8_t block[OVERFLOW_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    static overflow_sim_t sim;
+    const bench_case_t bc = {48000, 80000000, 0.0f};
+    bool ok = true;
+
+    // Left counts frames, right repeats the count tagged, as for resync
+    bench_stream_t st;
+    st.num_frames = opt->num_frames < RESYNC_RIGHT_TAG ? opt->num_frames : RESYNC_RIGHT_TAG;
+    st.input = malloc(st.num_frames * 2 * sizeof(int32_t));
+    for (size_t i = 0; i < st.num_frames; i++)
+    {
+        st.input[i * 2] = (int32_t)i;
+        st.input[i * 2 + 1] = (int32_t)i | RESYNC_RIGHT_TAG;
+    }
+    stream_encode(&st, &bc, 0, 0);
+    size_t num_chunks = (st.num_symbols + BENCH_CHUNK_SYMBOLS - 1) / BENCH_CHUNK_SYMBOLS;
+    double *chunk_end_us = malloc(num_chunks * sizeof(double));
+    uint64_t ticks = 0;
+    for (size_t k = 0; k < st.num_symbols; k++)
+    {
+        ticks += st.symbols[k].duration0 + st.symbols[k].duration1;
+        if (k % BENCH_CHUNK_SYMBOLS == BENCH_CHUNK_SYMBOLS - 1 || k == st.num_symbols - 1)
+        {
+            chunk_end_us[k / BENCH_CHUNK_SYMBOLS] = (double)ticks * 1e6 / bc.resolution_hz;
+        }
+    }
+    double stream_ms = (double)ticks * 1e3 / bc.resolution_hz;
+    size_t stalls = stream_ms > OVERFLOW_FIRST_STALL_MS
+                        ? (size_t)((stream_ms - OVERFLOW_FIRST_STALL_MS) / OVERFLOW_STALL_PERIOD_MS) + 1 : 0;
+    latency_plan_t plan = {.rx_symbols = BENCH_CHUNK_SYMBOLS, .ring_symbols = OVERFLOW_RING_CHUNKS * BENCH_CHUNK_SYMBOLS};
+    double hold_ms = symbol_hold_us(&plan, 0, bc.sample_rate) / 1000.0;
+    double ring_ms = OVERFLOW_PCM_FRAMES * 1000.0 / bc.sample_rate;
+    // The reader drains a full ring at one extra frame per frame; input
+    // held up in the symbol ring comes out behind it
+    double recovery_limit_ms = ring_ms + hold_ms + 2;
+    sim.out = malloc(st.num_frames * 2 * sizeof(int32_t));
+    sim.out_us = malloc(st.num_frames * sizeof(double));
+
+    printf("\nOverflow policies, reader stalled %d ms every %d ms (%u Hz, %d-frame PCM ring = %.1f ms, "
+           "%d-symbol ring = %.1f ms)\n", OVERFLOW_STALL_MS, OVERFLOW_STALL_PERIOD_MS, (unsigned)bc.sample_rate,
+           OVERFLOW_PCM_FRAMES, ring_ms, OVERFLOW_RING_CHUNKS * BENCH_CHUNK_SYMBOLS, hold_ms);
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++)
+    {
+        const overflow_case_t *oc = &cases[c];
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S24_32, block, OVERFLOW_BLOCK_FRAMES, overflow_write, &sim);
+        int32_t *out = sim.out;
+        double *out_us = sim.out_us;
+        memset(&sim, 0, sizeof(sim));
+        sim.st = &st;
+        sim.dec = &dec;
+        sim.policy = oc->policy;
+        sim.wait_ms = oc->wait_ms;
+        sim.mark_gaps = oc->mark_gaps;
+        sim.chunk_end_us = chunk_end_us;
+        sim.num_chunks = num_chunks;
+        sim.next_read_us = 1000;
+        sim.out = out;
+        sim.out_us = out_us;
+        overflow_run(&sim);
+
+        // Mispaired frames, and jumps in the count with how long after
+        // the end of the stall before them each came
+        size_t bad = 0, glitches = 0;
+        double recovery_ms = 0;
+        for (size_t i = 0; i < sim.out_count; i++)
+        {
+            int32_t l = sim.out[i * 2] >> 8, r = sim.out[i * 2 + 1] >> 8;
+            if (r != (l | RESYNC_RIGHT_TAG))
+            {
+                bad++;
+                continue;
+            }
+            if (i && l != (sim.out[(i - 1) * 2] >> 8) + 1)
+            {
+                glitches++;
+                double ms = sim.out_us[i] / 1000 - OVERFLOW_FIRST_STALL_MS;
+                double since_stall = ms < 0 ? ms : fmod(ms, OVERFLOW_STALL_PERIOD_MS) - OVERFLOW_STALL_MS;
+                recovery_ms = since_stall > recovery_ms ? since_stall : recovery_ms;
+            }
+        }
+        spdif_stats_t stats;
+        spdif_decoder_get_stats(&dec, &stats);
+        bool accounted = stats.frames_decoded == sim.out_count + stats.frames_dropped + stats.frames_overwritten;
+        size_t lost = st.num_frames - sim.out_count;
+        bool case_ok = !oc->mark_gaps ||
+                       (bad == 0 && accounted && glitches > 0 && recovery_ms <= recovery_limit_ms &&
+                        sim.longest_wait_us <= oc->wait_ms * 1000.0 &&
+                        (oc->policy == SPDIF_OVERFLOW_BLOCK || (stats.symbols_dropped == 0 && glitches <= stalls)));
+        ok &= case_ok;
+        printf("  %-26s | pcm dropped %5u overwritten %5u | symbols dropped %6u, %3u gaps, %3u sync errors | "
+               "wait <= %4.1f ms | %2zu jumps, %4.1f ms lost per stall, %zu bad frames | continuous %4.1f ms "
+               "after a stall %s\n", oc->name, (unsigned)stats.frames_dropped, (unsigned)stats.frames_overwritten,
+               (unsigned)stats.symbols_dropped, (unsigned)stats.symbol_gaps, (unsigned)stats.sync_errors,
+               sim.longest_wait_us / 1000, glitches, stalls ? lost * 1000.0 / bc.sample_rate / stalls : 0, bad,
+               recovery_ms, oc->mark_gaps ? (case_ok ? "ok" : "FAILED") : "");
+    }
+
+    free(sim.out);
+    free(sim.out_us);
+    free(chunk_end_us);
+    stream_free(&st);
+    return ok;
+}
+
+// Oversampled capture, as the I2S backend records it: each stream is
+// generated on a 1 GHz tick clock with edge jitter, sampled at the
+// oversampling rate into 1-bit words, and turned back into symbols by
+// oversample_edges(). The decoder runs with the sampling rate as its
+// resolution. The pipeline timing extracts one DMA buffer at a time into a
+// symbol scratch and feeds the decoder from it, as the backend's decoder
+// task does.
+#define OVERSAMPLE_GEN_HZ 1000000000u
+#define OVERSAMPLE_JITTER_NS 2.0f
+#define OVERSAMPLE_DMA_WORDS 1022
+#define OVERSAMPLE_SCRATCH_SYMBOLS 1024
+
+typedef struct
+{
+    uint32_t sample_rate;
+    uint32_t sample_hz;
+} oversample_case_t;
+
+static const oversample_case_t oversample_cases[] = {
+    {44100, 40000000}, {48000, 40000000}, {96000, 40000000}, {192000, 40000000},
+    {48000, 80000000}, {96000, 80000000}, {192000, 80000000},
+};
+
+typedef size_t (*edges_fn_t)(oversample_t *, const uint32_t *, size_t, rmt_symbol_word_t *, size_t, size_t *);
+
+// Extract words from a fresh start, max_symbols at most per call; returns
+// the symbols, or 0 if they don't fit in capacity
+static size_t oversample_extract(const uint32_t *words, size_t num_words, rmt_symbol_word_t *symbols,
+                                 size_t capacity, size_t max_symbols, edges_fn_t fn)
+{
+    oversample_t os;
+    oversample_init(&os);
+    size_t n = 0;
+    while (num_words)
+    {
+        size_t room = capacity - n < max_symbols ? capacity - n : max_symbols;
+        size_t used;
+        n += fn(&os, words, num_words, symbols + n, room, &used);
+        if (!used)
+        {
+            return 0;
+        }
+        words += used;
+        num_words -= used;
+    }
+    return n;
+}
+
+// Best time in ns to extract the whole stream
+static double oversample_timed(const uint32_t *words, size_t num_words, rmt_symbol_word_t *symbols,
+                               size_t capacity, int iterations, edges_fn_t fn, size_t *num_symbols)
+{
+    double best_ns = 0;
+    for (int it = 0; it < iterations; it++)
+    {
+        double t0 = now_ns();
+        *num_symbols = oversample_extract(words, num_words, symbols, capacity, capacity, fn);
+        double dt = now_ns() - t0;
+        if (it == 0 || dt < best_ns)
+        {
+            best_ns = dt;
+        }
+    }
+    return best_ns;
+}
+
+// The backend's receive loop over the whole stream
+static void oversample_feed(spdif_decoder_t *dec, const uint32_t *words, size_t num_words)
+{
+    static rmt_symbol_word_t scratch[OVERSAMPLE_SCRATCH_SYMBOLS];
+    oversample_t os;
+    oversample_init(&os);
+    for (size_t off = 0; off < num_words; off += OVERSAMPLE_DMA_WORDS)
+    {
+        const uint32_t *w = words + off;
+        size_t left = num_words - off < OVERSAMPLE_DMA_WORDS ? num_words - off : OVERSAMPLE_DMA_WORDS;
+        while (left)
+        {
+            size_t used;
+            size_t n = oversample_edges(&os, w, left, scratch, OVERSAMPLE_SCRATCH_SYMBOLS, &used);
+            if (n)
+            {
+                spdif_decoder_feed(dec, scratch, n);
+            }
+            w += used;
+            left -= used;
+        }
+    }
+    spdif_decoder_flush(dec);
+}
+
+// Noise, an edge at every sample and idle runs past OVERSAMPLE_MAX_RUN,
+// extracted into a scratch barely over a word's worth: both versions must
+// agree symbol for symbol and stop at the same words
+static bool oversample_edge_cases(void)
+{
+    enum { WORDS = 4096, CAPACITY = WORDS * OVERSAMPLE_MAX_SYMBOLS_PER_WORD };
+    uint32_t *words = malloc(WORDS * sizeof(uint32_t));
+    rmt_symbol_word_t *fast = malloc(CAPACITY * sizeof(rmt_symbol_word_t));
+    rmt_symbol_word_t *ref = malloc(CAPACITY * sizeof(rmt_symbol_word_t));
+    uint32_t rng = 0x12345678;
+    for (size_t i = 0; i < WORDS; i++)
+    {
+        rng = rng * 1664525u + 1013904223u;
+        switch (i / 1024)
+        {
+            case 0:
+                words[i] = rng;
+                break;
+            case 1:
+                words[i] = (i & 1) ? 0x55555555u : 0xAAAAAAAAu;
+                break;
+            case 2:
+                words[i] = i < 2048 + 1100 ? 0 : (i < 2048 + 1023 - 2 ? 0xFFFFFFFFu : rng);
+                break;
+            default:
+                words[i] = (rng & 0xF0000000u) ? 0xFFFFFFFFu : rng >> 3;
+                break;
+        }
+    }
+    bool ok = true;
+    size_t limits[] = {OVERSAMPLE_MAX_SYMBOLS_PER_WORD, OVERSAMPLE_MAX_SYMBOLS_PER_WORD + 7, CAPACITY};
+    for (size_t l = 0; l < sizeof(limits) / sizeof(limits[0]); l++)
+    {
+        size_t nf = oversample_extract(words, WORDS, fast, CAPACITY, limits[l], oversample_edges);
+        size_t nr = oversample_extract(words, WORDS, ref, CAPACITY, limits[l], oversample_edges_reference);
+        ok &= nf && nf == nr && !memcmp(fast, ref, nf * sizeof(rmt_symbol_word_t));
+        // Past the clamped first pulse, no pulse is empty or over the clamp
+        for (size_t i = 1; i < nf && ok; i++)
+        {
+            ok &= fast[i].duration0 && fast[i].duration0 <= OVERSAMPLE_MAX_RUN && fast[i].duration1;
+        }
+    }
+    free(words);
+    free(fast);
+    free(ref);
+    return ok;
+}
+
+static bool run_oversample(const bench_options_t *opt)
+{
+    static uint8_t block[BENCH_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    bool ok = true;
+
+    printf("\nOversampled capture (1 GHz generator, %.0f ns jitter, 1-bit samples 32 to a word)\n",
+           OVERSAMPLE_JITTER_NS);
+    for (size_t c = 0; c < sizeof(oversample_cases) / sizeof(oversample_cases[0]); c++)
+    {
+        const oversample_case_t *oc = &oversample_cases[c];
+        bench_case_t bc = {oc->sample_rate, OVERSAMPLE_GEN_HZ, OVERSAMPLE_JITTER_NS};
+        size_t num_frames = opt->num_frames < oc->sample_rate / 4 ? opt->num_frames : oc->sample_rate / 4;
+        // Two frames more than are checked, so the last one checked ends on an edge
+        bench_stream_t st;
+        stream_create(&st, &bc, num_frames + 2);
+        size_t max_words = (size_t)((double)st.num_frames / oc->sample_rate * oc->sample_hz / 32) + 1;
+        // A word of idle line first, so the stream starts on an edge
+        uint32_t *words = malloc((max_words + 1) * sizeof(uint32_t));
+        words[0] = st.symbols[0].level0 ? 0 : 0xFFFFFFFFu;
+        size_t num_words = 1 + spdif_gen_oversample(st.symbols, st.num_symbols, OVERSAMPLE_GEN_HZ, oc->sample_hz,
+                                                    words + 1, max_words);
+        size_t capacity = st.num_symbols + 2 * OVERSAMPLE_MAX_SYMBOLS_PER_WORD;
+        rmt_symbol_word_t *fast = malloc(capacity * sizeof(rmt_symbol_word_t));
+        rmt_symbol_word_t *ref = malloc(capacity * sizeof(rmt_symbol_word_t));
+        size_t nf = 0, nr = 0;
+        double fast_ns = oversample_timed(words, num_words, fast, capacity, opt->iterations, oversample_edges, &nf);
+        double ref_ns = oversample_timed(words, num_words, ref, capacity, 1, oversample_edges_reference, &nr);
+        bool same = nf && nf == nr && !memcmp(fast, ref, nf * sizeof(rmt_symbol_word_t));
+
+        // Decode the extracted pulses at the sampling resolution
+        bench_stream_t os_st = st;
+        os_st.symbols = fast;
+        os_st.num_symbols = nf;
+        os_st.bc.resolution_hz = oc->sample_hz;
+        pcm_capture_t cap;
+        capture_init(&cap, num_frames, SPDIF_PCM_FORMAT_S16);
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, SPDIF_PCM_FORMAT_S16, block, BENCH_BLOCK_FRAMES, capture_flush, &cap);
+        spdif_decoder_set_resolution(&dec, oc->sample_hz);
+        size_t lock_symbols = nf ? stream_lock(&os_st, &dec) : 0;
+        double decode_ns = lock_symbols ? stream_decode(&os_st, &dec, &cap, opt->iterations) : 0;
+        size_t compared = 0;
+        size_t errors = lock_symbols ? verify_pcm(SPDIF_PCM_FORMAT_S16, st.input, num_frames, &cap, &compared)
+                                     : num_frames;
+        spdif_stats_t stats;
+        spdif_decoder_get_stats(&dec, &stats);
+        spdif_clock_t clock;
+        bool clock_ok = lock_symbols && spdif_decoder_get_clock(&dec, &clock) &&
+                        clock.nominal_rate == oc->sample_rate && fabs(clock.ppm) < 100;
+        // The lead-in comes out as two unknown pulses: the one in progress
+        // at the start, clamped, and the idle word
+        bool decoded = lock_symbols && !errors && stats.unknown_pulses <= 2 && !stats.parity_errors &&
+                       timing_sample_rate(&timing, oc->sample_hz) == oc->sample_rate && clock_ok;
+
+        // Extraction and decoding together, DMA buffer by DMA buffer
+        double pipeline_ns = 0;
+        if (decoded)
+        {
+            for (int it = 0; it < opt->iterations; it++)
+            {
+                spdif_decoder_reset(&dec);
+                double t0 = now_ns();
+                oversample_feed(&dec, words, num_words);
+                double dt = now_ns() - t0;
+                pipeline_ns = (it == 0 || dt < pipeline_ns) ? dt : pipeline_ns;
+            }
+        }
+
+        // Three samples to the shortest pulse is what the decoder needs, as
+        // with RMT ticks
+        double samples_per_ui = (double)oc->sample_hz / (oc->sample_rate * 128.0);
+        bool case_ok = same && (samples_per_ui < 3.0 || decoded);
+        ok &= case_ok;
+        double audio_s = (double)num_frames / oc->sample_rate;
+        printf("%6u Hz @ %2u MHz | %4.2f samples/UI | kernel %5.2f ns/word, %5.1f ms/s of input, reference "
+               "%6.2f ns/word (%4.1fx) %s | decode %5.1f ms/s, kernel + decode %5.1f ms/s | clock %+6.1f ppm | "
+               "%zu/%zu frames %s\n",
+               (unsigned)oc->sample_rate, (unsigned)(oc->sample_hz / 1000000), samples_per_ui,
+               fast_ns / num_words, fast_ns / audio_s * 1e-6, ref_ns / num_words, ref_ns / fast_ns,
+               same ? "same" : "DIFFERENT", decode_ns / audio_s * 1e-6, pipeline_ns / audio_s * 1e-6,
+               clock_ok ? clock.ppm : 0, num_frames - errors, num_frames,
+               decoded ? "bit-exact" : samples_per_ui < 3.0 ? "(too coarse)" : "FAILED");
+        free(cap.data);
+        free(fast);
+        free(ref);
+        free(words);
+        stream_free(&st);
+        spdif_decoder_deinit(&dec);
+    }
+
+    bool edges_ok = oversample_edge_cases();
+    ok &= edges_ok;
+    printf("  noise, an edge per sample, idle past the clamp, stopping on a full scratch: kernel and reference "
+           "%s\n", edges_ok ? "agree" : "DIFFER");
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t opt = {
+        .num_frames = 48000 * 4,
+        .iterations = 10,
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--quick"))
+        {
+            opt.num_frames = 48000 / 2;
+            opt.iterations = 2;
+        }
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc)
+        {
+            opt.num_frames = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+        {
+            opt.iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--write-capture") && i + 1 < argc)
+        {
+            opt.capture_path = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [--quick] [--frames N] [--iterations N] [--write-capture PATH]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (opt.capture_path)
+    {
+        return write_capture_file(opt.capture_path, &opt) ? 0 : 1;
+    }
+
+    bool ok = true;
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); i++)
+    {
+        ok &= run_case(&bench_cases[i], SPDIF_PCM_FORMAT_S16, &opt);
+    }
+
+    printf("\nOther sample rates\n");
+    for (size_t i = 0; i < sizeof(rate_cases) / sizeof(rate_cases[0]); i++)
+    {
+        ok &= run_case(&rate_cases[i], SPDIF_PCM_FORMAT_S16, &opt);
+    }
+
+    printf("\nPCM output formats\n");
+    for (int f = 0; f < SPDIF_PCM_FORMAT_COUNT; f++)
+    {
+        ok &= run_case(&bench_cases[3], (spdif_pcm_format_t)f, &opt);
+    }
+    ok &= run_reference_compare(&opt);
+    ok &= run_parity_check(&opt);
+    ok &= run_professional_status(&opt);
+    run_block_sweep(&opt);
+    ok &= run_sinks(&opt);
+    ok &= run_instances(&opt);
+    ok &= run_clock();
+    ok &= run_asrc(&opt);
+    ok &= run_relock(&opt);
+    ok &= run_resync(&opt);
+    ok &= run_lock(&opt);
+    ok &= run_lock_state(&opt);
+    ok &= run_memory(&opt);
+    ok &= run_iec61937(&opt);
+    ok &= run_latency(&opt);
+    run_tracker_overhead(&opt);
+    run_isr_handoff();
+    ok &= run_profile(&opt);
+    ok &= run_capture(&opt);
+    ok &= run_post(&opt);
+    ok &= run_adat(&opt);
+    ok &= run_overflow(&opt);
+    ok &= run_oversample(&opt);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,293 @@
+#include "spdif_gen.h"
+#include "spdif_iec61937.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Preamble pulse widths in UI
+static const uint8_t preamble_b[4] = {3, 1, 1, 3};
+static const uint8_t preamble_m[4] = {3, 3, 1, 1};
+static const uint8_t preamble_w[4] = {3, 2, 1, 2};
+
+static uint32_t gen_rand(uint32_t *state)
+{
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+static float gen_jitter(spdif_gen_t *gen)
+{
+    if (gen->cfg.jitter_ticks <= 0.0f)
+    {
+        return 0.0f;
+    }
+    float u = (float)(gen_rand(&gen->rng) >> 8) / (float)(1 << 24);
+    return (u * 2.0f - 1.0f) * gen->cfg.jitter_ticks;
+}
+
+static size_t emit_pulse(spdif_gen_t *gen, uint32_t ui, rmt_symbol_word_t *out)
+{
+    gen->edge_ui += ui;
+    int64_t edge = llround((double)gen->edge_ui * gen->ticks_per_ui + gen_jitter(gen));
+    uint32_t duration = (uint32_t)(edge - gen->last_edge_tick);
+    gen->last_edge_tick = edge;
+
+    uint32_t level = gen->level;
+    gen->level ^= 1;
+
+    if (!gen->has_pending)
+    {
+        gen->pending.val = 0;
+        gen->pending.duration0 = duration;
+        gen->pending.level0 = level;
+        gen->has_pending = true;
+        return 0;
+    }
+    gen->pending.duration1 = duration;
+    gen->pending.level1 = level;
+    gen->has_pending = false;
+    *out = gen->pending;
+    return 1;
+}
+
+static size_t emit_subframe(spdif_gen_t *gen, const uint8_t *preamble, int32_t sample, rmt_symbol_word_t *out)
+{
+    uint32_t frame = gen->frame_index;
+    uint32_t c = (gen->cfg.channel_status[frame >> 3] >> (frame & 7)) & 1;
+    uint32_t u = (gen->cfg.user_data[frame >> 3] >> (frame & 7)) & 1;
+    size_t n = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        n += emit_pulse(gen, preamble[i], out + n);
+    }
+
+    // Time slots 4-27 audio (LSB first), 28 V, 29 U, 30 C, 31 P
+    uint32_t data = ((uint32_t)sample & 0xFFFFFF) | (u << 25) | (c << 26);
+    uint32_t parity = __builtin_popcount(data) & 1;
+    gen->subframe_count++;
+    if (gen->cfg.parity_error_interval && gen->subframe_count % gen->cfg.parity_error_interval == 0)
+    {
+        parity ^= 1;
+    }
+    data |= parity << 27;
+
+    for (int bit = 0; bit < 28; bit++)
+    {
+        if (data & (1UL << bit))
+        {
+            n += emit_pulse(gen, 1, out + n);
+            n += emit_pulse(gen, 1, out + n);
+        }
+        else
+        {
+            n += emit_pulse(gen, 2, out + n);
+        }
+    }
+    return n;
+}
+
+void spdif_gen_init(spdif_gen_t *gen, const spdif_gen_config_t *cfg)
+{
+    memset(gen, 0, sizeof(*gen));
+    gen->cfg = *cfg;
+    gen->ticks_per_ui = (double)cfg->resolution_hz / ((double)cfg->sample_rate * (1 + cfg->rate_ppm * 1e-6) * 128.0);
+    gen->rng = cfg->seed ? cfg->seed : 1;
+}
+
+size_t spdif_gen_encode(spdif_gen_t *gen, const int32_t *frames, size_t num_frames, rmt_symbol_word_t *out)
+{
+    size_t n = 0;
+    for (size_t f = 0; f < num_frames; f++)
+    {
+        const uint8_t *left_preamble = (gen->frame_index == 0) ? preamble_b : preamble_m;
+        n += emit_subframe(gen, left_preamble, frames[f * 2], out + n);
+        n += emit_subframe(gen, preamble_w, frames[f * 2 + 1], out + n);
+        if (++gen->frame_index == 192)
+        {
+            gen->frame_index = 0;
+        }
+    }
+    return n;
+}
+
+void spdif_gen_adat_init(spdif_gen_t *gen, const spdif_gen_config_t *cfg)
+{
+    spdif_gen_init(gen, cfg);
+    gen->ticks_per_ui = (double)cfg->resolution_hz / ((double)cfg->sample_rate * (1 + cfg->rate_ppm * 1e-6) * 256.0);
+}
+
+// NRZI: a one is an edge, so a pulse lasts from one one to the next
+static size_t adat_emit_bits(spdif_gen_t *gen, uint32_t bits, int count, uint32_t *run, rmt_symbol_word_t *out)
+{
+    size_t n = 0;
+    for (int i = count - 1; i >= 0; i--)
+    {
+        (*run)++;
+        if ((bits >> i) & 1)
+        {
+            n += emit_pulse(gen, *run, out + n);
+            *run = 0;
+        }
+    }
+    return n;
+}
+
+size_t spdif_gen_adat_encode(spdif_gen_t *gen, const int32_t *frames, size_t num_frames, rmt_symbol_word_t *out)
+{
+    size_t n = 0;
+    for (size_t f = 0; f < num_frames; f++)
+    {
+        // Ten zeros and a one, the user nibble, then each channel MSB first;
+        // every nibble is followed by a one
+        uint32_t run = 0;
+        n += adat_emit_bits(gen, 0x001, 11, &run, out + n);
+        n += adat_emit_bits(gen, 0x01, 5, &run, out + n);
+        for (int ch = 0; ch < 8; ch++)
+        {
+            uint32_t sample = (uint32_t)frames[f * 8 + ch] & 0xFFFFFF;
+            for (int nibble = 5; nibble >= 0; nibble--)
+            {
+                n += adat_emit_bits(gen, (((sample >> (nibble * 4)) & 0xF) << 1) | 1, 5, &run, out + n);
+            }
+        }
+    }
+    return n;
+}
+
+size_t spdif_gen_finish(spdif_gen_t *gen, rmt_symbol_word_t *out)
+{
+    if (!gen->has_pending)
+    {
+        return 0;
+    }
+    gen->pending.duration1 = 0;
+    gen->pending.level1 = gen->level;
+    gen->has_pending = false;
+    *out = gen->pending;
+    return 1;
+}
+
+size_t spdif_gen_oversample(const rmt_symbol_word_t *symbols, size_t num_symbols, uint32_t resolution_hz,
+                            uint32_t sample_hz, uint32_t *words, size_t max_words)
+{
+    uint64_t end_ticks = 0;
+    uint64_t sample = 0;
+    uint32_t word = 0;
+    size_t num_words = 0;
+    for (size_t i = 0; i < num_symbols * 2; i++)
+    {
+        const rmt_symbol_word_t *sym = &symbols[i / 2];
+        uint32_t level = (i & 1) ? sym->level1 : sym->level0;
+        end_ticks += (i & 1) ? sym->duration1 : sym->duration0;
+        // Sample k is taken at k / sample_hz seconds
+        while (sample * resolution_hz < end_ticks * sample_hz)
+        {
+            word = word << 1 | level;
+            if (++sample % 32 == 0)
+            {
+                if (num_words == max_words)
+                {
+                    return num_words;
+                }
+                words[num_words++] = word;
+            }
+        }
+    }
+    return num_words;
+}
+
+void spdif_gen_channel_status(uint8_t status[24], uint32_t sample_rate)
+{
+    static const struct
+    {
+        uint32_t rate;
+        uint8_t code;
+    } rate_codes[] = {
+        {44100, 0x0}, {48000, 0x2}, {32000, 0x3}, {22050, 0x4}, {24000, 0x6},
+        {88200, 0x8}, {96000, 0xA}, {176400, 0xC}, {192000, 0xE},
+    };
+
+    memset(status, 0, 24);
+    status[0] = 0x04;    // Consumer, PCM, copy permitted, no pre-emphasis
+    status[1] = 0x82;    // CD category, original
+    status[3] = 0x1;     // Sample rate not indicated unless listed below
+    for (size_t i = 0; i < sizeof(rate_codes) / sizeof(rate_codes[0]); i++)
+    {
+        if (rate_codes[i].rate == sample_rate)
+        {
+            status[3] = rate_codes[i].code;
+        }
+    }
+    status[4] = 0x0B;    // 24-bit words
+}
+
+void spdif_gen_professional_status(uint8_t status[24], uint32_t sample_rate)
+{
+    memset(status, 0, 24);
+    status[0] = 0x01;    // Professional, PCM, emphasis not indicated
+    if (sample_rate == 44100)
+    {
+        status[0] |= 1 << 6;
+    }
+    else if (sample_rate == 48000)
+    {
+        status[0] |= 2 << 6;
+    }
+    else if (sample_rate == 32000)
+    {
+        status[0] |= 3 << 6;
+    }
+}
+
+void spdif_gen_test_signal(int32_t *frames, size_t num_frames, uint32_t sample_rate, uint32_t seed)
+{
+    uint32_t rng = seed ? seed : 1;
+    const double amplitude = 0.5 * 8388607.0;
+    for (size_t f = 0; f < num_frames; f++)
+    {
+        double t = (double)f / sample_rate;
+        int32_t noise_l = (int32_t)(gen_rand(&rng) & 0x1FF) - 256;
+        int32_t noise_r = (int32_t)(gen_rand(&rng) & 0x1FF) - 256;
+        frames[f * 2] = (int32_t)(amplitude * sin(2.0 * M_PI * 997.0 * t)) + noise_l;
+        frames[f * 2 + 1] = (int32_t)(amplitude * sin(2.0 * M_PI * 1499.0 * t)) + noise_r;
+    }
+}
+
+void spdif_gen_tone(int32_t *frames, size_t num_frames, uint32_t sample_rate, double freq, double amplitude)
+{
+    for (size_t f = 0; f < num_frames; f++)
+    {
+        int32_t v = (int32_t)lrint(amplitude * 8388607.0 * sin(2.0 * M_PI * freq * f / sample_rate));
+        frames[f * 2] = v;
+        frames[f * 2 + 1] = v;
+    }
+}
+
+size_t spdif_gen_burst(int32_t *frames, uint8_t data_type, const uint8_t *payload, size_t payload_bytes)
+{
+    // Pd counts bytes for E-AC-3, DTS-HD and MAT, bits otherwise
+    bool bytes = data_type == IEC61937_EAC3 || data_type == IEC61937_DTSHD || data_type == IEC61937_MAT;
+    size_t words = 4 + (payload_bytes + 1) / 2;
+    size_t num_frames = (words + 1) / 2;
+    uint16_t *w = malloc(num_frames * 2 * sizeof(uint16_t));
+    memset(w, 0, num_frames * 2 * sizeof(uint16_t));
+    w[0] = IEC61937_PA;
+    w[1] = IEC61937_PB;
+    w[2] = data_type;
+    w[3] = (uint16_t)(bytes ? payload_bytes : payload_bytes * 8);
+    for (size_t i = 0; i < payload_bytes; i++)
+    {
+        w[4 + i / 2] |= (i & 1) ? payload[i] : payload[i] << 8;
+    }
+    for (size_t i = 0; i < num_frames * 2; i++)
+    {
+        frames[i] = (int32_t)(int16_t)w[i] * 256;
+    }
+    free(w);
+    return num_frames;
+}
@@ -0,0 +1,91 @@
+#ifndef SPDIF_GEN_H
+#define SPDIF_GEN_H
+
+// Synthetic S/PDIF stream generator for host benchmarks. Bi-phase-mark
+// encodes 24-bit PCM into RMT symbols the same way the RMT RX peripheral
+// would capture them; an ADAT mode NRZI-encodes 8-channel frames instead.
+
+#include "spdif_port.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Worst case: 4 preamble pulses + 2 pulses per data bit, 2 subframes, 2 pulses per symbol
+#define SPDIF_GEN_MAX_SYMBOLS_PER_FRAME 60
+
+// ADAT worst case: the sync + 5 pulses per nibble group, 49 groups, 2 pulses per symbol
+#define SPDIF_GEN_ADAT_MAX_SYMBOLS_PER_FRAME 124
+
+typedef struct
+{
+    uint32_t sample_rate;   // Frame rate in Hz
+    uint32_t resolution_hz; // RMT tick rate
+    float jitter_ticks;     // Peak edge jitter, uniformly distributed
+    uint32_t seed;          // Jitter PRNG seed
+    uint8_t channel_status[24]; // C bits, sent on both channels
+    uint8_t user_data[24];      // U bits, sent on both channels
+    uint32_t parity_error_interval; // Corrupt the P bit of every Nth subframe (0 = never)
+    double rate_ppm;        // Source clock offset from sample_rate, parts per million
+} spdif_gen_config_t;
+
+typedef struct
+{
+    spdif_gen_config_t cfg;
+    double ticks_per_ui;    // One UI is half a bit cell (ADAT: one bit cell)
+    uint64_t edge_ui;       // Position of the last edge in UI
+    int64_t last_edge_tick;
+    uint32_t level;
+    uint32_t frame_index;   // Position in the 192-frame block
+    uint32_t subframe_count;
+    uint32_t rng;
+    bool has_pending;       // duration0 written, duration1 outstanding
+    rmt_symbol_word_t pending;
+} spdif_gen_t;
+
+void spdif_gen_init(spdif_gen_t *gen, const spdif_gen_config_t *cfg);
+
+// Encode interleaved [L,R] 24-bit frames; returns symbols written to out.
+// out must hold num_frames * SPDIF_GEN_MAX_SYMBOLS_PER_FRAME symbols.
+size_t spdif_gen_encode(spdif_gen_t *gen, const int32_t *frames, size_t num_frames, rmt_symbol_word_t *out);
+
+// ADAT Lightpipe at cfg->sample_rate; channel status, user data and
+// parity errors do not apply
+void spdif_gen_adat_init(spdif_gen_t *gen, const spdif_gen_config_t *cfg);
+
+// Encode interleaved 8-channel 24-bit frames; returns symbols written to out.
+// out must hold num_frames * SPDIF_GEN_ADAT_MAX_SYMBOLS_PER_FRAME symbols.
+size_t spdif_gen_adat_encode(spdif_gen_t *gen, const int32_t *frames, size_t num_frames, rmt_symbol_word_t *out);
+
+// Flush a trailing half symbol, if any; returns symbols written (0 or 1)
+size_t spdif_gen_finish(spdif_gen_t *gen, rmt_symbol_word_t *out);
+
+// Sample the line that symbols at resolution_hz ticks describe sample_hz
+// times a second, as an oversampling capture would: 1-bit samples packed 32
+// to a word, earliest in bit 31. Returns whole words written.
+size_t spdif_gen_oversample(const rmt_symbol_word_t *symbols, size_t num_symbols, uint32_t resolution_hz,
+                            uint32_t sample_hz, uint32_t *words, size_t max_words);
+
+// Consumer channel status for 24-bit PCM at the given rate
+void spdif_gen_channel_status(uint8_t status[24], uint32_t sample_rate);
+
+// AES3 professional channel status at 32, 44.1 or 48 kHz; other rates are
+// sent as not indicated
+void spdif_gen_professional_status(uint8_t status[24], uint32_t sample_rate);
+
+// Two tones plus low-level noise so every sample bit toggles
+void spdif_gen_test_signal(int32_t *frames, size_t num_frames, uint32_t sample_rate, uint32_t seed);
+
+// Pure tone on both channels, amplitude relative to full scale, rounded to 24 bits
+void spdif_gen_tone(int32_t *frames, size_t num_frames, uint32_t sample_rate, double freq, double amplitude);
+
+// One IEC 61937 data burst at frames: Pa/Pb, Pc (data_type), Pd and the
+// payload, 16-bit words high byte first in the top of the 24-bit samples.
+// Returns the frames written; stuffing up to the next burst is left to the caller.
+size_t spdif_gen_burst(int32_t *frames, uint8_t data_type, const uint8_t *payload, size_t payload_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_GEN_H
@@ -0,0 +1,337 @@
+// Replays a raw RMT symbol capture (capture.h, written by a receiver with a
+// capture sink) through the decoder core at full speed: the same chunks, in
+// the same sizes, with their arrival times. Reports timing discovery, lock
+// changes, channel status, the recovered clock and error counts, optionally
+// writes the decoded audio to a WAV file, and times the decode.
+
+#include "spdif_decoder.h"
+#include "spdif_wav.h"
+#include "capture.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPLAY_BLOCK_FRAMES 256
+
+typedef struct
+{
+    rmt_symbol_word_t *symbols;
+    size_t num_symbols;
+    capture_chunk_t *chunks;
+    size_t num_chunks;
+    uint32_t resolution_hz;
+    uint32_t version;
+    uint64_t dropped;
+    size_t bytes;
+} replay_capture_t;
+
+typedef struct
+{
+    spdif_decoder_t *dec;
+    size_t position;          // Symbols fed by the end of the current chunk
+    uint32_t changes;
+} replay_lock_log_t;
+
+static const char *format_names[SPDIF_PCM_FORMAT_COUNT] = {"s16", "s24_32", "s24_packed", "f32"};
+static const char *lock_state_names[SPDIF_LOCK_STATE_COUNT] = {"no signal", "acquiring", "locked", "lost"};
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Read the whole file and decode every record up front, so the timed runs
+// only decode S/PDIF
+static bool load_capture(const char *path, replay_capture_t *cap)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+    {
+        perror(path);
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc(size) : NULL;
+    bool read_ok = data && fread(data, 1, size, f) == (size_t)size;
+    fclose(f);
+    if (!read_ok)
+    {
+        fprintf(stderr, "%s: read failed\n", path);
+        free(data);
+        return false;
+    }
+
+    // Every symbol takes at least two bytes, every record at least a header
+    memset(cap, 0, sizeof(*cap));
+    cap->bytes = size;
+    cap->symbols = malloc((size / 2 + 1) * sizeof(rmt_symbol_word_t));
+    cap->chunks = malloc((size / CAPTURE_RECORD_BYTES + 1) * sizeof(capture_chunk_t));
+    capture_reader_t reader;
+    bool ok = cap->symbols && cap->chunks && capture_reader_open(&reader, data, size);
+    if (ok)
+    {
+        cap->resolution_hz = reader.resolution_hz;
+        cap->version = reader.version;
+        capture_chunk_t *chunk = cap->chunks;
+        while (capture_reader_next(&reader, chunk, cap->symbols + cap->num_symbols, size / 2 + 1 - cap->num_symbols))
+        {
+            cap->num_symbols += chunk->num_symbols;
+            cap->dropped += chunk->dropped;
+            chunk = &cap->chunks[++cap->num_chunks];
+        }
+        ok = !reader.error;
+    }
+    if (!ok)
+    {
+        fprintf(stderr, "%s: not a valid capture (%zu chunks read)\n", path, cap->num_chunks);
+    }
+    free(data);
+    return ok;
+}
+
+static void discard_frames(void *ctx, const void *frames, size_t num_frames)
+{
+    (void)ctx;
+    (void)frames;
+    (void)num_frames;
+}
+
+static void log_lock(void *ctx, spdif_lock_state_t state)
+{
+    replay_lock_log_t *log = (replay_lock_log_t *)ctx;
+    log->changes++;
+    printf("  lock: %-9s by symbol %zu, frame %llu\n", lock_state_names[state], log->position,
+           (unsigned long long)(log->dec->frames_out + log->dec->block_fill));
+}
+
+// Feed the chunks as the receiver did, anchoring the stream position at
+// each known arrival time and restarting the bitstream after dropped symbols
+static void replay(spdif_decoder_t *dec, const replay_capture_t *cap, replay_lock_log_t *log,
+                   size_t *lock_symbol)
+{
+    const rmt_symbol_word_t *symbols = cap->symbols;
+    for (size_t i = 0; i < cap->num_chunks; i++)
+    {
+        const capture_chunk_t *chunk = &cap->chunks[i];
+        if (log)
+        {
+            log->position = symbols - cap->symbols + chunk->num_symbols;
+        }
+        bool was_locked = dec->timing->timing_discovered;
+        if (chunk->dropped)
+        {
+            spdif_decoder_gap(dec);
+        }
+        spdif_decoder_feed(dec, symbols, chunk->num_symbols);
+        symbols += chunk->num_symbols;
+        if (lock_symbol && !was_locked && dec->timing->timing_discovered && !*lock_symbol)
+        {
+            *lock_symbol = symbols - cap->symbols;
+        }
+        if (chunk->time_us)
+        {
+            spdif_decoder_set_time(dec, chunk->time_us);
+        }
+    }
+    spdif_decoder_flush(dec);
+}
+
+static void print_report(const spdif_decoder_t *dec, const replay_capture_t *cap, size_t lock_symbol)
+{
+    const spdif_timing_t *timing = dec->timing;
+    if (lock_symbol)
+    {
+        printf("  timing: locked after %zu symbols, pulses %u/%u/%u ticks (centres %.2f/%.2f/%.2f), %u Hz\n",
+               lock_symbol, (unsigned)timing->short_pulse_ticks, (unsigned)timing->medium_pulse_ticks,
+               (unsigned)timing->long_pulse_ticks, timing->short_pulse_x16 / 16.0, timing->medium_pulse_x16 / 16.0,
+               timing->long_pulse_x16 / 16.0, (unsigned)timing_sample_rate(timing, cap->resolution_hz));
+    }
+    else
+    {
+        printf("  timing: never discovered\n");
+    }
+
+    spdif_channel_status_t status;
+    if (spdif_decoder_get_channel_status(dec, &status))
+    {
+        printf("  channel status: %s, %s, %u Hz indicated, %u-bit, category 0x%02x\n",
+               status.professional ? "professional" : "consumer", status.non_audio ? "data" : "audio",
+               (unsigned)status.sample_rate, (unsigned)status.word_length, (unsigned)status.category_code);
+    }
+
+    spdif_clock_t clock;
+    if (spdif_decoder_get_clock(dec, &clock))
+    {
+        printf("  clock: %.3f Hz%s\n", clock.sample_rate, clock.locked ? ", locked" : ", settling");
+    }
+
+    spdif_stats_t stats;
+    spdif_decoder_get_stats(dec, &stats);
+    printf("  frames %lu, concealed %lu | unknown pulses %lu, preambles %lu, parity %lu, sync %lu, block %lu, "
+           "invalid %lu, gaps %lu | relocks %lu, bursts %lu\n",
+           (unsigned long)stats.frames_decoded, (unsigned long)stats.frames_concealed,
+           (unsigned long)stats.unknown_pulses, (unsigned long)stats.invalid_preambles,
+           (unsigned long)stats.parity_errors, (unsigned long)stats.sync_errors, (unsigned long)stats.block_errors,
+           (unsigned long)stats.invalid_subframes, (unsigned long)stats.symbol_gaps, (unsigned long)stats.relocks,
+           (unsigned long)stats.data_bursts);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = NULL;
+    const char *wav_path = NULL;
+    spdif_pcm_format_t format = SPDIF_PCM_FORMAT_S16;
+    int iterations = 5;
+    uint32_t expect_rate = 0;
+    long max_errors = -1;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--wav") && i + 1 < argc)
+        {
+            wav_path = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--format") && i + 1 < argc)
+        {
+            i++;
+            for (format = 0; format < SPDIF_PCM_FORMAT_COUNT && strcmp(argv[i], format_names[format]); format++)
+            {
+            }
+            if (format == SPDIF_PCM_FORMAT_COUNT)
+            {
+                fprintf(stderr, "unknown format %s\n", argv[i]);
+                return 2;
+            }
+        }
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+        {
+            iterations = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--expect-rate") && i + 1 < argc)
+        {
+            expect_rate = strtoul(argv[++i], NULL, 0);
+        }
+        else if (!strcmp(argv[i], "--max-errors") && i + 1 < argc)
+        {
+            max_errors = strtol(argv[++i], NULL, 0);
+        }
+        else if (argv[i][0] != '-' && !path)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+    if (!path)
+    {
+        fprintf(stderr,
+                "usage: %s [--wav out.wav] [--format s16|s24_32|s24_packed|f32] [--iterations N]\n"
+                "       [--expect-rate HZ] [--max-errors N] capture.spdc\n",
+                argv[0]);
+        return 2;
+    }
+
+    replay_capture_t cap;
+    if (!load_capture(path, &cap))
+    {
+        return 1;
+    }
+    double span_s = 0;
+    for (size_t i = 0, first = SIZE_MAX; i < cap.num_chunks; i++)
+    {
+        if (cap.chunks[i].time_us && first == SIZE_MAX)
+        {
+            first = i;
+        }
+        if (cap.chunks[i].time_us && first != SIZE_MAX)
+        {
+            span_s = (cap.chunks[i].time_us - cap.chunks[first].time_us) / 1e6;
+        }
+    }
+    printf("%s: version %u, %u Hz ticks, %zu chunks, %zu symbols (%.2f bytes each), %.3f s stamped, "
+           "%llu dropped on capture\n",
+           path, (unsigned)cap.version, (unsigned)cap.resolution_hz, cap.num_chunks, cap.num_symbols,
+           cap.num_symbols ? (double)cap.bytes / cap.num_symbols : 0, span_s, (unsigned long long)cap.dropped);
+
+    static uint8_t block[REPLAY_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+    static spdif_timing_t timing;
+    static spdif_decoder_t dec;
+    spdif_decoder_init(&dec, &timing, format, block, REPLAY_BLOCK_FRAMES, discard_frames, NULL);
+    spdif_decoder_set_resolution(&dec, cap.resolution_hz);
+    replay_lock_log_t log = {.dec = &dec};
+    spdif_decoder_set_lock_cb(&dec, log_lock, &log);
+
+    spdif_wav_sink_t wav;
+    if (wav_path)
+    {
+        if (!spdif_wav_sink_open(&wav, wav_path, format, 0))
+        {
+            perror(wav_path);
+            return 1;
+        }
+        spdif_pcm_sink_t sink = spdif_wav_sink(&wav);
+        spdif_decoder_set_sink(&dec, &sink);
+    }
+
+    size_t lock_symbol = 0;
+    replay(&dec, &cap, &log, &lock_symbol);
+    print_report(&dec, &cap, lock_symbol);
+    uint32_t rate = lock_symbol ? timing_sample_rate(&timing, cap.resolution_hz) : 0;
+
+    spdif_stats_t stats;
+    spdif_decoder_get_stats(&dec, &stats);
+    bool ok = true;
+    if (wav_path)
+    {
+        wav.sample_rate = rate;
+        if (!spdif_wav_sink_close(&wav))
+        {
+            fprintf(stderr, "%s: write failed\n", wav_path);
+            ok = false;
+        }
+    }
+
+    // Full speed: each run starts from a fresh decoder, discovery included
+    double best_ns = 0;
+    for (int it = 0; it < iterations; it++)
+    {
+        memset(&timing, 0, sizeof(timing));
+        spdif_decoder_init(&dec, &timing, format, block, REPLAY_BLOCK_FRAMES, discard_frames, NULL);
+    spdif_decoder_set_resolution(&dec, cap.resolution_hz);
+        double t0 = now_ns();
+        replay(&dec, &cap, NULL, NULL);
+        double dt = now_ns() - t0;
+        best_ns = it == 0 || dt < best_ns ? dt : best_ns;
+    }
+    if (iterations > 0 && best_ns > 0)
+    {
+        double audio_s = rate ? (double)stats.frames_decoded / rate : 0;
+        printf("  replay: %.1f Msym/s, %.1f ns/frame, %.0fx real time (best of %d)\n",
+               cap.num_symbols * 1e3 / best_ns, stats.frames_decoded ? best_ns / stats.frames_decoded : 0,
+               audio_s * 1e9 / best_ns, iterations);
+    }
+
+    uint32_t errors = stats.unknown_pulses + stats.invalid_preambles + stats.parity_errors + stats.sync_errors +
+                      stats.block_errors;
+    if (expect_rate && rate != expect_rate)
+    {
+        printf("  FAILED: decoded rate %u Hz, expected %u Hz\n", (unsigned)rate, (unsigned)expect_rate);
+        ok = false;
+    }
+    if (max_errors >= 0 && errors > (unsigned long)max_errors)
+    {
+        printf("  FAILED: %lu errors, at most %ld expected\n", (unsigned long)errors, max_errors);
+        ok = false;
+    }
+    free(cap.symbols);
+    free(cap.chunks);
+    return ok ? 0 : 1;
+}
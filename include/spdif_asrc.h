@@ -0,0 +1,89 @@
+#ifndef SPDIF_ASRC_H
+#define SPDIF_ASRC_H
+
+// Asynchronous sample-rate converter: a PCM sink that resamples the decoded
+// stream to a fixed output rate and hands it to another sink. Fixed-point
+// polyphase FIR with linear interpolation between phases; the ratio follows
+// the measured input rate (and the output clock, if it is measured too).
+// Platform independent.
+
+#include "spdif_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Cost/quality trade-off: filter length, phase count and stopband
+typedef enum
+{
+    SPDIF_ASRC_QUALITY_LOW = 0, // 16 taps, ~4 KB table
+    SPDIF_ASRC_QUALITY_MEDIUM,  // 32 taps, ~16 KB table
+    SPDIF_ASRC_QUALITY_HIGH,    // 64 taps, ~64 KB table
+    SPDIF_ASRC_QUALITY_COUNT,
+} spdif_asrc_quality_t;
+
+// Highest input rate over output rate; 192 kHz into 32 kHz
+#define SPDIF_ASRC_MAX_RATIO 6
+
+typedef struct
+{
+    spdif_pcm_format_t format;   // Same on input and output
+    spdif_asrc_quality_t quality;
+    uint32_t output_rate;        // Nominal output rate in Hz
+    double output_clock;         // Measured output rate in Hz
+    double input_clock;          // Measured input rate in Hz, 0 = not known yet
+    uint32_t input_rate;         // Nominal rate the filter is designed for, 0 = none
+    spdif_pcm_sink_t out;
+
+    // Filter: (phases + 1) rows of taps coefficients, Q30, each row summing to 1
+    int32_t *coefs;
+    uint32_t taps;
+    uint32_t phases;
+
+    // Input history, [L,R] 24-bit samples; pos is the input position of the
+    // next output frame in 32.32 fixed point, relative to history[0]
+    int32_t *history;
+    uint32_t history_frames;
+    uint32_t fill;
+    uint64_t pos;
+    uint64_t step;               // Input frames per output frame, 32.32
+
+    // Output block: own buffer, or one from the output sink
+    uint8_t *own_block;
+    uint8_t *block;
+    size_t block_frames;
+    size_t block_fill;
+
+    uint32_t frames_dropped;     // Input frames received before the input rate was known
+} spdif_asrc_t;
+
+// Allocate the filter table and buffers; frames are written to out
+bool spdif_asrc_init(spdif_asrc_t *asrc, spdif_pcm_format_t format, uint32_t output_rate,
+                     spdif_asrc_quality_t quality, const spdif_pcm_sink_t *out);
+void spdif_asrc_deinit(spdif_asrc_t *asrc);
+
+// Sink to hand to the decoder; writes are converted and passed on at once
+spdif_pcm_sink_t spdif_asrc_sink(spdif_asrc_t *asrc);
+
+// Set the measured input rate. A different nominal rate redesigns the filter
+// and restarts the converter; otherwise only the ratio changes. Returns false
+// for rates outside 22.05-192 kHz or above SPDIF_ASRC_MAX_RATIO times the output.
+bool spdif_asrc_set_input_rate(spdif_asrc_t *asrc, double rate);
+
+// Set the measured output rate, e.g. a DAC on its own clock; defaults to output_rate
+void spdif_asrc_set_output_rate(spdif_asrc_t *asrc, double rate);
+
+// Drop the history and start over with silence; keeps the filter and ratio
+void spdif_asrc_reset(spdif_asrc_t *asrc);
+
+// Delay through the filter in input frames
+static inline uint32_t spdif_asrc_latency_frames(const spdif_asrc_t *asrc)
+{
+    return asrc->taps / 2;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_ASRC_H
@@ -0,0 +1,80 @@
+#ifndef SPDIF_IEC61937_H
+#define SPDIF_IEC61937_H
+
+// IEC 61937 compressed audio (AC-3, DTS, AAC, ...) over S/PDIF. The payload
+// travels in data bursts of 16-bit words, one per subframe in the top 16 bits
+// of the audio field: Pa/Pb sync words, Pc burst info, Pd length, then the
+// payload. Frames between bursts are stuffing. Platform independent.
+
+#include "spdif_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IEC61937_PA 0xF872 // Left subframe of the first burst frame
+#define IEC61937_PB 0x4E1F // Right subframe
+
+// Pc data types (bits 0-4)
+#define IEC61937_NULL 0
+#define IEC61937_AC3 1
+#define IEC61937_PAUSE 3
+#define IEC61937_MPEG1_L1 4
+#define IEC61937_MPEG1_L23 5
+#define IEC61937_MPEG2_EXT 6
+#define IEC61937_MPEG2_AAC 7
+#define IEC61937_DTS1 11 // 512 frames per burst
+#define IEC61937_DTS2 12 // 1024
+#define IEC61937_DTS3 13 // 2048
+#define IEC61937_DTSHD 17
+#define IEC61937_EAC3 21
+#define IEC61937_MAT 22  // Dolby TrueHD
+
+// Longest burst repetition period (MAT), in frames
+#define IEC61937_MAX_BURST_FRAMES 15360
+
+// One data burst as received: the frames from Pa/Pb on, in the decoder's
+// PCM format, written there by the decoder without a copy
+typedef struct
+{
+    uint8_t data_type;           // Pc bits 0-4
+    uint8_t type_dependent;      // Pc bits 8-12
+    uint8_t bitstream_number;    // Pc bits 13-15
+    bool error;                  // Pc bit 7: payload may contain errors
+    uint32_t length_code;        // Pd as sent: payload length in bits, or bytes for E-AC-3, DTS-HD and MAT
+    uint32_t payload_bytes;
+    uint32_t period;             // Frames since the previous burst's Pa, 0 for the first
+    uint64_t frame;              // Index of the Pa frame, counted like spdif_clock_t frames
+    spdif_pcm_format_t format;
+    const void *frames;
+    size_t num_frames;           // Pa/Pb, Pc/Pd and the payload, rounded up to whole frames
+} spdif_burst_t;
+
+// Passthrough consumer: receives complete bursts on the decoder task.
+// get_buffer returns room for *max_frames frames the decoder writes the next
+// burst into, or NULL to drop it; a buffer returned without a write()
+// following is abandoned. A burst longer than the buffer is dropped.
+typedef struct
+{
+    void *(*get_buffer)(void *ctx, size_t *max_frames);
+    void (*write)(void *ctx, const spdif_burst_t *burst);
+    void *ctx;
+} spdif_burst_sink_t;
+
+// 16-bit word index of a burst in any PCM format: 0 Pa, 1 Pb, 2 Pc, 3 Pd,
+// then the payload
+uint16_t spdif_burst_word(const spdif_burst_t *burst, size_t index);
+
+// Copy the payload as a byte stream (each word high byte first, as AC-3 and
+// DTS decoders expect); returns the bytes copied, at most max_bytes
+size_t spdif_burst_read_payload(const spdif_burst_t *burst, uint8_t *out, size_t max_bytes);
+
+// Fill the burst info from Pc/Pd; returns the burst length in frames, or 0
+// if the length is not plausible for an IEC 61937 burst
+size_t iec61937_parse_header(spdif_burst_t *burst, uint16_t pc, uint16_t pd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_IEC61937_H
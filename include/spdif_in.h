@@ -4,7 +4,12 @@
 #include "sdkconfig.h"
 #include "esp_err.h"
 #include "freertos/ringbuf.h"
+#include "freertos/event_groups.h"
 #include "driver/rmt_rx.h"
+#include "spdif_types.h"
+#include "spdif_asrc.h"
+#include "spdif_post.h"
+#include "spdif_iec61937.h"
 #include <string.h>
 
 // Configuration constants sourced from Kconfig
@@ -12,66 +17,214 @@
 #define RMT_MEM_BLOCK_SYMBOLS CONFIG_SPDIF_IN_RMT_MEM_BLOCK_SYMBOLS
 #define SYMBOL_BUFFER_SIZE CONFIG_SPDIF_IN_SYMBOL_BUFFER_SIZE
 #define SPDIF_PCM_BUFFER_SIZE CONFIG_SPDIF_IN_PCM_BUFFER_SIZE
+#define PCM_BLOCK_FRAMES CONFIG_SPDIF_IN_PCM_BLOCK_FRAMES
+#define PCM_FLUSH_TIMEOUT_MS CONFIG_SPDIF_IN_PCM_FLUSH_TIMEOUT_MS
 #define DECODER_TASK_STACK CONFIG_SPDIF_IN_DECODER_TASK_STACK
 #define DECODER_TASK_PRIORITY CONFIG_SPDIF_IN_DECODER_TASK_PRIORITY
 #define MIN_SAMPLES_FOR_ANALYSIS CONFIG_SPDIF_IN_MIN_SAMPLES_FOR_ANALYSIS
+#define STATS_LOG_INTERVAL_MS CONFIG_SPDIF_IN_STATS_LOG_INTERVAL_MS
+#define ZERO_COPY_RX CONFIG_SPDIF_IN_ZERO_COPY_RX
+#define RX_BUFFER_COUNT CONFIG_SPDIF_IN_RX_BUFFER_COUNT
+#define LATENCY_STATS CONFIG_SPDIF_IN_LATENCY_STATS
+#define SIGNAL_TIMEOUT_MS CONFIG_SPDIF_IN_SIGNAL_TIMEOUT_MS
+#define UNLOCKED_POLL_MS CONFIG_SPDIF_IN_UNLOCKED_POLL_MS
+#define PROFILE_STATS CONFIG_SPDIF_IN_PROFILE
+#define PSRAM_BUFFERS CONFIG_SPDIF_IN_PSRAM_BUFFERS
+#define I2S_CAPTURE CONFIG_SPDIF_IN_I2S_CAPTURE
+#define I2S_SAMPLE_HZ CONFIG_SPDIF_IN_I2S_SAMPLE_HZ
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Receiver instance. Each has its own RMT channel, decoder task, buffers,
+// timing, decoder state and statistics.
+typedef struct spdif_receiver *spdif_receiver_handle_t;
+
+// PCM ring buffer of the default instance, NULL with a custom sink
 extern RingbufHandle_t spdif_in_pcm_buffer;
 
+// Lock event group bit of a state; exactly one is set at a time
+#define SPDIF_LOCK_EVENT_BIT(state) (1u << (state))
+#define SPDIF_LOCK_EVENT_ALL ((1u << SPDIF_LOCK_STATE_COUNT) - 1)
+
 typedef struct
 {
-    bool groups_identified;   // Three pulse groups found
-    bool ratios_valid;        // Ratios match 1:2:3 within tolerance
-    bool distribution_valid;  // Distribution matches expected percentages
-    float ratio_error;        // Error from ideal 1:2:3 ratio
-    float short_pulse_pct;    // Actual short pulse percentage
-    float medium_pulse_pct;   // Actual medium pulse percentage
-    float long_pulse_pct;     // Actual long pulse percentage
-    float distribution_error; // Total distribution error
-} timing_validation_t;
-
-// Peak detection structure for histogram analysis
-typedef struct
-{
-    uint32_t bin;
-    uint32_t count;
-    float center;
-    uint32_t width;
-} peak_t;
+    int input_pin;
+    spdif_pcm_format_t pcm_format; // Format of frames handed to the sink
+    void (*init_done_cb)(void);
+    // Where decoded frames go, called on the decoder task. Leave write NULL
+    // for the built-in PCM ring buffer read through spdif_receiver_read().
+    spdif_pcm_sink_t sink;
+    int core_id;                   // Core the decoder task is pinned to, or tskNO_AFFINITY
+    // Resample to this rate before the sink or ring buffer, following the
+    // recovered input clock; 0 passes the input rate through
+    uint32_t output_rate;
+    spdif_asrc_quality_t asrc_quality;
+    // Keeps the last locked timing across restarts; a matching entry is
+    // checked on the first few hundred pulses instead of running discovery
+    spdif_timing_store_t timing_store;
+    // Consumer for IEC 61937 bursts (AC-3, DTS, ...), called on the decoder
+    // task. While a compressed stream is received the PCM output is silence.
+    spdif_burst_sink_t burst_sink;
+    // Input-to-PCM latency budget in us, e.g. 2000 for live monitoring: the
+    // RMT receive chunk, symbol ring, PCM block and PCM ring are sized down
+    // to fit it at 48 kHz, at the cost of more interrupts and wake-ups, and
+    // a full PCM ring never makes the decoder wait (overflow_wait_ms is
+    // ignored). 0 keeps the Kconfig sizes.
+    uint32_t latency_us;
+    // Fill in frames lost to sync errors (a noisy pulse or a dropped chunk)
+    // by holding or interpolating, up to SPDIF_CONCEAL_MAX_FRAMES at a time
+    spdif_conceal_t conceal;
+    // Called on the decoder task on each lock state change, after the lock
+    // event group has been updated
+    spdif_lock_cb_t lock_cb;
+    void *lock_cb_ctx;
+    // Tee the raw RMT symbols, as fed to the decoder, to this sink for
+    // replay on a host (host/spdif_replay). Runs on the decoder task: a slow
+    // sink shows up as dropped symbols, which the capture records.
+    spdif_capture_sink_t capture;
+    // Highest sample rate the input will carry, e.g. 48000 for a TV or CD
+    // source: the RMT buffer and symbol ring are scaled down from the
+    // Kconfig sizes (taken as sized for 192 kHz) to hold the same time of
+    // input. Higher rates then overrun them. 0 keeps the Kconfig sizes.
+    uint32_t max_sample_rate;
+    // Gain, channel map, dither and level meters applied on the decoder
+    // task as each PCM block is produced, ahead of the sample-rate converter
+    // and sink. The decoder then works in 24 bits and the stage converts to
+    // pcm_format; settings can be changed later with spdif_rx_set_post().
+    spdif_post_config_t post;
+    // Line coding of the input. SPDIF_PROTOCOL_ADAT decodes ADAT Lightpipe
+    // into frames of SPDIF_ADAT_CHANNELS channels in pcm_format, through the
+    // same sink or ring buffer; AUTO tells the two apart at each lock, and
+    // spdif_rx_get_channels() gives the frame size. Neither combines with
+    // output_rate or post.enabled, which are stereo only.
+    spdif_protocol_t protocol;
+    // What a PCM block costs when the ring buffer is full, i.e. the reader
+    // has fallen behind by the whole ring: the block, the oldest frames, or
+    // a wait of up to overflow_wait_ms for room before dropping the block.
+    // Drops are counted in the stats. A wait longer than the symbol ring
+    // holds input for loses symbols as well; the decoder restarts at the
+    // next preamble after them. With SPDIF_OVERFLOW_DROP_OLDEST read through
+    // spdif_rx_read(), which keeps discards off the frames it is reading.
+    spdif_overflow_t overflow;
+    uint32_t overflow_wait_ms;
+    // Peripheral the input is received with. SPDIF_BACKEND_I2S needs
+    // CONFIG_SPDIF_IN_I2S_CAPTURE, otherwise spdif_rx_new() returns
+    // ESP_ERR_NOT_SUPPORTED; it samples the line at I2S_SAMPLE_HZ and
+    // extracts the pulses on the decoder task, so captures and timing come
+    // in ticks of that rate.
+    spdif_backend_t backend;
+} spdif_receiver_config_t;
+
+#define SPDIF_RECEIVER_CONFIG_DEFAULT(pin)    \
+    {                                         \
+        .input_pin = (pin),                   \
+        .pcm_format = SPDIF_PCM_FORMAT_S16,   \
+        .init_done_cb = NULL,                 \
+        .sink = {0},                          \
+        .core_id = 1,                         \
+        .output_rate = 0,                     \
+        .asrc_quality = SPDIF_ASRC_QUALITY_MEDIUM, \
+        .timing_store = {0},                  \
+        .burst_sink = {0},                    \
+        .latency_us = 0,                      \
+        .conceal = SPDIF_CONCEAL_NONE,        \
+        .lock_cb = NULL,                      \
+        .lock_cb_ctx = NULL,                  \
+        .capture = {0},                       \
+        .max_sample_rate = 0,                 \
+        .post = {0},                          \
+        .protocol = SPDIF_PROTOCOL_SPDIF,     \
+        .overflow = SPDIF_OVERFLOW_DROP_NEWEST, \
+        .overflow_wait_ms = 0,                \
+        .backend = SPDIF_BACKEND_RMT,         \
+    }
+
+// Instance API. The first receiver gets an RMT DMA channel; once those are
+// taken further receivers fall back to RMT memory.
+esp_err_t spdif_rx_new(const spdif_receiver_config_t *config, spdif_receiver_handle_t *ret_rx);
+esp_err_t spdif_rx_del(spdif_receiver_handle_t rx); // Not from the receiver's own sink
+// Receivers run from spdif_rx_new(). stop() halts input; start() resumes
+// it on the timing found so far, with the decoder picking up at the next preamble.
+esp_err_t spdif_rx_start(spdif_receiver_handle_t rx);
+esp_err_t spdif_rx_stop(spdif_receiver_handle_t rx);
+uint32_t spdif_rx_get_sample_rate(spdif_receiver_handle_t rx);
+spdif_pcm_format_t spdif_rx_get_pcm_format(spdif_receiver_handle_t rx);
+// Channels per PCM frame: 2, or SPDIF_ADAT_CHANNELS while locked to ADAT
+uint32_t spdif_rx_get_channels(spdif_receiver_handle_t rx);
+esp_err_t spdif_rx_get_channel_status(spdif_receiver_handle_t rx, spdif_channel_status_t *status);
+esp_err_t spdif_rx_get_stats(spdif_receiver_handle_t rx, spdif_stats_t *stats);
+// Recovered input clock; ESP_ERR_INVALID_STATE until two B preambles have been decoded
+esp_err_t spdif_rx_get_clock(spdif_receiver_handle_t rx, spdif_clock_t *clock);
+// Measured rate of the clock consuming the converted output, e.g. a DAC on its
+// own oscillator, against esp_timer; 0 for the nominal output_rate.
+// ESP_ERR_INVALID_STATE without a sample-rate converter.
+esp_err_t spdif_rx_set_output_rate(spdif_receiver_handle_t rx, double rate);
+// Distribution of the delay from RMT delivering a chunk to its PCM reaching
+// the sink or ring buffer; ESP_ERR_NOT_SUPPORTED without CONFIG_SPDIF_IN_LATENCY_STATS
+esp_err_t spdif_rx_get_latency(spdif_receiver_handle_t rx, spdif_latency_t *latency);
+// Lock state: no input for CONFIG_SPDIF_IN_SIGNAL_TIMEOUT_MS is
+// SPDIF_LOCK_NO_SIGNAL, and the sample rate reads 0 until the next lock
+spdif_lock_state_t spdif_rx_get_lock_state(spdif_receiver_handle_t rx);
+// Event group holding SPDIF_LOCK_EVENT_BIT() of the current state, to wait
+// on with xEventGroupWaitBits(); do not set or clear its bits
+EventGroupHandle_t spdif_rx_get_lock_events(spdif_receiver_handle_t rx);
+// Hot-path timing in CPU cycles since the receiver started: ISR, waits for
+// input, discovery, decoding and tracking, plus the decoder task's share of
+// its core; ESP_ERR_NOT_SUPPORTED without CONFIG_SPDIF_IN_PROFILE
+esp_err_t spdif_rx_get_profile(spdif_receiver_handle_t rx, spdif_profile_t *profile);
+// Buffers and state the receiver allocated, by kind and memory
+esp_err_t spdif_rx_get_memory(spdif_receiver_handle_t rx, spdif_memory_t *memory);
+// Change the post-processing settings (enabled is ignored); they apply from
+// the next PCM block. ESP_ERR_INVALID_STATE if post.enabled was not set.
+esp_err_t spdif_rx_set_post(spdif_receiver_handle_t rx, const spdif_post_config_t *post);
+// Last complete meter window; ESP_ERR_INVALID_STATE without metering or
+// before the first window has passed
+esp_err_t spdif_rx_get_meter(spdif_receiver_handle_t rx, spdif_meter_t *meter);
+RingbufHandle_t spdif_rx_get_ringbuf(spdif_receiver_handle_t rx);
 
+// Reads up to size bytes of PCM in the instance's format, rounded down to
+// whole frames, waiting up to wait ticks for each ring buffer item. A frame
+// split by the ring buffer wrap is completed with a second read. Returns 0
+// when a custom sink is configured.
+int spdif_rx_read(spdif_receiver_handle_t rx, uint8_t *buffer, size_t size, TickType_t wait);
 
+// Handle-less API, operating on a default instance created by init
 esp_err_t spdif_receiver_init(int input_pin, void (*init_done_cb)(void));
+esp_err_t spdif_receiver_init_config(const spdif_receiver_config_t *config);
 esp_err_t spdif_receiver_start(void);
 esp_err_t spdif_receiver_stop(void);
 void spdif_receiver_deinit(void);
+spdif_receiver_handle_t spdif_receiver_get_handle(void); // Default instance, NULL before init
 uint32_t spdif_receiver_get_sample_rate(void);
+spdif_pcm_format_t spdif_receiver_get_pcm_format(void);
+uint32_t spdif_receiver_get_channels(void);
+esp_err_t spdif_receiver_get_channel_status(spdif_channel_status_t *status);
+esp_err_t spdif_receiver_get_stats(spdif_stats_t *stats);
+esp_err_t spdif_receiver_get_clock(spdif_clock_t *clock);
+esp_err_t spdif_receiver_set_output_rate(double rate);
+esp_err_t spdif_receiver_get_latency(spdif_latency_t *latency);
+spdif_lock_state_t spdif_receiver_get_lock_state(void);
+EventGroupHandle_t spdif_receiver_get_lock_events(void);
+esp_err_t spdif_receiver_get_profile(spdif_profile_t *profile);
+esp_err_t spdif_receiver_get_memory(spdif_memory_t *memory);
+esp_err_t spdif_receiver_set_post(const spdif_post_config_t *post);
+esp_err_t spdif_receiver_get_meter(spdif_meter_t *meter);
 
 inline static RingbufHandle_t spdif_in_get_ringbuf(){
     return spdif_in_pcm_buffer;
 }
 
-inline static int spdif_receiver_read(uint8_t *buffer, size_t size)
+inline static int spdif_receiver_read_wait(uint8_t *buffer, size_t size, TickType_t wait)
 {
-    if (!spdif_in_pcm_buffer)
-    {
-        return 0;
-    }
-    size_t received_size = 0;
-    uint8_t *data = (uint8_t *)xRingbufferReceiveUpTo(
-        spdif_in_pcm_buffer, &received_size, pdMS_TO_TICKS(10), size);
-    if (data && received_size > 0)
-    {
-        memcpy(buffer, data, received_size);
-        vRingbufferReturnItem(spdif_in_pcm_buffer, (void *)data);
-        return received_size;
-    }
-    return 0;
+    return spdif_rx_read(spdif_receiver_get_handle(), buffer, size, wait);
 }
 
+inline static int spdif_receiver_read(uint8_t *buffer, size_t size)
+{
+    return spdif_receiver_read_wait(buffer, size, pdMS_TO_TICKS(10));
+}
 
 #ifdef __cplusplus
 }
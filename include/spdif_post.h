@@ -0,0 +1,105 @@
+#ifndef SPDIF_POST_H
+#define SPDIF_POST_H
+
+// PCM post-processing: a PCM sink that applies gain, a channel map, TPDF
+// dither and level metering to the decoded stream while each block is still
+// in cache, converts it to the output format and hands it to another sink.
+// Input is always SPDIF_PCM_FORMAT_S24_32. The work is done by fixed-point
+// block kernels over interleaved int32 frames, one operation per loop with
+// no branches in the body, so they vectorize where the compiler can and are
+// easy to replace with a SIMD build per target. Platform independent.
+
+#include "spdif_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum
+{
+    SPDIF_CHANNEL_MAP_STEREO = 0, // L, R
+    SPDIF_CHANNEL_MAP_SWAP,       // R, L
+    SPDIF_CHANNEL_MAP_DOWNMIX,    // (L + R) / 2 on both
+    SPDIF_CHANNEL_MAP_LEFT,       // L on both
+    SPDIF_CHANNEL_MAP_RIGHT,      // R on both
+    SPDIF_CHANNEL_MAP_COUNT,
+} spdif_channel_map_t;
+
+#define SPDIF_POST_MAX_GAIN_DB 18.0f
+
+// Frames per kernel pass; a longer write is processed in pieces
+#define SPDIF_POST_BLOCK_FRAMES 64
+
+typedef struct
+{
+    bool enabled;                    // Read at receiver init only
+    float gain_db;                   // Up to SPDIF_POST_MAX_GAIN_DB; below about -170 dB mutes
+    spdif_channel_map_t channel_map;
+    bool dither;                     // TPDF dither of +-1 LSB when quantizing to int16
+    uint32_t meter_frames;           // Frames per meter reading, 0 = no metering
+} spdif_post_config_t;
+
+typedef struct
+{
+    spdif_pcm_format_t format;       // Output format
+    spdif_pcm_sink_t out;
+
+    // Settings in effect. spdif_post_configure() stages new ones in
+    // pending[pending_generation & 1]; they apply at the next write.
+    int32_t matrix[4];               // Q28: L' = m0 L + m1 R, R' = m2 L + m3 R
+    bool identity;                   // matrix is unity, the mix pass is skipped
+    bool dither;
+    uint32_t meter_frames;
+    spdif_post_config_t pending[2];
+    volatile uint32_t pending_generation;
+    uint32_t applied_generation;
+
+    uint32_t rng;                    // Dither noise, xorshift32
+
+    // Meter window in progress and the last complete one
+    uint32_t peak[2];                // Largest magnitude, in int32 full scale
+    uint64_t sum_sq[2];              // Sum of squares of the top 16 bits
+    uint32_t clipped;
+    uint32_t meter_fill;
+    spdif_meter_t meter_slots[2];
+    volatile uint32_t meter_generation; // Latest reading in meter_slots[meter_generation & 1]
+
+    int32_t mixed[SPDIF_POST_BLOCK_FRAMES * 2];
+    uint8_t own_block[SPDIF_POST_BLOCK_FRAMES * SPDIF_PCM_MAX_FRAME_BYTES];
+} spdif_post_t;
+
+// Frames are converted to format and written to out
+void spdif_post_init(spdif_post_t *post, spdif_pcm_format_t format, const spdif_post_config_t *config,
+                     const spdif_pcm_sink_t *out);
+
+// Sink to hand to a decoder producing SPDIF_PCM_FORMAT_S24_32
+spdif_pcm_sink_t spdif_post_sink(spdif_post_t *post);
+
+// Change gain, channel map, dither and meter window; safe to call from
+// another task than the one writing, one caller at a time
+void spdif_post_configure(spdif_post_t *post, const spdif_post_config_t *config);
+
+// Copy the last complete meter reading; safe to call from any task.
+// Returns false until a full window has been metered.
+bool spdif_post_get_meter(const spdif_post_t *post, spdif_meter_t *meter);
+
+// Block kernels over interleaved [L,R] int32 frames, left-justified as in
+// SPDIF_PCM_FORMAT_S24_32. The sink runs mix, meter and one quantizer in turn.
+
+// out = matrix * in per frame, saturated; returns the samples saturated
+uint32_t spdif_post_mix(const int32_t *in, int32_t *out, size_t num_frames, const int32_t *matrix);
+
+// Fold frames into the meter window in progress
+void spdif_post_meter(spdif_post_t *post, const int32_t *in, size_t num_frames);
+
+// int16, the top 16 bits; with rng, TPDF dithered and rounded
+void spdif_post_quantize_s16(const int32_t *in, int16_t *out, size_t num_frames, uint32_t *rng);
+
+// The other output formats, truncated to 24 bits as the decoder stores them
+void spdif_post_quantize(const int32_t *in, uint8_t *out, size_t num_frames, spdif_pcm_format_t format);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_POST_H
@@ -0,0 +1,312 @@
+#ifndef SPDIF_TYPES_H
+#define SPDIF_TYPES_H
+
+// Platform-independent types shared by the driver and the host build
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    bool groups_identified;   // Three pulse groups found
+    bool ratios_valid;        // Ratios match 1:2:3 within tolerance
+    bool distribution_valid;  // Distribution matches expected percentages
+    float ratio_error;        // Error from ideal 1:2:3 ratio
+    float short_pulse_pct;    // Actual short pulse percentage
+    float medium_pulse_pct;   // Actual medium pulse percentage
+    float long_pulse_pct;     // Actual long pulse percentage
+    float distribution_error; // Total distribution error
+} timing_validation_t;
+
+// Peak detection structure for histogram analysis
+typedef struct
+{
+    uint32_t bin;
+    uint32_t count;
+    float center;
+    uint32_t width;
+} peak_t;
+
+// PCM output formats, all interleaved little-endian: stereo [L,R] for
+// S/PDIF, channels 1-8 in order for ADAT
+typedef enum
+{
+    SPDIF_PCM_FORMAT_S16 = 0,    // int16, top 16 bits of the 24-bit audio field
+    SPDIF_PCM_FORMAT_S24_32,     // int32, 24-bit audio left-justified (low byte zero)
+    SPDIF_PCM_FORMAT_S24_PACKED, // 3 bytes per sample
+    SPDIF_PCM_FORMAT_F32,        // float in [-1.0, 1.0)
+    SPDIF_PCM_FORMAT_COUNT,
+} spdif_pcm_format_t;
+
+#define SPDIF_PCM_MAX_FRAME_BYTES 8
+
+// Bytes per interleaved stereo frame; an ADAT frame is four times as long
+static inline size_t spdif_pcm_frame_bytes(spdif_pcm_format_t format)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+            return 4;
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            return 6;
+        default:
+            return 8;
+    }
+}
+
+// Input line coding. ADAT Lightpipe carries 8 channels of 24-bit audio at
+// 44.1 or 48 kHz in NRZI-coded 256-cell frames, without channel status.
+typedef enum
+{
+    SPDIF_PROTOCOL_SPDIF = 0, // IEC 60958 bi-phase mark, stereo
+    SPDIF_PROTOCOL_ADAT,      // ADAT Lightpipe, 8 channels
+    SPDIF_PROTOCOL_AUTO,      // Either, told apart by the pulse histogram
+    SPDIF_PROTOCOL_COUNT,
+} spdif_protocol_t;
+
+#define SPDIF_ADAT_CHANNELS 8
+
+// PCM sink: receives decoded frames in blocks on the decoder task.
+// write() is called with each full block, and with a partial block after a
+// flush; frames are only valid during the call and must not block for long.
+// A frame has 2 channels, or SPDIF_ADAT_CHANNELS for ADAT.
+// If get_buffer is set, the decoder writes frames straight into the buffer it
+// returns (room for *max_frames frames), so write() only has to commit them.
+// When get_buffer returns NULL the decoder falls back to its own block and
+// write() receives frames outside the sink's buffers.
+typedef struct
+{
+    void (*write)(void *ctx, const void *frames, size_t num_frames);
+    void *(*get_buffer)(void *ctx, size_t *max_frames);
+    void *ctx;
+} spdif_pcm_sink_t;
+
+// Channel status block (IEC 60958-3), assembled from the C bits of channel A
+// over 192 frames starting at a B preamble. raw[n] bit k is status bit 8n+k.
+typedef struct
+{
+    uint8_t raw[24];
+    uint8_t user_data[24];    // User (U) bits of channel A for the same block
+    bool professional;        // Bit 0: AES3 professional format
+    bool non_audio;           // Bit 1: payload is data (e.g. IEC 61937), not PCM
+    bool copy_permitted;      // Bit 2 (consumer): copyright not asserted
+    bool original;            // Bit 15 (consumer): L bit, original/commercial generation
+    uint8_t pre_emphasis;     // Bits 3-5 (consumer): 0 none, 1 50/15 us
+    uint8_t category_code;    // Bits 8-15 (consumer)
+    uint8_t sample_rate_code; // Bits 24-27 (consumer) or 6-7 (professional)
+    uint32_t sample_rate;     // Decoded sample_rate_code in Hz, 0 if not indicated
+    uint8_t word_length;      // Sample word length in bits, 0 if not indicated
+} spdif_channel_status_t;
+
+// Decoder health counters, totals since init. Each field has a single
+// writer and is read without locks, so a snapshot is consistent per field.
+typedef struct
+{
+    uint32_t frames_decoded;    // Frames handed to the PCM output
+    uint32_t unknown_pulses;    // Pulses outside every pulse class
+    uint32_t invalid_preambles; // Preamble runs matching no B/M/W pattern
+    uint32_t parity_errors;
+    uint32_t invalid_subframes; // Validity bit set by the source
+    uint32_t symbols_dropped;   // RMT symbols lost to a full symbol ring buffer
+    uint32_t symbols_overwritten; // Zero-copy receive: symbols the DMA wrote over before they were decoded
+    uint32_t frames_dropped;    // PCM frames lost to a full PCM ring buffer
+    uint32_t frames_overwritten; // Oldest PCM frames discarded from a full ring for newer ones
+    uint32_t symbol_gaps;       // Runs of dropped symbols the decoder restarted the bitstream after
+    uint32_t relocks;           // Timing changes picked up after the first lock
+    uint32_t data_bursts;       // IEC 61937 bursts handed to the passthrough consumer
+    uint32_t bursts_dropped;    // Bursts cut short, longer than the buffer, or without a consumer
+    uint32_t sync_errors;       // Subframes out of the B/M, W order (ADAT: frames cut short); the frame is dropped
+    uint32_t block_errors;      // B preambles not 192 frames after the previous one
+    uint32_t frames_concealed;  // Frames filled in for ones lost to sync errors
+    uint32_t isr_cycles_max;    // Longest RMT receive callback in CPU cycles (target only)
+} spdif_stats_t;
+
+// Stand-in for frames lost to a sync error, up to SPDIF_CONCEAL_MAX_FRAMES
+// at a time; a longer gap is left out, as without concealment
+typedef enum
+{
+    SPDIF_CONCEAL_NONE = 0,    // Drop lost frames, the output is shorter than the input
+    SPDIF_CONCEAL_HOLD,        // Repeat the last frame
+    SPDIF_CONCEAL_INTERPOLATE, // Ramp from the last frame to the next one
+} spdif_conceal_t;
+
+#define SPDIF_CONCEAL_MAX_FRAMES 8
+
+// What a PCM block that doesn't fit the full PCM ring buffer costs. Either
+// way only whole blocks or whole frames go, and the decoder keeps its place
+// in the bitstream.
+typedef enum
+{
+    SPDIF_OVERFLOW_DROP_NEWEST = 0, // Drop the block; the reader gets the older audio first
+    SPDIF_OVERFLOW_DROP_OLDEST,     // Discard the oldest frames to make room; the reader gets the newest audio
+    SPDIF_OVERFLOW_BLOCK,           // Wait a bounded time for room, then drop the block
+    SPDIF_OVERFLOW_COUNT,
+} spdif_overflow_t;
+
+// Peripheral a receiver takes its input from
+typedef enum
+{
+    SPDIF_BACKEND_RMT = 0, // RMT measures each pulse
+    SPDIF_BACKEND_I2S,     // I2S RX oversamples the line; needs CONFIG_SPDIF_IN_I2S_CAPTURE
+    SPDIF_BACKEND_COUNT,
+} spdif_backend_t;
+
+#define SPDIF_LATENCY_BUCKETS 40
+
+// Delay from the RMT ISR delivering a chunk to the last frame decoded from it
+// reaching the PCM sink or ring buffer, over all chunks since lock. Buckets
+// are quarter octaves: bucket b starts at spdif_latency_bucket_us(b), bucket
+// 0 also holds anything shorter and the last bucket anything longer.
+typedef struct
+{
+    uint32_t samples;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint32_t mean_us;
+    uint32_t p50_us;          // Percentiles, interpolated within their bucket
+    uint32_t p90_us;
+    uint32_t p99_us;
+    uint32_t histogram[SPDIF_LATENCY_BUCKETS];
+} spdif_latency_t;
+
+static inline uint32_t spdif_latency_bucket_us(uint32_t bucket)
+{
+    return (4 + (bucket & 3)) << (bucket / 4 + 2);
+}
+
+// Hot-path stages timed by the profiler (CONFIG_SPDIF_IN_PROFILE)
+typedef enum
+{
+    SPDIF_PROFILE_ISR = 0,    // RMT receive callback
+    SPDIF_PROFILE_RX_WAIT,    // Decoder task blocked until symbols arrived
+    SPDIF_PROFILE_DISCOVERY,  // Histogram, cached timing check and analysis, per chunk before lock
+    SPDIF_PROFILE_DECODE,     // Decoding one chunk, including the PCM sink
+    SPDIF_PROFILE_TRACKER,    // Timing tracker, per chunk after lock
+    SPDIF_PROFILE_STAGE_COUNT,
+} spdif_profile_stage_t;
+
+#define SPDIF_PROFILE_BUCKETS 96
+
+// One stage's durations in profiler clock ticks (CPU cycles on target, ns on
+// the host), since init; histogram buckets as for spdif_latency_t
+typedef struct
+{
+    uint32_t samples;
+    uint32_t min;
+    uint32_t max;
+    uint32_t mean;
+    uint32_t p50;
+    uint32_t p90;
+    uint32_t p99;
+    uint64_t total;
+    uint32_t histogram[SPDIF_PROFILE_BUCKETS];
+} spdif_profile_stage_stats_t;
+
+typedef struct
+{
+    uint32_t clock_hz;      // Profiler clock ticks per second
+    uint64_t elapsed;       // Ticks since the decoder task started
+    uint32_t load_permille; // Discovery, decode and tracker time against elapsed
+    spdif_profile_stage_stats_t stage[SPDIF_PROFILE_STAGE_COUNT];
+} spdif_profile_t;
+
+// Memory a receiver holds, in bytes. Everything is internal RAM except the
+// PCM ring and the histograms with CONFIG_SPDIF_IN_PSRAM_BUFFERS.
+typedef struct
+{
+    uint32_t dma_bytes;          // RMT receive buffers, DMA-capable
+    uint32_t symbol_ring_bytes;  // Symbol ring the ISR writes, 0 with zero-copy receive
+    uint32_t pcm_ring_bytes;     // PCM ring buffer, 0 with a custom sink
+    uint32_t state_bytes;        // Receiver and decoder state, including the PCM block
+    uint32_t discovery_bytes;    // Pulse histograms, held only while discovery or the tracker collects
+    uint32_t internal_bytes;     // Internal RAM while locked
+    uint32_t internal_peak_bytes; // Internal RAM while acquiring, with the histograms
+    uint32_t psram_bytes;
+} spdif_memory_t;
+
+// Output levels over one meter window of the post-processing stage, after
+// gain and channel map; 1.0 is full scale
+typedef struct
+{
+    float peak[2];      // [L,R] largest magnitude
+    float rms[2];       // [L,R] RMS level, a full-scale sine reads 0.707
+    uint32_t clipped;   // Samples the gain pushed past full scale
+    uint32_t frames;    // Window length
+    uint32_t windows;   // Readings since init
+} spdif_meter_t;
+
+// Receiver lock state, driven by symbol arrival and the decoded frame rate
+typedef enum
+{
+    SPDIF_LOCK_NO_SIGNAL = 0, // No input; the state at init
+    SPDIF_LOCK_ACQUIRING,     // Input present, timing discovery running
+    SPDIF_LOCK_LOCKED,        // Timing found, frames decoding
+    SPDIF_LOCK_LOST,          // Lock lost while input kept arriving; rediscovering
+    SPDIF_LOCK_STATE_COUNT,
+} spdif_lock_state_t;
+
+// Called on the decoder task on every lock state change
+typedef void (*spdif_lock_cb_t)(void *ctx, spdif_lock_state_t state);
+
+// Raw symbol capture consumer: receives the capture stream (format in
+// capture.h) in pieces on the decoder task, e.g. to append to a file. A
+// write that returns false ends the capture, so it must not write partially.
+typedef struct
+{
+    bool (*write)(void *ctx, const void *data, size_t bytes);
+    void *ctx;
+} spdif_capture_sink_t;
+
+// Pulse timing of a previous lock: the three pulse class centres in 1/16 RMT
+// tick. A receiver started with one checks it against the first few hundred
+// pulses and skips timing discovery if the input still matches.
+typedef struct
+{
+    uint32_t resolution_hz;   // RMT resolution the centres were measured at
+    uint32_t short_pulse_x16;
+    uint32_t medium_pulse_x16;
+    uint32_t long_pulse_x16;
+} spdif_timing_cache_t;
+
+// Persistent storage for the cached timing, e.g. an NVS entry. load() returns
+// false if nothing is stored; save() is called on the decoder task once a
+// lock found by discovery or the tracker has decoded a window of frames.
+typedef struct
+{
+    bool (*load)(void *ctx, spdif_timing_cache_t *cache);
+    void (*save)(void *ctx, const spdif_timing_cache_t *cache);
+    void *ctx;
+} spdif_timing_store_t;
+
+// Recovered input clock: the frame rate of the incoming stream measured
+// against the RMT clock, from the tick position of every B preamble (one per
+// 192 frames). Frame indices count frames handed to the PCM sink since init,
+// so the n-th frame a sink or ring buffer reader receives has index n (plus
+// frames_dropped for a ring buffer reader that fell behind).
+typedef struct
+{
+    bool locked;            // Loop settled on a continuous stream
+    uint32_t nominal_rate;  // Nearest IEC 60958 rate, 0 if none
+    double sample_rate;     // Filtered frame rate in Hz
+    double ppm;             // sample_rate against nominal_rate, parts per million
+    uint64_t frame;         // Index of the frame starting with the last B preamble
+    uint64_t ticks;         // RMT tick position of its start
+    int64_t time_us;        // esp_timer time of its start, 0 if not known
+} spdif_clock_t;
+
+// esp_timer time at which a frame started, extrapolated from the last B preamble
+static inline int64_t spdif_clock_frame_time_us(const spdif_clock_t *clock, uint64_t frame)
+{
+    return clock->time_us + (int64_t)((double)(int64_t)(frame - clock->frame) * 1e6 / clock->sample_rate);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_TYPES_H
@@ -0,0 +1,37 @@
+#ifndef SPDIF_WAV_H
+#define SPDIF_WAV_H
+
+// PCM sink writing a WAV file. Platform independent: used by the host tools
+// and on target with any stdio-backed filesystem (SD card, SPIFFS, ...).
+
+#include <stdio.h>
+#include "spdif_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct
+{
+    FILE *file;
+    spdif_pcm_format_t format;
+    uint32_t sample_rate;     // Written to the header on close; may be set once the rate is known
+    uint32_t data_bytes;
+    bool write_error;
+} spdif_wav_sink_t;
+
+// Create the file and reserve the header. sample_rate may be 0 if not known yet.
+bool spdif_wav_sink_open(spdif_wav_sink_t *wav, const char *path,
+                         spdif_pcm_format_t format, uint32_t sample_rate);
+
+// Sink handing every decoded block to the file
+spdif_pcm_sink_t spdif_wav_sink(spdif_wav_sink_t *wav);
+
+// Write the final header and close; false if any write failed
+bool spdif_wav_sink_close(spdif_wav_sink_t *wav);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_WAV_H
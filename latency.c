@@ -0,0 +1,207 @@
+#include "latency.h"
+#include <string.h>
+
+// Fewest and most RMT symbols per stereo frame: 64 bit cells with one edge
+// each for all-zero audio, about 1.5 edges per cell for full-scale noise;
+// two edges per symbol
+#define SYMBOLS_PER_FRAME_MIN 32
+#define SYMBOLS_PER_FRAME_MAX 48
+
+// Smallest chunk worth an interrupt
+#define LATENCY_MIN_RX_SYMBOLS 64
+
+static uint32_t min_u32(uint32_t a, uint32_t b)
+{
+    return a < b ? a : b;
+}
+
+static uint32_t max_u32(uint32_t a, uint32_t b)
+{
+    return a > b ? a : b;
+}
+
+void latency_plan(latency_plan_t *plan, uint32_t budget_us)
+{
+    uint32_t frames = (uint32_t)((uint64_t)budget_us * LATENCY_PLAN_RATE / 1000000);
+    uint32_t rx_symbols = frames / 2 * SYMBOLS_PER_FRAME_MIN;
+    rx_symbols -= rx_symbols % LATENCY_MIN_RX_SYMBOLS;
+    plan->rx_symbols = min_u32(plan->rx_symbols, max_u32(rx_symbols, LATENCY_MIN_RX_SYMBOLS));
+    plan->block_frames = min_u32(plan->block_frames, max_u32(frames / 4, 1));
+    plan->ring_symbols = min_u32(plan->ring_symbols, max_u32(frames * SYMBOLS_PER_FRAME_MAX, 2 * plan->rx_symbols));
+    plan->pcm_frames = min_u32(plan->pcm_frames, max_u32(frames, 2 * plan->block_frames));
+}
+
+void memory_plan(latency_plan_t *plan, uint32_t max_sample_rate)
+{
+    if (!max_sample_rate || max_sample_rate >= MEMORY_PLAN_RATE)
+    {
+        return;
+    }
+    uint32_t rx_symbols = (uint32_t)((uint64_t)plan->rx_symbols * max_sample_rate / MEMORY_PLAN_RATE);
+    rx_symbols -= rx_symbols % LATENCY_MIN_RX_SYMBOLS;
+    plan->rx_symbols = max_u32(rx_symbols, LATENCY_MIN_RX_SYMBOLS);
+    uint32_t ring_symbols = (uint32_t)((uint64_t)plan->ring_symbols * max_sample_rate / MEMORY_PLAN_RATE);
+    plan->ring_symbols = min_u32(plan->ring_symbols, max_u32(ring_symbols, 2 * plan->rx_symbols));
+}
+
+uint32_t symbol_hold_us(const latency_plan_t *plan, uint32_t rx_buffer_count, uint32_t sample_rate)
+{
+    uint32_t symbols = rx_buffer_count ? (rx_buffer_count - 1) * plan->rx_symbols : plan->ring_symbols;
+    return (uint32_t)((uint64_t)symbols * 1000000 / ((uint64_t)SYMBOLS_PER_FRAME_MAX * sample_rate));
+}
+
+void memory_footprint(const latency_plan_t *plan, uint32_t rx_buffer_count, size_t pcm_frame_bytes,
+                      size_t state_bytes, bool psram, spdif_memory_t *mem)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->dma_bytes = plan->rx_symbols * max_u32(rx_buffer_count, 1) * sizeof(rmt_symbol_word_t);
+    mem->symbol_ring_bytes = rx_buffer_count ? 0 : plan->ring_symbols * sizeof(rmt_symbol_word_t);
+    mem->pcm_ring_bytes = plan->pcm_frames * pcm_frame_bytes;
+    mem->state_bytes = state_bytes;
+    // Discovery, and the tracker if a rate change comes during it
+    mem->discovery_bytes = 2 * CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT * sizeof(uint32_t);
+    mem->internal_bytes = mem->dma_bytes + mem->symbol_ring_bytes + mem->state_bytes;
+    if (psram)
+    {
+        mem->psram_bytes = mem->pcm_ring_bytes + mem->discovery_bytes;
+        mem->internal_peak_bytes = mem->internal_bytes;
+    }
+    else
+    {
+        mem->internal_bytes += mem->pcm_ring_bytes;
+        mem->internal_peak_bytes = mem->internal_bytes + mem->discovery_bytes;
+    }
+}
+
+uint32_t IRAM_ATTR quarter_octave_bucket(uint32_t value, uint32_t buckets)
+{
+    if (value < 16)
+    {
+        return 0;
+    }
+    uint32_t msb = 31 - __builtin_clz(value);
+    uint32_t bucket = (msb - 4) * 4 + ((value >> (msb - 2)) & 3);
+    return bucket < buckets ? bucket : buckets - 1;
+}
+
+uint32_t quarter_octave_percentile(const uint32_t *histogram, uint32_t buckets, uint32_t samples,
+                                   uint32_t min, uint32_t max, uint32_t permille)
+{
+    uint64_t target = ((uint64_t)samples * permille + 999) / 1000;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < buckets - 1; b++)
+    {
+        uint32_t count = histogram[b];
+        if (seen + count >= target && count)
+        {
+            uint32_t lower = b ? spdif_latency_bucket_us(b) : 0;
+            uint32_t upper = spdif_latency_bucket_us(b + 1);
+            uint32_t value = lower + (uint32_t)((uint64_t)(upper - lower) * (target - seen) / count);
+            return max_u32(min_u32(value, max), min);
+        }
+        seen += count;
+    }
+    return max;
+}
+
+static void latency_add(latency_probe_t *probe, int64_t delay_us)
+{
+    uint32_t us = delay_us <= 0 ? 0 : delay_us > UINT32_MAX ? UINT32_MAX : (uint32_t)delay_us;
+    uint32_t *bin = &probe->histogram[quarter_octave_bucket(us, SPDIF_LATENCY_BUCKETS)];
+    __atomic_store_n(bin, *bin + 1, __ATOMIC_RELAXED);
+    if (!probe->samples || us < probe->min_us)
+    {
+        __atomic_store_n(&probe->min_us, us, __ATOMIC_RELAXED);
+    }
+    if (us > probe->max_us)
+    {
+        __atomic_store_n(&probe->max_us, us, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&probe->sum_us, probe->sum_us + us, __ATOMIC_RELAXED);
+    __atomic_store_n(&probe->samples, probe->samples + 1, __ATOMIC_RELEASE);
+}
+
+// Complete every chunk whose last frame the sink now has
+static void latency_resolve(latency_probe_t *probe)
+{
+    if (probe->tail == probe->head)
+    {
+        return;
+    }
+    int64_t now = probe->now_us(probe->now_ctx);
+    while (probe->tail != probe->head && probe->pending[probe->tail % LATENCY_PENDING].end_frame <= probe->committed)
+    {
+        latency_add(probe, now - probe->pending[probe->tail % LATENCY_PENDING].time_us);
+        probe->tail++;
+    }
+}
+
+static void *latency_get_buffer(void *ctx, size_t *max_frames)
+{
+    latency_probe_t *probe = (latency_probe_t *)ctx;
+    return probe->next.get_buffer ? probe->next.get_buffer(probe->next.ctx, max_frames) : NULL;
+}
+
+static void latency_write(void *ctx, const void *frames, size_t num_frames)
+{
+    latency_probe_t *probe = (latency_probe_t *)ctx;
+    probe->next.write(probe->next.ctx, frames, num_frames);
+    probe->committed += num_frames;
+    latency_resolve(probe);
+}
+
+void latency_probe_init(latency_probe_t *probe, const spdif_pcm_sink_t *next,
+                        int64_t (*now_us)(void *ctx), void *now_ctx)
+{
+    memset(probe, 0, sizeof(*probe));
+    probe->next = *next;
+    probe->now_us = now_us;
+    probe->now_ctx = now_ctx;
+}
+
+spdif_pcm_sink_t latency_probe_sink(latency_probe_t *probe)
+{
+    return (spdif_pcm_sink_t){
+        .write = latency_write,
+        .get_buffer = probe->next.get_buffer ? latency_get_buffer : NULL,
+        .ctx = probe,
+    };
+}
+
+void latency_probe_arrival(latency_probe_t *probe, uint64_t end_frame, int64_t time_us)
+{
+    // A full queue means blocks far longer than chunks; skip the sample
+    if (probe->head - probe->tail < LATENCY_PENDING)
+    {
+        probe->pending[probe->head % LATENCY_PENDING].end_frame = end_frame;
+        probe->pending[probe->head % LATENCY_PENDING].time_us = time_us;
+        probe->head++;
+    }
+    latency_resolve(probe);
+}
+
+static uint32_t latency_percentile(const spdif_latency_t *latency, uint32_t permille)
+{
+    return quarter_octave_percentile(latency->histogram, SPDIF_LATENCY_BUCKETS, latency->samples,
+                                     latency->min_us, latency->max_us, permille);
+}
+
+void latency_probe_get(const latency_probe_t *probe, spdif_latency_t *latency)
+{
+    memset(latency, 0, sizeof(*latency));
+    latency->samples = __atomic_load_n(&probe->samples, __ATOMIC_ACQUIRE);
+    if (!latency->samples)
+    {
+        return;
+    }
+    latency->min_us = __atomic_load_n(&probe->min_us, __ATOMIC_RELAXED);
+    latency->max_us = __atomic_load_n(&probe->max_us, __ATOMIC_RELAXED);
+    latency->mean_us = (uint32_t)(__atomic_load_n(&probe->sum_us, __ATOMIC_RELAXED) / latency->samples);
+    for (uint32_t b = 0; b < SPDIF_LATENCY_BUCKETS; b++)
+    {
+        latency->histogram[b] = __atomic_load_n(&probe->histogram[b], __ATOMIC_RELAXED);
+    }
+    latency->p50_us = latency_percentile(latency, 500);
+    latency->p90_us = latency_percentile(latency, 900);
+    latency->p99_us = latency_percentile(latency, 990);
+}
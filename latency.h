@@ -0,0 +1,102 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Buffer sizes derived from a latency budget, and the probe that measures
+// the delay from a chunk's arrival to its PCM being handed on. Platform
+// independent: the driver and the host bench share both.
+
+// Frame rate the budget is planned for; higher rates fill the same buffers faster
+#define LATENCY_PLAN_RATE 48000
+
+// Rate the Kconfig symbol buffer sizes are taken to be sized for
+#define MEMORY_PLAN_RATE 192000
+
+// Receive and output sizes. latency_plan() only ever shrinks them.
+typedef struct
+{
+    uint32_t rx_symbols;   // RMT receive buffer, i.e. symbols per chunk
+    uint32_t ring_symbols; // Symbol ring buffer
+    uint32_t block_frames; // PCM frames per sink write
+    uint32_t pcm_frames;   // PCM ring buffer
+} latency_plan_t;
+
+// Fit plan, holding the default sizes, into budget_us of input-to-PCM delay
+// at LATENCY_PLAN_RATE. The receiver flushes the PCM block after every
+// chunk, so the delay is the time a chunk takes to arrive plus decoding and
+// scheduling: a chunk gets half the budget (for digital silence, the fewest
+// symbols per frame) and a PCM block a quarter. The rings hold one budget,
+// so a reader that falls behind loses data instead of adding delay.
+void latency_plan(latency_plan_t *plan, uint32_t budget_us);
+
+// Scale the symbol buffers of a plan sized for 192 kHz (as the Kconfig
+// defaults are) to the highest rate the input will carry: each buffer then
+// holds the same time of input. Like latency_plan(), it only shrinks them.
+void memory_plan(latency_plan_t *plan, uint32_t max_sample_rate);
+
+// Time of input the symbol buffers of a plan absorb at sample_rate while
+// the decoder is held up, e.g. waiting for room in the PCM ring, before the
+// RMT ISR starts dropping symbols: the symbol ring, or with rx_buffer_count
+// zero-copy buffers all but the one being received into. Taken at the most
+// symbols per frame.
+uint32_t symbol_hold_us(const latency_plan_t *plan, uint32_t rx_buffer_count, uint32_t sample_rate);
+
+// Footprint of a receiver built from plan. rx_buffer_count is the number of
+// zero-copy receive buffers, 0 for a single buffer and a symbol ring;
+// pcm_frame_bytes is 0 with a custom sink; state_bytes is the receiver
+// struct. With psram the PCM ring and histograms count as PSRAM.
+void memory_footprint(const latency_plan_t *plan, uint32_t rx_buffer_count, size_t pcm_frame_bytes,
+                      size_t state_bytes, bool psram, spdif_memory_t *mem);
+
+// Quarter-octave histograms, shared with the profiler. Bucket b starts at
+// spdif_latency_bucket_us(b); bucket 0 also holds anything shorter and the
+// last bucket anything longer.
+uint32_t quarter_octave_bucket(uint32_t value, uint32_t buckets);
+
+// Value below which permille/1000 of the samples fall, interpolated linearly
+// within its bucket and clamped to [min, max]
+uint32_t quarter_octave_percentile(const uint32_t *histogram, uint32_t buckets, uint32_t samples,
+                                   uint32_t min, uint32_t max, uint32_t permille);
+
+#define LATENCY_PENDING 64
+
+// Sits between the decoder and its sink, counting committed frames. Each
+// chunk is recorded with the frame count it brings the decoder to; it is
+// complete once the sink has been handed that many frames.
+typedef struct
+{
+    struct
+    {
+        uint64_t end_frame;
+        int64_t time_us;
+    } pending[LATENCY_PENDING];
+    uint32_t head;
+    uint32_t tail;
+    uint64_t committed;
+    spdif_pcm_sink_t next;
+    int64_t (*now_us)(void *ctx);
+    void *now_ctx;
+
+    // Written by the decoder task only, read from any task
+    uint32_t samples;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t histogram[SPDIF_LATENCY_BUCKETS];
+} latency_probe_t;
+
+void latency_probe_init(latency_probe_t *probe, const spdif_pcm_sink_t *next,
+                        int64_t (*now_us)(void *ctx), void *now_ctx);
+
+// Sink to give the decoder in place of next
+spdif_pcm_sink_t latency_probe_sink(latency_probe_t *probe);
+
+// A chunk that arrived at time_us has been decoded up to frame end_frame
+void latency_probe_arrival(latency_probe_t *probe, uint64_t end_frame, int64_t time_us);
+
+// Snapshot the distribution; safe to call from any task
+void latency_probe_get(const latency_probe_t *probe, spdif_latency_t *latency);
+
+#endif // LATENCY_H
@@ -0,0 +1,115 @@
+#include "oversample.h"
+#include <string.h>
+
+void oversample_init(oversample_t *os)
+{
+    memset(os, 0, sizeof(*os));
+    // The pulse in progress has no known start; it comes out clamped long,
+    // which discovery and the decoder skip as an unknown pulse
+    os->run = OVERSAMPLE_MAX_RUN;
+}
+
+// Each pulse is one 16-bit half of a symbol, duration then level, and on
+// these little-endian targets the halves of a symbol array are in stream
+// order. Pulses go out as consecutive halves; an odd one at the end is
+// taken back into the state and put first next time.
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "oversample_edges() writes symbols as 16-bit halves in little-endian order"
+#endif
+
+size_t oversample_edges(oversample_t *os, const uint32_t *words, size_t num_words, rmt_symbol_word_t *symbols,
+                        size_t max_symbols, size_t *words_used)
+{
+    uint16_t *halves = (uint16_t *)symbols;
+    uint32_t level = os->level;
+    uint32_t run = os->run;
+    size_t h = 0;
+    if (os->has_half)
+    {
+        uint16_t half = (uint16_t)os->half;
+        memcpy(&halves[h++], &half, sizeof(half));
+    }
+    size_t i = 0;
+    for (; i < num_words && max_symbols - h / 2 >= OVERSAMPLE_MAX_SYMBOLS_PER_WORD; i++)
+    {
+        uint32_t w = words[i];
+        // Bit k set where sample k differs from the one before it
+        uint32_t edges = w ^ (w >> 1 | level << 31);
+        if (!edges)
+        {
+            run = run + 32 < OVERSAMPLE_MAX_RUN ? run + 32 : OVERSAMPLE_MAX_RUN;
+            continue;
+        }
+        // The first edge ends the pulse carried in, the only one that can
+        // exceed a word
+        uint32_t at = __builtin_clz(edges);
+        uint32_t ticks = run + at;
+        uint16_t pulse = (uint16_t)((ticks < OVERSAMPLE_MAX_RUN ? ticks : OVERSAMPLE_MAX_RUN) | level << 15);
+        memcpy(&halves[h++], &pulse, sizeof(pulse));
+        uint32_t pos = at;
+        edges &= 0x7FFFFFFFu >> at;
+        while (edges)
+        {
+            at = __builtin_clz(edges);
+            level ^= 1;
+            pulse = (uint16_t)((at - pos) | level << 15);
+            memcpy(&halves[h++], &pulse, sizeof(pulse));
+            pos = at;
+            edges &= 0x7FFFFFFFu >> at;
+        }
+        level = w & 1;
+        run = 32 - pos;
+    }
+    os->level = level;
+    os->run = run;
+    os->has_half = h & 1;
+    if (os->has_half)
+    {
+        uint16_t half;
+        memcpy(&half, &halves[h - 1], sizeof(half));
+        os->half = half;
+    }
+    *words_used = i;
+    return h / 2;
+}
+
+#if CONFIG_SPDIF_IN_REFERENCE_DECODER
+size_t oversample_edges_reference(oversample_t *os, const uint32_t *words, size_t num_words,
+                                  rmt_symbol_word_t *symbols, size_t max_symbols, size_t *words_used)
+{
+    size_t n = 0;
+    size_t i = 0;
+    for (; i < num_words && max_symbols - n >= OVERSAMPLE_MAX_SYMBOLS_PER_WORD; i++)
+    {
+        for (int b = 31; b >= 0; b--)
+        {
+            uint32_t sample = (words[i] >> b) & 1;
+            if (sample != os->level)
+            {
+                rmt_symbol_word_t *sym = &symbols[n];
+                if (os->has_half)
+                {
+                    sym->val = os->half;
+                    sym->duration1 = os->run;
+                    sym->level1 = os->level;
+                    n++;
+                }
+                else
+                {
+                    rmt_symbol_word_t first = {.duration0 = os->run, .level0 = os->level};
+                    os->half = first.val;
+                }
+                os->has_half = !os->has_half;
+                os->level = sample;
+                os->run = 0;
+            }
+            if (os->run < OVERSAMPLE_MAX_RUN)
+            {
+                os->run++;
+            }
+        }
+    }
+    *words_used = i;
+    return n;
+}
+#endif
@@ -0,0 +1,45 @@
+#ifndef OVERSAMPLE_H
+#define OVERSAMPLE_H
+
+#include "spdif_port.h"
+
+// Edge extraction for an oversampled capture: the input line sampled as a
+// 1-bit stream, e.g. by I2S RX DMA, 32 samples per word with the earliest
+// in bit 31. The pulses between edges come out as the RMT symbols the
+// decoder consumes, one tick per sample. Works a word at a time: the edges
+// are the set bits of the word XOR itself delayed by one sample, walked
+// with count-leading-zeros, so a word costs a step per edge, not per
+// sample. Platform independent: the I2S backend and the host bench share it.
+
+// Room one word may need: an edge at every sample completes 16 symbols, two
+// pulses each, and may start a 17th
+#define OVERSAMPLE_MAX_SYMBOLS_PER_WORD 17
+
+// Longest pulse a symbol holds; longer runs are clamped to it
+#define OVERSAMPLE_MAX_RUN 0x7FFF
+
+typedef struct
+{
+    uint32_t level;         // Last sample, 0 or 1
+    uint32_t run;           // Samples since the last edge, up to OVERSAMPLE_MAX_RUN
+    bool has_half;          // half holds the first pulse of the next symbol
+    uint32_t half;          // duration0 | level0 << 15
+} oversample_t;
+
+// Start of a stream, or a fresh start after samples were lost
+void oversample_init(oversample_t *os);
+
+// Extract the pulses ending in words into symbols; returns symbols written.
+// Stops at a word boundary once fewer than OVERSAMPLE_MAX_SYMBOLS_PER_WORD
+// symbols of room are left, with *words_used telling how far it got. The
+// pulse in progress at the end carries over to the next call.
+size_t oversample_edges(oversample_t *os, const uint32_t *words, size_t num_words, rmt_symbol_word_t *symbols,
+                        size_t max_symbols, size_t *words_used);
+
+#if CONFIG_SPDIF_IN_REFERENCE_DECODER
+// Sample-by-sample version; produces the same output as oversample_edges()
+size_t oversample_edges_reference(oversample_t *os, const uint32_t *words, size_t num_words,
+                                  rmt_symbol_word_t *symbols, size_t max_symbols, size_t *words_used);
+#endif
+
+#endif // OVERSAMPLE_H
@@ -0,0 +1,23 @@
+#include "pcm_ring.h"
+#include "spdif_decoder.h"
+
+void pcm_ring_write(const pcm_ring_t *ring, spdif_overflow_t policy, uint32_t wait_ms, const void *frames,
+                    size_t num_frames, size_t frame_bytes, spdif_stats_t *stats)
+{
+    size_t bytes = num_frames * frame_bytes;
+    if (ring->send(ring->ctx, frames, bytes, policy == SPDIF_OVERFLOW_BLOCK ? wait_ms : 0))
+    {
+        return;
+    }
+    if (policy == SPDIF_OVERFLOW_DROP_OLDEST)
+    {
+        // The reader may have made room meanwhile, so send again either way
+        size_t discarded = ring->discard(ring->ctx, bytes, frame_bytes);
+        spdif_stat_add(&stats->frames_overwritten, (uint32_t)(discarded / frame_bytes));
+        if (ring->send(ring->ctx, frames, bytes, 0))
+        {
+            return;
+        }
+    }
+    spdif_stat_add(&stats->frames_dropped, (uint32_t)num_frames);
+}
@@ -0,0 +1,32 @@
+#ifndef PCM_RING_H
+#define PCM_RING_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Backpressure between the decoder and a bounded PCM ring: the overflow
+// policy decides what a block that doesn't fit costs. Platform independent:
+// the driver runs it over the FreeRTOS ring buffer, the host bench over a
+// stand-in with a reader that stalls.
+
+// A byte ring holding whole frames. Readers must take whole frames too, or
+// a discard could leave them reading from the middle of one.
+typedef struct
+{
+    // Queue bytes, waiting up to wait_ms for room; false if they don't fit
+    bool (*send)(void *ctx, const void *data, size_t bytes, uint32_t wait_ms);
+    // Discard the oldest whole frames of frame_bytes until bytes more fit;
+    // returns the bytes discarded, 0 if none could be (e.g. a reader holds
+    // the ring)
+    size_t (*discard)(void *ctx, size_t bytes, size_t frame_bytes);
+    void *ctx;
+} pcm_ring_t;
+
+// Queue num_frames frames under policy, waiting up to wait_ms for room with
+// SPDIF_OVERFLOW_BLOCK. Frames that don't make it are counted in
+// stats->frames_dropped, frames discarded for them in frames_overwritten;
+// where the discard doesn't make room, the block is dropped as well.
+void pcm_ring_write(const pcm_ring_t *ring, spdif_overflow_t policy, uint32_t wait_ms, const void *frames,
+                    size_t num_frames, size_t frame_bytes, spdif_stats_t *stats);
+
+#endif // PCM_RING_H
@@ -0,0 +1,70 @@
+#include "profile.h"
+#include "latency.h"
+#include <string.h>
+
+void profile_init(profile_t *profile)
+{
+    memset(profile, 0, sizeof(*profile));
+    profile->last_now = spdif_profile_now();
+}
+
+void IRAM_ATTR profile_add(profile_t *profile, spdif_profile_stage_t stage, uint32_t ticks)
+{
+    profile_stage_t *s = &profile->stage[stage];
+    uint32_t *bin = &s->histogram[quarter_octave_bucket(ticks, SPDIF_PROFILE_BUCKETS)];
+    __atomic_store_n(bin, *bin + 1, __ATOMIC_RELAXED);
+    if (!s->samples || ticks < s->min)
+    {
+        __atomic_store_n(&s->min, ticks, __ATOMIC_RELAXED);
+    }
+    if (ticks > s->max)
+    {
+        __atomic_store_n(&s->max, ticks, __ATOMIC_RELAXED);
+    }
+    __atomic_store_n(&s->total, s->total + ticks, __ATOMIC_RELAXED);
+    __atomic_store_n(&s->samples, s->samples + 1, __ATOMIC_RELEASE);
+}
+
+void profile_tick(profile_t *profile)
+{
+    uint32_t now = spdif_profile_now();
+    __atomic_store_n(&profile->elapsed, profile->elapsed + (now - profile->last_now), __ATOMIC_RELAXED);
+    profile->last_now = now;
+}
+
+void profile_get(const profile_t *profile, spdif_profile_t *out)
+{
+    memset(out, 0, sizeof(*out));
+    out->clock_hz = SPDIF_PROFILE_CLOCK_HZ;
+    out->elapsed = __atomic_load_n(&profile->elapsed, __ATOMIC_RELAXED);
+    uint64_t busy = 0;
+    for (int i = 0; i < SPDIF_PROFILE_STAGE_COUNT; i++)
+    {
+        const profile_stage_t *s = &profile->stage[i];
+        spdif_profile_stage_stats_t *st = &out->stage[i];
+        st->samples = __atomic_load_n(&s->samples, __ATOMIC_ACQUIRE);
+        if (!st->samples)
+        {
+            continue;
+        }
+        st->min = __atomic_load_n(&s->min, __ATOMIC_RELAXED);
+        st->max = __atomic_load_n(&s->max, __ATOMIC_RELAXED);
+        st->total = __atomic_load_n(&s->total, __ATOMIC_RELAXED);
+        st->mean = (uint32_t)(st->total / st->samples);
+        for (uint32_t b = 0; b < SPDIF_PROFILE_BUCKETS; b++)
+        {
+            st->histogram[b] = __atomic_load_n(&s->histogram[b], __ATOMIC_RELAXED);
+        }
+        st->p50 = quarter_octave_percentile(st->histogram, SPDIF_PROFILE_BUCKETS, st->samples, st->min, st->max, 500);
+        st->p90 = quarter_octave_percentile(st->histogram, SPDIF_PROFILE_BUCKETS, st->samples, st->min, st->max, 900);
+        st->p99 = quarter_octave_percentile(st->histogram, SPDIF_PROFILE_BUCKETS, st->samples, st->min, st->max, 990);
+        if (i == SPDIF_PROFILE_DISCOVERY || i == SPDIF_PROFILE_DECODE || i == SPDIF_PROFILE_TRACKER)
+        {
+            busy += st->total;
+        }
+    }
+    if (out->elapsed)
+    {
+        out->load_permille = (uint32_t)(busy * 1000 / out->elapsed);
+    }
+}
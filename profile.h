@@ -0,0 +1,57 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "spdif_port.h"
+#include "spdif_types.h"
+
+// Hot-path profiler: durations per stage into quarter-octave histograms, in
+// spdif_profile_now() ticks. Platform independent: the driver and the host
+// bench share it. Without CONFIG_SPDIF_IN_PROFILE the PROFILE_ macros
+// compile to nothing.
+
+typedef struct
+{
+    uint32_t samples;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+    uint32_t histogram[SPDIF_PROFILE_BUCKETS];
+} profile_stage_t;
+
+// Each stage has a single writer (the ISR or the decoder task), read from any task
+typedef struct
+{
+    profile_stage_t stage[SPDIF_PROFILE_STAGE_COUNT];
+    uint32_t last_now;
+    uint64_t elapsed;
+} profile_t;
+
+void profile_init(profile_t *profile);
+
+// Record one duration; callable from the ISR
+void profile_add(profile_t *profile, spdif_profile_stage_t stage, uint32_t ticks);
+
+// Advance the elapsed time to now. Call at least once per counter wrap (about
+// 18 s at 240 MHz); the decoder task does on every wake-up.
+void profile_tick(profile_t *profile);
+
+// Snapshot with percentiles and the decoder load; safe to call from any task
+void profile_get(const profile_t *profile, spdif_profile_t *out);
+
+#if CONFIG_SPDIF_IN_PROFILE
+// Time a stage when profile is not NULL
+#define PROFILE_START(profile, var) uint32_t var = (profile) ? spdif_profile_now() : 0
+#define PROFILE_END(profile, stage, var)                                    \
+    do                                                                      \
+    {                                                                       \
+        if (profile)                                                        \
+        {                                                                   \
+            profile_add((profile), (stage), spdif_profile_now() - (var));   \
+        }                                                                   \
+    } while (0)
+#else
+#define PROFILE_START(profile, var)
+#define PROFILE_END(profile, stage, var) ((void)0)
+#endif
+
+#endif // PROFILE_H
@@ -0,0 +1,396 @@
+#include "spdif_asrc.h"
+#include "histogram.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Input frames appended to the history per filter pass
+#define ASRC_IN_CHUNK 64
+
+// Output frames per write to the output sink when it has no buffers of its own
+#define ASRC_OUT_FRAMES 64
+
+// Fewest filter phases kept when a downsampling filter is stretched
+#define ASRC_MIN_PHASES 16
+
+// Per quality: taps and phases at ratio <= 1, cutoff as a fraction of the
+// lower of the two Nyquist rates, and the Kaiser window beta (stopband
+// ~ 8.7 + beta / 0.1102 dB). The transition band is centred on the cutoff, so
+// only content in it can alias, back into the transition band.
+typedef struct
+{
+    uint16_t taps;
+    uint16_t phases;
+    float cutoff;
+    float beta;
+} asrc_profile_t;
+
+static const asrc_profile_t asrc_profiles[SPDIF_ASRC_QUALITY_COUNT] = {
+    [SPDIF_ASRC_QUALITY_LOW] = {16, 64, 0.90f, 5.0f},
+    [SPDIF_ASRC_QUALITY_MEDIUM] = {32, 128, 0.94f, 7.5f},
+    [SPDIF_ASRC_QUALITY_HIGH] = {64, 256, 0.96f, 10.5f},
+};
+
+// Downsampling by up to k needs k times the taps for the same transition
+// band relative to the output; the lower cutoff also makes the phases
+// smoother, so k times fewer of them keep the interpolation error
+static void asrc_filter_size(const asrc_profile_t *profile, uint32_t k, uint32_t *taps, uint32_t *phases)
+{
+    *taps = profile->taps * k;
+    *phases = profile->phases / k;
+    if (*phases < ASRC_MIN_PHASES)
+    {
+        *phases = ASRC_MIN_PHASES;
+    }
+}
+
+static uint32_t asrc_max_stretch(uint32_t output_rate)
+{
+    uint32_t k = (192000 + output_rate - 1) / output_rate;
+    return k < SPDIF_ASRC_MAX_RATIO ? k : SPDIF_ASRC_MAX_RATIO;
+}
+
+// Zeroth-order modified Bessel function of the first kind, for the Kaiser window
+static float bessel_i0(float x)
+{
+    float sum = 1, term = 1;
+    for (int k = 1; k < 32; k++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+        if (term < sum * 1e-8f)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+// Kaiser-windowed sinc with cutoff fc (cycles per input frame) at t input
+// frames from the centre, for a window of half-width half
+static float asrc_prototype(float t, float fc, float half, float beta, float i0_beta)
+{
+    float x = 2 * fc * t;
+    float sinc = fabsf(x) < 1e-6f ? 1 : sinf((float)M_PI * x) / ((float)M_PI * x);
+    float r = t / half;
+    float window = fabsf(r) < 1 ? bessel_i0(beta * sqrtf(1 - r * r)) / i0_beta : 0;
+    return 2 * fc * sinc * window;
+}
+
+// Sample the prototype at every phase. Row p holds the taps for an output at
+// fraction p / phases past input frame i, applied to frames i - taps/2 + 1 ..
+// i + taps/2; row phases is row 0 shifted by one frame, so interpolation
+// never reads past the table. Single precision: this runs on the decoder
+// task when the input rate changes.
+static void asrc_design(spdif_asrc_t *asrc, uint32_t input_rate)
+{
+    const asrc_profile_t *profile = &asrc_profiles[asrc->quality];
+    float ratio = (float)input_rate / asrc->output_rate;
+    uint32_t k = ratio > 1 ? (uint32_t)ceilf(ratio - 1e-4f) : 1;
+    asrc_filter_size(profile, k, &asrc->taps, &asrc->phases);
+
+    float fc = 0.5f * profile->cutoff * (ratio > 1 ? 1 / ratio : 1);
+    float half = asrc->taps / 2.0f;
+    float i0_beta = bessel_i0(profile->beta);
+    for (uint32_t p = 0; p <= asrc->phases; p++)
+    {
+        int32_t *coefs = &asrc->coefs[p * asrc->taps];
+        float phi = (float)p / asrc->phases;
+        double sum = 0;
+        for (uint32_t n = 0; n < asrc->taps; n++)
+        {
+            sum += asrc_prototype(phi + (half - 1) - n, fc, half, profile->beta, i0_beta);
+        }
+        // Unity gain at DC for every phase
+        float scale = (float)((1 << 30) / sum);
+        for (uint32_t n = 0; n < asrc->taps; n++)
+        {
+            coefs[n] = (int32_t)lrintf(asrc_prototype(phi + (half - 1) - n, fc, half, profile->beta, i0_beta) * scale);
+        }
+    }
+    asrc->input_rate = input_rate;
+}
+
+bool spdif_asrc_init(spdif_asrc_t *asrc, spdif_pcm_format_t format, uint32_t output_rate,
+                     spdif_asrc_quality_t quality, const spdif_pcm_sink_t *out)
+{
+    memset(asrc, 0, sizeof(*asrc));
+    if (format >= SPDIF_PCM_FORMAT_COUNT || quality >= SPDIF_ASRC_QUALITY_COUNT ||
+        output_rate == 0 || !out || !out->write)
+    {
+        return false;
+    }
+    asrc->format = format;
+    asrc->quality = quality;
+    asrc->output_rate = output_rate;
+    asrc->output_clock = output_rate;
+    asrc->out = *out;
+
+    // Size for the most stretched filter this output rate can need
+    const asrc_profile_t *profile = &asrc_profiles[quality];
+    uint32_t max_k = asrc_max_stretch(output_rate);
+    size_t table = 0;
+    for (uint32_t k = 1; k <= max_k; k++)
+    {
+        uint32_t taps, phases;
+        asrc_filter_size(profile, k, &taps, &phases);
+        if (taps * (phases + 1) > table)
+        {
+            table = taps * (phases + 1);
+        }
+    }
+    asrc->history_frames = profile->taps * max_k + ASRC_IN_CHUNK;
+    asrc->coefs = malloc(table * sizeof(int32_t));
+    asrc->history = malloc(asrc->history_frames * 2 * sizeof(int32_t));
+    asrc->own_block = malloc(ASRC_OUT_FRAMES * spdif_pcm_frame_bytes(format));
+    if (!asrc->coefs || !asrc->history || !asrc->own_block)
+    {
+        spdif_asrc_deinit(asrc);
+        return false;
+    }
+    asrc->block = asrc->own_block;
+    asrc->block_frames = ASRC_OUT_FRAMES;
+    return true;
+}
+
+void spdif_asrc_deinit(spdif_asrc_t *asrc)
+{
+    free(asrc->coefs);
+    free(asrc->history);
+    free(asrc->own_block);
+    asrc->coefs = NULL;
+    asrc->history = NULL;
+    asrc->own_block = NULL;
+    asrc->input_rate = 0;
+}
+
+void spdif_asrc_reset(spdif_asrc_t *asrc)
+{
+    // Start with taps/2 - 1 frames of silence so the first input frame is the
+    // first output's centre tap
+    uint32_t lead = asrc->taps ? asrc->taps / 2 - 1 : 0;
+    memset(asrc->history, 0, lead * 2 * sizeof(int32_t));
+    asrc->fill = lead;
+    asrc->pos = (uint64_t)lead << 32;
+}
+
+static void asrc_update_step(spdif_asrc_t *asrc)
+{
+    asrc->step = (uint64_t)llround(asrc->input_clock / asrc->output_clock * 4294967296.0);
+}
+
+bool spdif_asrc_set_input_rate(spdif_asrc_t *asrc, double rate)
+{
+    uint32_t nominal = rate > 0 ? nominal_sample_rate((uint32_t)(rate + 0.5)) : 0;
+    if (!nominal || nominal > (uint64_t)asrc->output_rate * asrc_max_stretch(asrc->output_rate))
+    {
+        return false;
+    }
+    if (nominal != asrc->input_rate)
+    {
+        asrc_design(asrc, nominal);
+        spdif_asrc_reset(asrc);
+    }
+    asrc->input_clock = rate;
+    asrc_update_step(asrc);
+    return true;
+}
+
+void spdif_asrc_set_output_rate(spdif_asrc_t *asrc, double rate)
+{
+    if (rate > 0)
+    {
+        asrc->output_clock = rate;
+        if (asrc->input_rate)
+        {
+            asrc_update_step(asrc);
+        }
+    }
+}
+
+// Frame conversion to and from 24-bit samples in int32
+static void load_frame(spdif_pcm_format_t format, const uint8_t *in, int32_t *out)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t frame[2];
+            memcpy(frame, in, sizeof(frame));
+            out[0] = frame[0] * 256;
+            out[1] = frame[1] * 256;
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t frame[2];
+            memcpy(frame, in, sizeof(frame));
+            out[0] = frame[0] >> 8;
+            out[1] = frame[1] >> 8;
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            out[0] = (int32_t)((uint32_t)in[0] << 8 | (uint32_t)in[1] << 16 | (uint32_t)in[2] << 24) >> 8;
+            out[1] = (int32_t)((uint32_t)in[3] << 8 | (uint32_t)in[4] << 16 | (uint32_t)in[5] << 24) >> 8;
+            break;
+        default:
+        {
+            float frame[2];
+            memcpy(frame, in, sizeof(frame));
+            for (int c = 0; c < 2; c++)
+            {
+                float v = frame[c] * 8388608.0f;
+                out[c] = v >= 8388607.0f ? 8388607 : v <= -8388608.0f ? -8388608 : (int32_t)lrintf(v);
+            }
+            break;
+        }
+    }
+}
+
+static inline int32_t clamp24(int64_t v)
+{
+    return v > 8388607 ? 8388607 : v < -8388608 ? -8388608 : (int32_t)v;
+}
+
+static void store_frame(spdif_pcm_format_t format, uint8_t *out, const int32_t *in)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t frame[2];
+            for (int c = 0; c < 2; c++)
+            {
+                int32_t v = (in[c] + 128) >> 8;
+                frame[c] = (int16_t)(v > 32767 ? 32767 : v);
+            }
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t frame[2] = {(int32_t)((uint32_t)in[0] << 8), (int32_t)((uint32_t)in[1] << 8)};
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            for (int i = 0; i < 3; i++)
+            {
+                out[i] = (uint8_t)(in[0] >> (8 * i));
+                out[3 + i] = (uint8_t)(in[1] >> (8 * i));
+            }
+            break;
+        default:
+        {
+            float frame[2] = {in[0] / 8388608.0f, in[1] / 8388608.0f};
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+    }
+}
+
+static void asrc_next_block(spdif_asrc_t *asrc)
+{
+    size_t max_frames = 0;
+    void *buffer = asrc->out.get_buffer ? asrc->out.get_buffer(asrc->out.ctx, &max_frames) : NULL;
+    if (buffer && max_frames)
+    {
+        asrc->block = (uint8_t *)buffer;
+        asrc->block_frames = max_frames;
+    }
+    else
+    {
+        asrc->block = asrc->own_block;
+        asrc->block_frames = ASRC_OUT_FRAMES;
+    }
+}
+
+static void asrc_emit(spdif_asrc_t *asrc)
+{
+    if (asrc->block_fill)
+    {
+        asrc->out.write(asrc->out.ctx, asrc->block, asrc->block_fill);
+        asrc->block_fill = 0;
+        asrc_next_block(asrc);
+    }
+}
+
+// One output frame at pos: the coefficients are interpolated between the two
+// nearest phases, then applied to both channels
+static void asrc_filter(const spdif_asrc_t *asrc, uint64_t pos, int32_t *out)
+{
+    const uint32_t taps = asrc->taps;
+    uint64_t phase_pos = (pos & 0xFFFFFFFFu) * asrc->phases;
+    const int32_t *c0 = &asrc->coefs[(phase_pos >> 32) * taps];
+    const int32_t *c1 = c0 + taps;
+    int32_t frac = (int32_t)((phase_pos >> 16) & 0xFFFF);
+    const int32_t *x = &asrc->history[((pos >> 32) - (taps / 2 - 1)) * 2];
+
+    int64_t left = 0, right = 0;
+    for (uint32_t n = 0; n < taps; n++)
+    {
+        int32_t c = c0[n] + (int32_t)(((int64_t)(c1[n] - c0[n]) * frac) >> 16);
+        left += (int64_t)x[2 * n] * c;
+        right += (int64_t)x[2 * n + 1] * c;
+    }
+    out[0] = clamp24((left + (1 << 29)) >> 30);
+    out[1] = clamp24((right + (1 << 29)) >> 30);
+}
+
+static void asrc_write(void *ctx, const void *frames, size_t num_frames)
+{
+    spdif_asrc_t *asrc = (spdif_asrc_t *)ctx;
+    if (!asrc->input_rate)
+    {
+        asrc->frames_dropped += num_frames;
+        return;
+    }
+
+    const size_t frame_bytes = spdif_pcm_frame_bytes(asrc->format);
+    const uint8_t *in = (const uint8_t *)frames;
+    const uint32_t half = asrc->taps / 2;
+    while (num_frames)
+    {
+        // Append what fits, then produce every output whose taps are all in
+        size_t take = asrc->history_frames - asrc->fill;
+        if (take > num_frames)
+        {
+            take = num_frames;
+        }
+        for (size_t i = 0; i < take; i++)
+        {
+            load_frame(asrc->format, in, &asrc->history[(asrc->fill + i) * 2]);
+            in += frame_bytes;
+        }
+        asrc->fill += take;
+        num_frames -= take;
+
+        while ((asrc->pos >> 32) + half < asrc->fill)
+        {
+            int32_t frame[2];
+            asrc_filter(asrc, asrc->pos, frame);
+            store_frame(asrc->format, &asrc->block[asrc->block_fill * frame_bytes], frame);
+            if (++asrc->block_fill == asrc->block_frames)
+            {
+                asrc_emit(asrc);
+            }
+            asrc->pos += asrc->step;
+        }
+
+        // Drop the frames no future output reaches
+        uint32_t first = (uint32_t)(asrc->pos >> 32) - (half - 1);
+        if (first > asrc->fill)
+        {
+            first = asrc->fill;
+        }
+        memmove(asrc->history, &asrc->history[first * 2], (asrc->fill - first) * 2 * sizeof(int32_t));
+        asrc->fill -= first;
+        asrc->pos -= (uint64_t)first << 32;
+    }
+    asrc_emit(asrc);
+}
+
+spdif_pcm_sink_t spdif_asrc_sink(spdif_asrc_t *asrc)
+{
+    return (spdif_pcm_sink_t){.write = asrc_write, .get_buffer = NULL, .ctx = asrc};
+}
@@ -0,0 +1,1835 @@
+#include "spdif_decoder.h"
+#include "channel_status.h"
+#include "string.h"
+#include <stdlib.h>
+
+static const char *TAG = "spdif_decoder";
+
+// Timing tracker: sample stride in symbols, window length in sampled pulses,
+// unknown-pulse rate and peak shift (1/16 tick) that trigger a relock
+#define TRACK_STRIDE 16
+#define TRACK_WINDOW 1024
+#define TRACK_UNKNOWN_PERMILLE 50
+#define TRACK_PEAK_SHIFT_16THS 8
+
+// Tick counting for clock recovery, usable inside macros
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+#define CLOCK_RECOVERY 1
+#else
+#define CLOCK_RECOVERY 0
+#endif
+
+// Lock check: a window of symbols must bring at least a quarter of the
+// frames the densest signal (48 symbols per frame) would, at any rate.
+// Three windows cover the timing tracker's relock after a rate change.
+#define LOCK_WINDOW_SYMBOLS 16384
+#define LOCK_MIN_FRAMES (LOCK_WINDOW_SYMBOLS / (4 * 48))
+#define LOCK_LOSS_WINDOWS 3
+
+// cs_frame value while waiting for a B preamble
+#define CS_FRAME_UNSYNCED 255
+
+// Subframe sequence (channel): B or M opens a frame with its left subframe,
+// W has to follow once that is complete. Anything else drops the frame in
+// progress, and subframes are discarded until the next B or M.
+#define SEQ_LEFT 0      // Receiving a left subframe
+#define SEQ_WAIT_W 1    // Left subframe stored, W expected
+#define SEQ_RIGHT 2     // Receiving the right subframe of a stored left one
+#define SEQ_WAIT_LEFT 3 // Frame complete, B or M expected
+#define SEQ_UNSYNCED 4  // Waiting for B or M
+
+// Output routing for IEC 61937: plain PCM, data mode between bursts, and the
+// two parts of a burst (Pa/Pb and Pc/Pd, then the payload)
+#define BURST_OFF 0
+#define BURST_SEARCH 1
+#define BURST_HEADER 2
+#define BURST_PAYLOAD 3
+
+// ADAT frame: an 11-cell sync pulse, then 49 groups of a nibble and a
+// separator one: the user bits, and each channel's 24 bits MSB first.
+// Pulse LUT entries are cell counts, 0 for unknown. The decoder takes the
+// groups three at a time: the user group behind two empty ones, then half
+// a channel per take.
+#define ADAT_SYNC_CELLS 11
+#define ADAT_MAX_DATA_CELLS 5
+#define ADAT_FRAME_CELLS 256
+#define ADAT_FRAME_TAKES 17
+#define ADAT_SYNC_BITS 0x21 // Two empty groups: 0000 1 0000 1
+#define ADAT_UNSYNCED 0xFF
+
+// Preamble patterns - both normal and inverted
+#define PREAMBLE_B_0 0xE8
+#define PREAMBLE_B_1 0x17
+#define PREAMBLE_M_0 0xE2
+#define PREAMBLE_M_1 0x1D
+#define PREAMBLE_W_0 0xE4
+#define PREAMBLE_W_1 0x1B
+
+// 1 if the 28 bits after the preamble have odd parity
+FORCE_INLINE_ATTR uint32_t subframe_parity(uint32_t data)
+{
+    data ^= data >> 16;
+    data ^= data >> 8;
+    data ^= data >> 4;
+    data ^= data >> 2;
+    data ^= data >> 1;
+    return data & 1;
+}
+
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+// B preamble at tick count ticks, starting frame index frame: step the clock
+// loop and publish a snapshot
+static void clock_observe(spdif_decoder_t *dec, uint32_t ticks, uint64_t frame)
+{
+    clock_loop_t *loop = &dec->clock_loop;
+    clock_loop_observe(loop, ticks, frame, dec->resolution_hz);
+
+    uint32_t generation = dec->clock_generation + 1;
+    spdif_clock_t *slot = &dec->clock_slots[generation & 1];
+    // As for the channel status: the last publish is visible first
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    clock_loop_rate(loop, dec->resolution_hz, slot);
+    // ticks is the end of the left subframe; the frame started half a frame earlier
+    uint32_t half_frame = loop->observations >= 2 ? (uint32_t)(loop->period / (2 * 192) + 0.5) : 0;
+    slot->frame = frame;
+    slot->ticks = loop->ticks - half_frame;
+    slot->time_us = 0;
+    if (dec->anchor_time_us)
+    {
+        int32_t since_anchor = (int32_t)(ticks - half_frame - dec->anchor_ticks);
+        slot->time_us = dec->anchor_time_us +
+                        (int64_t)since_anchor * 1000000 / dec->resolution_hz;
+    }
+    __atomic_store_n(&dec->clock_generation, generation, __ATOMIC_RELEASE);
+}
+#endif
+
+// Concealment only applies to PCM; in data mode the frames are muted anyway
+static bool conceal_active(const spdif_decoder_t *dec)
+{
+    return dec->conceal != SPDIF_CONCEAL_NONE && dec->burst_state == BURST_OFF && !dec->non_audio;
+}
+
+// Subframe out of sequence: the frame in progress is lost
+static void sequence_error(spdif_decoder_t *dec)
+{
+    spdif_stat_add(&dec->stats.sync_errors, 1);
+    if (conceal_active(dec) && dec->conceal_pending < SPDIF_CONCEAL_MAX_FRAMES)
+    {
+        dec->conceal_pending++;
+    }
+}
+
+// A preamble out of order or matching no pattern: drop the frame and wait for B or M
+static uint32_t sequence_lost(spdif_decoder_t *dec, uint32_t channel)
+{
+    if (channel != SEQ_UNSYNCED)
+    {
+        sequence_error(dec);
+    }
+    return SEQ_UNSYNCED;
+}
+
+// B or M preamble: a new frame starts, whether or not the last one was complete
+FORCE_INLINE_ATTR uint32_t sequence_left(spdif_decoder_t *dec, uint32_t channel)
+{
+    if (__builtin_expect(channel < SEQ_WAIT_LEFT, 0))
+    {
+        sequence_error(dec);
+    }
+    return SEQ_LEFT;
+}
+
+// W preamble: only valid right after a complete left subframe
+FORCE_INLINE_ATTR uint32_t sequence_right(spdif_decoder_t *dec, uint32_t channel)
+{
+    if (__builtin_expect(channel == SEQ_WAIT_W, 1))
+    {
+        return SEQ_RIGHT;
+    }
+    return sequence_lost(dec, channel);
+}
+
+// B preamble starting output frame index frame: check it against the last
+// one. Frames the sequence check missed, e.g. whole frames in a lost chunk,
+// show up as a short block (or a block and a bit, if the gap took a B
+// preamble along) and are concealed if there are few enough.
+// Returns the frame's index once those are counted in.
+static uint64_t block_check(spdif_decoder_t *dec, uint64_t frame)
+{
+    uint64_t last = dec->last_b_frame;
+    if (last != UINT64_MAX && frame - last != 192)
+    {
+        spdif_stat_add(&dec->stats.block_errors, 1);
+        uint64_t missing = (192 - (frame - last) % 192) % 192;
+        if (conceal_active(dec) && dec->conceal_pending + missing <= SPDIF_CONCEAL_MAX_FRAMES)
+        {
+            dec->conceal_pending += (uint32_t)missing;
+            frame += missing;
+        }
+    }
+    dec->last_b_frame = frame;
+    return frame;
+}
+
+// Collect the C and U bits of channel A; publish the block when the next B arrives
+static void track_status_bits(spdif_decoder_t *dec, uint32_t subframe_data, uint32_t block_start,
+                              uint32_t ticks, size_t block_fill)
+{
+    if (block_start)
+    {
+        // Concealed frames still to come go before this one
+        uint64_t frame = block_check(dec, dec->frames_out + block_fill + dec->conceal_pending);
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+        clock_observe(dec, ticks, frame);
+#else
+        (void)frame;
+#endif
+        if (dec->cs_frame == 192)
+        {
+            uint32_t generation = dec->cs_generation + 1;
+            spdif_channel_status_t *slot = &dec->cs_slots[generation & 1];
+            // The last publish is visible before this slot changes, so a
+            // reader that copied it sees the generation move and retries
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            memcpy(slot->raw, dec->cs_bits, sizeof(slot->raw));
+            memcpy(slot->user_data, dec->user_bits, sizeof(slot->user_data));
+            channel_status_parse(slot);
+            dec->non_audio = slot->non_audio;
+            __atomic_store_n(&dec->cs_generation, generation, __ATOMIC_RELEASE);
+        }
+        dec->cs_frame = 0;
+        memset(dec->cs_bits, 0, sizeof(dec->cs_bits));
+        memset(dec->user_bits, 0, sizeof(dec->user_bits));
+    }
+
+    uint32_t frame = dec->cs_frame;
+    if (frame < 192)
+    {
+        dec->cs_bits[frame >> 3] |= ((subframe_data >> 26) & 1) << (frame & 7);
+        dec->user_bits[frame >> 3] |= ((subframe_data >> 25) & 1) << (frame & 7);
+        dec->cs_frame = frame + 1;
+    }
+    else
+    {
+        dec->cs_frame = CS_FRAME_UNSYNCED; // Lost block alignment, wait for the next B
+    }
+}
+
+// Pick the buffer the next frames go into: the sink's, or our own block,
+// which holds a quarter as many ADAT frames
+static void next_block(spdif_decoder_t *dec)
+{
+    size_t max_frames = 0;
+    void *buffer = dec->sink.get_buffer ? dec->sink.get_buffer(dec->sink.ctx, &max_frames) : NULL;
+    if (buffer && max_frames)
+    {
+        dec->pcm_block = (uint8_t *)buffer;
+        dec->block_frames = max_frames;
+    }
+    else
+    {
+        size_t own_frames = dec->own_block_frames * 2 / dec->channels;
+        dec->pcm_block = dec->own_block;
+        dec->block_frames = own_frames ? own_frames : 1;
+    }
+}
+
+// Commit frames of the current block to the sink
+static void write_block(spdif_decoder_t *dec, size_t num_frames)
+{
+    spdif_stat_add(&dec->stats.frames_decoded, num_frames);
+    dec->frames_out += num_frames;
+    dec->sink.write(dec->sink.ctx, dec->pcm_block, num_frames);
+}
+
+// Silence in place of frames that carried data; keeps the sink's frame
+// count, and so the clock's frame indices, in step with the input
+static void write_silence(spdif_decoder_t *dec, size_t num_frames)
+{
+    const size_t frame_bytes = spdif_pcm_frame_bytes(dec->format);
+    while (num_frames)
+    {
+        size_t max_frames = 0;
+        uint8_t *block = dec->sink.get_buffer ? (uint8_t *)dec->sink.get_buffer(dec->sink.ctx, &max_frames) : NULL;
+        if (!block || !max_frames)
+        {
+            block = dec->own_block;
+            max_frames = dec->own_block_frames;
+        }
+        size_t n = num_frames < max_frames ? num_frames : max_frames;
+        memset(block, 0, n * frame_bytes);
+        spdif_stat_add(&dec->stats.frames_decoded, n);
+        dec->frames_out += n;
+        dec->sink.write(dec->sink.ctx, block, n);
+        num_frames -= n;
+    }
+}
+
+// Between bursts: frames go to own_block as scratch
+static void burst_search(spdif_decoder_t *dec)
+{
+    dec->burst_state = BURST_SEARCH;
+    dec->pcm_block = dec->own_block;
+    dec->block_frames = dec->own_block_frames;
+}
+
+// Out of data mode: frames are PCM again
+static void burst_stop(spdif_decoder_t *dec)
+{
+    dec->burst_state = BURST_OFF;
+    dec->idle_frames = 0;
+    next_block(dec);
+}
+
+// A full block outside plain PCM mode
+static void deliver_data(spdif_decoder_t *dec, size_t num_frames)
+{
+    const size_t frame_bytes = spdif_pcm_frame_bytes(dec->format);
+    switch (dec->burst_state)
+    {
+        case BURST_OFF:
+            // Channel status turned to data: mute from this block on
+            memset(dec->pcm_block, 0, num_frames * frame_bytes);
+            write_block(dec, num_frames);
+            dec->idle_frames = 0;
+            burst_search(dec);
+            break;
+
+        case BURST_SEARCH:
+            write_silence(dec, num_frames);
+            dec->idle_frames += num_frames;
+            if (dec->idle_frames > 2 * IEC61937_MAX_BURST_FRAMES && !dec->non_audio)
+            {
+                burst_stop(dec);
+            }
+            else
+            {
+                burst_search(dec);
+            }
+            break;
+
+        case BURST_HEADER:
+        {
+            // Pa/Pb and Pc/Pd are in: size the rest of the burst
+            dec->burst.frames = dec->burst_buffer;
+            size_t total = iec61937_parse_header(&dec->burst, spdif_burst_word(&dec->burst, 2),
+                                                 spdif_burst_word(&dec->burst, 3));
+            if (!total || total > dec->burst_capacity || dec->burst_buffer == dec->own_block)
+            {
+                spdif_stat_add(&dec->stats.bursts_dropped, 1);
+                write_silence(dec, num_frames);
+                if (!total && dec->last_burst_frame == UINT64_MAX && !dec->non_audio)
+                {
+                    // Not a burst after all: PCM that happened to match Pa/Pb
+                    burst_stop(dec);
+                }
+                else
+                {
+                    burst_search(dec);
+                }
+                break;
+            }
+            dec->burst.num_frames = total;
+            dec->burst_state = BURST_PAYLOAD;
+            dec->pcm_block = dec->burst_buffer + num_frames * frame_bytes;
+            dec->block_frames = total - num_frames;
+            if (dec->block_frames)
+            {
+                break;
+            }
+            // A burst without payload is complete
+            __attribute__((fallthrough));
+        }
+        case BURST_PAYLOAD:
+        default:
+            dec->burst.period = dec->last_burst_frame == UINT64_MAX ? 0 : (uint32_t)(dec->burst.frame - dec->last_burst_frame);
+            dec->last_burst_frame = dec->burst.frame;
+            dec->burst_sink.write(dec->burst_sink.ctx, &dec->burst);
+            spdif_stat_add(&dec->stats.data_bursts, 1);
+            write_silence(dec, dec->burst.num_frames);
+            dec->idle_frames = 0;
+            burst_search(dec);
+            break;
+    }
+}
+
+// Hand the filled part of the current block to the sink
+static void deliver_block(spdif_decoder_t *dec, size_t num_frames)
+{
+    if (dec->burst_state != BURST_OFF || dec->non_audio)
+    {
+        deliver_data(dec, num_frames);
+        return;
+    }
+    write_block(dec, num_frames);
+    next_block(dec);
+}
+
+// Pa/Pb in the frame about to be stored at index fill of the current block:
+// close what came before and receive the burst into a buffer of the consumer
+static void burst_sync(spdif_decoder_t *dec, size_t fill)
+{
+    const size_t frame_bytes = spdif_pcm_frame_bytes(dec->format);
+    switch (dec->burst_state)
+    {
+        case BURST_OFF:
+            if (fill)
+            {
+                if (dec->non_audio)
+                {
+                    memset(dec->pcm_block, 0, fill * frame_bytes);
+                }
+                write_block(dec, fill);
+            }
+            break;
+        case BURST_SEARCH:
+            write_silence(dec, fill);
+            break;
+        default:
+            // The previous burst was cut short
+            spdif_stat_add(&dec->stats.bursts_dropped, 1);
+            write_silence(dec, (dec->pcm_block - dec->burst_buffer) / frame_bytes + fill);
+            break;
+    }
+
+    size_t max_frames = 0;
+    void *buffer = dec->burst_sink.get_buffer ? dec->burst_sink.get_buffer(dec->burst_sink.ctx, &max_frames) : NULL;
+    if (buffer && max_frames >= 2)
+    {
+        dec->burst_buffer = (uint8_t *)buffer;
+        dec->burst_capacity = max_frames;
+    }
+    else
+    {
+        // Nowhere to put it: read the header into scratch and drop the burst
+        dec->burst_buffer = dec->own_block;
+        dec->burst_capacity = dec->own_block_frames;
+    }
+    memset(&dec->burst, 0, sizeof(dec->burst));
+    dec->burst.format = dec->format;
+    dec->burst.frame = dec->frames_out;
+    dec->burst_state = BURST_HEADER;
+    dec->pcm_block = dec->burst_buffer;
+    dec->block_frames = 2;
+}
+
+// Write one stereo frame; format is a compile-time constant at every call site
+FORCE_INLINE_ATTR void store_frame(spdif_pcm_format_t format, uint8_t *out, uint32_t left, uint32_t right)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t frame[2] = {(int16_t)(left >> 16), (int16_t)(right >> 16)};
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t frame[2] = {(int32_t)left, (int32_t)right};
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            out[0] = left >> 8;
+            out[1] = left >> 16;
+            out[2] = left >> 24;
+            out[3] = right >> 8;
+            out[4] = right >> 16;
+            out[5] = right >> 24;
+            break;
+        case SPDIF_PCM_FORMAT_F32:
+        default:
+        {
+            float frame[2] = {(int32_t)left * (1.0f / 2147483648.0f),
+                              (int32_t)right * (1.0f / 2147483648.0f)};
+            memcpy(out, frame, sizeof(frame));
+            break;
+        }
+    }
+}
+
+// Stand-ins for lost frames ahead of the frame (left, right), per dec->conceal
+static void conceal_frames(spdif_decoder_t *dec, uint32_t left, uint32_t right)
+{
+    uint32_t n = dec->conceal_pending;
+    dec->conceal_pending = 0;
+    if (!conceal_active(dec))
+    {
+        return;
+    }
+    const size_t frame_bytes = spdif_pcm_frame_bytes(dec->format);
+    int32_t from[2] = {(int32_t)dec->last_left >> 8, (int32_t)dec->last_right >> 8};
+    int32_t to[2] = {(int32_t)left >> 8, (int32_t)right >> 8};
+    for (uint32_t i = 1; i <= n; i++)
+    {
+        uint32_t word[2];
+        for (int ch = 0; ch < 2; ch++)
+        {
+            int32_t sample = from[ch];
+            if (dec->conceal == SPDIF_CONCEAL_INTERPOLATE)
+            {
+                sample += (int32_t)((int64_t)(to[ch] - from[ch]) * i / (n + 1));
+            }
+            word[ch] = (uint32_t)sample << 8;
+        }
+        store_frame(dec->format, dec->pcm_block + dec->block_fill * frame_bytes, word[0], word[1]);
+        if (++dec->block_fill == dec->block_frames)
+        {
+            deliver_block(dec, dec->block_fill);
+            dec->block_fill = 0;
+        }
+    }
+    spdif_stat_add(&dec->stats.frames_concealed, n);
+}
+
+// Subframe complete: check parity, collect status bits and emit a stereo frame
+// once the right channel of the same frame arrives. Subframes out of sequence
+// are dropped. Expects the decode loop's locals.
+#define EMIT_SUBFRAME(block_start)                                                   \
+    {                                                                                \
+        /* Time slots 4-31 carry even parity; V is slot 28 */                        \
+        parity_errors += subframe_parity(subframe_data);                             \
+        invalid_subframes += (subframe_data >> 24) & 1;                              \
+                                                                                     \
+        /* Left-justify the 24-bit audio field */                                    \
+        uint32_t word = subframe_data << 8;                                          \
+                                                                                     \
+        if (channel == SEQ_LEFT)                                                     \
+        {                                                                            \
+            left_word = word;                                                        \
+            track_status_bits(dec, subframe_data, block_start, ticks, block_fill);   \
+            channel = SEQ_WAIT_W;                                                    \
+        }                                                                            \
+        else if (channel == SEQ_RIGHT)                                               \
+        {                                                                            \
+            channel = SEQ_WAIT_LEFT;                                                 \
+            if (__builtin_expect(dec->conceal_pending != 0, 0))                      \
+            {                                                                        \
+                dec->block_fill = block_fill;                                        \
+                dec->last_left = last_left;                                          \
+                dec->last_right = last_right;                                        \
+                conceal_frames(dec, left_word, word);                                \
+                pcm_block = dec->pcm_block;                                          \
+                block_frames = dec->block_frames;                                    \
+                block_fill = dec->block_fill;                                        \
+            }                                                                        \
+            last_left = left_word;                                                   \
+            last_right = word;                                                       \
+                                                                                     \
+            /* IEC 61937 burst start: one compare per frame on the PCM path */       \
+            if (__builtin_expect((left_word >> 16) == IEC61937_PA, 0) &&             \
+                (word >> 16) == IEC61937_PB)                                         \
+            {                                                                        \
+                burst_sync(dec, block_fill);                                         \
+                pcm_block = dec->pcm_block;                                          \
+                block_frames = dec->block_frames;                                    \
+                block_fill = 0;                                                      \
+            }                                                                        \
+            store_frame(format, pcm_block + block_fill * frame_bytes, left_word, word); \
+            if (++block_fill == block_frames)                                        \
+            {                                                                        \
+                deliver_block(dec, block_fill);                                      \
+                pcm_block = dec->pcm_block;                                          \
+                block_frames = dec->block_frames;                                    \
+                block_fill = 0;                                                      \
+            }                                                                        \
+        }                                                                            \
+    }
+
+// Transition table decoder. Both pulses of an RMT symbol are classified with
+// pulse_lut and looked up together: dfa_table[state + (class0 << 2 | class1)].
+// The table is generated by running the reference decoder's per-pulse logic
+// over every reachable state, so the two decoders produce identical output.
+//
+// Entry layout:
+//   bits 0-10   next state, pre-multiplied by 16
+//   bits 11-12  number of data bits emitted (0-2)
+//   bit  13     subframe complete after this symbol
+//   bits 14-15  preamble recognised: 0 none/invalid, 1 B, 2 M, 3 W
+//   bits 16-17  unknown pulses in this symbol (0-2)
+//   bit  18     preamble run matched no valid pattern
+//   bits 30-31  emitted data bits, pre-positioned for the shift register
+#define DFA_MAX_STATES 80 // 72 reachable
+#define DFA_NEXT_MASK 0x7FF
+#define DFA_NBITS_SHIFT 11
+#define DFA_COMPLETE (1UL << 13)
+#define DFA_PREAMBLE_SHIFT 14
+#define DFA_UNKNOWN_SHIFT 16
+#define DFA_BAD_PREAMBLE (1UL << 18)
+#define DFA_EVENTS (DFA_COMPLETE | (3UL << DFA_PREAMBLE_SHIFT) | (3UL << DFA_UNKNOWN_SHIFT) | DFA_BAD_PREAMBLE)
+#define DFA_BITS_MASK 0xC0000000UL
+
+#define DFA_PREAMBLE_NONE 0
+#define DFA_PREAMBLE_B 1
+#define DFA_PREAMBLE_M 2
+#define DFA_PREAMBLE_W 3
+
+// Shared by all decoder instances. Decoders initialized concurrently before
+// the first build has been published each build it; they write identical
+// entries, and a decoder only reads the table after its own build or the
+// published one.
+static uint32_t dfa_table[DFA_MAX_STATES * 16];
+static bool dfa_ready = false;
+
+// Reference decoder state minus the data bits and the absolute line level.
+// Preamble identity does not depend on the level since every valid pattern's
+// complement is the same preamble, so the level starts at 1 in the preamble.
+typedef struct
+{
+    uint8_t in_preamble;
+    uint8_t level;
+    uint8_t pindex;
+    uint8_t pattern;
+    uint8_t expecting_short;
+    uint8_t bit_count;
+} dfa_sim_state_t;
+
+// One pulse of the reference decoder; *bit is -1 when no data bit completes.
+// *preamble is DFA_PREAMBLE_NONE, or -1 for a run matching no preamble.
+static void dfa_sim_step(dfa_sim_state_t *s, uint32_t ptype, int *bit, bool *complete, int *preamble)
+{
+    *bit = -1;
+    *complete = false;
+    *preamble = DFA_PREAMBLE_NONE;
+    if (ptype >= 3)
+    {
+        return;
+    }
+
+    if (s->in_preamble)
+    {
+        s->level ^= 1;
+        for (uint32_t j = 0; j < ptype + 1 && s->pindex < 8; j++)
+        {
+            if (s->level)
+                s->pattern |= (1 << (7 - s->pindex));
+            s->pindex++;
+        }
+        if (s->pindex >= 8)
+        {
+            if (s->pattern == PREAMBLE_B_0 || s->pattern == PREAMBLE_B_1)
+                *preamble = DFA_PREAMBLE_B;
+            else if (s->pattern == PREAMBLE_M_0 || s->pattern == PREAMBLE_M_1)
+                *preamble = DFA_PREAMBLE_M;
+            else if (s->pattern == PREAMBLE_W_0 || s->pattern == PREAMBLE_W_1)
+                *preamble = DFA_PREAMBLE_W;
+            else
+                *preamble = -1;
+            s->in_preamble = 0;
+            s->level = 0;
+            s->pindex = 0;
+            s->pattern = 0;
+        }
+    }
+    else if (ptype == 2 && !s->expecting_short)
+    {
+        s->in_preamble = 1;
+        s->level = 1;
+        s->pattern = 0xE0;
+        s->pindex = 3;
+        s->bit_count = 0;
+        s->expecting_short = 0;
+    }
+    else if (s->bit_count < 28)
+    {
+        if (s->expecting_short)
+        {
+            *bit = (ptype == 0);
+            s->bit_count++;
+            s->expecting_short = 0;
+        }
+        else if (ptype == 1)
+        {
+            *bit = 0;
+            s->bit_count++;
+        }
+        else if (ptype == 0)
+        {
+            s->expecting_short = 1;
+        }
+        *complete = (s->bit_count == 28);
+    }
+}
+
+static int dfa_state_index(dfa_sim_state_t *states, uint32_t *num_states, const dfa_sim_state_t *s)
+{
+    for (uint32_t i = 0; i < *num_states; i++)
+    {
+        if (!memcmp(&states[i], s, sizeof(*s)))
+        {
+            return i;
+        }
+    }
+    if (*num_states == DFA_MAX_STATES)
+    {
+        return -1;
+    }
+    states[*num_states] = *s;
+    return (*num_states)++;
+}
+
+// Build the shared transition table from the initial state by breadth-first search
+static bool dfa_build(void)
+{
+    static dfa_sim_state_t states[DFA_MAX_STATES];
+    uint32_t num_states = 0;
+    dfa_sim_state_t initial = {0};
+    dfa_state_index(states, &num_states, &initial);
+
+    for (uint32_t i = 0; i < num_states; i++)
+    {
+        for (uint32_t cls = 0; cls < 16; cls++)
+        {
+            dfa_sim_state_t s = states[i];
+            uint32_t nbits = 0;
+            uint32_t bits = 0;
+            uint32_t entry = 0;
+            for (uint32_t half = 0; half < 2; half++)
+            {
+                int bit;
+                bool complete;
+                int preamble;
+                uint32_t ptype = half ? (cls & 3) : (cls >> 2);
+                dfa_sim_step(&s, ptype, &bit, &complete, &preamble);
+                if (ptype == 3)
+                {
+                    entry += 1UL << DFA_UNKNOWN_SHIFT;
+                }
+                if (bit >= 0)
+                {
+                    // Data after a completed subframe would corrupt it in the shift register
+                    if (entry & DFA_COMPLETE)
+                    {
+                        return false;
+                    }
+                    bits |= (uint32_t)bit << nbits;
+                    nbits++;
+                }
+                if (complete)
+                {
+                    entry |= DFA_COMPLETE;
+                }
+                if (preamble < 0)
+                {
+                    entry |= DFA_BAD_PREAMBLE;
+                }
+                else if (preamble)
+                {
+                    entry |= (uint32_t)preamble << DFA_PREAMBLE_SHIFT;
+                }
+            }
+            int next = dfa_state_index(states, &num_states, &s);
+            if (next < 0)
+            {
+                return false;
+            }
+            entry |= (uint32_t)next * 16;
+            entry |= nbits << DFA_NBITS_SHIFT;
+            if (nbits)
+            {
+                entry |= (bits << (32 - nbits)) & DFA_BITS_MASK;
+            }
+            dfa_table[i * 16 + cls] = entry;
+        }
+    }
+    return true;
+}
+
+// LUT index for a 15-bit duration: scaled to the LUT range, with anything
+// beyond it landing on the last entry, which is always UNKNOWN
+FORCE_INLINE_ATTR uint32_t lut_index(uint32_t dur, uint32_t shift)
+{
+    dur >>= shift;
+    return dur < 255 ? dur : 255;
+}
+
+// Initialize thresholds and build LUT
+void decoder_init_thresholds(spdif_decoder_t *dec)
+{
+    const spdif_timing_t *timing = dec->timing;
+    uint8_t *pulse_lut = (dec->pulse_lut == dec->lut_buffers[0]) ? dec->lut_buffers[1] : dec->lut_buffers[0];
+
+    // Only very high RMT resolutions need more than 255 ticks; those are
+    // classified in 2^shift tick steps, at the step centre
+    uint32_t shift = 0;
+    while (((timing->max_pulse_threshold / 16) >> shift) >= 255)
+    {
+        shift++;
+    }
+
+    const bool adat = timing->protocol == SPDIF_PROTOCOL_ADAT;
+    for (uint32_t i = 0; i < 256; i++)
+    {
+        uint32_t x16 = ((i << shift) << 4) + ((1u << shift) - 1) * 8;
+        if (adat)
+        {
+            // Nearest whole number of cells, if a pulse can be that long
+            uint32_t cells = (x16 + timing->cell_x16 / 2) / timing->cell_x16;
+            bool valid = i != 255 && x16 >= timing->min_pulse_threshold && x16 <= timing->max_pulse_threshold &&
+                         (cells <= ADAT_MAX_DATA_CELLS || cells == ADAT_SYNC_CELLS);
+            pulse_lut[i] = valid ? cells : 0;
+        }
+        else if (i == 255 || x16 < timing->min_pulse_threshold || x16 > timing->max_pulse_threshold)
+        {
+            pulse_lut[i] = 3; // UNKNOWN
+        }
+        else if (x16 < timing->short_medium_threshold)
+        {
+            pulse_lut[i] = 0; // SHORT
+        }
+        else if (x16 < timing->medium_long_threshold)
+        {
+            pulse_lut[i] = 1; // MEDIUM
+        }
+        else
+        {
+            pulse_lut[i] = 2; // LONG
+        }
+    }
+    dec->lut_shift = shift;
+    dec->pulse_lut = pulse_lut;
+    dec->lut_ready = true;
+    memset(dec->tracker.ref_mean, 0, sizeof(dec->tracker.ref_mean));
+
+    // The frame size follows the protocol; a block taken at the old size is abandoned
+    dec->adat_sync_offset = adat ? (ADAT_FRAME_CELLS / 2 - ADAT_SYNC_CELLS) * timing->cell_x16 / 16 : 0;
+    uint32_t channels = adat ? SPDIF_ADAT_CHANNELS : 2;
+    if (channels != dec->channels)
+    {
+        spdif_decoder_flush(dec);
+        __atomic_store_n(&dec->channels, channels, __ATOMIC_RELAXED);
+        next_block(dec);
+    }
+    __atomic_store_n(&dec->timing_rate, timing_sample_rate(timing, dec->resolution_hz), __ATOMIC_RELAXED);
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+    // New timing: restart the clock loop, and wait for a fresh time anchor
+    // since ticks were not counted before the first lock
+    clock_loop_reset(&dec->clock_loop);
+    dec->anchor_time_us = 0;
+#endif
+}
+
+// Hand the current timing to the store
+static void save_timing(spdif_decoder_t *dec)
+{
+    if (dec->timing_store.save)
+    {
+        spdif_timing_cache_t cache;
+        save_cached_timing(dec->timing, dec->resolution_hz, &cache);
+        dec->timing_store.save(dec->timing_store.ctx, &cache);
+    }
+}
+
+static void tracker_reset_window(spdif_timing_tracker_t *tracker)
+{
+    tracker->window_pulses = 0;
+    memset(tracker->class_sum, 0, sizeof(tracker->class_sum));
+    memset(tracker->class_count, 0, sizeof(tracker->class_count));
+}
+
+FORCE_INLINE_ATTR void tracker_sample(spdif_timing_tracker_t *tracker, const uint8_t *pulse_lut, uint32_t shift,
+                                      uint32_t dur)
+{
+    uint32_t ptype = pulse_lut[lut_index(dur, shift)];
+    if (tracker->collecting)
+    {
+        histogram_add(&tracker->candidate, dur);
+    }
+    tracker->window_pulses++;
+    tracker->class_sum[ptype] += dur;
+    tracker->class_count[ptype]++;
+}
+
+// Analyze the tracker histogram and swap in a new LUT if the timing changed
+static void tracker_relock(spdif_decoder_t *dec)
+{
+    spdif_timing_tracker_t *tracker = &dec->tracker;
+    spdif_timing_t *candidate = &tracker->candidate;
+    spdif_timing_t *timing = dec->timing;
+
+    candidate->timing_discovered = false;
+    analyze_pulse_timing(candidate);
+    if (!candidate->timing_discovered)
+    {
+        return;
+    }
+    tracker->collecting = false;
+    histogram_release(candidate);
+
+    if (abs((int)candidate->short_pulse_x16 - (int)timing->short_pulse_x16) > TRACK_PEAK_SHIFT_16THS ||
+        abs((int)candidate->medium_pulse_x16 - (int)timing->medium_pulse_x16) > TRACK_PEAK_SHIFT_16THS ||
+        abs((int)candidate->long_pulse_x16 - (int)timing->long_pulse_x16) > TRACK_PEAK_SHIFT_16THS)
+    {
+        ESP_LOGI(TAG, "Timing changed: %u/%u/%u -> %u/%u/%u ticks",
+                 (unsigned)timing->short_pulse_ticks, (unsigned)timing->medium_pulse_ticks,
+                 (unsigned)timing->long_pulse_ticks, (unsigned)candidate->short_pulse_ticks,
+                 (unsigned)candidate->medium_pulse_ticks, (unsigned)candidate->long_pulse_ticks);
+        timing->base_unit_ticks = candidate->base_unit_ticks;
+        timing->short_pulse_ticks = candidate->short_pulse_ticks;
+        timing->medium_pulse_ticks = candidate->medium_pulse_ticks;
+        timing->long_pulse_ticks = candidate->long_pulse_ticks;
+        timing->short_pulse_x16 = candidate->short_pulse_x16;
+        timing->medium_pulse_x16 = candidate->medium_pulse_x16;
+        timing->long_pulse_x16 = candidate->long_pulse_x16;
+        timing->min_pulse_threshold = candidate->min_pulse_threshold;
+        timing->short_medium_threshold = candidate->short_medium_threshold;
+        timing->medium_long_threshold = candidate->medium_long_threshold;
+        timing->max_pulse_threshold = candidate->max_pulse_threshold;
+        timing->last_validation = candidate->last_validation;
+        decoder_init_thresholds(dec);
+        spdif_stat_add(&dec->stats.relocks, 1);
+        dec->save_pending = true;
+    }
+    memset(tracker->ref_mean, 0, sizeof(tracker->ref_mean));
+}
+
+// Window complete: check the unknown rate and peak positions
+static void tracker_end_window(spdif_decoder_t *dec)
+{
+    spdif_timing_tracker_t *tracker = &dec->tracker;
+    spdif_timing_t *candidate = &tracker->candidate;
+
+    if (tracker->collecting)
+    {
+        // Histogram holds only pulses seen since the trigger
+        tracker_relock(dec);
+        tracker_reset_window(tracker);
+        return;
+    }
+
+    bool triggered = tracker->class_count[3] * 1000 > tracker->window_pulses * TRACK_UNKNOWN_PERMILLE;
+    for (int c = 0; c < 3; c++)
+    {
+        if (tracker->class_count[c] < 16)
+        {
+            continue;
+        }
+        uint32_t mean = tracker->class_sum[c] * 16 / tracker->class_count[c];
+        if (!tracker->ref_mean[c])
+        {
+            tracker->ref_mean[c] = mean;
+        }
+        else if (abs((int)mean - (int)tracker->ref_mean[c]) > TRACK_PEAK_SHIFT_16THS)
+        {
+            triggered = true;
+        }
+    }
+
+    if (triggered && histogram_acquire(candidate))
+    {
+        // Analyze a fresh window so pulses at the old timing don't compete
+        reset_pulse_histogram(candidate);
+        tracker->collecting = true;
+    }
+    tracker_reset_window(tracker);
+}
+
+// Sample a subset of the chunk; runs between chunks on the decoder task
+static void track_timing(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    spdif_timing_tracker_t *tracker = &dec->tracker;
+    const uint8_t *pulse_lut = dec->pulse_lut;
+    uint32_t shift = dec->lut_shift;
+
+    for (size_t i = 0; i < num_symbols; i += TRACK_STRIDE)
+    {
+        tracker_sample(tracker, pulse_lut, shift, symbols[i].duration0);
+        tracker_sample(tracker, pulse_lut, shift, symbols[i].duration1);
+        if (tracker->window_pulses >= TRACK_WINDOW)
+        {
+            tracker_end_window(dec);
+            pulse_lut = dec->pulse_lut;
+            shift = dec->lut_shift;
+        }
+    }
+}
+
+void spdif_decoder_init(spdif_decoder_t *dec, spdif_timing_t *timing,
+                        spdif_pcm_format_t format, void *pcm_block, size_t block_frames,
+                        spdif_pcm_flush_cb_t flush_cb, void *flush_ctx)
+{
+    if (!__atomic_load_n(&dfa_ready, __ATOMIC_ACQUIRE))
+    {
+        bool built = dfa_build();
+        __atomic_store_n(&dfa_ready, built, __ATOMIC_RELEASE);
+        if (!built)
+        {
+            ESP_LOGE(TAG, "Transition table exceeds %d states", DFA_MAX_STATES);
+        }
+    }
+
+    memset(dec, 0, sizeof(*dec));
+    dec->timing = timing;
+    dec->format = format;
+    dec->own_block = (uint8_t *)pcm_block;
+    dec->own_block_frames = block_frames;
+    dec->pcm_block = dec->own_block;
+    dec->block_frames = block_frames;
+    dec->sink.write = flush_cb;
+    dec->sink.ctx = flush_ctx;
+    dec->cs_frame = CS_FRAME_UNSYNCED;
+    dec->channel = SEQ_UNSYNCED;
+    dec->last_b_frame = UINT64_MAX;
+    dec->pulse_lut = dec->lut_buffers[0];
+    dec->last_burst_frame = UINT64_MAX;
+    dec->channels = 2;
+    dec->adat_take = ADAT_UNSYNCED;
+    dec->resolution_hz = CONFIG_SPDIF_IN_RMT_RESOLUTION_HZ;
+#if CONFIG_SPDIF_IN_TIMING_TRACKING
+    dec->tracker.enabled = true;
+#endif
+}
+
+void spdif_decoder_deinit(spdif_decoder_t *dec)
+{
+    histogram_release(dec->timing);
+    histogram_release(&dec->tracker.candidate);
+}
+
+void spdif_decoder_reset(spdif_decoder_t *dec)
+{
+    dec->state = 0;
+    dec->bit_count = 0;
+    dec->subframe_data = 0;
+    dec->preamble_data = 0;
+    dec->dfa_state = 0;
+    dec->shift_reg = 0;
+    dec->block_start = 0;
+    dec->channel = SEQ_UNSYNCED;
+    dec->left_word = 0;
+    dec->conceal_pending = 0;
+    dec->last_b_frame = UINT64_MAX;
+    dec->block_fill = 0;
+    dec->cs_frame = CS_FRAME_UNSYNCED;
+    dec->non_audio = false;
+    dec->last_burst_frame = UINT64_MAX;
+    dec->adat_bits = 0;
+    dec->adat_nbits = 0;
+    dec->adat_take = ADAT_UNSYNCED;
+    dec->adat_syncs = 0;
+    if (dec->burst_state != BURST_OFF)
+    {
+        burst_stop(dec);
+    }
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+    clock_loop_reset(&dec->clock_loop);
+    dec->anchor_time_us = 0;
+#endif
+}
+
+void spdif_decoder_set_burst_sink(spdif_decoder_t *dec, const spdif_burst_sink_t *sink)
+{
+    dec->burst_sink = *sink;
+}
+
+void spdif_decoder_set_concealment(spdif_decoder_t *dec, spdif_conceal_t mode)
+{
+    dec->conceal = mode;
+    dec->conceal_pending = 0;
+}
+
+void spdif_decoder_set_resolution(spdif_decoder_t *dec, uint32_t resolution_hz)
+{
+    dec->resolution_hz = resolution_hz;
+}
+
+void spdif_decoder_set_timing_store(spdif_decoder_t *dec, const spdif_timing_store_t *store)
+{
+    dec->timing_store = *store;
+    spdif_timing_cache_t cache;
+    if (!dec->timing->timing_discovered && dec->protocol != SPDIF_PROTOCOL_ADAT && store->load &&
+        store->load(store->ctx, &cache) &&
+        cache.resolution_hz == dec->resolution_hz)
+    {
+        load_cached_timing(dec->timing, &cache);
+    }
+}
+
+// Decode loop body, specialized per output format by the wrappers below
+FORCE_INLINE_ATTR void decode_symbols(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols,
+                                      size_t num_symbols, const spdif_pcm_format_t format)
+{
+    // Work on locals so the hot loop stays in registers
+    const uint8_t *pulse_lut = dec->pulse_lut;
+    const uint32_t shift = dec->lut_shift;
+    const uint32_t *table = dfa_table;
+    uint32_t dfa_state = dec->dfa_state;
+    uint32_t shift_reg = dec->shift_reg; // Data bits arrive LSB first at bit 31
+    uint32_t block_start = dec->block_start;
+    uint32_t channel = dec->channel;
+    uint32_t left_word = dec->left_word;
+    uint32_t last_left = dec->last_left;
+    uint32_t last_right = dec->last_right;
+    uint8_t *pcm_block = dec->pcm_block;
+    size_t block_fill = dec->block_fill;
+    size_t block_frames = dec->block_frames;
+    const size_t frame_bytes = spdif_pcm_frame_bytes(format);
+    uint32_t parity_errors = dec->stats.parity_errors;
+    uint32_t invalid_subframes = dec->stats.invalid_subframes;
+    uint32_t unknown_pulses = dec->stats.unknown_pulses;
+    uint32_t invalid_preambles = dec->stats.invalid_preambles;
+    uint32_t ticks = dec->ticks;
+
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        // duration0 in bits 0-14, duration1 in bits 16-30
+        uint32_t val = symbols[i].val;
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+        ticks += (val & 0x7FFF) + ((val >> 16) & 0x7FFF);
+#endif
+        uint32_t cls = (pulse_lut[lut_index(val & 0x7FFF, shift)] << 2) |
+                       pulse_lut[lut_index((val >> 16) & 0x7FFF, shift)];
+        uint32_t entry = table[dfa_state + cls];
+
+        shift_reg = (shift_reg >> ((entry >> DFA_NBITS_SHIFT) & 3)) | (entry & DFA_BITS_MASK);
+        dfa_state = entry & DFA_NEXT_MASK;
+
+        if (entry & DFA_EVENTS)
+        {
+            unknown_pulses += (entry >> DFA_UNKNOWN_SHIFT) & 3;
+            invalid_preambles += (entry & DFA_BAD_PREAMBLE) ? 1 : 0;
+            uint32_t preamble = (entry >> DFA_PREAMBLE_SHIFT) & 3;
+            if (preamble == DFA_PREAMBLE_W)
+            {
+                channel = sequence_right(dec, channel);
+            }
+            else if (preamble)
+            {
+                channel = sequence_left(dec, channel);
+                block_start = (preamble == DFA_PREAMBLE_B);
+            }
+            else if (entry & DFA_BAD_PREAMBLE)
+            {
+                channel = sequence_lost(dec, channel);
+            }
+
+            if (entry & DFA_COMPLETE)
+            {
+                uint32_t subframe_data = shift_reg >> 4;
+                EMIT_SUBFRAME(block_start);
+            }
+        }
+    }
+
+    dec->dfa_state = dfa_state;
+    dec->shift_reg = shift_reg;
+    dec->block_start = block_start;
+    dec->channel = channel;
+    dec->left_word = left_word;
+    dec->last_left = last_left;
+    dec->last_right = last_right;
+    dec->block_fill = block_fill;
+    dec->ticks = ticks;
+    __atomic_store_n(&dec->stats.parity_errors, parity_errors, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.invalid_subframes, invalid_subframes, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.unknown_pulses, unknown_pulses, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.invalid_preambles, invalid_preambles, __ATOMIC_RELAXED);
+}
+
+static void decode_symbols_s16(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_symbols(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S16);
+}
+
+static void decode_symbols_s24_32(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_symbols(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S24_32);
+}
+
+static void decode_symbols_s24_packed(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_symbols(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S24_PACKED);
+}
+
+static void decode_symbols_f32(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_symbols(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_F32);
+}
+
+// Write one ADAT channel sample; format is a compile-time constant at every call site
+FORCE_INLINE_ATTR void store_sample(spdif_pcm_format_t format, uint8_t *out, uint32_t word)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t sample = (int16_t)(word >> 16);
+            memcpy(out, &sample, sizeof(sample));
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+            memcpy(out, &word, sizeof(word));
+            break;
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            out[0] = word >> 8;
+            out[1] = word >> 16;
+            out[2] = word >> 24;
+            break;
+        case SPDIF_PCM_FORMAT_F32:
+        default:
+        {
+            float sample = (int32_t)word * (1.0f / 2147483648.0f);
+            memcpy(out, &sample, sizeof(sample));
+            break;
+        }
+    }
+}
+
+// ADAT frame sync at tick count ticks: feed the clock loop every 192 frames,
+// like a B preamble would
+static void adat_sync(spdif_decoder_t *dec, uint32_t ticks, size_t block_fill)
+{
+    if (++dec->adat_syncs % 192 == 0)
+    {
+#if CONFIG_SPDIF_IN_CLOCK_RECOVERY
+        clock_observe(dec, ticks + dec->adat_sync_offset, dec->frames_out + block_fill);
+#else
+        (void)ticks;
+        (void)block_fill;
+#endif
+    }
+}
+
+// A frame cut short, or bits where a sync belonged: drop it and wait for the next sync
+static uint32_t adat_lost(spdif_decoder_t *dec, uint32_t take)
+{
+    if (take != ADAT_UNSYNCED)
+    {
+        spdif_stat_add(&dec->stats.sync_errors, 1);
+    }
+    return ADAT_UNSYNCED;
+}
+
+// One ADAT pulse of dur ticks: (cells - 1) zeros and a one. Bits are taken
+// 15 at a time, three groups with their separators checked by one mask; the
+// sync primes adat_bits with two empty groups so the user group ends the
+// first take, and each channel is the next two. The frame at block_fill is
+// committed after the last. Expects decode_adat()'s locals.
+#define ADAT_PULSE(dur)                                                              \
+    {                                                                                \
+        uint32_t cells = pulse_lut[lut_index(dur, shift)];                           \
+        ticks += CLOCK_RECOVERY ? (dur) : 0;                                         \
+        if (__builtin_expect(cells - 1 < ADAT_MAX_DATA_CELLS, 1))                    \
+        {                                                                            \
+            bits = (bits << cells) | 1;                                              \
+            nbits += cells;                                                          \
+            if (nbits >= 15)                                                         \
+            {                                                                        \
+                nbits -= 15;                                                         \
+                uint32_t x = bits >> nbits;                                          \
+                if (__builtin_expect(take < ADAT_FRAME_TAKES && (x & 0x421) == 0x421, 1)) \
+                {                                                                    \
+                    word = (word << 12) | ((x >> 1) & 0xF) | ((x >> 2) & 0xF0) |     \
+                           ((x >> 3) & 0xF00);                                       \
+                    if (take && !(take & 1))                                         \
+                    {                                                                \
+                        store_sample(format, pcm_block + block_fill * frame_bytes +  \
+                                     (take / 2 - 1) * sample_bytes, word << 8);      \
+                    }                                                                \
+                    if (++take == ADAT_FRAME_TAKES && ++block_fill == block_frames)  \
+                    {                                                                \
+                        deliver_block(dec, block_fill);                              \
+                        pcm_block = dec->pcm_block;                                  \
+                        block_frames = dec->block_frames;                            \
+                        block_fill = 0;                                              \
+                    }                                                                \
+                }                                                                    \
+                else                                                                 \
+                {                                                                    \
+                    take = adat_lost(dec, take);                                     \
+                }                                                                    \
+            }                                                                        \
+        }                                                                            \
+        else if (cells == ADAT_SYNC_CELLS)                                           \
+        {                                                                            \
+            if (take < ADAT_FRAME_TAKES)                                             \
+            {                                                                        \
+                adat_lost(dec, take);                                                \
+            }                                                                        \
+            take = 0;                                                                \
+            bits = ADAT_SYNC_BITS;                                                   \
+            nbits = 10;                                                              \
+            adat_sync(dec, ticks, block_fill);                                       \
+        }                                                                            \
+        else if (dur)                                                                \
+        {                                                                            \
+            /* Zero marks the end of an RMT receive, not a pulse */                  \
+            unknown_pulses++;                                                        \
+            take = adat_lost(dec, take);                                             \
+        }                                                                            \
+    }
+
+// ADAT decode loop, specialized per output format like decode_symbols(). A
+// pulse completes at most one take, so there is no inner loop.
+FORCE_INLINE_ATTR void decode_adat(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols,
+                                   size_t num_symbols, const spdif_pcm_format_t format)
+{
+    const uint8_t *pulse_lut = dec->pulse_lut;
+    const uint32_t shift = dec->lut_shift;
+    uint32_t bits = dec->adat_bits;
+    uint32_t nbits = dec->adat_nbits;
+    uint32_t take = dec->adat_take;
+    uint32_t word = dec->adat_word;
+    uint8_t *pcm_block = dec->pcm_block;
+    size_t block_fill = dec->block_fill;
+    size_t block_frames = dec->block_frames;
+    const size_t sample_bytes = spdif_pcm_frame_bytes(format) / 2;
+    const size_t frame_bytes = sample_bytes * SPDIF_ADAT_CHANNELS;
+    uint32_t unknown_pulses = dec->stats.unknown_pulses;
+    uint32_t ticks = dec->ticks;
+
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        uint32_t val = symbols[i].val;
+        ADAT_PULSE(val & 0x7FFF);
+        ADAT_PULSE((val >> 16) & 0x7FFF);
+    }
+
+    dec->adat_bits = bits;
+    dec->adat_nbits = nbits;
+    dec->adat_take = take;
+    dec->adat_word = word;
+    dec->block_fill = block_fill;
+    dec->ticks = ticks;
+    __atomic_store_n(&dec->stats.unknown_pulses, unknown_pulses, __ATOMIC_RELAXED);
+}
+
+static void decode_adat_s16(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_adat(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S16);
+}
+
+static void decode_adat_s24_32(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_adat(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S24_32);
+}
+
+static void decode_adat_s24_packed(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_adat(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_S24_PACKED);
+}
+
+static void decode_adat_f32(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    decode_adat(dec, symbols, num_symbols, SPDIF_PCM_FORMAT_F32);
+}
+
+void spdif_decoder_process(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    if (dec->timing->protocol == SPDIF_PROTOCOL_ADAT)
+    {
+        switch (dec->format)
+        {
+            case SPDIF_PCM_FORMAT_S16:
+                decode_adat_s16(dec, symbols, num_symbols);
+                break;
+            case SPDIF_PCM_FORMAT_S24_32:
+                decode_adat_s24_32(dec, symbols, num_symbols);
+                break;
+            case SPDIF_PCM_FORMAT_S24_PACKED:
+                decode_adat_s24_packed(dec, symbols, num_symbols);
+                break;
+            default:
+                decode_adat_f32(dec, symbols, num_symbols);
+                break;
+        }
+        return;
+    }
+    switch (dec->format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+            decode_symbols_s16(dec, symbols, num_symbols);
+            break;
+        case SPDIF_PCM_FORMAT_S24_32:
+            decode_symbols_s24_32(dec, symbols, num_symbols);
+            break;
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            decode_symbols_s24_packed(dec, symbols, num_symbols);
+            break;
+        default:
+            decode_symbols_f32(dec, symbols, num_symbols);
+            break;
+    }
+}
+
+#if CONFIG_SPDIF_IN_REFERENCE_DECODER
+
+// Reference decoder: the original per-pulse branch decoder, kept to check the
+// transition table against. Macro to process each duration - uses LUT for pulse classification
+#define PROCESS_SYMBOL(dur)                                                          \
+    {                                                                                \
+        uint32_t ptype = pulse_lut[lut_index(dur, shift)];                           \
+        ticks += CLOCK_RECOVERY ? (dur) : 0;                                         \
+        if (ptype < 3)                                                               \
+        {                                                                            \
+                                                                                     \
+            if (state & 2)                                                           \
+            {               /* in_preamble */                                        \
+                state ^= 8; /* Toggle level */                                       \
+                                                                                     \
+                uint32_t bits_to_add = ptype + 1;                                    \
+                uint32_t pindex = (preamble_data >> 8) & 0xF;                        \
+                uint32_t pattern = preamble_data & 0xFF;                             \
+                                                                                     \
+                for (uint32_t j = 0; j < bits_to_add && pindex < 8; j++)             \
+                {                                                                    \
+                    if (state & 8)                                                   \
+                        pattern |= (1 << (7 - pindex));                              \
+                    pindex++;                                                        \
+                }                                                                    \
+                                                                                     \
+                if (pindex >= 8)                                                     \
+                {                                                                    \
+                    state &= ~2; /* Clear in_preamble */                             \
+                                                                                     \
+                    /* Check all 6 valid preambles */                                \
+                    if (pattern == PREAMBLE_B_0 || pattern == PREAMBLE_B_1)          \
+                    {                                                                \
+                        channel = sequence_left(dec, channel);                       \
+                        state |= 16; /* Block start */                               \
+                    }                                                                \
+                    else if (pattern == PREAMBLE_M_0 || pattern == PREAMBLE_M_1)     \
+                    {                                                                \
+                        channel = sequence_left(dec, channel);                       \
+                        state &= ~16;                                                \
+                    }                                                                \
+                    else if (pattern == PREAMBLE_W_0 || pattern == PREAMBLE_W_1)     \
+                    {                                                                \
+                        channel = sequence_right(dec, channel);                      \
+                    }                                                                \
+                    else                                                             \
+                    {                                                                \
+                        invalid_preambles++;                                         \
+                        channel = sequence_lost(dec, channel);                       \
+                    }                                                                \
+                }                                                                    \
+                else                                                                 \
+                {                                                                    \
+                    preamble_data = pattern | (pindex << 8);                         \
+                }                                                                    \
+            }                                                                        \
+            else if (ptype == 2 && !(state & 1))                                     \
+            { /* LONG pulse, not expecting_short */                                  \
+                /* Start preamble */                                                 \
+                state |= 2; /* Set in_preamble */                                    \
+                preamble_data = 0;                                                   \
+                                                                                     \
+                /* Set initial level based on last_data_bit and toggle */            \
+                state = (state & ~8) | ((state & 4) << 1); /* Copy bit 2 to bit 3 */ \
+                state ^= 8;                                /* Toggle */              \
+                                                                                     \
+                /* Add 3 bits for LONG */                                            \
+                uint32_t pattern = 0;                                                \
+                if (state & 8)                                                       \
+                    pattern = 0xE0; /* 111 in top 3 bits */                          \
+                preamble_data = pattern | (3 << 8);                                  \
+                                                                                     \
+                /* Reset subframe */                                                 \
+                bit_count = 0;                                                       \
+                subframe_data = 0;                                                   \
+                state &= ~1; /* Clear expecting_short */                             \
+            }                                                                        \
+            else if (bit_count < 28)                                                 \
+            { /* Normal data */                                                      \
+                if (state & 1)                                                       \
+                { /* expecting_short */                                              \
+                    if (ptype == 0)                                                  \
+                    { /* SHORT - completes '1' bit */                                \
+                        subframe_data |= (1UL << bit_count);                         \
+                    }                                                                \
+                    bit_count++;                                                     \
+                    state &= ~1; /* Clear expecting_short */                         \
+                }                                                                    \
+                else                                                                 \
+                {                                                                    \
+                    if (ptype == 1)                                                  \
+                    { /* MEDIUM - '0' bit */                                         \
+                        bit_count++;                                                 \
+                    }                                                                \
+                    else if (ptype == 0)                                             \
+                    {               /* SHORT - first half of '1' */                  \
+                        state |= 1; /* Set expecting_short */                        \
+                    }                                                                \
+                }                                                                    \
+                                                                                     \
+                if (bit_count == 28)                                                 \
+                {                                                                    \
+                    /* Track last bit for next preamble */                           \
+                    state = (state & ~4) | ((subframe_data & (1UL << 27)) ? 4 : 0);  \
+                                                                                     \
+                    EMIT_SUBFRAME(state & 16);                                       \
+                }                                                                    \
+            }                                                                        \
+        }                                                                            \
+        else                                                                         \
+        {                                                                            \
+            unknown_pulses++;                                                        \
+        }                                                                            \
+    }
+
+void spdif_decoder_process_reference(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    const uint8_t *pulse_lut = dec->pulse_lut;
+    const uint32_t shift = dec->lut_shift;
+    uint32_t state = dec->state;
+    uint32_t bit_count = dec->bit_count;
+    uint32_t subframe_data = dec->subframe_data;
+    uint32_t preamble_data = dec->preamble_data;
+    uint32_t channel = dec->channel;
+    uint32_t left_word = dec->left_word;
+    uint32_t last_left = dec->last_left;
+    uint32_t last_right = dec->last_right;
+    uint8_t *pcm_block = dec->pcm_block;
+    size_t block_fill = dec->block_fill;
+    size_t block_frames = dec->block_frames;
+    const spdif_pcm_format_t format = dec->format;
+    const size_t frame_bytes = spdif_pcm_frame_bytes(format);
+    uint32_t parity_errors = dec->stats.parity_errors;
+    uint32_t invalid_subframes = dec->stats.invalid_subframes;
+    uint32_t unknown_pulses = dec->stats.unknown_pulses;
+    uint32_t invalid_preambles = dec->stats.invalid_preambles;
+    uint32_t ticks = dec->ticks;
+
+    for (size_t i = 0; i < num_symbols; i++)
+    {
+        PROCESS_SYMBOL(symbols[i].duration0);
+        PROCESS_SYMBOL(symbols[i].duration1);
+    }
+
+    dec->state = state;
+    dec->bit_count = bit_count;
+    dec->subframe_data = subframe_data;
+    dec->preamble_data = preamble_data;
+    dec->channel = channel;
+    dec->left_word = left_word;
+    dec->last_left = last_left;
+    dec->last_right = last_right;
+    dec->block_fill = block_fill;
+    dec->ticks = ticks;
+    __atomic_store_n(&dec->stats.parity_errors, parity_errors, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.invalid_subframes, invalid_subframes, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.unknown_pulses, unknown_pulses, __ATOMIC_RELAXED);
+    __atomic_store_n(&dec->stats.invalid_preambles, invalid_preambles, __ATOMIC_RELAXED);
+}
+
+#endif // CONFIG_SPDIF_IN_REFERENCE_DECODER
+
+static void lock_set_state(spdif_decoder_t *dec, spdif_lock_state_t state)
+{
+    if (dec->lock_state == state)
+    {
+        return;
+    }
+    __atomic_store_n(&dec->lock_state, state, __ATOMIC_RELAXED);
+    if (dec->lock_cb)
+    {
+        dec->lock_cb(dec->lock_cb_ctx, state);
+    }
+}
+
+static void lock_reset_window(spdif_decoder_t *dec)
+{
+    dec->lock_window_symbols = 0;
+    dec->lock_window_frame = dec->frames_out + dec->block_fill;
+    dec->lock_bad_windows = 0;
+}
+
+// Back to timing discovery. With keep_timing the current timing is checked
+// first, as a cached one would be.
+static void revert_to_discovery(spdif_decoder_t *dec, bool keep_timing)
+{
+    spdif_timing_t *timing = dec->timing;
+    spdif_decoder_flush(dec);
+    spdif_decoder_reset(dec);
+    if (timing->timing_discovered)
+    {
+        spdif_timing_cache_t cache;
+        save_cached_timing(timing, dec->resolution_hz, &cache);
+        timing->timing_discovered = false;
+        __atomic_store_n(&dec->timing_rate, 0, __ATOMIC_RELAXED);
+        timing->cache_pending = false;
+        // Only S/PDIF timings are cached
+        if (keep_timing && timing->protocol == SPDIF_PROTOCOL_SPDIF && dec->protocol != SPDIF_PROTOCOL_ADAT)
+        {
+            load_cached_timing(timing, &cache);
+        }
+    }
+    reset_pulse_histogram(timing);
+    dec->lut_ready = false;
+    dec->save_pending = false;
+    dec->tracker.collecting = false;
+    histogram_release(&dec->tracker.candidate);
+    tracker_reset_window(&dec->tracker);
+    lock_reset_window(dec);
+}
+
+// Too few blocks for the symbols received: noise, or a signal the timing no
+// longer fits and the tracker did not pick up
+static void lock_check(spdif_decoder_t *dec, size_t num_symbols)
+{
+    dec->lock_window_symbols += num_symbols;
+    if (dec->lock_window_symbols < LOCK_WINDOW_SYMBOLS)
+    {
+        return;
+    }
+    bool bad = dec->frames_out + dec->block_fill - dec->lock_window_frame < LOCK_MIN_FRAMES;
+    uint32_t bad_windows = bad ? dec->lock_bad_windows + 1 : 0;
+    lock_reset_window(dec);
+    dec->lock_bad_windows = bad_windows;
+    if (!bad && dec->save_pending)
+    {
+        // Only a timing that decodes reaches the store: noise locks too
+        dec->save_pending = false;
+        save_timing(dec);
+    }
+    if (bad_windows >= LOCK_LOSS_WINDOWS)
+    {
+        ESP_LOGW(TAG, "Lock lost, rediscovering timing");
+        revert_to_discovery(dec, false);
+        lock_set_state(dec, SPDIF_LOCK_LOST);
+    }
+}
+
+void spdif_decoder_feed(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols)
+{
+    spdif_timing_t *timing = dec->timing;
+
+    if (dec->lock_state == SPDIF_LOCK_NO_SIGNAL)
+    {
+        lock_set_state(dec, SPDIF_LOCK_ACQUIRING);
+    }
+    if (!timing->timing_discovered)
+    {
+        // The histogram fills while a cached timing is checked, so discovery
+        // loses nothing if the input has changed since. Without memory for
+        // it the chunk is skipped and acquisition tries again on the next.
+        if (!histogram_acquire(timing))
+        {
+            return;
+        }
+        PROFILE_START(dec->profile, discovery_start);
+        collect_pulse_histogram(timing, symbols, num_symbols);
+        bool cached = timing->cache_pending;
+        if (cached)
+        {
+            verify_cached_timing(timing, symbols, num_symbols);
+        }
+        if (!timing->timing_discovered && !timing->cache_pending &&
+            timing->total_samples >= CONFIG_SPDIF_IN_MIN_SAMPLES_FOR_ANALYSIS)
+        {
+            cached = false;
+            // ADAT first: its 1-3 cell pulses can pass for the 1:2:3
+            // groups, while S/PDIF never fits the ADAT cell grid
+            if (dec->protocol != SPDIF_PROTOCOL_SPDIF)
+            {
+                analyze_adat_timing(timing);
+            }
+            if (!timing->timing_discovered && dec->protocol != SPDIF_PROTOCOL_ADAT)
+            {
+                analyze_pulse_timing(timing);
+            }
+        }
+        PROFILE_END(dec->profile, SPDIF_PROFILE_DISCOVERY, discovery_start);
+        if (!timing->timing_discovered)
+        {
+            return;
+        }
+        if (timing->protocol == SPDIF_PROTOCOL_ADAT)
+        {
+            ESP_LOGD(TAG, "ADAT timing locked after %u pulses: %u/16 ticks per cell",
+                     (unsigned)timing->total_samples, (unsigned)timing->cell_x16);
+        }
+        else
+        {
+            ESP_LOGD(TAG, "Timing locked %s after %u pulses: %u/%u/%u ticks", cached ? "on cached timing" : "by discovery",
+                     (unsigned)timing->total_samples, (unsigned)timing->short_pulse_ticks,
+                     (unsigned)timing->medium_pulse_ticks, (unsigned)timing->long_pulse_ticks);
+        }
+        dec->save_pending = !cached && timing->protocol == SPDIF_PROTOCOL_SPDIF;
+        histogram_release(timing);
+    }
+
+    if (!dec->lut_ready)
+    {
+        decoder_init_thresholds(dec);
+    }
+    if (dec->lock_state != SPDIF_LOCK_LOCKED)
+    {
+        lock_reset_window(dec);
+        lock_set_state(dec, SPDIF_LOCK_LOCKED);
+    }
+    PROFILE_START(dec->profile, decode_start);
+    spdif_decoder_process(dec, symbols, num_symbols);
+    PROFILE_END(dec->profile, SPDIF_PROFILE_DECODE, decode_start);
+    if (dec->tracker.enabled && timing->protocol == SPDIF_PROTOCOL_SPDIF)
+    {
+        PROFILE_START(dec->profile, track_start);
+        track_timing(dec, symbols, num_symbols);
+        PROFILE_END(dec->profile, SPDIF_PROFILE_TRACKER, track_start);
+    }
+    lock_check(dec, num_symbols);
+}
+
+void spdif_decoder_input_lost(spdif_decoder_t *dec)
+{
+    if (dec->lock_state != SPDIF_LOCK_NO_SIGNAL)
+    {
+        revert_to_discovery(dec, true);
+        lock_set_state(dec, SPDIF_LOCK_NO_SIGNAL);
+    }
+}
+
+void spdif_decoder_gap(spdif_decoder_t *dec)
+{
+    spdif_stat_add(&dec->stats.symbol_gaps, 1);
+    if (dec->channel != SEQ_WAIT_LEFT)
+    {
+        sequence_lost(dec, dec->channel);
+    }
+    dec->channel = SEQ_UNSYNCED;
+    dec->state = 0;
+    dec->bit_count = 0;
+    dec->subframe_data = 0;
+    dec->preamble_data = 0;
+    dec->dfa_state = 0;
+    dec->shift_reg = 0;
+    dec->block_start = 0;
+    dec->left_word = 0;
+    dec->adat_take = adat_lost(dec, dec->adat_take);
+    dec->adat_bits = 0;
+    dec->adat_nbits = 0;
+    if (dec->burst_state == BURST_PAYLOAD)
+    {
+        dec->burst.error = true; // Resumes in the wrong place; the consumer decides
+    }
+}
+
+void spdif_decoder_set_protocol(spdif_decoder_t *dec, spdif_protocol_t protocol)
+{
+    dec->protocol = protocol;
+    if (protocol == SPDIF_PROTOCOL_ADAT)
+    {
+        dec->timing->cache_pending = false;
+    }
+}
+
+uint32_t spdif_decoder_get_channels(const spdif_decoder_t *dec)
+{
+    return __atomic_load_n(&dec->channels, __ATOMIC_RELAXED);
+}
+
+void spdif_decoder_set_profile(spdif_decoder_t *dec, profile_t *profile)
+{
+    dec->profile = profile;
+}
+
+void spdif_decoder_set_lock_cb(spdif_decoder_t *dec, spdif_lock_cb_t cb, void *ctx)
+{
+    dec->lock_cb = cb;
+    dec->lock_cb_ctx = ctx;
+}
+
+spdif_lock_state_t spdif_decoder_get_lock_state(const spdif_decoder_t *dec)
+{
+    return (spdif_lock_state_t)__atomic_load_n(&dec->lock_state, __ATOMIC_RELAXED);
+}
+
+uint32_t spdif_decoder_get_timing_rate(const spdif_decoder_t *dec)
+{
+    return __atomic_load_n(&dec->timing_rate, __ATOMIC_RELAXED);
+}
+
+void spdif_decoder_flush(spdif_decoder_t *dec)
+{
+    // A burst is only handed on complete
+    if (dec->block_fill > 0 && dec->burst_state < BURST_HEADER)
+    {
+        deliver_block(dec, dec->block_fill);
+        dec->block_fill = 0;
+    }
+}
+
+void spdif_decoder_set_sink(spdif_decoder_t *dec, const spdif_pcm_sink_t *sink)
+{
+    // In data mode the pending frames are not PCM; the new sink gets their silence
+    if (dec->burst_state != BURST_OFF)
+    {
+        dec->sink = *sink;
+        return;
+    }
+    // Commit pending frames to the old sink without taking another buffer from it
+    if (dec->block_fill > 0)
+    {
+        spdif_stat_add(&dec->stats.frames_decoded, dec->block_fill);
+        dec->frames_out += dec->block_fill;
+        dec->sink.write(dec->sink.ctx, dec->pcm_block, dec->block_fill);
+        dec->block_fill = 0;
+    }
+    dec->sink = *sink;
+    next_block(dec);
+}
+
+bool spdif_decoder_get_channel_status(const spdif_decoder_t *dec, spdif_channel_status_t *status)
+{
+    uint32_t generation;
+    do
+    {
+        generation = __atomic_load_n(&dec->cs_generation, __ATOMIC_ACQUIRE);
+        if (generation == 0)
+        {
+            return false;
+        }
+        *status = dec->cs_slots[generation & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // The writer moves on to the slot we copied right after the next
+        // publish, so any publish since the load may have torn it
+    } while (__atomic_load_n(&dec->cs_generation, __ATOMIC_RELAXED) != generation);
+    return true;
+}
+
+void spdif_decoder_set_time(spdif_decoder_t *dec, int64_t time_us)
+{
+    dec->anchor_ticks = dec->ticks;
+    dec->anchor_time_us = time_us;
+}
+
+bool spdif_decoder_get_clock(const spdif_decoder_t *dec, spdif_clock_t *clock)
+{
+    uint32_t generation;
+    do
+    {
+        generation = __atomic_load_n(&dec->clock_generation, __ATOMIC_ACQUIRE);
+        if (generation == 0)
+        {
+            return false;
+        }
+        *clock = dec->clock_slots[generation & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // Any publish since the load may have started on the slot we copied
+    } while (__atomic_load_n(&dec->clock_generation, __ATOMIC_RELAXED) != generation);
+    return clock->sample_rate > 0;
+}
+
+void spdif_decoder_get_stats(const spdif_decoder_t *dec, spdif_stats_t *stats)
+{
+    const spdif_stats_t *src = &dec->stats;
+    stats->frames_decoded = __atomic_load_n(&src->frames_decoded, __ATOMIC_RELAXED);
+    stats->unknown_pulses = __atomic_load_n(&src->unknown_pulses, __ATOMIC_RELAXED);
+    stats->invalid_preambles = __atomic_load_n(&src->invalid_preambles, __ATOMIC_RELAXED);
+    stats->parity_errors = __atomic_load_n(&src->parity_errors, __ATOMIC_RELAXED);
+    stats->invalid_subframes = __atomic_load_n(&src->invalid_subframes, __ATOMIC_RELAXED);
+    stats->symbols_dropped = __atomic_load_n(&src->symbols_dropped, __ATOMIC_RELAXED);
+    stats->symbols_overwritten = __atomic_load_n(&src->symbols_overwritten, __ATOMIC_RELAXED);
+    stats->frames_dropped = __atomic_load_n(&src->frames_dropped, __ATOMIC_RELAXED);
+    stats->frames_overwritten = __atomic_load_n(&src->frames_overwritten, __ATOMIC_RELAXED);
+    stats->symbol_gaps = __atomic_load_n(&src->symbol_gaps, __ATOMIC_RELAXED);
+    stats->relocks = __atomic_load_n(&src->relocks, __ATOMIC_RELAXED);
+    stats->data_bursts = __atomic_load_n(&src->data_bursts, __ATOMIC_RELAXED);
+    stats->bursts_dropped = __atomic_load_n(&src->bursts_dropped, __ATOMIC_RELAXED);
+    stats->sync_errors = __atomic_load_n(&src->sync_errors, __ATOMIC_RELAXED);
+    stats->block_errors = __atomic_load_n(&src->block_errors, __ATOMIC_RELAXED);
+    stats->frames_concealed = __atomic_load_n(&src->frames_concealed, __ATOMIC_RELAXED);
+    stats->isr_cycles_max = __atomic_load_n(&src->isr_cycles_max, __ATOMIC_RELAXED);
+}
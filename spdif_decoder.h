@@ -0,0 +1,250 @@
+#ifndef SPDIF_DECODER_H
+#define SPDIF_DECODER_H
+
+#include "spdif_port.h"
+#include "histogram.h"
+#include "clock_recovery.h"
+#include "spdif_iec61937.h"
+#include "profile.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Called with a block of interleaved frames in the decoder's format once it is full
+typedef void (*spdif_pcm_flush_cb_t)(void *ctx, const void *frames, size_t num_frames);
+
+// Background timing tracker. While locked, every TRACK_STRIDE-th symbol is
+// sampled; a rising unknown-pulse rate or moving pulse peaks trigger one
+// window of histogram collection, a new analysis and a LUT swap.
+typedef struct
+{
+    bool enabled;
+    bool collecting;            // Triggered: filling the histogram, analyze at window end
+    spdif_timing_t candidate;   // Sampled histogram and the timing found in it
+    uint32_t window_pulses;
+    uint32_t class_sum[4];      // Sampled durations per pulse class, [3] = unknown
+    uint32_t class_count[4];
+    uint32_t ref_mean[3];       // Class means in 1/16 tick after the last lock, 0 = unset
+} spdif_timing_tracker_t;
+
+// Bi-phase-mark decoder state, with an ADAT mode. Platform independent: fed
+// with RMT symbols, produces PCM through the flush callback or a PCM sink.
+typedef struct spdif_decoder
+{
+    // Transition table decoder state
+    uint32_t dfa_state;     // Table row, pre-multiplied by 16
+    uint32_t shift_reg;     // Last 32 data bits, newest at bit 31
+    uint32_t block_start;   // Current left subframe started with a B preamble
+
+    // Reference decoder state
+    uint32_t state;         // Bit 0: expecting_short, Bit 1: in_preamble, Bit 2: last_data_bit, Bit 3: last_level, Bit 4: B preamble
+    uint32_t bit_count;
+    uint32_t subframe_data;
+    uint32_t preamble_data; // Bits 0-7: pattern, Bits 8-11: bit_index
+
+    // Subframe sequencing, shared by both decoders: a left subframe (B or M)
+    // pairs only with the W subframe right after it
+    uint32_t channel;       // SEQ_* in spdif_decoder.c
+    uint32_t left_word;     // Left audio field, left-justified in 32 bits
+    uint32_t last_left;     // Last frame handed on, for concealment
+    uint32_t last_right;
+    spdif_conceal_t conceal;
+    uint32_t conceal_pending;   // Lost frames to fill in before the next one
+    uint64_t last_b_frame;      // Frame index of the last B preamble, UINT64_MAX if none
+
+    // ADAT decoder state. Pulses add (cells - 1) zeros and a one to
+    // adat_bits; 5-bit groups (a nibble and its separator one) are taken
+    // off the top three at a time, ADAT_* in spdif_decoder.c.
+    spdif_protocol_t protocol;  // Line coding to look for; the timing holds the one found
+    uint32_t channels;          // Per output frame: 2, or SPDIF_ADAT_CHANNELS
+    uint32_t adat_bits;
+    uint32_t adat_nbits;
+    uint32_t adat_take;         // Takes since the sync, ADAT_UNSYNCED before one
+    uint32_t adat_word;         // Channel sample being assembled, MSB first
+    uint32_t adat_syncs;        // Syncs seen, dropped frames included
+    uint32_t adat_sync_offset;  // Ticks from a sync's end to the middle of its frame
+
+    // 256-byte LUTs for pulse classification; a rebuilt LUT goes into the
+    // inactive buffer and is swapped in between symbol chunks
+    const uint8_t *pulse_lut;
+    uint8_t lut_buffers[2][256];
+    uint8_t lut_shift;          // LUT index = duration >> lut_shift, clamped to 255
+    bool lut_ready;
+
+    spdif_timing_t *timing;
+    // timing_sample_rate() of the timing in use, 0 without one. The timing
+    // changes a field at a time on the decoder task; other tasks read this.
+    volatile uint32_t timing_rate;
+    spdif_timing_tracker_t tracker;
+    spdif_timing_store_t timing_store; // Saves each new lock, save == NULL if none
+
+    // Lock state. While locked, the frames decoded per window of symbols
+    // are checked; too few several windows in a row means the lock is lost.
+    volatile uint32_t lock_state; // spdif_lock_state_t, written by the decoder task
+    spdif_lock_cb_t lock_cb;
+    void *lock_cb_ctx;
+    uint32_t lock_window_symbols;
+    uint64_t lock_window_frame; // frames_out + block_fill at the window start
+    uint32_t lock_bad_windows;
+    bool save_pending;          // New timing, saved once a window decodes
+
+    profile_t *profile;         // Stage timing in feed(), NULL if off
+
+    // Health counters. The decoder task writes all but symbols_dropped and
+    // isr_cycles_max (RMT ISR) and frames_dropped and frames_overwritten
+    // (PCM sink)
+    spdif_stats_t stats;
+
+    // Input clock recovery. ticks counts the RMT ticks of every decoded
+    // symbol; B preambles feed the loop and publish a snapshot.
+    uint32_t ticks;
+    uint32_t resolution_hz;     // Tick rate of the symbol durations
+    uint64_t frames_out;        // Frames handed to the sink
+    clock_loop_t clock_loop;
+    uint32_t anchor_ticks;      // ticks at anchor_time_us
+    int64_t anchor_time_us;     // 0 = no anchor
+    spdif_clock_t clock_slots[2];
+    volatile uint32_t clock_generation; // Latest snapshot in clock_slots[clock_generation & 1]
+
+    // Channel status/user data of channel A, assembled over 192 frames aligned on the B preamble
+    uint32_t cs_frame;          // Frame index in the block; >= 192 until the first B
+    uint8_t cs_bits[24];
+    uint8_t user_bits[24];
+    spdif_channel_status_t cs_slots[2];
+    volatile uint32_t cs_generation; // Completed blocks; the latest is in cs_slots[cs_generation & 1]
+
+    // IEC 61937 data bursts. Outside PCM mode frames are written into the
+    // burst buffer, or own_block as scratch between bursts, and the sink
+    // gets the same number of silent frames instead.
+    uint32_t burst_state;       // BURST_* in spdif_decoder.c
+    bool non_audio;             // Last channel status block flagged data
+    spdif_burst_sink_t burst_sink;
+    uint8_t *burst_buffer;
+    size_t burst_capacity;      // Frames
+    spdif_burst_t burst;        // Burst being received
+    uint64_t last_burst_frame;  // Pa frame of the previous burst, UINT64_MAX if none
+    uint32_t idle_frames;       // Frames without a burst in data mode
+
+    // PCM output block: the decoder's own block, or a buffer from the sink
+    spdif_pcm_format_t format;
+    uint8_t *pcm_block;
+    size_t block_frames;
+    size_t block_fill;
+    uint8_t *own_block;
+    size_t own_block_frames;
+    spdif_pcm_sink_t sink;
+} spdif_decoder_t;
+
+// pcm_block must hold block_frames * spdif_pcm_frame_bytes(format) bytes,
+// and for ADAT at least one frame of SPDIF_ADAT_CHANNELS; an ADAT block is
+// a quarter as many frames
+void spdif_decoder_init(spdif_decoder_t *dec, spdif_timing_t *timing,
+                        spdif_pcm_format_t format, void *pcm_block, size_t block_frames,
+                        spdif_pcm_flush_cb_t flush_cb, void *flush_ctx);
+// Free the pulse histograms of a discovery or tracker window in progress
+void spdif_decoder_deinit(spdif_decoder_t *dec);
+// Drop the bitstream and clock state so decoding restarts at the next
+// preamble, e.g. after a gap in the input; the timing is kept
+void spdif_decoder_reset(spdif_decoder_t *dec);
+// Build the LUT for the current timing. An ADAT timing switches the output
+// to SPDIF_ADAT_CHANNELS, which takes a new buffer from the sink.
+void decoder_init_thresholds(spdif_decoder_t *dec);
+
+// Line coding for discovery to accept (SPDIF_PROTOCOL_SPDIF by default).
+// Call before feeding; ADAT decodes without the timing tracker, the timing
+// store, channel status or IEC 61937 detection.
+void spdif_decoder_set_protocol(spdif_decoder_t *dec, spdif_protocol_t protocol);
+
+// Channels per frame handed to the sink; changes when a lock finds the
+// other protocol. Safe to call from any task.
+uint32_t spdif_decoder_get_channels(const spdif_decoder_t *dec);
+
+// Replace the flush callback with a sink; pending frames go to the old one first.
+// A buffer already taken from the old sink with no frames in it is abandoned.
+void spdif_decoder_set_sink(spdif_decoder_t *dec, const spdif_pcm_sink_t *sink);
+
+// Decode symbols with the current LUT; timing must already be discovered
+void spdif_decoder_process(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols);
+
+#if CONFIG_SPDIF_IN_REFERENCE_DECODER
+// Original per-pulse branch decoder; produces the same output as spdif_decoder_process()
+void spdif_decoder_process_reference(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols);
+#endif
+
+// Hand IEC 61937 bursts to a passthrough consumer. Without one bursts are
+// still detected, counted as dropped, and muted on the PCM side.
+void spdif_decoder_set_burst_sink(spdif_decoder_t *dec, const spdif_burst_sink_t *sink);
+
+// Fill in frames lost to sync errors (SPDIF_CONCEAL_NONE by default)
+void spdif_decoder_set_concealment(spdif_decoder_t *dec, spdif_conceal_t mode);
+
+// Tick rate of the symbol durations, CONFIG_SPDIF_IN_RMT_RESOLUTION_HZ by
+// default: the RMT resolution, or the sample rate of an oversampled capture.
+// Clock recovery and the timing store work in it; set it before either.
+void spdif_decoder_set_resolution(spdif_decoder_t *dec, uint32_t resolution_hz);
+
+// Try the timing saved in store before discovery, and save every new lock to
+// it. A stored entry from another resolution is ignored.
+void spdif_decoder_set_timing_store(spdif_decoder_t *dec, const spdif_timing_store_t *store);
+
+// Run timing discovery until locked, then decode; the chunk that completes
+// the lock is decoded as well. Drives the lock state: input moves it out of
+// SPDIF_LOCK_NO_SIGNAL, a lock to SPDIF_LOCK_LOCKED, and a locked stream that
+// stops producing frames to SPDIF_LOCK_LOST and back to discovery.
+void spdif_decoder_feed(spdif_decoder_t *dec, const rmt_symbol_word_t *symbols, size_t num_symbols);
+
+// The input has stopped, e.g. no symbols for a while: flush, drop the timing
+// and go to SPDIF_LOCK_NO_SIGNAL. The last timing is tried first when input
+// returns, so the same source relocks on its first few hundred pulses.
+void spdif_decoder_input_lost(spdif_decoder_t *dec);
+
+// Symbols were dropped between the last chunk fed and the next, e.g. on a
+// full symbol ring: drop the frame in progress and pick up at the next
+// preamble (ADAT: sync), as if the next chunk started a new stream. Timing,
+// lock, clock and block counts carry on, so a short gap is concealed.
+void spdif_decoder_gap(spdif_decoder_t *dec);
+
+// Report lock state changes to cb on the decoder task
+void spdif_decoder_set_lock_cb(spdif_decoder_t *dec, spdif_lock_cb_t cb, void *ctx);
+
+// Current lock state; safe to call from any task
+spdif_lock_state_t spdif_decoder_get_lock_state(const spdif_decoder_t *dec);
+
+// Nominal sample rate of the timing in use, 0 before discovery or if it
+// matches none; safe to call from any task
+uint32_t spdif_decoder_get_timing_rate(const spdif_decoder_t *dec);
+
+// Time discovery, decoding and tracking in spdif_decoder_feed() into
+// profile; NULL stops. No effect without CONFIG_SPDIF_IN_PROFILE.
+void spdif_decoder_set_profile(spdif_decoder_t *dec, profile_t *profile);
+
+// Hand any partially filled PCM block to the sink
+void spdif_decoder_flush(spdif_decoder_t *dec);
+
+// Copy the last complete channel status block; safe to call from any task.
+// Returns false until a full block has been received.
+bool spdif_decoder_get_channel_status(const spdif_decoder_t *dec, spdif_channel_status_t *status);
+
+// Tie the current stream position (the end of the last symbol fed) to a
+// timestamp, e.g. the esp_timer time at which RMT delivered that symbol
+void spdif_decoder_set_time(spdif_decoder_t *dec, int64_t time_us);
+
+// Copy the latest recovered clock; safe to call from any task.
+// Returns false until two consecutive B preambles have been decoded.
+bool spdif_decoder_get_clock(const spdif_decoder_t *dec, spdif_clock_t *clock);
+
+// Snapshot the health counters; safe to call from any task
+void spdif_decoder_get_stats(const spdif_decoder_t *dec, spdif_stats_t *stats);
+
+// Counter update for the single writer of a stats field; readers may be on other tasks
+FORCE_INLINE_ATTR void spdif_stat_add(uint32_t *counter, uint32_t n)
+{
+    __atomic_store_n(counter, *counter + n, __ATOMIC_RELAXED);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // SPDIF_DECODER_H
@@ -0,0 +1,72 @@
+#include "spdif_iec61937.h"
+#include <math.h>
+#include <string.h>
+
+uint16_t spdif_burst_word(const spdif_burst_t *burst, size_t index)
+{
+    const uint8_t *frames = (const uint8_t *)burst->frames;
+    switch (burst->format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+        {
+            int16_t sample;
+            memcpy(&sample, frames + index * sizeof(sample), sizeof(sample));
+            return (uint16_t)sample;
+        }
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t sample;
+            memcpy(&sample, frames + index * sizeof(sample), sizeof(sample));
+            return (uint16_t)((uint32_t)sample >> 16);
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            return frames[index * 3 + 1] | (frames[index * 3 + 2] << 8);
+        case SPDIF_PCM_FORMAT_F32:
+        default:
+        {
+            // Exact: the audio field has 24 significant bits
+            float sample;
+            memcpy(&sample, frames + index * sizeof(sample), sizeof(sample));
+            return (uint16_t)(int32_t)floorf(sample * 32768.0f);
+        }
+    }
+}
+
+size_t spdif_burst_read_payload(const spdif_burst_t *burst, uint8_t *out, size_t max_bytes)
+{
+    size_t bytes = burst->payload_bytes < max_bytes ? burst->payload_bytes : max_bytes;
+    for (size_t i = 0; i < bytes; i += 2)
+    {
+        uint16_t word = spdif_burst_word(burst, 4 + i / 2);
+        out[i] = word >> 8;
+        if (i + 1 < bytes)
+        {
+            out[i + 1] = word & 0xFF;
+        }
+    }
+    return bytes;
+}
+
+size_t iec61937_parse_header(spdif_burst_t *burst, uint16_t pc, uint16_t pd)
+{
+    burst->data_type = pc & 0x1F;
+    burst->error = (pc >> 7) & 1;
+    burst->type_dependent = (pc >> 8) & 0x1F;
+    burst->bitstream_number = pc >> 13;
+    burst->length_code = pd;
+
+    switch (burst->data_type)
+    {
+        case IEC61937_EAC3:
+        case IEC61937_DTSHD:
+        case IEC61937_MAT:
+            burst->payload_bytes = pd;
+            break;
+        default:
+            burst->payload_bytes = (pd + 7) / 8;
+            break;
+    }
+    size_t words = 4 + (burst->payload_bytes + 1) / 2;
+    size_t frames = (words + 1) / 2;
+    return frames <= IEC61937_MAX_BURST_FRAMES ? frames : 0;
+}
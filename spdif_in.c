@@ -1,254 +1,648 @@
 #include "spdif_in.h"
+#include "spdif_decoder.h"
 #include "histogram.h"
+#include "latency.h"
+#include "profile.h"
+#include "capture.h"
+#include "pcm_ring.h"
+#include "oversample.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/ringbuf.h"
+#include "freertos/queue.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
 #include "driver/rmt_rx.h"
+#if I2S_CAPTURE
+#include "driver/i2s_std.h"
+#endif
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "soc/soc_caps.h"
 #include "esp_log.h"
 #include "string.h"
 #include "math.h"
 #include "sdkconfig.h"
 
-// Global state
-static rmt_channel_handle_t g_rx_channel = NULL;
-static TaskHandle_t g_decoder_task = NULL;
-static TaskHandle_t g_init_task = NULL;
-static RingbufHandle_t g_symbol_buffer = NULL;
-static rmt_symbol_word_t *g_rmt_buffer = NULL;
-static rmt_receive_config_t g_rx_config;
+#if ZERO_COPY_RX
+// Zero-copy receive: RMT DMA writes into RX_BUFFER_COUNT buffers, taking the
+// next one at each transaction end, and the ISR only posts chunk descriptors
+// pointing into them. A buffer goes back to RMT once the decoder has consumed
+// its last chunk.
+#define RX_QUEUE_LENGTH 32
+#define RX_STALLED (1UL << 31) // RMT needs a buffer but all are held by the decoder
 
-// 256-byte LUT for pulse classification
-static uint8_t pulse_lut[256];
+typedef struct
+{
+    rmt_symbol_word_t *symbols;
+    uint32_t num_symbols;
+    uint16_t buffer;       // Index into rx_buffers
+    uint8_t last;          // Final chunk of the buffer's transaction
+    uint8_t gap;           // Symbols were dropped right before the chunk
+    uint32_t transaction;  // rx_transaction when received
+    uint32_t end_count;    // rx_symbol_count after this chunk
+    int64_t time_us;       // esp_timer time at the end of the chunk
+} rx_chunk_t;
+#else
+// Arrival time of each chunk sent to the symbol ring buffer, where chunks
+// run together; the decoder receives up to each chunk end in turn
+#define RX_STAMP_COUNT 16
+
+typedef struct
+{
+    uint32_t end_count;    // rx_symbol_count after the chunk
+    uint32_t gap_count;    // Where symbols were dropped right before the chunk; end_count if none
+    int64_t time_us;       // esp_timer time at the end of the chunk
+} rx_stamp_t;
+#endif
+
+// RMT memory used per channel when no DMA channel is left: two blocks, so
+// partial receive can ping-pong between their halves
+#define RMT_NO_DMA_MEM_SYMBOLS (2 * SOC_RMT_MEM_WORDS_PER_CHANNEL)
+
+#if I2S_CAPTURE
+// I2S RX DMA: descriptors, and stereo 32-bit frames per descriptor, i.e. 64
+// samples of the line each. 511 frames is the most a descriptor holds.
+#define I2S_DMA_BUFFERS 8
+#define I2S_DMA_FRAMES 511
+#define I2S_MIN_DMA_FRAMES 16
+
+// Symbols extracted per pass over a DMA buffer
+#define I2S_SCRATCH_SYMBOLS 1024
+#endif
+
+// Idle wake-up period of the decoder task, bounding how long delete waits
+#define TASK_STOP_POLL_MS 100
+
+// Time input gets to lock before the decoder falls back to polling it
+#define ACQUIRE_WINDOW_MS 20
+
+// The decoder's own PCM block, with room for at least one ADAT frame
+#define PCM_BLOCK_BYTES ((PCM_BLOCK_FRAMES > SPDIF_ADAT_CHANNELS / 2 ? PCM_BLOCK_FRAMES : SPDIF_ADAT_CHANNELS / 2) * \
+                         SPDIF_PCM_MAX_FRAME_BYTES)
+
+// Input behind the decoder task. RMT measures the pulses and its ISR passes
+// them on through the symbol transport; I2S samples the line and the decoder
+// task extracts the pulses itself.
+typedef struct
+{
+    esp_err_t (*init)(spdif_receiver_handle_t rx, const spdif_receiver_config_t *config, latency_plan_t *plan);
+    esp_err_t (*start)(spdif_receiver_handle_t rx);  // From the decoder task, once
+    esp_err_t (*resume)(spdif_receiver_handle_t rx); // After a stop
+    esp_err_t (*stop)(spdif_receiver_handle_t rx);
+    bool (*wait)(spdif_receiver_handle_t rx, TickType_t wait); // Input arrived within wait
+    void (*consume)(spdif_receiver_handle_t rx);     // Decode all input pending
+    void (*discard)(spdif_receiver_handle_t rx);     // Drop all input pending, for polling
+    void (*del)(spdif_receiver_handle_t rx);         // Anything init got, even if it failed
+} rx_backend_t;
+
+// One receiver: input channel, decoder task, symbol transport, timing,
+// decoder state and PCM output. Allocated in internal RAM since the RMT ISR
+// touches it.
+struct spdif_receiver
+{
+    const rx_backend_t *backend;
+    rmt_channel_handle_t rx_channel;
+    TaskHandle_t decoder_task;
+    TaskHandle_t stop_waiter;   // Set by delete; the task notifies it on exit
+    int input_pin;
+    rmt_receive_config_t rx_config;
+    uint32_t rx_symbols;        // Receive buffer, per DMA buffer with zero-copy receive
+#if ZERO_COPY_RX
+    rmt_symbol_word_t *rx_buffers[RX_BUFFER_COUNT];
+    QueueHandle_t rx_queue;
+    uint32_t rx_active;        // Buffer of the running transaction
+    uint32_t rx_transaction;   // Receive transactions started
+    uint32_t rx_symbol_count;  // Symbols received, written by the ISR only
+    uint32_t rx_owned;         // Bit per buffer held by RMT or the decoder, plus RX_STALLED
+    bool rx_gap;               // A chunk was dropped since the last one queued; ISR only
+    rx_chunk_t rx_pending;     // Taken off rx_queue, not yet consumed
+#else
+    RingbufHandle_t symbol_buffer;
+    uint32_t ring_symbols;
+    rmt_symbol_word_t *rmt_buffer;
+    uint32_t rx_symbol_count;  // Symbols sent to symbol_buffer
+    // Written by the ISR at rx_stamp_head, read by the decoder at rx_stamp_tail
+    rx_stamp_t rx_stamps[RX_STAMP_COUNT];
+    uint32_t rx_stamp_head;
+    uint32_t rx_stamp_tail;
+    bool rx_gap;               // Symbols were dropped since the last chunk sent; ISR only
+    rmt_symbol_word_t *rx_pending; // Received from symbol_buffer, not yet consumed
+    size_t rx_pending_size;
+    uint32_t symbols_fed;      // Symbols taken from symbol_buffer so far
+#endif
+#if I2S_CAPTURE
+    // The I2S backend; rx_symbol_count is then kept by the decoder task
+    i2s_chan_handle_t i2s_channel;
+    uint32_t *i2s_words;       // One DMA buffer's worth, read by the decoder task
+    uint32_t i2s_chunk_words;  // Words per DMA buffer
+    size_t i2s_pending_words;
+    int64_t i2s_time_us;       // esp_timer time the pending words were read
+    rmt_symbol_word_t *i2s_symbols; // Extraction scratch, I2S_SCRATCH_SYMBOLS
+    oversample_t oversample;
+    bool i2s_overflow;         // The driver dropped a DMA buffer; set by its ISR
+#endif
+
+    // Timing discovery and decoder core
+    spdif_timing_t timing;
+    spdif_decoder_t decoder;
+    uint8_t pcm_block[PCM_BLOCK_BYTES];
+    spdif_pcm_format_t pcm_format; // Output; the decoder's is S24_32 with post-processing
+    RingbufHandle_t pcm_buffer; // Built-in sink, NULL with a custom sink
+    pcm_ring_t pcm_ring;        // pcm_buffer under the overflow policy
+    spdif_overflow_t overflow;
+    uint32_t overflow_wait_ms;  // Longest wait for room with SPDIF_OVERFLOW_BLOCK
+    SemaphoreHandle_t pcm_read_lock; // Keeps discards off frames being read; SPDIF_OVERFLOW_DROP_OLDEST only
+    bool flush_each_chunk;      // Hand on a partial block whenever the input is drained
+#if LATENCY_STATS
+    latency_probe_t latency;    // Between the decoder and its sink
+#endif
+#if PROFILE_STATS
+    profile_t profile;
+#endif
+    capture_t capture;          // Raw symbol tee; sink.write is NULL when off
+    spdif_memory_t memory;      // Footprint as allocated
+
+    // Post-processing between the decoder and the converter, NULL if off
+    spdif_post_t *post;
+
+    // Sample-rate converter between the decoder and the sink, NULL if off
+    spdif_asrc_t *asrc;
+    uint32_t output_clock_mhz;  // From spdif_rx_set_output_rate(), 0 = nominal
+
+    // Stop/start. The decoder drops its bitstream state where the input
+    // resumed: at rx_symbol_count as of the stop.
+    bool running;               // Input enabled; changed by start/stop only
+    uint32_t resume_count;
+    bool resync;                // Set by start, cleared by the decoder task
+
+    // Lock state events. While polling, the ISR discards input instead of
+    // passing it to the decoder task.
+    EventGroupHandle_t lock_events;
+    spdif_lock_cb_t lock_cb;
+    void *lock_cb_ctx;
+    bool polling;
+};
+
+// Instance behind the handle-less API
+static spdif_receiver_handle_t g_default_rx = NULL;
 
 RingbufHandle_t spdif_in_pcm_buffer = NULL;
 
-#define TIMING_VARIANCE 3
-
-// Preamble patterns - both normal and inverted
-#define PREAMBLE_B_0 0xE8
-#define PREAMBLE_B_1 0x17
-#define PREAMBLE_M_0 0xE2
-#define PREAMBLE_M_1 0x1D
-#define PREAMBLE_W_0 0xE4
-#define PREAMBLE_W_1 0x1B
-
-// Macro to process each duration - uses LUT for pulse classification
-#define PROCESS_SYMBOL(dur)                                                          \
-    {                                                                                \
-        uint32_t ptype = pulse_lut[dur & 0xFF];                                      \
-        if (ptype < 3)                                                               \
-        {                                                                            \
-                                                                                     \
-            if (state & 2)                                                           \
-            {               /* in_preamble */                                        \
-                state ^= 8; /* Toggle level */                                       \
-                                                                                     \
-                uint32_t bits_to_add = ptype + 1;                                    \
-                uint32_t pindex = (preamble_data >> 8) & 0xF;                        \
-                uint32_t pattern = preamble_data & 0xFF;                             \
-                                                                                     \
-                for (uint32_t j = 0; j < bits_to_add && pindex < 8; j++)             \
-                {                                                                    \
-                    if (state & 8)                                                   \
-                        pattern |= (1 << (7 - pindex));                              \
-                    pindex++;                                                        \
-                }                                                                    \
-                                                                                     \
-                if (pindex >= 8)                                                     \
-                {                                                                    \
-                    state &= ~2; /* Clear in_preamble */                             \
-                                                                                     \
-                    /* Check all 6 valid preambles */                                \
-                    if (pattern == PREAMBLE_B_0 || pattern == PREAMBLE_B_1)          \
-                    {                                                                \
-                        channel = 0;                                                 \
-                    }                                                                \
-                    else if (pattern == PREAMBLE_M_0 || pattern == PREAMBLE_M_1)     \
-                    {                                                                \
-                        channel = 0;                                                 \
-                    }                                                                \
-                    else if (pattern == PREAMBLE_W_0 || pattern == PREAMBLE_W_1)     \
-                    {                                                                \
-                        channel = 1;                                                 \
-                    }                                                                \
-                }                                                                    \
-                else                                                                 \
-                {                                                                    \
-                    preamble_data = pattern | (pindex << 8);                         \
-                }                                                                    \
-            }                                                                        \
-            else if (ptype == 2 && !(state & 1))                                     \
-            { /* LONG pulse, not expecting_short */                                  \
-                /* Start preamble */                                                 \
-                state |= 2; /* Set in_preamble */                                    \
-                preamble_data = 0;                                                   \
-                                                                                     \
-                /* Set initial level based on last_data_bit and toggle */            \
-                state = (state & ~8) | ((state & 4) << 1); /* Copy bit 2 to bit 3 */ \
-                state ^= 8;                                /* Toggle */              \
-                                                                                     \
-                /* Add 3 bits for LONG */                                            \
-                uint32_t pattern = 0;                                                \
-                if (state & 8)                                                       \
-                    pattern = 0xE0; /* 111 in top 3 bits */                          \
-                preamble_data = pattern | (3 << 8);                                  \
-                                                                                     \
-                /* Reset subframe */                                                 \
-                bit_count = 0;                                                       \
-                subframe_data = 0;                                                   \
-                state &= ~1; /* Clear expecting_short */                             \
-            }                                                                        \
-            else if (bit_count < 28)                                                 \
-            { /* Normal data */                                                      \
-                if (state & 1)                                                       \
-                { /* expecting_short */                                              \
-                    if (ptype == 0)                                                  \
-                    { /* SHORT - completes '1' bit */                                \
-                        subframe_data |= (1UL << bit_count);                         \
-                    }                                                                \
-                    bit_count++;                                                     \
-                    state &= ~1; /* Clear expecting_short */                         \
-                }                                                                    \
-                else                                                                 \
-                {                                                                    \
-                    if (ptype == 1)                                                  \
-                    { /* MEDIUM - '0' bit */                                         \
-                        bit_count++;                                                 \
-                    }                                                                \
-                    else if (ptype == 0)                                             \
-                    {               /* SHORT - first half of '1' */                  \
-                        state |= 1; /* Set expecting_short */                        \
-                    }                                                                \
-                }                                                                    \
-                                                                                     \
-                if (bit_count == 28)                                                 \
-                {                                                                    \
-                    /* Track last bit for next preamble */                           \
-                    state = (state & ~4) | ((subframe_data & (1UL << 27)) ? 4 : 0);  \
-                                                                                     \
-                    /* Extract audio */                                              \
-                    int32_t sample = (int32_t)(subframe_data & 0xFFFFFF);            \
-                                                                                     \
-                    /* Sign extend from 24-bit to 32-bit */                          \
-                    if (sample & 0x800000)                                           \
-                    {                                                                \
-                        sample |= 0xFF000000;                                        \
-                    }                                                                \
-                                                                                     \
-                    /* Convert to 16-bit */                                          \
-                    int16_t s16 = (int16_t)(sample >> 8);                            \
-                                                                                     \
-                    if (channel == 0)                                                \
-                    {                                                                \
-                        left_sample = s16;                                           \
-                    }                                                                \
-                    else                                                             \
-                    {                                                                \
-                        int16_t stereo[2] = {left_sample, s16};                      \
-                        xRingbufferSend(spdif_in_pcm_buffer, stereo, sizeof(stereo), 10000);  \
-                    }                                                                \
-                }                                                                    \
-            }                                                                        \
-        }                                                                            \
-    }
-
-// Initialize thresholds and build LUT
-void decoder_init_thresholds(void)
-{
-    for (int i = 0; i < 256; i++)
-    {
-        if (i < g_timing.short_pulse_ticks - TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 3; // UNKNOWN
-        }
-        else if (i < g_timing.short_pulse_ticks + TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 0; // SHORT
-        }
-        else if (i < g_timing.medium_pulse_ticks - TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 3; // UNKNOWN
-        }
-        else if (i < g_timing.medium_pulse_ticks + TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 1; // MEDIUM
-        }
-        else if (i < g_timing.long_pulse_ticks - TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 3; // UNKNOWN
-        }
-        else if (i < g_timing.long_pulse_ticks + TIMING_VARIANCE)
-        {
-            pulse_lut[i] = 2; // LONG
+// Bytes per output frame, 2 or SPDIF_ADAT_CHANNELS channels as last locked
+static size_t rx_frame_bytes(spdif_receiver_handle_t rx)
+{
+    return spdif_pcm_frame_bytes(rx->pcm_format) * spdif_decoder_get_channels(&rx->decoder) / 2;
+}
+
+static bool pcm_ring_send(void *ctx, const void *data, size_t bytes, uint32_t wait_ms)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)ctx;
+    return xRingbufferSend(rx->pcm_buffer, data, bytes, pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+}
+
+// Take whole frames off the read side, unless spdif_rx_read() is in the
+// middle of one
+static size_t pcm_ring_discard(void *ctx, size_t bytes, size_t frame_bytes)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)ctx;
+    if (!rx->pcm_read_lock || xSemaphoreTake(rx->pcm_read_lock, 0) != pdTRUE)
+    {
+        return 0;
+    }
+    size_t free_bytes = xRingbufferGetCurFreeSize(rx->pcm_buffer);
+    size_t need = bytes > free_bytes ? bytes - free_bytes : 0;
+    need = (need + frame_bytes - 1) / frame_bytes * frame_bytes;
+    size_t discarded = 0;
+    while (discarded < need)
+    {
+        size_t size = 0;
+        void *data = xRingbufferReceiveUpTo(rx->pcm_buffer, &size, 0, need - discarded);
+        if (!data)
+        {
+            break;
         }
-        else
+        vRingbufferReturnItem(rx->pcm_buffer, data);
+        discarded += size;
+    }
+    xSemaphoreGive(rx->pcm_read_lock);
+    return discarded;
+}
+
+// Decoder output: one ring buffer send per PCM block, under the overflow policy
+static void pcm_ringbuf_flush(void *ctx, const void *frames, size_t num_frames)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)ctx;
+    pcm_ring_write(&rx->pcm_ring, rx->overflow, rx->overflow_wait_ms, frames, num_frames, rx_frame_bytes(rx),
+                   &rx->decoder.stats);
+}
+
+static const char *const lock_state_names[SPDIF_LOCK_STATE_COUNT] = {
+    "no signal", "acquiring", "locked", "lost",
+};
+
+// Decoder lock callback: publish the state, then tell the application
+static void lock_state_changed(void *ctx, spdif_lock_state_t state)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)ctx;
+    xEventGroupClearBits(rx->lock_events, SPDIF_LOCK_EVENT_ALL & ~SPDIF_LOCK_EVENT_BIT(state));
+    xEventGroupSetBits(rx->lock_events, SPDIF_LOCK_EVENT_BIT(state));
+    ESP_LOGI("SPDIF_IN", "gpio %d: %s", rx->input_pin, lock_state_names[state]);
+    if (rx->lock_cb)
+    {
+        rx->lock_cb(rx->lock_cb_ctx, state);
+    }
+}
+
+#if STATS_LOG_INTERVAL_MS
+static void log_stats(spdif_receiver_handle_t rx)
+{
+    spdif_stats_t stats;
+    spdif_decoder_get_stats(&rx->decoder, &stats);
+    ESP_LOGI("SPDIF_IN", "gpio %d: %s, frames %lu unknown %lu bad preamble %lu parity %lu invalid %lu "
+             "sym drop %lu sym overwritten %lu gaps %lu pcm drop %lu overwritten %lu relocks %lu bursts %lu/%lu dropped sync %lu block %lu concealed %lu "
+             "isr max %lu cycles", rx->input_pin, lock_state_names[spdif_decoder_get_lock_state(&rx->decoder)],
+             (unsigned long)stats.frames_decoded, (unsigned long)stats.unknown_pulses,
+             (unsigned long)stats.invalid_preambles, (unsigned long)stats.parity_errors,
+             (unsigned long)stats.invalid_subframes, (unsigned long)stats.symbols_dropped,
+             (unsigned long)stats.symbols_overwritten, (unsigned long)stats.symbol_gaps,
+             (unsigned long)stats.frames_dropped, (unsigned long)stats.frames_overwritten,
+             (unsigned long)stats.relocks,
+             (unsigned long)stats.data_bursts, (unsigned long)stats.bursts_dropped,
+             (unsigned long)stats.sync_errors, (unsigned long)stats.block_errors,
+             (unsigned long)stats.frames_concealed, (unsigned long)stats.isr_cycles_max);
+#if LATENCY_STATS
+    spdif_latency_t latency;
+    latency_probe_get(&rx->latency, &latency);
+    ESP_LOGI("SPDIF_IN", "gpio %d: latency min %lu mean %lu p50 %lu p99 %lu max %lu us over %lu chunks",
+             rx->input_pin, (unsigned long)latency.min_us, (unsigned long)latency.mean_us,
+             (unsigned long)latency.p50_us, (unsigned long)latency.p99_us, (unsigned long)latency.max_us,
+             (unsigned long)latency.samples);
+#endif
+#if PROFILE_STATS
+    spdif_profile_t profile;
+    profile_get(&rx->profile, &profile);
+    ESP_LOGI("SPDIF_IN", "gpio %d: decoder load %lu.%lu%%, decode mean %lu max %lu cycles, isr mean %lu max %lu cycles",
+             rx->input_pin, (unsigned long)profile.load_permille / 10, (unsigned long)profile.load_permille % 10,
+             (unsigned long)profile.stage[SPDIF_PROFILE_DECODE].mean, (unsigned long)profile.stage[SPDIF_PROFILE_DECODE].max,
+             (unsigned long)profile.stage[SPDIF_PROFILE_ISR].mean, (unsigned long)profile.stage[SPDIF_PROFILE_ISR].max);
+#endif
+}
+#endif
+
+// Drop the decoder state once it reaches the symbols received after a
+// restart; position is the stream position of the next symbol to decode
+static void rx_resync(spdif_receiver_handle_t rx, uint32_t position)
+{
+    if (__atomic_load_n(&rx->resync, __ATOMIC_ACQUIRE) && (int32_t)(position - rx->resume_count) >= 0)
+    {
+        __atomic_store_n(&rx->resync, false, __ATOMIC_RELAXED);
+        spdif_decoder_flush(&rx->decoder);
+        spdif_decoder_reset(&rx->decoder);
+        if (rx->asrc)
         {
-            pulse_lut[i] = 3; // UNKNOWN
+            spdif_asrc_reset(rx->asrc);
         }
     }
 }
 
-// Main decoder task
-static void spdif_decoder_task(void *arg)
+// The decoder has been fed exactly the symbols received up to time_us: anchor
+// its stream position there and start timing the chunk's way to the sink
+static void rx_arrival(spdif_receiver_handle_t rx, int64_t time_us)
 {
-    g_rx_config = (rmt_receive_config_t){
-        .signal_range_min_ns = 10,
-        .signal_range_max_ns = 10000,
-        .flags.en_partial_rx = true,
-    };
+    spdif_decoder_set_time(&rx->decoder, time_us);
+#if LATENCY_STATS
+    if (rx->timing.timing_discovered)
+    {
+        latency_probe_arrival(&rx->latency, rx->decoder.frames_out + rx->decoder.block_fill, time_us);
+    }
+#endif
+}
+
+#if LATENCY_STATS
+static int64_t latency_now_us(void *ctx)
+{
+    return esp_timer_get_time();
+}
+#endif
+
+// Tee a chunk to the capture sink ahead of decoding it; a refused write ends
+// the capture
+static void rx_capture(spdif_receiver_handle_t rx, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                       int64_t time_us)
+{
+    if (rx->capture.sink.write &&
+        !capture_chunk(&rx->capture, symbols, num_symbols, time_us, rx->decoder.stats.symbols_dropped))
+    {
+        ESP_LOGW("SPDIF_IN", "gpio %d: capture sink failed after %llu symbols, capture stopped", rx->input_pin,
+                 (unsigned long long)rx->capture.symbols);
+        rx->capture.sink.write = NULL;
+    }
+}
+
+#if ZERO_COPY_RX
+static void IRAM_ATTR rx_start(spdif_receiver_handle_t rx, uint32_t buffer)
+{
+    rx->rx_active = buffer;
+    __atomic_store_n(&rx->rx_transaction, rx->rx_transaction + 1, __ATOMIC_RELAXED);
+    rmt_receive(rx->rx_channel, rx->rx_buffers[buffer],
+                rx->rx_symbols * sizeof(rmt_symbol_word_t), &rx->rx_config);
+}
+
+// Claim a buffer for RMT; if the decoder still holds it, mark RMT stalled instead
+static bool IRAM_ATTR rx_claim(spdif_receiver_handle_t rx, uint32_t buffer)
+{
+    uint32_t bit = 1UL << buffer;
+    uint32_t owned = __atomic_load_n(&rx->rx_owned, __ATOMIC_RELAXED);
+    uint32_t want;
+    do
+    {
+        want = (owned & bit) ? (owned | RX_STALLED) : (owned | bit);
+    } while (!__atomic_compare_exchange_n(&rx->rx_owned, &owned, want, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return !(owned & bit);
+}
+
+// Hand a consumed buffer back. Returns true when RMT was stalled, in which
+// case the buffer stays claimed and the caller restarts reception into it.
+static bool IRAM_ATTR rx_release(spdif_receiver_handle_t rx, uint32_t buffer)
+{
+    uint32_t owned = __atomic_load_n(&rx->rx_owned, __ATOMIC_RELAXED);
+    uint32_t want;
+    do
+    {
+        want = (owned & RX_STALLED) ? (owned & ~RX_STALLED) : (owned & ~(1UL << buffer));
+    } while (!__atomic_compare_exchange_n(&rx->rx_owned, &owned, want, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return (owned & RX_STALLED) != 0;
+}
+
+// Decode one chunk in place. While its transaction is still running, the DMA
+// may come back around to the chunk once the rest of the buffer has been
+// written; symbols decoded after that point are counted as dropped.
+static void rx_consume(spdif_receiver_handle_t rx, const rx_chunk_t *chunk)
+{
+    if (chunk->num_symbols)
+    {
+        rx_resync(rx, chunk->end_count - chunk->num_symbols);
+        if (chunk->gap)
+        {
+            spdif_decoder_gap(&rx->decoder);
+        }
+        rx_capture(rx, chunk->symbols, chunk->num_symbols, chunk->time_us);
+        spdif_decoder_feed(&rx->decoder, chunk->symbols, chunk->num_symbols);
+        rx_arrival(rx, chunk->time_us);
+        uint32_t behind = __atomic_load_n(&rx->rx_symbol_count, __ATOMIC_RELAXED) - chunk->end_count;
+        if (__atomic_load_n(&rx->rx_transaction, __ATOMIC_RELAXED) == chunk->transaction &&
+            behind > rx->rx_symbols - chunk->num_symbols)
+        {
+            // Part of it was overwritten with later input. Counted apart from
+            // the ISR's drops: spdif_stat_add() allows one writer per counter.
+            spdif_stat_add(&rx->decoder.stats.symbols_overwritten, chunk->num_symbols);
+            spdif_decoder_gap(&rx->decoder);
+        }
+    }
+    if (chunk->last && rx_release(rx, chunk->buffer))
+    {
+        rx_start(rx, chunk->buffer);
+    }
+}
+
+// Drop the chunks queued before polling started
+static void rx_discard(spdif_receiver_handle_t rx)
+{
+    rx_chunk_t chunk;
+    while (xQueueReceive(rx->rx_queue, &chunk, 0) == pdTRUE)
+    {
+        if (chunk.last && rx_release(rx, chunk.buffer))
+        {
+            rx_start(rx, chunk.buffer);
+        }
+    }
+}
+#else
+// Take the stamps of chunks the decoder has been fed up to; one ending
+// exactly there gives its arrival time
+static void rx_update_time(spdif_receiver_handle_t rx, uint32_t symbols_fed)
+{
+    uint32_t head = __atomic_load_n(&rx->rx_stamp_head, __ATOMIC_ACQUIRE);
+    while (rx->rx_stamp_tail != head)
+    {
+        const rx_stamp_t *stamp = &rx->rx_stamps[rx->rx_stamp_tail % RX_STAMP_COUNT];
+        if ((int32_t)(stamp->end_count - symbols_fed) > 0)
+        {
+            break;
+        }
+        if (stamp->end_count == symbols_fed)
+        {
+            rx_arrival(rx, stamp->time_us);
+        }
+        __atomic_store_n(&rx->rx_stamp_tail, rx->rx_stamp_tail + 1, __ATOMIC_RELEASE);
+    }
+}
+
+// The next chunk follows dropped symbols: restart the bitstream where it starts
+static void rx_gap_check(spdif_receiver_handle_t rx, uint32_t symbols_fed)
+{
+    if (rx->rx_stamp_tail != __atomic_load_n(&rx->rx_stamp_head, __ATOMIC_ACQUIRE))
+    {
+        const rx_stamp_t *stamp = &rx->rx_stamps[rx->rx_stamp_tail % RX_STAMP_COUNT];
+        if (stamp->gap_count != stamp->end_count && stamp->gap_count == symbols_fed)
+        {
+            spdif_decoder_gap(&rx->decoder);
+        }
+    }
+}
+
+// Arrival time of a receive ending at symbol count end, if a chunk ends there
+static int64_t rx_stamp_time(spdif_receiver_handle_t rx, uint32_t end)
+{
+    if (rx->rx_stamp_tail != __atomic_load_n(&rx->rx_stamp_head, __ATOMIC_ACQUIRE) &&
+        rx->rx_stamps[rx->rx_stamp_tail % RX_STAMP_COUNT].end_count == end)
+    {
+        return rx->rx_stamps[rx->rx_stamp_tail % RX_STAMP_COUNT].time_us;
+    }
+    return 0;
+}
+
+// Items run together in the byte ring buffer; end a receive at the next
+// chunk end or gap, and where the input resumed after a restart so the
+// decoder can be reset there
+static size_t rx_receive_limit(spdif_receiver_handle_t rx, uint32_t symbols_fed)
+{
+    uint32_t limit = rx->ring_symbols;
+    if (rx->rx_stamp_tail != __atomic_load_n(&rx->rx_stamp_head, __ATOMIC_ACQUIRE))
+    {
+        const rx_stamp_t *stamp = &rx->rx_stamps[rx->rx_stamp_tail % RX_STAMP_COUNT];
+        uint32_t to_end = stamp->end_count - symbols_fed;
+        uint32_t to_gap = stamp->gap_count - symbols_fed;
+        if ((int32_t)to_gap > 0 && to_gap < to_end)
+        {
+            to_end = to_gap;
+        }
+        if ((int32_t)to_end > 0 && to_end < limit)
+        {
+            limit = to_end;
+        }
+    }
+    if (__atomic_load_n(&rx->resync, __ATOMIC_ACQUIRE) && (int32_t)(rx->resume_count - symbols_fed) > 0 &&
+        rx->resume_count - symbols_fed < limit)
+    {
+        limit = rx->resume_count - symbols_fed;
+    }
+    return limit * sizeof(rmt_symbol_word_t);
+}
+
+// Drop the symbols buffered before polling started; returns symbols_fed
+static uint32_t rx_discard(spdif_receiver_handle_t rx, uint32_t symbols_fed)
+{
+    size_t rx_size;
+    void *symbols;
+    while ((symbols = xRingbufferReceiveUpTo(rx->symbol_buffer, &rx_size, 0, rx_receive_limit(rx, symbols_fed))))
+    {
+        vRingbufferReturnItem(rx->symbol_buffer, symbols);
+        symbols_fed += rx_size / sizeof(rmt_symbol_word_t);
+        rx_update_time(rx, symbols_fed);
+    }
+    return symbols_fed;
+}
+#endif
+
+// Follow the recovered input clock, or the nominal rate until it settles,
+// and the output clock set by the application
+static void asrc_track(spdif_receiver_handle_t rx, uint32_t *output_clock_mhz)
+{
+    uint32_t mhz = __atomic_load_n(&rx->output_clock_mhz, __ATOMIC_RELAXED);
+    if (mhz != *output_clock_mhz)
+    {
+        *output_clock_mhz = mhz;
+        spdif_asrc_set_output_rate(rx->asrc, mhz ? mhz / 1000.0 : rx->asrc->output_rate);
+    }
+    spdif_clock_t clock;
+    double rate = spdif_decoder_get_clock(&rx->decoder, &clock) && clock.locked ? clock.sample_rate
+                                                                               : spdif_rx_get_sample_rate(rx);
+    if (rate > 0)
+    {
+        spdif_asrc_set_input_rate(rx->asrc, rate);
+    }
+}
 
-    ESP_ERROR_CHECK(rmt_enable(g_rx_channel));
-    ESP_ERROR_CHECK(rmt_receive(g_rx_channel, g_rmt_buffer,
-                                RMT_MEM_BLOCK_SYMBOLS * sizeof(rmt_symbol_word_t),
-                                &g_rx_config));
+// Decoder task, one per receiver
+static void spdif_decoder_task(void *arg)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)arg;
+    ESP_ERROR_CHECK(rx->backend->start(rx));
 
-    size_t rx_size = 0;
-    rmt_symbol_word_t *symbols = NULL;
+    TickType_t flush_ticks = pdMS_TO_TICKS(PCM_FLUSH_TIMEOUT_MS);
+    if (flush_ticks == 0)
+    {
+        flush_ticks = 1;
+    }
+    const TickType_t idle_ticks = pdMS_TO_TICKS(TASK_STOP_POLL_MS);
+    const TickType_t signal_ticks = pdMS_TO_TICKS(SIGNAL_TIMEOUT_MS) ? pdMS_TO_TICKS(SIGNAL_TIMEOUT_MS) : 1;
+    const TickType_t acquire_ticks = pdMS_TO_TICKS(ACQUIRE_WINDOW_MS);
+    TickType_t last_input = xTaskGetTickCount();
+    TickType_t unlocked_since = last_input;
+    bool unlocked = false;
+    bool was_running = true;
+    uint32_t output_clock_mhz = 0;
 
-    ESP_LOGI("SPDIF_IN", "Decoder task started, waiting for PCM buffer");
-    while (!spdif_in_pcm_buffer) vTaskDelay(100);
-    ESP_LOGI("SPDIF_IN", "PCM buffer found, continuing");
-    while (1)
+    ESP_LOGI("SPDIF_IN", "Decoder task started for gpio %d", rx->input_pin);
+#if STATS_LOG_INTERVAL_MS
+    const TickType_t log_ticks = pdMS_TO_TICKS(STATS_LOG_INTERVAL_MS) ? pdMS_TO_TICKS(STATS_LOG_INTERVAL_MS) : 1;
+    TickType_t last_log = xTaskGetTickCount();
+#endif
+    while (!__atomic_load_n(&rx->stop_waiter, __ATOMIC_ACQUIRE))
     {
-        //ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        symbols = (rmt_symbol_word_t *)xRingbufferReceive(g_symbol_buffer, &rx_size, portMAX_DELAY);
-        while (symbols)
+        // Only wake on timeout while a partial PCM block is pending, or to
+        // check for a stop request
+        TickType_t wait = rx->decoder.block_fill ? flush_ticks : idle_ticks;
+        TickType_t now = xTaskGetTickCount();
+        // Wake in time to notice the input stopping; a stop by the
+        // application is not a lost signal
+        bool running = __atomic_load_n(&rx->running, __ATOMIC_RELAXED);
+        if (running && !was_running)
+        {
+            last_input = now;
+        }
+        was_running = running;
+        if (running && spdif_decoder_get_lock_state(&rx->decoder) != SPDIF_LOCK_NO_SIGNAL)
         {
-            size_t num_symbols = rx_size / sizeof(rmt_symbol_word_t);
-            if (!g_timing.timing_discovered)
+            TickType_t silent = now - last_input;
+            if (silent >= signal_ticks)
             {
-                collect_pulse_histogram(symbols, num_symbols);
-                if (g_timing.total_samples >= MIN_SAMPLES_FOR_ANALYSIS)
+                spdif_decoder_input_lost(&rx->decoder);
+                if (rx->asrc)
                 {
-                    analyze_pulse_timing();
+                    spdif_asrc_reset(rx->asrc);
                 }
+                unlocked = false;
+                continue;
             }
-            else
+            if (wait > signal_ticks - silent)
             {
-                if (!pulse_lut[0])
-                {
-                    decoder_init_thresholds();
-                }
-
-                // Static state - keep minimal for cache efficiency
-                static uint32_t state = 0; // Bit 0: expecting_short, Bit 1: in_preamble, Bit 2: last_data_bit, Bit 3: last_level
-                static uint32_t bit_count = 0;
-                static uint32_t subframe_data = 0;
-                static uint32_t preamble_data = 0; // Bits 0-7: pattern, Bits 8-11: bit_index
-                static uint32_t channel = 0;       // 0=left, 1=right
-                static int16_t left_sample;
-
-                // Process all symbols
-                for (size_t i = 0; i < num_symbols; i++)
-                {
-                    PROCESS_SYMBOL(symbols[i].duration0);
-                    PROCESS_SYMBOL(symbols[i].duration1);
-                }
+                wait = signal_ticks - silent;
             }
-            vRingbufferReturnItem(g_symbol_buffer, (void *)symbols);
-            symbols = (rmt_symbol_word_t *)xRingbufferReceive(g_symbol_buffer, &rx_size, 0);
+        }
+#if STATS_LOG_INTERVAL_MS
+        if (now - last_log >= log_ticks)
+        {
+            log_stats(rx);
+            last_log = now;
+        }
+        if (wait > log_ticks)
+        {
+            wait = log_ticks;
+        }
+#endif
+#if PROFILE_STATS
+        profile_tick(&rx->profile);
+        uint32_t wait_start = spdif_profile_now();
+#endif
+        if (!rx->backend->wait(rx, wait))
+        {
+            spdif_decoder_flush(&rx->decoder);
+            continue;
+        }
+#if PROFILE_STATS
+        profile_add(&rx->profile, SPDIF_PROFILE_RX_WAIT, spdif_profile_now() - wait_start);
+#endif
+        last_input = xTaskGetTickCount();
+        rx->backend->consume(rx);
+        if (rx->flush_each_chunk)
+        {
+            spdif_decoder_flush(&rx->decoder);
+        }
+        if (rx->asrc)
+        {
+            asrc_track(rx, &output_clock_mhz);
+        }
+
+        // Input that fails to lock is only sampled every UNLOCKED_POLL_MS
+        // from here on, rather than keeping the decoder busy with noise
+        if (spdif_decoder_get_lock_state(&rx->decoder) == SPDIF_LOCK_LOCKED)
+        {
+            unlocked = false;
+        }
+        else if (!unlocked)
+        {
+            unlocked = true;
+            unlocked_since = last_input;
+        }
+        else if (UNLOCKED_POLL_MS && last_input - unlocked_since >= acquire_ticks)
+        {
+            __atomic_store_n(&rx->polling, true, __ATOMIC_RELAXED);
+            rx->backend->discard(rx);
+            vTaskDelay(pdMS_TO_TICKS(UNLOCKED_POLL_MS));
+            __atomic_store_n(&rx->polling, false, __ATOMIC_RELAXED);
+            // A fresh window; the histogram keeps what it has gathered so far
+            last_input = xTaskGetTickCount();
+            unlocked_since = last_input;
         }
     }
+
+    spdif_decoder_flush(&rx->decoder);
+    xTaskNotifyGive(rx->stop_waiter);
+    vTaskDelete(NULL);
 }
 
 // RMT receive callback (ISR context)
@@ -257,138 +651,1175 @@ static bool IRAM_ATTR rmt_rx_done_callback(
     const rmt_rx_done_event_data_t *edata,
     void *user_ctx)
 {
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)user_ctx;
     BaseType_t task_woken = pdFALSE;
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+
+#if ZERO_COPY_RX
+    rx->rx_symbol_count += edata->num_symbols;
+    rx_chunk_t chunk = {
+        .symbols = edata->received_symbols,
+        .num_symbols = edata->num_symbols,
+        .buffer = rx->rx_active,
+        .last = edata->flags.is_last,
+        .gap = rx->rx_gap,
+        .transaction = rx->rx_transaction,
+        .end_count = rx->rx_symbol_count,
+        .time_us = esp_timer_get_time(),
+    };
+    bool polling = __atomic_load_n(&rx->polling, __ATOMIC_RELAXED);
+    if ((chunk.num_symbols > 0 || chunk.last) &&
+        (polling || xQueueSendFromISR(rx->rx_queue, &chunk, &task_woken) != pdTRUE))
+    {
+        if (!polling)
+        {
+            spdif_stat_add(&rx->decoder.stats.symbols_dropped, chunk.num_symbols);
+            rx->rx_gap |= chunk.num_symbols > 0;
+        }
+        if (chunk.last)
+        {
+            rx_release(rx, chunk.buffer); // Nobody else will; RMT is not stalled while running
+        }
+    }
+    else if (chunk.num_symbols > 0)
+    {
+        rx->rx_gap = false;
+    }
 
     if (edata->flags.is_last)
     {
-        rmt_receive(g_rx_channel, g_rmt_buffer,
-                    RMT_MEM_BLOCK_SYMBOLS * sizeof(rmt_symbol_word_t),
-                    &g_rx_config);
+        uint32_t next = (rx->rx_active + 1) % RX_BUFFER_COUNT;
+        if (rx_claim(rx, next))
+        {
+            rx_start(rx, next);
+        }
+        // Otherwise the decoder restarts reception when it releases a buffer
+    }
+#else
+    if (edata->flags.is_last)
+    {
+        rmt_receive(rx->rx_channel, rx->rmt_buffer,
+                    rx->rx_symbols * sizeof(rmt_symbol_word_t),
+                    &rx->rx_config);
     }
 
-    if (edata->num_symbols > 0)
+    if (edata->num_symbols > 0 && !__atomic_load_n(&rx->polling, __ATOMIC_RELAXED))
     {
-        xRingbufferSendFromISR(g_symbol_buffer,
-                              edata->received_symbols,
-                              edata->num_symbols * sizeof(rmt_symbol_word_t),
-                              &task_woken);
+        if (xRingbufferSendFromISR(rx->symbol_buffer,
+                                   edata->received_symbols,
+                                   edata->num_symbols * sizeof(rmt_symbol_word_t),
+                                   &task_woken) != pdTRUE)
+        {
+            spdif_stat_add(&rx->decoder.stats.symbols_dropped, edata->num_symbols);
+            rx->rx_gap = true;
+        }
+        else
+        {
+            uint32_t start = rx->rx_symbol_count;
+            __atomic_store_n(&rx->rx_symbol_count, start + edata->num_symbols, __ATOMIC_RELAXED);
+            // Without room the chunk goes unstamped and runs into the next,
+            // and a gap before it goes unmarked
+            uint32_t head = rx->rx_stamp_head;
+            if (head - __atomic_load_n(&rx->rx_stamp_tail, __ATOMIC_ACQUIRE) < RX_STAMP_COUNT)
+            {
+                rx->rx_stamps[head % RX_STAMP_COUNT] = (rx_stamp_t){
+                    rx->rx_symbol_count, rx->rx_gap ? start : rx->rx_symbol_count, esp_timer_get_time()};
+                __atomic_store_n(&rx->rx_stamp_head, head + 1, __ATOMIC_RELEASE);
+            }
+            rx->rx_gap = false;
+        }
     }
 
-    vTaskNotifyGiveFromISR(g_decoder_task, &task_woken);
+    vTaskNotifyGiveFromISR(rx->decoder_task, &task_woken);
+#endif
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start_cycles;
+    if (cycles > rx->decoder.stats.isr_cycles_max)
+    {
+        __atomic_store_n(&rx->decoder.stats.isr_cycles_max, cycles, __ATOMIC_RELAXED);
+    }
+#if PROFILE_STATS
+    profile_add(&rx->profile, SPDIF_PROFILE_ISR, cycles);
+#endif
     return task_woken == pdTRUE;
 }
 
-// Initialize S/PDIF receiver
-esp_err_t spdif_receiver_init(int input_pin, void (*init_done_cb)(void))
+// Release everything a receiver owns; its decoder task must not be running
+static void receiver_free(spdif_receiver_handle_t rx)
 {
-    ESP_LOGI("SPDIF_IN", "SPDIF Init Called");
-
-    spdif_in_pcm_buffer = xRingbufferCreate(SPDIF_PCM_BUFFER_SIZE, RINGBUF_TYPE_BYTEBUF);
-    if (!spdif_in_pcm_buffer)
+    rx->backend->del(rx);
+    if (rx->pcm_buffer)
     {
-        return ESP_FAIL;
+#if PSRAM_BUFFERS
+        vRingbufferDeleteWithCaps(rx->pcm_buffer);
+#else
+        vRingbufferDelete(rx->pcm_buffer);
+#endif
     }
-
-    g_symbol_buffer = xRingbufferCreate(SYMBOL_BUFFER_SIZE * sizeof(rmt_symbol_word_t), RINGBUF_TYPE_BYTEBUF);
-    if (!g_symbol_buffer)
+    if (rx->pcm_read_lock)
     {
-        return ESP_FAIL;
+        vSemaphoreDelete(rx->pcm_read_lock);
     }
-
-    g_rmt_buffer = heap_caps_malloc(
-        RMT_MEM_BLOCK_SYMBOLS * sizeof(rmt_symbol_word_t),
-        MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
-    if (!g_rmt_buffer)
+    if (rx->asrc)
     {
-        return ESP_FAIL;
+        spdif_asrc_deinit(rx->asrc);
+        heap_caps_free(rx->asrc);
+    }
+    if (rx->post)
+    {
+        heap_caps_free(rx->post);
+    }
+    if (rx->lock_events)
+    {
+        vEventGroupDelete(rx->lock_events);
+    }
+    if (rx->decoder.timing)
+    {
+        spdif_decoder_deinit(&rx->decoder);
     }
+    heap_caps_free(rx);
+}
+
+// The PCM ring is only touched by tasks, so it may live in PSRAM
+static RingbufHandle_t pcm_ring_create(size_t bytes)
+{
+#if PSRAM_BUFFERS
+    RingbufHandle_t ring = xRingbufferCreateWithCaps(bytes, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_SPIRAM);
+    return ring ? ring : xRingbufferCreateWithCaps(bytes, RINGBUF_TYPE_BYTEBUF, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    return xRingbufferCreate(bytes, RINGBUF_TYPE_BYTEBUF);
+#endif
+}
+
+// RMT RX channel with DMA, or in RMT memory once the DMA-capable channels
+// are taken (ESP32-S3 has one)
+static esp_err_t receiver_new_channel(spdif_receiver_handle_t rx, int input_pin, uint32_t mem_block_symbols)
+{
     rmt_rx_channel_config_t rx_channel_cfg = {
         .gpio_num = input_pin,
         .clk_src = RMT_CLK_SRC_DEFAULT,
         .resolution_hz = RMT_RESOLUTION_HZ,
-        .mem_block_symbols = RMT_MEM_BLOCK_SYMBOLS,
+        .mem_block_symbols = mem_block_symbols,
         .flags.with_dma = true,
     };
-
-    esp_err_t ret = rmt_new_rx_channel(&rx_channel_cfg, &g_rx_channel);
-    if (ret != ESP_OK)
+    esp_err_t ret = rmt_new_rx_channel(&rx_channel_cfg, &rx->rx_channel);
+    if (ret == ESP_ERR_NOT_FOUND || ret == ESP_ERR_NOT_SUPPORTED)
     {
-        return ESP_FAIL;
+        ESP_LOGW("SPDIF_IN", "gpio %d: no RMT DMA channel left, receiving without DMA", input_pin);
+        rx_channel_cfg.mem_block_symbols = RMT_NO_DMA_MEM_SYMBOLS;
+        rx_channel_cfg.flags.with_dma = false;
+        ret = rmt_new_rx_channel(&rx_channel_cfg, &rx->rx_channel);
     }
+    return ret;
+}
 
-    rmt_rx_event_callbacks_t cbs = {.on_recv_done = rmt_rx_done_callback};
-    ret = rmt_rx_register_event_callbacks(g_rx_channel, &cbs, NULL);
+static esp_err_t rmt_input_init(spdif_receiver_handle_t rx, const spdif_receiver_config_t *config,
+                                latency_plan_t *plan)
+{
+#if ZERO_COPY_RX
+    rx->rx_queue = xQueueCreate(RX_QUEUE_LENGTH, sizeof(rx_chunk_t));
+    if (!rx->rx_queue)
+    {
+        return ESP_ERR_NO_MEM;
+    }
 
-    if (ret != ESP_OK)
+    for (int i = 0; i < RX_BUFFER_COUNT; i++)
     {
-        return ESP_FAIL;
+        rx->rx_buffers[i] = heap_caps_malloc(rx->rx_symbols * sizeof(rmt_symbol_word_t),
+                                             MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+        if (!rx->rx_buffers[i])
+        {
+            return ESP_ERR_NO_MEM;
+        }
     }
-    
-    if (init_done_cb)
+#else
+    rx->ring_symbols = plan->ring_symbols;
+    rx->symbol_buffer = xRingbufferCreate(rx->ring_symbols * sizeof(rmt_symbol_word_t), RINGBUF_TYPE_BYTEBUF);
+    if (!rx->symbol_buffer)
     {
-        init_done_cb();
+        return ESP_ERR_NO_MEM;
     }
 
-    if (xTaskCreatePinnedToCore(spdif_decoder_task, "spdif_decoder",
-                                DECODER_TASK_STACK, NULL,
-                                DECODER_TASK_PRIORITY, &g_decoder_task, 1) != pdPASS)
+    rx->rmt_buffer = heap_caps_malloc(
+        rx->rx_symbols * sizeof(rmt_symbol_word_t),
+        MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (!rx->rmt_buffer)
     {
-        return ESP_FAIL;
+        return ESP_ERR_NO_MEM;
     }
+#endif
 
-    return ESP_OK;
-}
+#if ZERO_COPY_RX
+    esp_err_t ret = receiver_new_channel(rx, config->input_pin, rx->rx_symbols * RX_BUFFER_COUNT);
+#else
+    esp_err_t ret = receiver_new_channel(rx, config->input_pin, rx->rx_symbols);
+#endif
+    if (ret != ESP_OK)
+    {
+        rx->rx_channel = NULL;
+        return ret;
+    }
 
-esp_err_t spdif_receiver_start(void)
-{
-    return ESP_OK;
+    rmt_rx_event_callbacks_t cbs = {.on_recv_done = rmt_rx_done_callback};
+    return rmt_rx_register_event_callbacks(rx->rx_channel, &cbs, rx);
 }
 
-esp_err_t spdif_receiver_stop(void)
+static esp_err_t rmt_input_start(spdif_receiver_handle_t rx)
 {
-    if (g_rx_channel)
+    rx->rx_config = (rmt_receive_config_t){
+        .signal_range_min_ns = 10,
+        .signal_range_max_ns = 10000,
+        .flags.en_partial_rx = true,
+    };
+
+    esp_err_t ret = rmt_enable(rx->rx_channel);
+    if (ret != ESP_OK)
     {
-        return rmt_disable(g_rx_channel);
+        return ret;
     }
+#if ZERO_COPY_RX
+    rx_claim(rx, 0);
+    rx_start(rx, 0);
     return ESP_OK;
+#else
+    return rmt_receive(rx->rx_channel, rx->rmt_buffer, rx->rx_symbols * sizeof(rmt_symbol_word_t),
+                       &rx->rx_config);
+#endif
 }
 
-void spdif_receiver_deinit(void)
+static esp_err_t rmt_input_resume(spdif_receiver_handle_t rx)
 {
-    if (g_rx_channel)
+    esp_err_t ret = rmt_enable(rx->rx_channel);
+    if (ret != ESP_OK)
     {
-        rmt_disable(g_rx_channel);
-        rmt_del_channel(g_rx_channel);
-        g_rx_channel = NULL;
+        return ret;
     }
-    if (g_rmt_buffer)
+#if ZERO_COPY_RX
+    // The stopped transaction never delivers a last chunk: take its buffer
+    // back and continue in the next one, as at a transaction end. While RMT
+    // is stalled the decoder restarts it on its next release instead.
+    if (!(__atomic_load_n(&rx->rx_owned, __ATOMIC_ACQUIRE) & RX_STALLED))
     {
-        heap_caps_free(g_rmt_buffer);
-        g_rmt_buffer = NULL;
+        __atomic_and_fetch(&rx->rx_owned, ~(1UL << rx->rx_active), __ATOMIC_ACQ_REL);
+        uint32_t next = (rx->rx_active + 1) % RX_BUFFER_COUNT;
+        if (rx_claim(rx, next))
+        {
+            rx_start(rx, next);
+        }
     }
-    if (g_symbol_buffer)
+#else
+    ret = rmt_receive(rx->rx_channel, rx->rmt_buffer, rx->rx_symbols * sizeof(rmt_symbol_word_t),
+                      &rx->rx_config);
+    if (ret != ESP_OK)
     {
-        vRingbufferDelete(g_symbol_buffer);
-        g_symbol_buffer = NULL;
+        rmt_disable(rx->rx_channel);
+        return ret;
     }
+#endif
+    return ESP_OK;
 }
 
-uint32_t spdif_receiver_get_sample_rate(void)
+static esp_err_t rmt_input_stop(spdif_receiver_handle_t rx)
 {
-    if (!g_timing.timing_discovered)
-    {
-        return 0;
-    }
-
-    uint32_t T = g_timing.base_unit_ticks;
+    return rmt_disable(rx->rx_channel);
+}
 
-    switch (T)
+static bool rmt_input_wait(spdif_receiver_handle_t rx, TickType_t wait)
+{
+#if ZERO_COPY_RX
+    return xQueueReceive(rx->rx_queue, &rx->rx_pending, wait) == pdTRUE;
+#else
+    rx->rx_pending = (rmt_symbol_word_t *)xRingbufferReceiveUpTo(rx->symbol_buffer, &rx->rx_pending_size, wait,
+                                                                 rx_receive_limit(rx, rx->symbols_fed));
+    return rx->rx_pending != NULL;
+#endif
+}
+
+static void rmt_input_consume(spdif_receiver_handle_t rx)
+{
+#if ZERO_COPY_RX
+    do
+    {
+        rx_consume(rx, &rx->rx_pending);
+    } while (xQueueReceive(rx->rx_queue, &rx->rx_pending, 0) == pdTRUE);
+#else
+    while (rx->rx_pending)
+    {
+        size_t num_symbols = rx->rx_pending_size / sizeof(rmt_symbol_word_t);
+        rx_resync(rx, rx->symbols_fed);
+        rx_gap_check(rx, rx->symbols_fed);
+        if (rx->capture.sink.write)
+        {
+            rx_capture(rx, rx->rx_pending, num_symbols, rx_stamp_time(rx, rx->symbols_fed + num_symbols));
+        }
+        spdif_decoder_feed(&rx->decoder, rx->rx_pending, num_symbols);
+        rx->symbols_fed += num_symbols;
+        vRingbufferReturnItem(rx->symbol_buffer, (void *)rx->rx_pending);
+        rx_update_time(rx, rx->symbols_fed);
+        rx->rx_pending = (rmt_symbol_word_t *)xRingbufferReceiveUpTo(rx->symbol_buffer, &rx->rx_pending_size, 0,
+                                                                     rx_receive_limit(rx, rx->symbols_fed));
+    }
+#endif
+}
+
+static void rmt_input_discard(spdif_receiver_handle_t rx)
+{
+#if ZERO_COPY_RX
+    rx_discard(rx);
+#else
+    rx->symbols_fed = rx_discard(rx, rx->symbols_fed);
+#endif
+}
+
+static void rmt_input_del(spdif_receiver_handle_t rx)
+{
+    if (rx->rx_channel)
+    {
+        rmt_disable(rx->rx_channel);
+        rmt_del_channel(rx->rx_channel);
+    }
+#if ZERO_COPY_RX
+    for (int i = 0; i < RX_BUFFER_COUNT; i++)
+    {
+        heap_caps_free(rx->rx_buffers[i]);
+    }
+    if (rx->rx_queue)
+    {
+        vQueueDelete(rx->rx_queue);
+    }
+#else
+    heap_caps_free(rx->rmt_buffer);
+    if (rx->symbol_buffer)
+    {
+        vRingbufferDelete(rx->symbol_buffer);
+    }
+#endif
+}
+
+static const rx_backend_t rmt_backend = {
+    .init = rmt_input_init,
+    .start = rmt_input_start,
+    .resume = rmt_input_resume,
+    .stop = rmt_input_stop,
+    .wait = rmt_input_wait,
+    .consume = rmt_input_consume,
+    .discard = rmt_input_discard,
+    .del = rmt_input_del,
+};
+
+#if I2S_CAPTURE
+// The driver's queue of filled DMA buffers was full and it dropped the
+// oldest (ISR context)
+static bool IRAM_ATTR i2s_overflow_callback(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+    spdif_receiver_handle_t rx = (spdif_receiver_handle_t)user_ctx;
+    __atomic_store_n(&rx->i2s_overflow, true, __ATOMIC_RELEASE);
+    return false;
+}
+
+// I2S RX as a 1-bit sampler: the bit clock is the sample clock, and with
+// 32-bit left-justified slots the words read back hold the line's samples
+// back to back, earliest in the MSB. Only the data pin is routed.
+static esp_err_t i2s_input_init(spdif_receiver_handle_t rx, const spdif_receiver_config_t *config,
+                                latency_plan_t *plan)
+{
+    // A DMA buffer is a chunk; under a latency budget it gets half of it
+    uint32_t frames = I2S_DMA_FRAMES;
+    if (config->latency_us)
+    {
+        uint64_t budget_frames = (uint64_t)config->latency_us * (I2S_SAMPLE_HZ / 64) / 2 / 1000000;
+        if (budget_frames < frames)
+        {
+            frames = budget_frames > I2S_MIN_DMA_FRAMES ? (uint32_t)budget_frames : I2S_MIN_DMA_FRAMES;
+        }
+        ESP_LOGI("SPDIF_IN", "gpio %d: %lu us latency: %lu samples per I2S chunk", config->input_pin,
+                 (unsigned long)config->latency_us, (unsigned long)frames * 64);
+    }
+    rx->i2s_chunk_words = frames * 2;
+    rx->i2s_words = heap_caps_malloc(rx->i2s_chunk_words * sizeof(uint32_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    rx->i2s_symbols = heap_caps_malloc(I2S_SCRATCH_SYMBOLS * sizeof(rmt_symbol_word_t),
+                                       MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!rx->i2s_words || !rx->i2s_symbols)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    oversample_init(&rx->oversample);
+
+    i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
+    chan_cfg.dma_desc_num = I2S_DMA_BUFFERS;
+    chan_cfg.dma_frame_num = frames;
+    esp_err_t ret = i2s_new_channel(&chan_cfg, NULL, &rx->i2s_channel);
+    if (ret != ESP_OK)
+    {
+        rx->i2s_channel = NULL;
+        return ret;
+    }
+    i2s_std_config_t std_cfg = {
+        .clk_cfg = I2S_STD_CLK_DEFAULT_CONFIG(I2S_SAMPLE_HZ / 64),
+        .slot_cfg = I2S_STD_MSB_SLOT_DEFAULT_CONFIG(I2S_DATA_BIT_WIDTH_32BIT, I2S_SLOT_MODE_STEREO),
+        .gpio_cfg = {
+            .mclk = I2S_GPIO_UNUSED,
+            .bclk = I2S_GPIO_UNUSED,
+            .ws = I2S_GPIO_UNUSED,
+            .dout = I2S_GPIO_UNUSED,
+            .din = config->input_pin,
+        },
+    };
+    // MCLK at twice the bit clock, the lowest the dividers allow
+    std_cfg.clk_cfg.mclk_multiple = I2S_MCLK_MULTIPLE_128;
+    ret = i2s_channel_init_std_mode(rx->i2s_channel, &std_cfg);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+
+    i2s_event_callbacks_t cbs = {.on_recv_q_ovf = i2s_overflow_callback};
+    return i2s_channel_register_event_callback(rx->i2s_channel, &cbs, rx);
+}
+
+static esp_err_t i2s_input_start(spdif_receiver_handle_t rx)
+{
+    return i2s_channel_enable(rx->i2s_channel);
+}
+
+static esp_err_t i2s_input_stop(spdif_receiver_handle_t rx)
+{
+    return i2s_channel_disable(rx->i2s_channel);
+}
+
+// One DMA buffer, or what arrived of it within wait
+static bool i2s_input_wait(spdif_receiver_handle_t rx, TickType_t wait)
+{
+    // A disabled channel fails the read at once; sleep the wait out instead
+    if (!__atomic_load_n(&rx->running, __ATOMIC_RELAXED))
+    {
+        vTaskDelay(wait);
+        return false;
+    }
+    size_t bytes = 0;
+    i2s_channel_read(rx->i2s_channel, rx->i2s_words, rx->i2s_chunk_words * sizeof(uint32_t), &bytes,
+                     pdTICKS_TO_MS(wait));
+    rx->i2s_time_us = esp_timer_get_time();
+    rx->i2s_pending_words = bytes / sizeof(uint32_t);
+    return rx->i2s_pending_words > 0;
+}
+
+// Empty the driver's queue; the next read is current input
+static void i2s_input_discard(spdif_receiver_handle_t rx)
+{
+    size_t bytes;
+    while (i2s_channel_read(rx->i2s_channel, rx->i2s_words, rx->i2s_chunk_words * sizeof(uint32_t), &bytes, 0) ==
+           ESP_OK)
+    {
+    }
+    oversample_init(&rx->oversample);
+}
+
+// Extract the pulses of the pending words and decode them, a scratch buffer
+// at a time
+static void i2s_input_consume(spdif_receiver_handle_t rx)
+{
+    // The buffer dropped may be anywhere in the queue: drop the rest too, so
+    // that decoding restarts right after the gap
+    if (__atomic_exchange_n(&rx->i2s_overflow, false, __ATOMIC_ACQ_REL))
+    {
+        i2s_input_discard(rx);
+        spdif_decoder_gap(&rx->decoder);
+        return;
+    }
+    // Input resumed after a stop; the pulse in progress is not the old one
+    if (__atomic_load_n(&rx->resync, __ATOMIC_ACQUIRE))
+    {
+        oversample_init(&rx->oversample);
+    }
+    const uint32_t *words = rx->i2s_words;
+    size_t num_words = rx->i2s_pending_words;
+    while (num_words)
+    {
+        size_t used;
+        size_t num_symbols = oversample_edges(&rx->oversample, words, num_words, rx->i2s_symbols,
+                                              I2S_SCRATCH_SYMBOLS, &used);
+        words += used;
+        num_words -= used;
+        if (num_symbols)
+        {
+            rx_resync(rx, rx->rx_symbol_count);
+            rx_capture(rx, rx->i2s_symbols, num_symbols, num_words ? 0 : rx->i2s_time_us);
+            spdif_decoder_feed(&rx->decoder, rx->i2s_symbols, num_symbols);
+            __atomic_store_n(&rx->rx_symbol_count, rx->rx_symbol_count + num_symbols, __ATOMIC_RELAXED);
+        }
+    }
+    rx_arrival(rx, rx->i2s_time_us);
+}
+
+static void i2s_input_del(spdif_receiver_handle_t rx)
+{
+    if (rx->i2s_channel)
+    {
+        i2s_del_channel(rx->i2s_channel);
+    }
+    heap_caps_free(rx->i2s_words);
+    heap_caps_free(rx->i2s_symbols);
+}
+
+static const rx_backend_t i2s_backend = {
+    .init = i2s_input_init,
+    .start = i2s_input_start,
+    .resume = i2s_input_start,
+    .stop = i2s_input_stop,
+    .wait = i2s_input_wait,
+    .consume = i2s_input_consume,
+    .discard = i2s_input_discard,
+    .del = i2s_input_del,
+};
+#endif
+
+esp_err_t spdif_rx_new(const spdif_receiver_config_t *config, spdif_receiver_handle_t *ret_rx)
+{
+    if (!config || !ret_rx || config->pcm_format >= SPDIF_PCM_FORMAT_COUNT ||
+        (config->output_rate && config->asrc_quality >= SPDIF_ASRC_QUALITY_COUNT) ||
+        config->post.channel_map >= SPDIF_CHANNEL_MAP_COUNT || config->protocol >= SPDIF_PROTOCOL_COUNT ||
+        config->overflow >= SPDIF_OVERFLOW_COUNT || config->backend >= SPDIF_BACKEND_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if !I2S_CAPTURE
+    if (config->backend == SPDIF_BACKEND_I2S)
+    {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+#endif
+    // The converter and post-processing are stereo only
+    if (config->protocol != SPDIF_PROTOCOL_SPDIF && (config->output_rate || config->post.enabled))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    spdif_receiver_handle_t rx = heap_caps_calloc(1, sizeof(*rx), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!rx)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+    rx->backend = &rmt_backend;
+#if I2S_CAPTURE
+    if (config->backend == SPDIF_BACKEND_I2S)
+    {
+        rx->backend = &i2s_backend;
+    }
+#endif
+    rx->input_pin = config->input_pin;
+    rx->pcm_format = config->pcm_format;
+
+    // Kconfig sizes, or smaller ones fitting the latency budget. The PCM ring
+    // keeps its size in bytes, so it holds a quarter as many ADAT frames.
+    size_t frame_bytes = spdif_pcm_frame_bytes(config->pcm_format);
+    if (config->protocol != SPDIF_PROTOCOL_SPDIF)
+    {
+        frame_bytes = frame_bytes * SPDIF_ADAT_CHANNELS / 2;
+    }
+    latency_plan_t plan = {
+#if ZERO_COPY_RX
+        .rx_symbols = RMT_MEM_BLOCK_SYMBOLS / RX_BUFFER_COUNT,
+#else
+        .rx_symbols = RMT_MEM_BLOCK_SYMBOLS,
+#endif
+        .ring_symbols = SYMBOL_BUFFER_SIZE,
+        .block_frames = PCM_BLOCK_FRAMES,
+        .pcm_frames = SPDIF_PCM_BUFFER_SIZE / frame_bytes,
+    };
+    rx->overflow = config->overflow;
+    rx->overflow_wait_ms = config->overflow_wait_ms;
+    if (config->max_sample_rate)
+    {
+        memory_plan(&plan, config->max_sample_rate);
+    }
+    if (config->latency_us)
+    {
+        latency_plan(&plan, config->latency_us);
+        rx->overflow_wait_ms = 0;
+        rx->flush_each_chunk = true;
+        ESP_LOGI("SPDIF_IN", "gpio %d: %lu us latency: %lu symbols per chunk, %lu symbol ring, "
+                 "%lu frames per block, %lu frame PCM ring", config->input_pin, (unsigned long)config->latency_us,
+                 (unsigned long)plan.rx_symbols, (unsigned long)plan.ring_symbols,
+                 (unsigned long)plan.block_frames, (unsigned long)plan.pcm_frames);
+    }
+    rx->rx_symbols = plan.rx_symbols;
+
+    spdif_pcm_format_t decode_format = config->post.enabled ? SPDIF_PCM_FORMAT_S24_32 : config->pcm_format;
+    spdif_decoder_init(&rx->decoder, &rx->timing, decode_format,
+                       rx->pcm_block, plan.block_frames, pcm_ringbuf_flush, rx);
+    spdif_decoder_set_protocol(&rx->decoder, config->protocol);
+#if I2S_CAPTURE
+    if (config->backend == SPDIF_BACKEND_I2S)
+    {
+        // A tick is one sample of the line
+        spdif_decoder_set_resolution(&rx->decoder, I2S_SAMPLE_HZ);
+    }
+#endif
+    spdif_decoder_set_timing_store(&rx->decoder, &config->timing_store);
+    spdif_decoder_set_burst_sink(&rx->decoder, &config->burst_sink);
+    spdif_decoder_set_concealment(&rx->decoder, config->conceal);
+
+    rx->lock_events = xEventGroupCreate();
+    if (!rx->lock_events)
+    {
+        receiver_free(rx);
+        return ESP_ERR_NO_MEM;
+    }
+    xEventGroupSetBits(rx->lock_events, SPDIF_LOCK_EVENT_BIT(SPDIF_LOCK_NO_SIGNAL));
+    rx->lock_cb = config->lock_cb;
+    rx->lock_cb_ctx = config->lock_cb_ctx;
+    spdif_decoder_set_lock_cb(&rx->decoder, lock_state_changed, rx);
+
+    // A custom sink replaces the PCM ring buffer; frames go to it straight
+    // from the decoder task
+    if (config->sink.write)
+    {
+        spdif_decoder_set_sink(&rx->decoder, &config->sink);
+    }
+    else
+    {
+        rx->pcm_buffer = pcm_ring_create(plan.pcm_frames * frame_bytes);
+        if (rx->pcm_buffer && rx->overflow == SPDIF_OVERFLOW_DROP_OLDEST)
+        {
+            rx->pcm_read_lock = xSemaphoreCreateMutex();
+        }
+        if (!rx->pcm_buffer || (rx->overflow == SPDIF_OVERFLOW_DROP_OLDEST && !rx->pcm_read_lock))
+        {
+            receiver_free(rx);
+            return ESP_ERR_NO_MEM;
+        }
+        rx->pcm_ring = (pcm_ring_t){.send = pcm_ring_send, .discard = pcm_ring_discard, .ctx = rx};
+    }
+
+    // The sample-rate converter goes between the decoder and that sink. Its
+    // filter table may live outside internal RAM.
+    if (config->output_rate)
+    {
+        spdif_pcm_sink_t out = rx->decoder.sink;
+        rx->asrc = heap_caps_calloc(1, sizeof(spdif_asrc_t), MALLOC_CAP_DEFAULT);
+        if (!rx->asrc || !spdif_asrc_init(rx->asrc, config->pcm_format, config->output_rate,
+                                          config->asrc_quality, &out))
+        {
+            receiver_free(rx);
+            return ESP_ERR_NO_MEM;
+        }
+        spdif_pcm_sink_t in = spdif_asrc_sink(rx->asrc);
+        spdif_decoder_set_sink(&rx->decoder, &in);
+    }
+
+    // Post-processing in front of both, on the decoder's 24-bit frames
+    if (config->post.enabled)
+    {
+        spdif_pcm_sink_t out = rx->decoder.sink;
+        rx->post = heap_caps_calloc(1, sizeof(spdif_post_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        if (!rx->post)
+        {
+            receiver_free(rx);
+            return ESP_ERR_NO_MEM;
+        }
+        spdif_post_init(rx->post, config->pcm_format, &config->post, &out);
+        spdif_pcm_sink_t in = spdif_post_sink(rx->post);
+        spdif_decoder_set_sink(&rx->decoder, &in);
+    }
+
+#if PROFILE_STATS
+    profile_init(&rx->profile);
+    spdif_decoder_set_profile(&rx->decoder, &rx->profile);
+#endif
+
+    if (config->capture.write && !capture_start(&rx->capture, &config->capture, rx->decoder.resolution_hz, 0))
+    {
+        ESP_LOGW("SPDIF_IN", "gpio %d: capture sink failed on the header, capture off", config->input_pin);
+        rx->capture.sink.write = NULL;
+    }
+
+#if LATENCY_STATS
+    // Last in front of the decoder, so it sees each block as it leaves
+    latency_probe_init(&rx->latency, &rx->decoder.sink, latency_now_us, NULL);
+    spdif_pcm_sink_t probe = latency_probe_sink(&rx->latency);
+    spdif_decoder_set_sink(&rx->decoder, &probe);
+#endif
+
+    esp_err_t ret = rx->backend->init(rx, config, &plan);
+    if (ret != ESP_OK)
+    {
+        receiver_free(rx);
+        return ret;
+    }
+
+    uint32_t rx_buffer_count = 0;
+    bool psram = false;
+#if ZERO_COPY_RX
+    rx_buffer_count = RX_BUFFER_COUNT;
+#endif
+#if PSRAM_BUFFERS
+    psram = true;
+#endif
+    // A longer wait for the PCM ring costs input as well
+    uint32_t hold_us = symbol_hold_us(&plan, rx_buffer_count,
+                                      config->max_sample_rate ? config->max_sample_rate : MEMORY_PLAN_RATE);
+    size_t state_bytes = sizeof(*rx) + (rx->post ? sizeof(spdif_post_t) : 0);
+#if I2S_CAPTURE
+    if (config->backend == SPDIF_BACKEND_I2S)
+    {
+        // DMA buffers of words, a symbol's size each, and no symbol ring
+        plan.rx_symbols = rx->i2s_chunk_words;
+        plan.ring_symbols = 0;
+        rx_buffer_count = I2S_DMA_BUFFERS;
+        hold_us = (uint32_t)((uint64_t)(I2S_DMA_BUFFERS - 1) * rx->i2s_chunk_words * 32 * 1000000 / I2S_SAMPLE_HZ);
+        state_bytes += rx->i2s_chunk_words * sizeof(uint32_t) + I2S_SCRATCH_SYMBOLS * sizeof(rmt_symbol_word_t);
+    }
+#endif
+    if (rx->pcm_buffer && rx->overflow == SPDIF_OVERFLOW_BLOCK && rx->overflow_wait_ms * 1000 > hold_us)
+    {
+        ESP_LOGW("SPDIF_IN", "gpio %d: overflow wait %lu ms is longer than the %lu us of input the symbol "
+                 "buffers hold; a stalled reader will cost symbols too", config->input_pin,
+                 (unsigned long)rx->overflow_wait_ms, (unsigned long)hold_us);
+    }
+    memory_footprint(&plan, rx_buffer_count, rx->pcm_buffer ? frame_bytes : 0, state_bytes, psram, &rx->memory);
+    ESP_LOGI("SPDIF_IN", "gpio %d: memory: %lu DMA, %lu symbol ring, %lu PCM ring, %lu state; "
+             "%lu internal locked, %lu acquiring, %lu PSRAM bytes", config->input_pin,
+             (unsigned long)rx->memory.dma_bytes, (unsigned long)rx->memory.symbol_ring_bytes,
+             (unsigned long)rx->memory.pcm_ring_bytes, (unsigned long)rx->memory.state_bytes,
+             (unsigned long)rx->memory.internal_bytes, (unsigned long)rx->memory.internal_peak_bytes,
+             (unsigned long)rx->memory.psram_bytes);
+
+    if (config->init_done_cb)
+    {
+        config->init_done_cb();
+    }
+
+    rx->running = true;
+
+    if (xTaskCreatePinnedToCore(spdif_decoder_task, "spdif_decoder",
+                                DECODER_TASK_STACK, rx,
+                                DECODER_TASK_PRIORITY, &rx->decoder_task, config->core_id) != pdPASS)
+    {
+        receiver_free(rx);
+        return ESP_FAIL;
+    }
+
+    *ret_rx = rx;
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_del(spdif_receiver_handle_t rx)
+{
+    if (!rx)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // Stop input first so the task drains, then wait for it to exit
+    rx->backend->stop(rx);
+    __atomic_store_n(&rx->stop_waiter, xTaskGetCurrentTaskHandle(), __ATOMIC_RELEASE);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    receiver_free(rx);
+    return ESP_OK;
+}
+
+// Resume input without timing discovery: the decoder keeps its timing and
+// restarts at the first preamble after the gap
+esp_err_t spdif_rx_start(spdif_receiver_handle_t rx)
+{
+    if (!rx)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rx->running)
+    {
+        return ESP_OK;
+    }
+    __atomic_store_n(&rx->resync, true, __ATOMIC_RELEASE);
+    esp_err_t ret = rx->backend->resume(rx);
+    if (ret != ESP_OK)
+    {
+        return ret;
+    }
+    rx->running = true;
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_stop(spdif_receiver_handle_t rx)
+{
+    if (!rx)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!rx->running)
+    {
+        return ESP_OK;
+    }
+    esp_err_t ret = rx->backend->stop(rx);
+    if (ret == ESP_OK)
+    {
+        // The ISR is quiet from here; later symbols come after the restart
+        rx->running = false;
+        rx->resume_count = __atomic_load_n(&rx->rx_symbol_count, __ATOMIC_RELAXED);
+    }
+    return ret;
+}
+
+uint32_t spdif_rx_get_sample_rate(spdif_receiver_handle_t rx)
+{
+    if (!rx)
+    {
+        return 0;
+    }
+
+    // Measured rate first; the channel status code covers rates the
+    // pulse timing can't distinguish at the configured resolution. The
+    // timing itself is the decoder task's, so only its published rate is read.
+    uint32_t rate = spdif_decoder_get_timing_rate(&rx->decoder);
+    if (rate)
+    {
+        return rate;
+    }
+
+    spdif_channel_status_t status;
+    if (spdif_decoder_get_lock_state(&rx->decoder) == SPDIF_LOCK_LOCKED &&
+        spdif_decoder_get_channel_status(&rx->decoder, &status))
+    {
+        return status.sample_rate;
+    }
+    return 0;
+}
+
+spdif_pcm_format_t spdif_rx_get_pcm_format(spdif_receiver_handle_t rx)
+{
+    return rx ? rx->pcm_format : SPDIF_PCM_FORMAT_S16;
+}
+
+uint32_t spdif_rx_get_channels(spdif_receiver_handle_t rx)
+{
+    return rx ? spdif_decoder_get_channels(&rx->decoder) : 2;
+}
+
+esp_err_t spdif_rx_get_channel_status(spdif_receiver_handle_t rx, spdif_channel_status_t *status)
+{
+    if (!rx || !status)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!spdif_decoder_get_channel_status(&rx->decoder, status))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_get_stats(spdif_receiver_handle_t rx, spdif_stats_t *stats)
+{
+    if (!rx || !stats)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    spdif_decoder_get_stats(&rx->decoder, stats);
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_get_clock(spdif_receiver_handle_t rx, spdif_clock_t *clock)
+{
+    if (!rx || !clock)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!spdif_decoder_get_clock(&rx->decoder, clock))
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_get_latency(spdif_receiver_handle_t rx, spdif_latency_t *latency)
+{
+    if (!rx || !latency)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if LATENCY_STATS
+    latency_probe_get(&rx->latency, latency);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+spdif_lock_state_t spdif_rx_get_lock_state(spdif_receiver_handle_t rx)
+{
+    return rx ? spdif_decoder_get_lock_state(&rx->decoder) : SPDIF_LOCK_NO_SIGNAL;
+}
+
+EventGroupHandle_t spdif_rx_get_lock_events(spdif_receiver_handle_t rx)
+{
+    return rx ? rx->lock_events : NULL;
+}
+
+esp_err_t spdif_rx_get_profile(spdif_receiver_handle_t rx, spdif_profile_t *profile)
+{
+    if (!rx || !profile)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+#if PROFILE_STATS
+    profile_get(&rx->profile, profile);
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t spdif_rx_get_memory(spdif_receiver_handle_t rx, spdif_memory_t *memory)
+{
+    if (!rx || !memory)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *memory = rx->memory;
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_set_output_rate(spdif_receiver_handle_t rx, double rate)
+{
+    if (!rx || rate < 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!rx->asrc)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    __atomic_store_n(&rx->output_clock_mhz, (uint32_t)(rate * 1000 + 0.5), __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_set_post(spdif_receiver_handle_t rx, const spdif_post_config_t *post)
+{
+    if (!rx || !post || post->channel_map >= SPDIF_CHANNEL_MAP_COUNT)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!rx->post)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    spdif_post_configure(rx->post, post);
+    return ESP_OK;
+}
+
+esp_err_t spdif_rx_get_meter(spdif_receiver_handle_t rx, spdif_meter_t *meter)
+{
+    if (!rx || !meter)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return rx->post && spdif_post_get_meter(rx->post, meter) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+RingbufHandle_t spdif_rx_get_ringbuf(spdif_receiver_handle_t rx)
+{
+    return rx ? rx->pcm_buffer : NULL;
+}
+
+int spdif_rx_read(spdif_receiver_handle_t rx, uint8_t *buffer, size_t size, TickType_t wait)
+{
+    if (!rx || !rx->pcm_buffer)
+    {
+        return 0;
+    }
+    size_t frame_bytes = rx_frame_bytes(rx);
+    size -= size % frame_bytes;
+
+    // Whole frames only, with no discard in between
+    if (rx->pcm_read_lock)
+    {
+        xSemaphoreTake(rx->pcm_read_lock, portMAX_DELAY);
+    }
+    size_t total = 0;
+    while (total < size)
+    {
+        size_t received_size = 0;
+        uint8_t *data = (uint8_t *)xRingbufferReceiveUpTo(
+            rx->pcm_buffer, &received_size, wait, size - total);
+        if (!data)
+        {
+            break;
+        }
+        memcpy(buffer + total, data, received_size);
+        vRingbufferReturnItem(rx->pcm_buffer, (void *)data);
+        total += received_size;
+        if (total % frame_bytes == 0)
+        {
+            break;
+        }
+    }
+    if (rx->pcm_read_lock)
+    {
+        xSemaphoreGive(rx->pcm_read_lock);
+    }
+    return total;
+}
+
+// Handle-less API on the default instance
+
+esp_err_t spdif_receiver_init(int input_pin, void (*init_done_cb)(void))
+{
+    spdif_receiver_config_t config = SPDIF_RECEIVER_CONFIG_DEFAULT(input_pin);
+    config.init_done_cb = init_done_cb;
+    return spdif_receiver_init_config(&config);
+}
+
+esp_err_t spdif_receiver_init_config(const spdif_receiver_config_t *config)
+{
+    ESP_LOGI("SPDIF_IN", "SPDIF Init Called");
+
+    if (g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_err_t ret = spdif_rx_new(config, &g_default_rx);
+    if (ret == ESP_OK)
+    {
+        spdif_in_pcm_buffer = g_default_rx->pcm_buffer;
+    }
+    return ret;
+}
+
+esp_err_t spdif_receiver_start(void)
+{
+    if (g_default_rx)
+    {
+        return spdif_rx_start(g_default_rx);
+    }
+    return ESP_OK;
+}
+
+esp_err_t spdif_receiver_stop(void)
+{
+    if (g_default_rx)
+    {
+        return spdif_rx_stop(g_default_rx);
+    }
+    return ESP_OK;
+}
+
+void spdif_receiver_deinit(void)
+{
+    if (g_default_rx)
+    {
+        spdif_in_pcm_buffer = NULL;
+        spdif_rx_del(g_default_rx);
+        g_default_rx = NULL;
+    }
+}
+
+spdif_receiver_handle_t spdif_receiver_get_handle(void)
+{
+    return g_default_rx;
+}
+
+uint32_t spdif_receiver_get_sample_rate(void)
+{
+    return spdif_rx_get_sample_rate(g_default_rx);
+}
+
+spdif_pcm_format_t spdif_receiver_get_pcm_format(void)
+{
+    return spdif_rx_get_pcm_format(g_default_rx);
+}
+
+uint32_t spdif_receiver_get_channels(void)
+{
+    return spdif_rx_get_channels(g_default_rx);
+}
+
+esp_err_t spdif_receiver_get_channel_status(spdif_channel_status_t *status)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_channel_status(g_default_rx, status);
+}
+
+esp_err_t spdif_receiver_get_stats(spdif_stats_t *stats)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_stats(g_default_rx, stats);
+}
+
+esp_err_t spdif_receiver_get_clock(spdif_clock_t *clock)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_clock(g_default_rx, clock);
+}
+
+esp_err_t spdif_receiver_get_latency(spdif_latency_t *latency)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_latency(g_default_rx, latency);
+}
+
+spdif_lock_state_t spdif_receiver_get_lock_state(void)
+{
+    return spdif_rx_get_lock_state(g_default_rx);
+}
+
+EventGroupHandle_t spdif_receiver_get_lock_events(void)
+{
+    return spdif_rx_get_lock_events(g_default_rx);
+}
+
+esp_err_t spdif_receiver_get_profile(spdif_profile_t *profile)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_profile(g_default_rx, profile);
+}
+
+esp_err_t spdif_receiver_get_memory(spdif_memory_t *memory)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_memory(g_default_rx, memory);
+}
+
+esp_err_t spdif_receiver_set_post(const spdif_post_config_t *post)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_set_post(g_default_rx, post);
+}
+
+esp_err_t spdif_receiver_get_meter(spdif_meter_t *meter)
+{
+    if (!g_default_rx)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    return spdif_rx_get_meter(g_default_rx, meter);
+}
+
+esp_err_t spdif_receiver_set_output_rate(double rate)
+{
+    if (!g_default_rx)
     {
-        case 13:
-            return 48000;
-        case 14:
-            return 44100;
-        default:
-            return 0;
+        return ESP_ERR_INVALID_STATE;
     }
+    return spdif_rx_set_output_rate(g_default_rx, rate);
 }
@@ -0,0 +1,110 @@
+#ifndef SPDIF_PORT_H
+#define SPDIF_PORT_H
+
+// Platform shim so the decoder core (histogram.c, spdif_decoder.c) builds both
+// as part of the ESP-IDF component and natively on the host for benchmarking.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef ESP_PLATFORM
+
+#include "sdkconfig.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "driver/rmt_types.h"
+
+// Profiler clock: CPU cycles
+#define SPDIF_PROFILE_CLOCK_HZ (CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1000000u)
+
+static inline uint32_t spdif_profile_now(void)
+{
+    return esp_cpu_get_cycle_count();
+}
+
+// Discovery state (pulse histograms) is only touched by the decoder task,
+// so it may go to PSRAM
+static inline void *spdif_discovery_calloc(size_t n, size_t size)
+{
+#ifdef CONFIG_SPDIF_IN_PSRAM_BUFFERS
+    return heap_caps_calloc_prefer(n, size, 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT,
+                                   MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#else
+    return heap_caps_calloc(n, size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+#endif
+}
+
+static inline void spdif_discovery_free(void *p)
+{
+    heap_caps_free(p);
+}
+
+#else
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+// Same layout as the IDF definition in hal/rmt_types.h
+typedef union
+{
+    struct
+    {
+        uint16_t duration0 : 15;
+        uint16_t level0 : 1;
+        uint16_t duration1 : 15;
+        uint16_t level1 : 1;
+    };
+    uint32_t val;
+} rmt_symbol_word_t;
+
+#define ESP_LOGE(tag, fmt, ...) fprintf(stderr, "E (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, fmt, ...) fprintf(stderr, "W (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, fmt, ...) fprintf(stderr, "I (%s) " fmt "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, fmt, ...) ((void)(tag))
+
+#define IRAM_ATTR
+#define FORCE_INLINE_ATTR static inline __attribute__((always_inline))
+
+// Profiler clock: the monotonic clock in ns, wrapping like a cycle counter
+#define SPDIF_PROFILE_CLOCK_HZ 1000000000u
+
+static inline uint32_t spdif_profile_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+}
+
+static inline void *spdif_discovery_calloc(size_t n, size_t size)
+{
+    return calloc(n, size);
+}
+
+static inline void spdif_discovery_free(void *p)
+{
+    free(p);
+}
+
+// Kconfig defaults for host builds (keep in sync with Kconfig)
+#define CONFIG_SPDIF_IN_RMT_RESOLUTION_HZ 80000000
+#define CONFIG_SPDIF_IN_HISTOGRAM_BIN_COUNT 256
+#define CONFIG_SPDIF_IN_MAX_PULSE_WIDTH_NS 2000
+#define CONFIG_SPDIF_IN_MIN_SAMPLES_FOR_ANALYSIS 2048
+#define CONFIG_SPDIF_IN_PULSE_RATIO_TOLERANCE_MILLIPCT 150
+#define CONFIG_SPDIF_IN_EXPECTED_SHORT_PULSE_PCT_TENTHS 600
+#define CONFIG_SPDIF_IN_EXPECTED_MEDIUM_PULSE_PCT_TENTHS 350
+#define CONFIG_SPDIF_IN_EXPECTED_LONG_PULSE_PCT_TENTHS 50
+#define CONFIG_SPDIF_IN_DISTRIBUTION_TOLERANCE_PCT 100
+#define CONFIG_SPDIF_IN_REFERENCE_DECODER 1
+#define CONFIG_SPDIF_IN_TIMING_TRACKING 1
+#define CONFIG_SPDIF_IN_CLOCK_RECOVERY 1
+#define CONFIG_SPDIF_IN_CLOCK_BANDWIDTH_MHZ 500
+#define CONFIG_SPDIF_IN_PROFILE 1
+
+#endif // ESP_PLATFORM
+
+#endif // SPDIF_PORT_H
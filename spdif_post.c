@@ -0,0 +1,287 @@
+#include "spdif_post.h"
+#include <math.h>
+#include <string.h>
+
+// Q28 unity gain; +18 dB still fits int32
+#define POST_UNITY (1 << 28)
+
+static int32_t sat32(int64_t v)
+{
+    return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t)v;
+}
+
+static void post_apply(spdif_post_t *post, const spdif_post_config_t *config)
+{
+    float gain_db = config->gain_db < SPDIF_POST_MAX_GAIN_DB ? config->gain_db : SPDIF_POST_MAX_GAIN_DB;
+    int32_t g = (int32_t)lrintf(powf(10.0f, gain_db / 20.0f) * POST_UNITY);
+    int32_t half = g / 2;
+    switch (config->channel_map)
+    {
+        case SPDIF_CHANNEL_MAP_SWAP:
+            post->matrix[0] = 0, post->matrix[1] = g, post->matrix[2] = g, post->matrix[3] = 0;
+            break;
+        case SPDIF_CHANNEL_MAP_DOWNMIX:
+            post->matrix[0] = half, post->matrix[1] = half, post->matrix[2] = half, post->matrix[3] = half;
+            break;
+        case SPDIF_CHANNEL_MAP_LEFT:
+            post->matrix[0] = g, post->matrix[1] = 0, post->matrix[2] = g, post->matrix[3] = 0;
+            break;
+        case SPDIF_CHANNEL_MAP_RIGHT:
+            post->matrix[0] = 0, post->matrix[1] = g, post->matrix[2] = 0, post->matrix[3] = g;
+            break;
+        default:
+            post->matrix[0] = g, post->matrix[1] = 0, post->matrix[2] = 0, post->matrix[3] = g;
+            break;
+    }
+    post->identity = post->matrix[0] == POST_UNITY && !post->matrix[1] && !post->matrix[2] &&
+                     post->matrix[3] == POST_UNITY;
+    post->dither = config->dither;
+    if (config->meter_frames != post->meter_frames)
+    {
+        // Start a fresh window at the new length
+        post->meter_frames = config->meter_frames;
+        memset(post->peak, 0, sizeof(post->peak));
+        memset(post->sum_sq, 0, sizeof(post->sum_sq));
+        post->clipped = 0;
+        post->meter_fill = 0;
+    }
+}
+
+void spdif_post_init(spdif_post_t *post, spdif_pcm_format_t format, const spdif_post_config_t *config,
+                     const spdif_pcm_sink_t *out)
+{
+    memset(post, 0, sizeof(*post));
+    post->format = format;
+    post->out = *out;
+    post->rng = 0x9E3779B9u;
+    post_apply(post, config);
+}
+
+void spdif_post_configure(spdif_post_t *post, const spdif_post_config_t *config)
+{
+    uint32_t generation = post->pending_generation + 1;
+    // The last publish is visible before this slot changes, so a reader
+    // copying it sees the generation move and retries
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    post->pending[generation & 1] = *config;
+    __atomic_store_n(&post->pending_generation, generation, __ATOMIC_RELEASE);
+}
+
+// Pick up settings staged since the last write
+static void post_update(spdif_post_t *post)
+{
+    uint32_t generation = __atomic_load_n(&post->pending_generation, __ATOMIC_ACQUIRE);
+    if (generation == post->applied_generation)
+    {
+        return;
+    }
+    spdif_post_config_t config;
+    do
+    {
+        generation = __atomic_load_n(&post->pending_generation, __ATOMIC_ACQUIRE);
+        config = post->pending[generation & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        // Any publish since the load may have started on the slot we copied
+    } while (__atomic_load_n(&post->pending_generation, __ATOMIC_RELAXED) != generation);
+    post->applied_generation = generation;
+    post_apply(post, &config);
+}
+
+uint32_t spdif_post_mix(const int32_t *restrict in, int32_t *restrict out, size_t num_frames, const int32_t *matrix)
+{
+    const int64_t m0 = matrix[0], m1 = matrix[1], m2 = matrix[2], m3 = matrix[3];
+    uint32_t clipped = 0;
+    for (size_t i = 0; i < num_frames; i++)
+    {
+        int64_t l = (in[2 * i] * m0 + in[2 * i + 1] * m1) >> 28;
+        int64_t r = (in[2 * i] * m2 + in[2 * i + 1] * m3) >> 28;
+        out[2 * i] = sat32(l);
+        out[2 * i + 1] = sat32(r);
+        clipped += (out[2 * i] != l) + (out[2 * i + 1] != r);
+    }
+    return clipped;
+}
+
+void spdif_post_meter(spdif_post_t *post, const int32_t *restrict in, size_t num_frames)
+{
+    uint32_t peak_l = post->peak[0], peak_r = post->peak[1];
+    uint64_t sum_l = post->sum_sq[0], sum_r = post->sum_sq[1];
+    for (size_t i = 0; i < num_frames; i++)
+    {
+        // Magnitude without overflow at INT32_MIN; squares of the top 16 bits
+        int32_t l = in[2 * i], r = in[2 * i + 1];
+        uint32_t al = (uint32_t)(l ^ (l >> 31)), ar = (uint32_t)(r ^ (r >> 31));
+        peak_l = al > peak_l ? al : peak_l;
+        peak_r = ar > peak_r ? ar : peak_r;
+        int32_t hl = l >> 16, hr = r >> 16;
+        sum_l += (uint32_t)(hl * hl);
+        sum_r += (uint32_t)(hr * hr);
+    }
+    post->peak[0] = peak_l, post->peak[1] = peak_r;
+    post->sum_sq[0] = sum_l, post->sum_sq[1] = sum_r;
+}
+
+void spdif_post_quantize_s16(const int32_t *restrict in, int16_t *restrict out, size_t num_frames, uint32_t *rng)
+{
+    if (!rng)
+    {
+        for (size_t i = 0; i < num_frames * 2; i++)
+        {
+            out[i] = (int16_t)(in[i] >> 16);
+        }
+        return;
+    }
+    // Difference of two uniform 16-bit values: triangular over +-1 output
+    // LSB. Halved along with the sample so the rounding sum fits int32.
+    uint32_t x = *rng;
+    for (size_t i = 0; i < num_frames * 2; i++)
+    {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        int32_t tpdf = (int32_t)(x & 0xFFFF) - (int32_t)(x >> 16);
+        int32_t v = ((in[i] >> 1) + (tpdf >> 1) + 0x4000) >> 15;
+        out[i] = (int16_t)(v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : v);
+    }
+    *rng = x;
+}
+
+void spdif_post_quantize(const int32_t *restrict in, uint8_t *restrict out, size_t num_frames,
+                         spdif_pcm_format_t format)
+{
+    switch (format)
+    {
+        case SPDIF_PCM_FORMAT_S16:
+            spdif_post_quantize_s16(in, (int16_t *)out, num_frames, NULL);
+            break;
+        case SPDIF_PCM_FORMAT_S24_32:
+        {
+            int32_t *o = (int32_t *)out;
+            for (size_t i = 0; i < num_frames * 2; i++)
+            {
+                o[i] = (int32_t)((uint32_t)in[i] & 0xFFFFFF00u);
+            }
+            break;
+        }
+        case SPDIF_PCM_FORMAT_S24_PACKED:
+            for (size_t i = 0; i < num_frames * 2; i++)
+            {
+                out[3 * i] = (uint8_t)(in[i] >> 8);
+                out[3 * i + 1] = (uint8_t)(in[i] >> 16);
+                out[3 * i + 2] = (uint8_t)(in[i] >> 24);
+            }
+            break;
+        case SPDIF_PCM_FORMAT_F32:
+        default:
+        {
+            float *o = (float *)out;
+            for (size_t i = 0; i < num_frames * 2; i++)
+            {
+                o[i] = (int32_t)((uint32_t)in[i] & 0xFFFFFF00u) * (1.0f / 2147483648.0f);
+            }
+            break;
+        }
+    }
+}
+
+// Close the meter window and publish it
+static void post_publish(spdif_post_t *post)
+{
+    uint32_t generation = post->meter_generation + 1;
+    spdif_meter_t *slot = &post->meter_slots[generation & 1];
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int c = 0; c < 2; c++)
+    {
+        slot->peak[c] = post->peak[c] * (1.0f / 2147483648.0f);
+        slot->rms[c] = sqrtf((float)post->sum_sq[c] / post->meter_frames) * (1.0f / 32768.0f);
+    }
+    slot->clipped = post->clipped;
+    slot->frames = post->meter_frames;
+    slot->windows = generation;
+    __atomic_store_n(&post->meter_generation, generation, __ATOMIC_RELEASE);
+    memset(post->peak, 0, sizeof(post->peak));
+    memset(post->sum_sq, 0, sizeof(post->sum_sq));
+    post->clipped = 0;
+    post->meter_fill = 0;
+}
+
+// Meter n frames, closing windows where they end
+static void post_meter_frames(spdif_post_t *post, const int32_t *frames, size_t n)
+{
+    while (n)
+    {
+        size_t take = post->meter_frames - post->meter_fill;
+        take = take < n ? take : n;
+        spdif_post_meter(post, frames, take);
+        post->meter_fill += take;
+        if (post->meter_fill == post->meter_frames)
+        {
+            post_publish(post);
+        }
+        frames += take * 2;
+        n -= take;
+    }
+}
+
+static void post_write(void *ctx, const void *frames, size_t num_frames)
+{
+    spdif_post_t *post = (spdif_post_t *)ctx;
+    post_update(post);
+    const int32_t *in = (const int32_t *)frames;
+    while (num_frames)
+    {
+        size_t max_frames = 0;
+        uint8_t *block = post->out.get_buffer ? (uint8_t *)post->out.get_buffer(post->out.ctx, &max_frames) : NULL;
+        if (!block || !max_frames)
+        {
+            block = post->own_block;
+            max_frames = SPDIF_POST_BLOCK_FRAMES;
+        }
+        size_t n = num_frames < max_frames ? num_frames : max_frames;
+        n = n < SPDIF_POST_BLOCK_FRAMES ? n : SPDIF_POST_BLOCK_FRAMES;
+
+        // Each pass reads the last one's output from L1
+        const int32_t *mixed = in;
+        if (!post->identity)
+        {
+            post->clipped += spdif_post_mix(in, post->mixed, n, post->matrix);
+            mixed = post->mixed;
+        }
+        if (post->meter_frames)
+        {
+            post_meter_frames(post, mixed, n);
+        }
+        if (post->format == SPDIF_PCM_FORMAT_S16)
+        {
+            spdif_post_quantize_s16(mixed, (int16_t *)block, n, post->dither ? &post->rng : NULL);
+        }
+        else
+        {
+            spdif_post_quantize(mixed, block, n, post->format);
+        }
+        post->out.write(post->out.ctx, block, n);
+        in += n * 2;
+        num_frames -= n;
+    }
+}
+
+spdif_pcm_sink_t spdif_post_sink(spdif_post_t *post)
+{
+    return (spdif_pcm_sink_t){.write = post_write, .get_buffer = NULL, .ctx = post};
+}
+
+bool spdif_post_get_meter(const spdif_post_t *post, spdif_meter_t *meter)
+{
+    uint32_t generation;
+    do
+    {
+        generation = __atomic_load_n(&post->meter_generation, __ATOMIC_ACQUIRE);
+        if (generation == 0)
+        {
+            return false;
+        }
+        *meter = post->meter_slots[generation & 1];
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while (__atomic_load_n(&post->meter_generation, __ATOMIC_RELAXED) != generation);
+    return true;
+}
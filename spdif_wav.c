@@ -0,0 +1,102 @@
+#include "spdif_wav.h"
+#include <string.h>
+
+#define WAV_HEADER_BYTES 44
+#define WAV_FORMAT_PCM 1
+#define WAV_FORMAT_IEEE_FLOAT 3
+
+static void put_le16(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v);
+    put_le16(p + 2, v >> 16);
+}
+
+// Canonical 44-byte RIFF header. S24_32 is stored as 32-bit PCM: the 24-bit
+// audio is left-justified, so the samples are already full-scale 32-bit values.
+static bool write_header(spdif_wav_sink_t *wav)
+{
+    uint8_t header[WAV_HEADER_BYTES];
+    uint32_t frame_bytes = (uint32_t)spdif_pcm_frame_bytes(wav->format);
+    uint32_t bits = (frame_bytes / 2) * 8;
+
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, WAV_HEADER_BYTES - 8 + wav->data_bytes);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16);
+    put_le16(header + 20, wav->format == SPDIF_PCM_FORMAT_F32 ? WAV_FORMAT_IEEE_FLOAT : WAV_FORMAT_PCM);
+    put_le16(header + 22, 2);
+    put_le32(header + 24, wav->sample_rate);
+    put_le32(header + 28, wav->sample_rate * frame_bytes);
+    put_le16(header + 32, frame_bytes);
+    put_le16(header + 34, bits);
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, wav->data_bytes);
+
+    return fseek(wav->file, 0, SEEK_SET) == 0 &&
+           fwrite(header, 1, sizeof(header), wav->file) == sizeof(header);
+}
+
+static void wav_write(void *ctx, const void *frames, size_t num_frames)
+{
+    spdif_wav_sink_t *wav = (spdif_wav_sink_t *)ctx;
+    size_t bytes = num_frames * spdif_pcm_frame_bytes(wav->format);
+    // The RIFF size fields are 32-bit; stop short of overflowing them
+    if (wav->write_error || bytes > UINT32_MAX - WAV_HEADER_BYTES - wav->data_bytes)
+    {
+        wav->write_error = true;
+        return;
+    }
+    if (fwrite(frames, 1, bytes, wav->file) != bytes)
+    {
+        wav->write_error = true;
+        return;
+    }
+    wav->data_bytes += (uint32_t)bytes;
+}
+
+bool spdif_wav_sink_open(spdif_wav_sink_t *wav, const char *path,
+                         spdif_pcm_format_t format, uint32_t sample_rate)
+{
+    memset(wav, 0, sizeof(*wav));
+    if (format >= SPDIF_PCM_FORMAT_COUNT)
+    {
+        return false;
+    }
+    wav->file = fopen(path, "wb");
+    if (!wav->file)
+    {
+        return false;
+    }
+    wav->format = format;
+    wav->sample_rate = sample_rate;
+    if (!write_header(wav))
+    {
+        fclose(wav->file);
+        wav->file = NULL;
+        return false;
+    }
+    return true;
+}
+
+spdif_pcm_sink_t spdif_wav_sink(spdif_wav_sink_t *wav)
+{
+    return (spdif_pcm_sink_t){.write = wav_write, .get_buffer = NULL, .ctx = wav};
+}
+
+bool spdif_wav_sink_close(spdif_wav_sink_t *wav)
+{
+    if (!wav->file)
+    {
+        return false;
+    }
+    bool ok = !wav->write_error && write_header(wav);
+    ok = (fclose(wav->file) == 0) && ok;
+    wav->file = NULL;
+    return ok;
+}